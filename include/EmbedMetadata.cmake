@@ -114,15 +114,166 @@ function(BIN2H)
     file(WRITE ${BIN2H_HEADER_FILE} "${declarations}")
 endfunction()
 
+# Function to convert an unsigned integer to little-endian hex bytes (without prefix).
+# Parameters:
+#   VALUE       - The integer to convert
+#   BYTES       - The number of bytes
+#   VARIABLE    - The name of the output variable
+function(UINT_TO_HEX)
+    set(oneValueArgs VALUE BYTES VARIABLE)
+    cmake_parse_arguments(UINT_TO_HEX "" "${oneValueArgs}" "" ${ARGN})
+
+    set(hex "")
+    math(EXPR lastByte "${UINT_TO_HEX_BYTES} - 1")
+    foreach(i RANGE ${lastByte})
+        math(EXPR byte "(${UINT_TO_HEX_VALUE} >> (8 * ${i})) & 255" OUTPUT_FORMAT HEXADECIMAL)
+        string(SUBSTRING "${byte}" 2 -1 byte)
+        string(LENGTH "${byte}" byteLength)
+        if(byteLength EQUAL 1)
+            set(byte "0${byte}")
+        endif()
+        set(hex "${hex}${byte}")
+    endforeach()
+
+    set(${UINT_TO_HEX_VARIABLE} "${hex}" PARENT_SCOPE)
+endfunction()
+
+# Function to generate the binary metadata (read by the plugin manager without any JSON parsing)
+# in a C/C++ header file. Requires CMake 3.19 (for string(JSON)).
+# The format is described in src/private/binarymetadata.h.
+# Parameters
+#   SOURCE_FILE     - The metadata text file (formatted in JSON)
+#   VARIABLE_NAME   - The name of the exported byte array
+#   HEADER_FILE     - The path of header file.
+#   RESULT_VARIABLE - Set to TRUE if the header was generated
+#   STATIC          - If set, the array is not exported (for static plugins)
+function(BINARY_METADATA)
+    set(options STATIC)
+    set(oneValueArgs SOURCE_FILE VARIABLE_NAME HEADER_FILE RESULT_VARIABLE)
+    cmake_parse_arguments(BINMETA "${options}" "${oneValueArgs}" "" ${ARGN})
+    set(${BINMETA_RESULT_VARIABLE} FALSE PARENT_SCOPE)
+
+    file(READ ${BINMETA_SOURCE_FILE} json)
+
+    # Collect all strings (as hex) in the order of the header
+    # (each item is prefixed by "x" since empty list items are dropped)
+    set(stringsHex "")
+    foreach(key api name prettyName version author url license copyright)
+        string(JSON value ERROR_VARIABLE error GET "${json}" ${key})
+        if(error)
+            message(WARNING "Binary metadata not generated (${key}: ${error})")
+            return()
+        endif()
+        string(HEX "${value}" valueHex)
+        list(APPEND stringsHex "x${valueHex}")
+    endforeach()
+
+    string(JSON depNb ERROR_VARIABLE error LENGTH "${json}" dependencies)
+    if(error)
+        message(WARNING "Binary metadata not generated (dependencies: ${error})")
+        return()
+    endif()
+    if(depNb GREATER 0)
+        math(EXPR lastDep "${depNb} - 1")
+        foreach(i RANGE ${lastDep})
+            foreach(key name version)
+                string(JSON value ERROR_VARIABLE error GET "${json}" dependencies ${i} ${key})
+                if(error)
+                    message(WARNING "Binary metadata not generated (dependency ${i}: ${error})")
+                    return()
+                endif()
+                string(HEX "${value}" valueHex)
+                list(APPEND stringsHex "x${valueHex}")
+            endforeach()
+        endforeach()
+    endif()
+
+    set(flags 0)
+    string(JSON threadSafe ERROR_VARIABLE error GET "${json}" threadSafe)
+    if(NOT error AND NOT threadSafe)
+        set(flags 1)
+    endif()
+
+    # Build the offsets table and the string table (strings are stored after the header)
+    math(EXPR offset "48 + 8 * ${depNb}")
+    set(offsetsHex "")
+    set(tableHex "")
+    foreach(valueHex ${stringsHex})
+        string(SUBSTRING "${valueHex}" 1 -1 valueHex)
+        uint_to_hex(VALUE ${offset} BYTES 4 VARIABLE offsetHex)
+        set(offsetsHex "${offsetsHex}${offsetHex}")
+        set(tableHex "${tableHex}${valueHex}00")
+        string(LENGTH "${valueHex}" valueHexLength)
+        math(EXPR offset "${offset} + ${valueHexLength} / 2 + 1")
+    endforeach()
+
+    uint_to_hex(VALUE 1 BYTES 2 VARIABLE versionHex)
+    uint_to_hex(VALUE ${flags} BYTES 2 VARIABLE flagsHex)
+    uint_to_hex(VALUE ${offset} BYTES 4 VARIABLE sizeHex)
+    uint_to_hex(VALUE ${depNb} BYTES 4 VARIABLE depNbHex)
+
+    # Offsets of api ... copyright, then the number of dependencies, then the offsets of dependencies
+    string(SUBSTRING "${offsetsHex}" 0 64 stringOffsetsHex)
+    string(SUBSTRING "${offsetsHex}" 64 -1 depOffsetsHex)
+    string(HEX "JPMB" magicHex)
+    set(hexString "${magicHex}${versionHex}${flagsHex}${sizeHex}${stringOffsetsHex}${depNbHex}${depOffsetsHex}${tableHex}")
+
+    wrap_string(VARIABLE hexString AT_COLUMN 32)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " arrayValues ${hexString})
+    string(REGEX REPLACE ", $" "" arrayValues ${arrayValues})
+
+    string(TOUPPER "${BINMETA_HEADER_FILE}" headerProtection)
+    string(REGEX REPLACE "[^A-Z]" "_" headerProtection "${headerProtection}")
+
+    if(BINMETA_STATIC)
+        set(arrayDeclaration "#undef JP_STATIC_METADATA_BIN\n#define JP_STATIC_METADATA_BIN ${BINMETA_VARIABLE_NAME}")
+    else()
+        set(arrayDeclaration "extern \"C\" JP_EXPORT_SYMBOL const unsigned char ${BINMETA_VARIABLE_NAME}[];")
+    endif()
+    set(arrayDefinition "const unsigned char ${BINMETA_VARIABLE_NAME}[] = { ${arrayValues} };")
+
+    set(declarations "#ifndef ${headerProtection}\n#define ${headerProtection}\n\n${arrayDeclaration}\n${arrayDefinition}\n\n#endif")
+    file(WRITE ${BINMETA_HEADER_FILE} "${declarations}")
+    set(${BINMETA_RESULT_VARIABLE} TRUE PARENT_SCOPE)
+endfunction()
+
 # Function to embed metadata text file into the plugin library
 # Parameters
 #   METADATA_FILE    - Metadata text file (formatted in JSON)
+#   STATIC           - If set, metadata are generated for a plugin linked in the executable
+#                      (registered with JP_REGISTER_STATIC_PLUGIN, after including metadata.h)
 #
 # Usage
 #   embed_metadata(METADATA_FILE meta.json)
 function(EMBED_METADATA)
+    set(options STATIC)
     set(oneValueArgs METADATA_FILE)
     cmake_parse_arguments(EMBED_METADATA "${options}" "${oneValueArgs}" "" ${ARGN})
-    bin2h(SOURCE_FILE ${EMBED_METADATA_METADATA_FILE} HEADER_FILE "${CMAKE_CURRENT_BINARY_DIR}/pluginMetadata/metadata.h" VARIABLE_NAME "jp_metadata" NULL_TERMINATE ON)
+
+    # Static plugins don't export any symbol, so their arrays can't clash in the executable
+    if(EMBED_METADATA_STATIC)
+        set(variableSuffix "_static")
+        set(staticArg STATIC)
+    else()
+        set(variableSuffix "")
+        set(staticArg "")
+    endif()
+    bin2h(SOURCE_FILE ${EMBED_METADATA_METADATA_FILE} HEADER_FILE "${CMAKE_CURRENT_BINARY_DIR}/pluginMetadata/metadata.h" VARIABLE_NAME "jp_metadata${variableSuffix}" NULL_TERMINATE ON)
+    if(EMBED_METADATA_STATIC)
+        file(APPEND "${CMAKE_CURRENT_BINARY_DIR}/pluginMetadata/metadata.h" "\n\n#ifndef JP_STATIC_METADATA_BIN\n#  define JP_STATIC_METADATA_BIN nullptr\n#endif\n")
+    endif()
+
+    # Binary metadata (optional, the plugin manager uses the JSON metadata if they are not available)
+    if(NOT CMAKE_VERSION VERSION_LESS 3.19)
+        binary_metadata(SOURCE_FILE ${EMBED_METADATA_METADATA_FILE}
+                        HEADER_FILE "${CMAKE_CURRENT_BINARY_DIR}/pluginMetadata/metadata_bin.h"
+                        VARIABLE_NAME "jp_metadata_bin${variableSuffix}"
+                        RESULT_VARIABLE hasBinaryMetadata
+                        ${staticArg})
+        if(hasBinaryMetadata)
+            file(APPEND "${CMAKE_CURRENT_BINARY_DIR}/pluginMetadata/metadata.h" "\n\n#include \"metadata_bin.h\"\n")
+        endif()
+    endif()
+
     include_directories(${CMAKE_CURRENT_BINARY_DIR}/pluginMetadata)
 endfunction()
@@ -0,0 +1,126 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <cstddef> // for size_t
+
+namespace jp
+{
+
+/**
+ * @brief Function run by the executor.
+ *
+ * @a context is the pointer given to IExecutor::submit() or IExecutor::then().
+ */
+typedef void (*TaskFunction)(void* context);
+
+/**
+ * @brief Set of tasks that can be waited for, or followed by continuations.
+ *
+ * Opaque type, created by IExecutor::createGroup() and released by IExecutor::releaseGroup().
+ */
+struct TaskGroup;
+
+/**
+ * @class IExecutor
+ * @brief Work-stealing task executor owned by the plugin manager.
+ *
+ * The executor is shared by all plugins, the application and the manager itself (for the
+ * concurrent search of the plugins), so that the whole process uses a single pool
+ * of threads, sized to the hardware by default.
+ * Each thread of the pool has its own queue: tasks submitted from a task are pushed to the
+ * queue of its thread (and run last-in first-out), and idle threads steal the oldest tasks
+ * of the other queues.
+ *
+ * Plugins get the executor with IPlugin::executor() (or the GET_EXECUTOR manager request),
+ * and the application with PluginManager::executor().
+ * @note Tasks must not block (on a lock held by another task, an I/O or another thread):
+ * a blocked task holds a thread of the pool, and a pool where all threads are blocked
+ * runs nothing anymore. Waiting for a group with wait() is allowed.
+ * @note Tasks are never cancelled: a plugin must wait for its tasks before returning from
+ * its aboutToBeUnloaded() function, since its library is closed just after.
+ * @note All functions are thread-safe.
+ */
+class IExecutor
+{
+public:
+    /**
+     * @brief Run a task on a thread of the pool.
+     * @param func The function to run
+     * @param context A pointer given back to @a func
+     * @param group The group the task belongs to (may be null)
+     */
+    virtual void submit(TaskFunction func, void* context, TaskGroup* group = nullptr) = 0;
+
+    /**
+     * @brief Create an empty group.
+     * @return The group, to be released with releaseGroup()
+     */
+    virtual TaskGroup* createGroup() = 0;
+
+    /**
+     * @brief Add a continuation to a group.
+     *
+     * The continuation is submitted as soon as all the tasks of @a group are done (immediately
+     * if the group is empty). Tasks submitted to @a group before that moment are waited for too.
+     * @param group The group to wait for
+     * @param func The function to run
+     * @param context A pointer given back to @a func
+     * @param next The group the continuation belongs to (may be null, must not be @a group)
+     */
+    virtual void then(TaskGroup* group, TaskFunction func, void* context, TaskGroup* next = nullptr) = 0;
+
+    /**
+     * @brief Wait until all the tasks of a group are done.
+     *
+     * The calling thread runs the queued tasks of @a group meanwhile (and only them), so waiting
+     * from a task does not block the pool.
+     * @param group The group
+     */
+    virtual void wait(TaskGroup* group) = 0;
+
+    /**
+     * @brief Release a group.
+     *
+     * The group is deleted once its remaining tasks are done: it must not be used anymore.
+     * Tasks and continuations already submitted still run.
+     * @param group The group
+     */
+    virtual void releaseGroup(TaskGroup* group) = 0;
+
+    /**
+     * @brief Return the number of threads of the pool.
+     */
+    virtual unsigned int threadsCount() const = 0;
+
+protected:
+    // The executor is owned by the manager, and cannot be deleted by its users
+    virtual ~IExecutor() {}
+};
+
+} // namespace jp
+
+#endif // EXECUTOR_H
@@ -26,8 +26,13 @@
 #define IPLUGIN_H
 
 #include <cstring> // for strcmp
+#include <cstddef> // for size_t
 #include <cstdint> // for intN_t types
 #include "confinfo.h"
+#include "messagebus.h"
+#include "requestmetrics.h"
+#include "executor.h"
+#include "service.h"
 
 /*****************************************************************************/
 /***** Macros definitions ****************************************************/
@@ -63,7 +68,9 @@
  * @sa JP_DECLARE_PLUGIN_CUSTOMPARENT
  * @related jp::IPlugin
  */
-#define JP_DECLARE_INTERFACE(className, parentClass) _JP_DECLARE_INTERFACE__IMPL(className, parentClass)
+#define JP_DECLARE_INTERFACE(className, parentClass)   \
+    _JP_DECLARE_SERVICE__IMPL(className)                \
+    _JP_DECLARE_INTERFACE__IMPL(className, parentClass)
 
 /**
  * @brief Allow the plugin class to export the correct symbols.
@@ -73,6 +80,21 @@
  */
 #define JP_REGISTER_PLUGIN(className) _JP_REGISTER_PLUGIN__IMPL(className)
 
+/**
+ * @brief Register a plugin linked in the executable (instead of a library).
+ *
+ * The plugin is added to a table collected by the linker, and PluginManager::searchForStaticPlugins()
+ * registers all plugins of this table: no library is loaded and no symbol is looked up, but
+ * dependencies are checked and plugins loaded in order just like plugins found by searchForPlugins().
+ * Metadata must be embedded with <tt>embed_metadata(METADATA_FILE meta.json STATIC)</tt>.
+ * @note Must be declared AFTER the class definition, and AFTER the include of metadata.h.
+ * @note Only available if JP_HAS_STATIC_PLUGINS is defined (GCC and Clang, on ELF and Mach-O platforms).
+ * When the plugin is part of a static library, the object file must be linked entirely
+ * (for example with an OBJECT library in CMake), since nothing references it.
+ * @related jp::IPlugin
+ */
+#define JP_REGISTER_STATIC_PLUGIN(className) _JP_REGISTER_STATIC_PLUGIN__IMPL(className)
+
 // Simply avoid the "unused" warning
 #define JP_UNUSED(x) (void)x
 
@@ -80,9 +102,69 @@
 /***** IPlugin class *********************************************************/
 /*****************************************************************************/
 
+namespace jp_private
+{
+struct PlugMgrPrivate;
+}
+
 namespace jp
 {
 
+class IPlugin;
+
+/**
+ * @struct Request
+ * @brief One request of a batch sent with IPlugin::sendRequestBatch().
+ *
+ * The fields match the arguments of IPlugin::handleRequest(): the receiver reads and
+ * writes data and dataSize in place, and the return code is stored in result.
+ */
+struct Request
+{
+    uint16_t code; //!< The code identifying the request
+    uint16_t result; //!< Set to the code returned by the receiver
+    uint32_t dataSize; //!< The size of the data
+    void* data; //!< The data sent to (or retrieved from) the receiver
+};
+
+/**
+ * @class PluginHandle
+ * @brief Pre-resolved receiver of requests.
+ *
+ * A handle is obtained once with IPlugin::pluginHandle() and then given to
+ * IPlugin::sendRequest(const PluginHandle&, uint16_t, void**, uint32_t*), which dispatches
+ * the request directly, without comparing any plugin name.
+ * @note A handle to a dependency (or to the plugin itself or the manager) stays valid as long as
+ * the plugin is loaded. A handle to a non-dependency plugin (for the main plugin) is only valid
+ * while the receiver is loaded.
+ * @see jp::IPlugin::pluginHandle()
+ */
+class PluginHandle
+{
+public:
+    /**
+     * @brief Construct an invalid handle.
+     */
+    PluginHandle(): _plugin(nullptr), _valid(false) {}
+
+    /**
+     * @brief Return true if the handle refers to a plugin or to the plugin manager.
+     */
+    bool isValid() const { return _valid; }
+    /**
+     * @brief Return true if the handle refers to the plugin manager.
+     */
+    bool isManager() const { return _valid && !_plugin; }
+
+private:
+    friend class IPlugin;
+    explicit PluginHandle(IPlugin* plugin): _plugin(plugin), _valid(true) {}
+
+    // nullptr for the manager
+    IPlugin* _plugin;
+    bool _valid;
+};
+
 /**
  * @class IPlugin
  * @brief Base class for all plugins
@@ -136,6 +218,195 @@ public:
         return sendRequestImpl(receiver, code, data, dataSize);
     }
 
+    /**
+     * @brief Resolve the receiver of future requests.
+     *
+     * The receiver is searched like in sendRequest(const char*, uint16_t, void**, uint32_t*), but only once.
+     * @param receiver The name of the receiver plugin (If NULL, the handle refers to the plugin's manager).
+     * @return The handle, invalid if the receiver is not a dependency, this plugin or (for the main plugin)
+     *         a loaded plugin.
+     * @see sendRequest(const PluginHandle&, uint16_t, void**, uint32_t*)
+     */
+    PluginHandle pluginHandle(const char* receiver)
+    {
+        // Manager (receiver is null)
+        if(!receiver)
+            return PluginHandle(nullptr);
+
+        for(int i=0; i < _depNb; ++i)
+        {
+            if(strcmp(receiver, _depPlugins[i]->jp_name()) == 0)
+                return PluginHandle(_depPlugins[i]);
+        }
+
+        if(strcmp(receiver, jp_name()) == 0)
+            return PluginHandle(this);
+
+        if(_isMainPlugin)
+        {
+            IPlugin* plug = _nonDepFunc(jp_name(), receiver);
+            if(plug)
+                return PluginHandle(plug);
+        }
+
+        return PluginHandle();
+    }
+
+    /**
+     * @brief Send a request to a receiver resolved by pluginHandle()
+     *
+     * Same as sendRequest(const char*, uint16_t, void**, uint32_t*), but without any lookup of the receiver.
+     * @param receiver The handle of the receiver
+     * @param code The code identifying the request.
+     * @param data A pointer to potential data to send (resp. retrieve) to (resp. from) the receiver.
+     * @param dataSize A pointer to the size of the data. Must not be NULL if data are sent or expected.
+     * @return A code depending on the success of the operation (0 on success), or NOT_A_DEPENDENCY if
+     *         the handle is invalid.
+     */
+    uint16_t sendRequest(const PluginHandle& receiver,
+                         uint16_t code,
+                         void** data,
+                         uint32_t* dataSize)
+    {
+        if(!receiver._valid)
+            return IPlugin::NOT_A_DEPENDENCY;
+        if(!receiver._plugin)
+            return _requestFunc(jp_name(), code, data, dataSize);
+        return forwardRequest(receiver._plugin, code, data, dataSize);
+    }
+
+    /**
+     * @brief Send several requests to the same receiver.
+     *
+     * The receiver is resolved once, and its handleRequestBatch() function receives all the
+     * requests at once (requests to the manager are still handled one by one).
+     * @param receiver The name of the receiver plugin (If NULL, the requests are sent to the plugin's manager).
+     * @param requests The requests, their result, data and dataSize fields are updated by the receiver
+     * @param count The number of requests
+     * @return SUCCESS once the receiver handled the requests (see their result field), or
+     *         NOT_A_DEPENDENCY if the receiver was not found (the requests are then left unchanged).
+     * @note The receiver must be built with this version of the headers.
+     */
+    uint16_t sendRequestBatch(const char* receiver, Request* requests, size_t count)
+    {
+        const PluginHandle handle = pluginHandle(receiver);
+        if(!handle._valid && _requestMetrics && _requestMetrics->active())
+        {
+            for(size_t i = 0; i < count; ++i)
+                _requestMetrics->record(jp_name(), receiver, requests[i].code, IPlugin::NOT_A_DEPENDENCY, 0);
+        }
+        return sendRequestBatch(handle, requests, count);
+    }
+
+    /**
+     * @brief Send several requests to a receiver resolved by pluginHandle()
+     *
+     * Same as sendRequestBatch(const char*, Request*, size_t), but without any lookup of the receiver.
+     * @param receiver The handle of the receiver
+     * @param requests The requests
+     * @param count The number of requests
+     * @return SUCCESS, or NOT_A_DEPENDENCY if the handle is invalid
+     */
+    uint16_t sendRequestBatch(const PluginHandle& receiver, Request* requests, size_t count)
+    {
+        if(!receiver._valid)
+            return IPlugin::NOT_A_DEPENDENCY;
+
+        if(!receiver._plugin)
+        {
+            for(size_t i = 0; i < count; ++i)
+                requests[i].result = _requestFunc(jp_name(), requests[i].code, &requests[i].data, &requests[i].dataSize);
+            return IPlugin::SUCCESS;
+        }
+
+        if(_requestMetrics && _requestMetrics->active())
+            _requestMetrics->dispatchBatch(jp_name(), receiver._plugin, receiver._plugin->jp_name(), requests, count);
+        else
+            receiver._plugin->handleRequestBatch(jp_name(), requests, count);
+        return IPlugin::SUCCESS;
+    }
+
+    /**
+     * @brief Get the message bus shared by all plugins.
+     *
+     * Same as sending the GET_MESSAGEBUS request to the manager.
+     * @note The subscriptions of the plugin are removed when it's unloaded.
+     * @return The bus (owned by the manager, must not be deleted), or nullptr on error
+     * @see jp::IMessageBus
+     */
+    IMessageBus* messageBus()
+    {
+        void* bus = nullptr;
+        uint32_t size = 0;
+        if(_requestFunc(jp_name(), GET_MESSAGEBUS | MANAGER_OWNED, &bus, &size) != SUCCESS)
+            return nullptr;
+        return static_cast<IMessageBus*>(bus);
+    }
+
+    /**
+     * @brief Get the task executor shared by all plugins.
+     *
+     * Plugins should submit their background work there instead of starting their own threads.
+     * Same as sending the GET_EXECUTOR request to the manager.
+     * @note Tasks are not cancelled when the plugin is unloaded: the plugin must wait for
+     * them in aboutToBeUnloaded().
+     * @return The executor (owned by the manager, must not be deleted), or nullptr on error
+     * @see jp::IExecutor
+     */
+    IExecutor* executor()
+    {
+        void* executor = nullptr;
+        uint32_t size = 0;
+        if(_requestFunc(jp_name(), GET_EXECUTOR | MANAGER_OWNED, &executor, &size) != SUCCESS)
+            return nullptr;
+        return static_cast<IExecutor*>(executor);
+    }
+
+    /**
+     * @brief Publish a service implemented by this plugin.
+     *
+     * Any plugin (and the application) can then resolve the service with service(), whatever
+     * the dependencies between plugins. The interface must be given explicitly, for example
+     * @code publishService<IMyService>(this); @endcode
+     * @note The services of the plugin are removed when it's unloaded, after its
+     * aboutToBeUnloaded() function.
+     * @param service The implementation (must stay valid until it's unpublished)
+     * @return SUCCESS, or ALREADY_EXISTS if another implementation is published
+     */
+    template<class Interface>
+    uint16_t publishService(typename jp_private::ServiceType<Interface>::type* service)
+    {
+        ServiceRequest request = { Interface::jp_serviceId(), Interface::jp_serviceName(), static_cast<void*>(service) };
+        return serviceRequest(PUBLISH_SERVICE, &request);
+    }
+
+    /**
+     * @brief Remove a service published by this plugin.
+     * @return SUCCESS, or NOT_FOUND if this plugin does not publish the service
+     */
+    template<class Interface>
+    uint16_t unpublishService()
+    {
+        ServiceRequest request = { Interface::jp_serviceId(), Interface::jp_serviceName(), nullptr };
+        return serviceRequest(UNPUBLISH_SERVICE, &request);
+    }
+
+    /**
+     * @brief Resolve a service.
+     *
+     * The lookup is done once: keep the handle to call the service directly.
+     * @return The handle (invalid if the service is not published)
+     * @see ServiceHandle
+     */
+    template<class Interface>
+    ServiceHandle<Interface> service()
+    {
+        ServiceRequest request = { Interface::jp_serviceId(), Interface::jp_serviceName(), nullptr };
+        if(serviceRequest(GET_SERVICE, &request) != SUCCESS)
+            return ServiceHandle<Interface>();
+        return ServiceHandle<Interface>(static_cast<Interface*>(request.service));
+    }
+
     /**
      * @brief Handle request send by other plugins to this plugin.
      *
@@ -157,6 +428,22 @@ public:
         return RequestReturnCode::UNKNOWN_REQUEST;
     }
 
+    /**
+     * @brief Handle a batch of requests sent by another plugin with sendRequestBatch().
+     *
+     * The default implementation calls handleRequest() for each request and stores its return
+     * code in the result field. Plugins receiving many small requests can re-implement this
+     * function to process them at once.
+     * @param sender
+     * @param requests The requests (data, dataSize and result can be modified)
+     * @param count The number of requests
+     */
+    virtual void handleRequestBatch(const char* sender, Request* requests, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+            requests[i].result = handleRequest(sender, requests[i].code, &requests[i].data, &requests[i].dataSize);
+    }
+
     /**
      * @brief The ManagerRequest enum
      */
@@ -167,20 +454,74 @@ public:
 
         // Get the plugin API
         GET_PLUGINAPI = 1,
-        // Get the number of plugins the manager is aware of
+        // Get the number of plugins the manager is aware of (size_t, *dataSize is set to sizeof(size_t)
+        // with and without CALLER_BUFFER, MANAGER_OWNED is not supported)
         GET_PLUGINSCOUNT = 2,
 
         // Get the PluginInfo object for the specified plugin (this plugin if data is null)
         GET_PLUGININFO = 10,
         // Get the version for the specified plugin (this plugin if data is null)
         GET_PLUGINVERSION = 11,
-
+        // Get the jp::PluginMemory object for the specified plugin (this plugin if data is null,
+        // MANAGER_OWNED is not supported)
+        GET_PLUGINMEMORY = 12,
+
+        // Get the message bus (jp::IMessageBus*, always owned by the manager, CALLER_BUFFER is not supported)
+        GET_MESSAGEBUS = 20,
+        // Get the recorder of the request metrics (jp::IRequestMetrics*, always owned by the manager,
+        // CALLER_BUFFER is not supported)
+        GET_REQUESTMETRICS = 21,
+        // Get the task executor (jp::IExecutor*, always owned by the manager, CALLER_BUFFER is not supported)
+        GET_EXECUTOR = 22,
+
+        // Service requests never allocate: CALLER_BUFFER and MANAGER_OWNED are not supported
+        // Publish a service (*data points to a jp::ServiceRequest, with service set)
+        PUBLISH_SERVICE = 30,
+        // Remove a service published by the sender (*data points to a jp::ServiceRequest)
+        UNPUBLISH_SERVICE = 31,
+        // Find a service (*data points to a jp::ServiceRequest, service is set on success)
+        GET_SERVICE = 32,
+
+        // Checks return RESULT_TRUE or RESULT_FALSE, without data: the flags are ignored
         // Check if the specified plugin exists
         CHECK_PLUGIN = 100,
         // Check if the specified plugin is loaded
         CHECK_PLUGINLOADED = 101,
     };
 
+    /**
+     * @brief Flags that can be combined (with |) with a ManagerRequest code to avoid any allocation.
+     *
+     * Without flag, the manager allocates the returned data and the caller must free it.
+     * Only one flag can be used at a time.
+     * A request that does not support a flag (or both flags together) returns UNSUPPORTED_FLAG,
+     * without changing *data and *dataSize.
+     */
+    enum ManagerRequestFlag
+    {
+        /**
+         * The caller provides the buffer: *data points to it and *dataSize is its size in bytes.
+         * For GET_PLUGININFO, GET_PLUGINVERSION and GET_PLUGINMEMORY, the buffer must contain the NUL-terminated
+         * name of the plugin (or an empty string for the sender) when the request is sent.
+         * On success, *dataSize is set to the size of the written data (strings are NUL-terminated but the
+         * NUL character is not counted, like without flag).
+         * If the buffer is too small, BUFFER_TOO_SMALL is returned, the buffer is left unchanged and
+         * *dataSize is set to the required size.
+         * For GET_PLUGININFO, the buffer (aligned like a PluginInfo object) receives the PluginInfo object followed
+         * by all its strings: it must NOT be freed with PluginInfo::free().
+         * Supported by GET_APPDIRECTORY, GET_PLUGINAPI, GET_PLUGINSCOUNT (size_t), GET_PLUGININFO,
+         * GET_PLUGINVERSION and GET_PLUGINMEMORY (jp::PluginMemory).
+         */
+        CALLER_BUFFER = 0x8000,
+        /**
+         * *data is set to immutable data owned by the manager, that must not be freed.
+         * The app directory and the API version remain valid for the lifetime of the application,
+         * plugin data (PluginInfo object and version) until the corresponding plugin is unloaded.
+         * Supported by GET_APPDIRECTORY, GET_PLUGINAPI, GET_PLUGININFO and GET_PLUGINVERSION.
+         */
+        MANAGER_OWNED = 0x4000
+    };
+
     /**
      * @brief The RequestReturnCode enum
      */
@@ -198,6 +539,15 @@ public:
 
         NOT_FOUND = 5,
 
+        // Used with the CALLER_BUFFER flag
+        BUFFER_TOO_SMALL = 6,
+
+        // Used by PUBLISH_SERVICE, if the service is already published
+        ALREADY_EXISTS = 7,
+
+        // The ManagerRequestFlag flags used are not supported by the request
+        UNSUPPORTED_FLAG = 8,
+
         USER_RETURN_CODE = 100
     };
 
@@ -225,11 +575,15 @@ protected:
           _depPlugins(depPlugins),
           _depNb(depNb),
           _isMainPlugin(isMainPlugin)
-    {}
+    {
+    }
 
     //! @endcond
 
 private:
+    // Sets _requestMetrics once the plugin is created
+    friend struct jp_private::PlugMgrPrivate;
+
     _JP_MGR_REQUEST_FUNC_SIGNATURE(_requestFunc);
     // This function is used only for the main plugin, to send request to a non dependency plugin
     _JP_MGR_GET_NON_DEP_PLUGIN_SIGNATURE(_nonDepFunc);
@@ -239,6 +593,10 @@ private:
 
     bool _isMainPlugin = false;
 
+    // Set by the manager before loaded() is called (requests sent by the constructor
+    // are never recorded)
+    IRequestMetrics* _requestMetrics = nullptr;
+
     virtual const char* jp_name() = 0;
 
     IPlugin() = default;
@@ -247,6 +605,14 @@ private:
     IPlugin(const IPlugin&) = delete;
     const IPlugin& operator=(const IPlugin&) = delete;
 
+    // Send a service request to the manager
+    uint16_t serviceRequest(uint16_t code, ServiceRequest* request)
+    {
+        void* data = request;
+        uint32_t size = sizeof(ServiceRequest);
+        return _requestFunc(jp_name(), code, &data, &size);
+    }
+
     // Private implementation of sendRequest
     uint16_t sendRequestImpl(const char *receiver, uint16_t code, void **data, uint32_t *dataSize)
     {
@@ -258,24 +624,35 @@ private:
         for(int i=0; i < _depNb; ++i)
         {
             if(strcmp(receiver, _depPlugins[i]->jp_name()) == 0)
-                return _depPlugins[i]->handleRequest(jp_name(), code, data, dataSize);
+                return forwardRequest(_depPlugins[i], code, data, dataSize);
         }
 
         // Send to itself
         if(strcmp(receiver, jp_name()) == 0)
-            return this->handleRequest(jp_name(), code, data, dataSize);
+            return forwardRequest(this, code, data, dataSize);
 
         // Send to non-dependency if main plugin
         if(_isMainPlugin)
         {
             IPlugin* plug = _nonDepFunc(jp_name(), receiver);
             if(plug)
-                return plug->handleRequest(jp_name(), code, data, dataSize);
+                return forwardRequest(plug, code, data, dataSize);
         }
 
         // Dependency was not found
+        if(_requestMetrics && _requestMetrics->active())
+            _requestMetrics->record(jp_name(), receiver, code, IPlugin::NOT_A_DEPENDENCY, 0);
         return IPlugin::NOT_A_DEPENDENCY;
     }
+
+    // Call the handleRequest() function of another plugin (or of this one)
+    // While metrics are recorded, the manager does the call to measure it
+    uint16_t forwardRequest(IPlugin* receiver, uint16_t code, void** data, uint32_t* dataSize)
+    {
+        if(_requestMetrics && _requestMetrics->active())
+            return _requestMetrics->dispatch(jp_name(), receiver, receiver->jp_name(), code, data, dataSize);
+        return receiver->handleRequest(jp_name(), code, data, dataSize);
+    }
 };
 
 } // namespace jp
@@ -387,4 +764,88 @@ constexpr inline bool containsOnly(const char* str, const char* allowed)
     extern "C" JP_EXPORT_SYMBOL const char jp_metadata[];                   \
     _JP_EXPORT_FUNCTION_ALIAS(className::jp_createPlugin, jp_createPlugin)
 
+/* Static plugins */
+
+namespace jp_private
+{
+// Entry of the table of static plugins (the table contains pointers to these entries)
+struct StaticPluginEntry
+{
+    const char* name;
+    const char* metadata;
+    // Binary metadata, nullptr if not generated
+    const unsigned char* binMetadata;
+    jp::IPlugin* (*create)(_JP_MGR_REQUEST_FUNC_SIGNATURE(),
+                           _JP_MGR_GET_NON_DEP_PLUGIN_SIGNATURE(),
+                           jp::IPlugin**,
+                           int,
+                           bool);
+};
+} // namespace jp_private
+
+// The linker places all entries of a section next to each other, and defines symbols
+// at the beginning and the end of the section
+#if (defined(CONFINFO_COMPILER_GCC) || defined(CONFINFO_COMPILER_CLANG)) && defined(__ELF__)
+#  define JP_HAS_STATIC_PLUGINS
+#  define _JP_STATIC_PLUGINS_SECTION __attribute__((__used__, __section__("jp_static_plugins")))
+extern "C" __attribute__((__weak__, __visibility__("hidden")))
+const jp_private::StaticPluginEntry* const __start_jp_static_plugins[];
+extern "C" __attribute__((__weak__, __visibility__("hidden")))
+const jp_private::StaticPluginEntry* const __stop_jp_static_plugins[];
+#  define _JP_STATIC_PLUGINS_BEGIN __start_jp_static_plugins
+#  define _JP_STATIC_PLUGINS_END __stop_jp_static_plugins
+#elif (defined(CONFINFO_COMPILER_GCC) || defined(CONFINFO_COMPILER_CLANG)) && defined(CONFINFO_PLATFORM_MACOS)
+#  define JP_HAS_STATIC_PLUGINS
+#  define _JP_STATIC_PLUGINS_SECTION __attribute__((__used__, __section__("__DATA,jp_plugins")))
+extern const jp_private::StaticPluginEntry* const jp_staticPluginsBegin[] __asm("section$start$__DATA$jp_plugins");
+extern const jp_private::StaticPluginEntry* const jp_staticPluginsEnd[] __asm("section$end$__DATA$jp_plugins");
+#  define _JP_STATIC_PLUGINS_BEGIN jp_staticPluginsBegin
+#  define _JP_STATIC_PLUGINS_END jp_staticPluginsEnd
+#endif
+
+#ifdef JP_HAS_STATIC_PLUGINS
+
+// The names of the entries are unique in the file (className may be qualified, so it
+// cannot be part of the names)
+#define _JP_REGISTER_STATIC_PLUGIN__IMPL(className) _JP_REGISTER_STATIC_PLUGIN__ENTRY(className, __COUNTER__)
+#define _JP_REGISTER_STATIC_PLUGIN__ENTRY(className, id) _JP_REGISTER_STATIC_PLUGIN__ENTRY2(className, id)
+#define _JP_REGISTER_STATIC_PLUGIN__ENTRY2(className, id)                                           \
+    namespace {                                                                                     \
+    const jp_private::StaticPluginEntry jp_staticPluginEntry##id = {                                \
+        className::name(), jp_metadata_static,                                                      \
+        JP_STATIC_METADATA_BIN, &className::jp_createPlugin                                         \
+    };                                                                                              \
+    _JP_STATIC_PLUGINS_SECTION const jp_private::StaticPluginEntry* const jp_staticPluginEntryPtr##id \
+        = &jp_staticPluginEntry##id;                                                                \
+    }
+
+namespace jp_private
+{
+// Return the table of static plugins linked in the module of the caller
+inline const StaticPluginEntry* const* staticPlugins(size_t* count)
+{
+    // Both symbols are null if no static plugin was registered
+    const StaticPluginEntry* const* begin = _JP_STATIC_PLUGINS_BEGIN;
+    const StaticPluginEntry* const* end = _JP_STATIC_PLUGINS_END;
+    *count = begin ? static_cast<size_t>(end - begin) : 0;
+    return begin;
+}
+} // namespace jp_private
+
+#else
+
+#define _JP_REGISTER_STATIC_PLUGIN__IMPL(className) \
+    static_assert(sizeof(className) == 0, "Static plugins are not supported with this compiler and platform");
+
+namespace jp_private
+{
+inline const StaticPluginEntry* const* staticPlugins(size_t* count)
+{
+    *count = 0;
+    return nullptr;
+}
+} // namespace jp_private
+
+#endif
+
 #endif // IPLUGIN_H
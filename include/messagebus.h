@@ -0,0 +1,139 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEBUS_H
+#define MESSAGEBUS_H
+
+#include <cstddef> // for size_t
+#include <cstdint> // for intN_t types
+
+namespace jp
+{
+
+/**
+ * @brief Identifier of a message bus topic.
+ *
+ * Topic ids are chosen by the plugins: publishers and subscribers of a topic
+ * only have to agree on the same value.
+ */
+typedef uint32_t TopicId;
+
+/**
+ * @struct Message
+ * @brief A message delivered by the message bus.
+ *
+ * The payload is never copied: all subscribers receive the pointer given to
+ * IMessageBus::publish(). It's only valid during the call of the handler.
+ */
+struct Message
+{
+    TopicId topic; //!< The topic the message was published to
+    const void* payload; //!< The payload (shared by all subscribers, must not be modified)
+    uint32_t size; //!< The size of the payload, as given by the publisher
+};
+
+/**
+ * @brief Function receiving the messages of a subscription.
+ *
+ * Messages are delivered in batches: @a messages is an array of @a count messages,
+ * in publication order for each publisher. @a context is the pointer given to
+ * IMessageBus::subscribe().
+ * @note Handlers are called from the thread of the bus, never concurrently.
+ * They should return quickly, since other subscriptions wait meanwhile.
+ */
+typedef void (*MessageHandler)(void* context, const Message* messages, size_t count);
+
+/**
+ * @brief Function releasing a payload once all subscribers received it.
+ */
+typedef void (*PayloadRelease)(void* payload);
+
+/**
+ * @class IMessageBus
+ * @brief Publish/subscribe message bus owned by the plugin manager.
+ *
+ * Any plugin can publish messages to a topic, and every subscriber of the topic
+ * receives them, whatever the dependencies between plugins.
+ * Publishing never waits for the subscribers: the message is queued in a lock-free
+ * queue per subscription, and delivered by a background thread of the bus.
+ *
+ * Plugins get the bus with IPlugin::messageBus() (or the GET_MESSAGEBUS manager
+ * request), and the application with PluginManager::messageBus().
+ * The subscriptions of a plugin are automatically removed when it's unloaded, after
+ * its aboutToBeUnloaded() function, and all the messages published before are
+ * delivered (and released) before its library is closed.
+ * @note All functions are thread-safe.
+ */
+class IMessageBus
+{
+public:
+    /**
+     * @brief Publish a message to a topic.
+     *
+     * @a payload is handed over to the bus: it's given to every subscriber without
+     * any copy, then @a release (if not null) is called once all of them received it.
+     * If the topic has no subscriber, @a release is called before returning.
+     * @param topic The topic
+     * @param payload The payload (may be null)
+     * @param size The size of the payload (only forwarded to the subscribers)
+     * @param release The function releasing the payload, or null if the payload outlives the delivery
+     * @return The number of subscriptions that will receive the message
+     */
+    virtual size_t publish(TopicId topic, void* payload, uint32_t size, PayloadRelease release) = 0;
+
+    /**
+     * @brief Subscribe to a topic.
+     *
+     * A topic may have several subscriptions, and a plugin may subscribe several times.
+     * @param topic The topic
+     * @param handler The function receiving the messages
+     * @param context A pointer given back to @a handler
+     * @return The id of the subscription (never 0), used by unsubscribe()
+     */
+    virtual uint64_t subscribe(TopicId topic, MessageHandler handler, void* context) = 0;
+
+    /**
+     * @brief Remove a subscription.
+     *
+     * Returns once the handler of the subscription is not running (unless called from
+     * a handler). Messages not delivered yet are released without calling the handler.
+     * @param subscription The id returned by subscribe()
+     * @return false if the subscription does not exist
+     */
+    virtual bool unsubscribe(uint64_t subscription) = 0;
+
+    /**
+     * @brief Wait until all messages published so far are delivered and released.
+     * @note Returns immediately when called from a handler.
+     */
+    virtual void flush() = 0;
+
+protected:
+    // The bus is owned by the manager, and cannot be deleted by its users
+    virtual ~IMessageBus() {}
+};
+
+} // namespace jp
+
+#endif // MESSAGEBUS_H
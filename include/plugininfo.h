@@ -79,13 +79,16 @@ struct PluginInfo
         std::free((char*)url);
         std::free((char*)license);
         std::free((char*)copyright);
-        std::free((char*)dependencies);
 
+        // The entries must be freed before the array holding them
         for(int i=0; i<dependenciesNb; ++i)
         {
             std::free((char*)dependencies[i].name);
             std::free((char*)dependencies[i].version);
         }
+        std::free((char*)dependencies);
+        dependencies = nullptr;
+        dependenciesNb = 0;
     }
 };
 
@@ -93,6 +96,61 @@ struct PluginInfo
 } // extern "C"
 #endif
 
+/**
+ * @class PluginInfoView
+ * @brief Borrowed, read-only access to the metadata of a plugin.
+ *
+ * Unlike the PluginInfo objects returned by PluginManager::pluginInfo(), a view
+ * doesn't copy anything: it points to the metadata stored by the manager,
+ * and must not be freed. It stays valid while the plugin is registered
+ * (until it's removed by reloadPlugin() or unloadPlugins()).
+ *
+ * An invalid view (isValid() returns false) is returned for unknown plugins.
+ * @see PluginManager::pluginInfoView()
+ */
+class PluginInfoView
+{
+public:
+    /**
+     * @brief Construct an invalid view.
+     */
+    PluginInfoView() {}
+    /**
+     * @brief Construct a view of @a info (which must outlive the view).
+     */
+    explicit PluginInfoView(const PluginInfo* info) : _info(info) {}
+
+    /**
+     * @brief Checks if the view points to some metadata.
+     */
+    bool isValid() const
+    { return _info != nullptr; }
+    /**
+     * @brief Same as isValid().
+     */
+    explicit operator bool() const
+    { return isValid(); }
+
+    /**
+     * @brief Access the metadata (the view must be valid).
+     */
+    const PluginInfo& operator*() const
+    { return *_info; }
+    /**
+     * @brief Access the metadata (the view must be valid).
+     */
+    const PluginInfo* operator->() const
+    { return _info; }
+    /**
+     * @brief Returns the viewed metadata, or nullptr for an invalid view.
+     */
+    const PluginInfo* get() const
+    { return _info; }
+
+private:
+    const PluginInfo* _info = nullptr;
+};
+
 } // namespace jp
 
 #endif // PLUGININFO_H
@@ -30,9 +30,15 @@
 #include <functional> // for std::function
 #include <memory> // for std::shared_ptr
 #include <ostream> // for std::ostream
+#include <future> // for std::future
 
 #include "plugininfo.h"
+#include "pluginprofile.h"
+#include "pluginmemory.h"
+#include "requestmetrics.h"
+#include "executor.h"
 #include "iplugin.h"
+#include "messagebus.h"
 
 namespace jp_private
 {
@@ -72,9 +78,19 @@ struct JP_EXPORT_SYMBOL ReturnCode
         LOAD_DEPENDENCY_BAD_VERSION = 200,
         LOAD_DEPENDENCY_NOT_FOUND = 201,
         LOAD_DEPENDENCY_CYCLE = 202,
+        LOAD_LIBRARY_ERROR = 203,
+        // More than PluginManager::MAX_MANAGERS managers exist at the same time
+        LOAD_TOO_MANY_MANAGERS = 204,
+        LOAD_PLUGIN_NOT_FOUND = 205,
 
         // Raised by unloadPlugins()
-        UNLOAD_NOT_ALL = 300
+        UNLOAD_NOT_ALL = 300,
+        UNLOAD_TIMEOUT = 301,
+
+        // Raised by reloadPlugin()
+        RELOAD_PLUGIN_NOT_FOUND = 400,
+        RELOAD_INVALID_LIBRARY = 401,
+        RELOAD_LIBRARY_STILL_LOADED = 402
     };
     /**
      * @brief The type of the error (the error code).
@@ -139,7 +155,12 @@ struct JP_EXPORT_SYMBOL ReturnCode
  * @class PluginManager
  * @brief Main class to manage all plugins.
  *
- * Since it is a singleton-class, only one instance can be created.
+ * instance() returns a default manager shared by the whole program. Other managers
+ * can be created to run independent sets of plugins (for example one per worker
+ * thread): they share nothing, and plugins only send requests to the manager that
+ * loaded them. Note that a library used by several managers is only loaded once
+ * by the system, so its global variables are shared.
+ * At most MAX_MANAGERS managers can load plugins at the same time.
  */
 class JP_EXPORT_SYMBOL PluginManager
 {
@@ -147,7 +168,17 @@ class JP_EXPORT_SYMBOL PluginManager
 public:
 
     /**
-     * @brief Return an instance of the plugin manager.
+     * @brief Maximum number of managers that can load plugins at the same time.
+     *
+     * Plugins receive plain function pointers to send requests to their manager, so each
+     * manager reserves one of these entries until it's destroyed (or, if some of its plugins
+     * were never unloaded because of a timeout, until their threads end).
+     * loadPlugins() fails with ReturnCode::LOAD_TOO_MANY_MANAGERS if none is free.
+     */
+    static const size_t MAX_MANAGERS = 64;
+
+    /**
+     * @brief Return the default instance of the plugin manager.
      *
      * Calling instance() several times at different places always return a reference
      * to the same object. This allow the program to manage plugins and access informations
@@ -156,6 +187,16 @@ public:
      */
     static PluginManager& instance();
 
+    /**
+     * @brief Create a manager independent from instance().
+     *
+     * At most MAX_MANAGERS (64) managers, including instance(), can load plugins at the same
+     * time: loadPlugins() fails with ReturnCode::LOAD_TOO_MANY_MANAGERS otherwise.
+     * The destructor unloads all its plugins.
+     */
+    PluginManager();
+    ~PluginManager();
+
     /**
      * @brief Signature for all callback functions used for error report in this class.
      *
@@ -165,11 +206,81 @@ public:
      */
     typedef std::function<void(const ReturnCode&, const char*)> callback;
 
+    /**
+     * @brief Signature of the function used by loadPluginsAsync() to report the progress.
+     *
+     * Progress functions must accept four parameters:
+     *  - const std::string& name: the plugin processed
+     *  - bool loaded: true if the plugin was loaded (false if it or one of its dependencies failed)
+     *  - size_t done: number of plugins processed
+     *  - size_t total: number of plugins to process
+     */
+    typedef std::function<void(const std::string&, bool, size_t, size_t)> progressCallback;
+
+    /**
+     * @brief Severity of the log messages.
+     * @see setLogLevel()
+     */
+    enum LogLevel
+    {
+        LOG_DEBUG = 0, //!< Detailed messages (plugins metadata, load order, requests)
+        LOG_INFO = 1, //!< Main steps (search, load, unload)
+        LOG_WARNING = 2, //!< Recoverable problems
+        LOG_ERROR = 3 //!< Failures
+    };
+
+    /**
+     * @brief Signature of the function receiving log messages.
+     *
+     * Log functions must accept two parameters:
+     *  - LogLevel level: the severity of the message
+     *  - const char* message: the message (only valid during the call)
+     * @see setLogCallback()
+     */
+    typedef std::function<void(LogLevel, const char*)> logCallback;
+
+    /**
+     * @brief Policy used by searchForPlugins() for the discovery cache.
+     *
+     * The discovery cache stores the metadata of each library found, with the size and the
+     * modification time of the file. When the cache is used, unchanged libraries are not loaded
+     * during the search: they are only loaded by loadPlugins().
+     * @see setCacheFile()
+     */
+    enum CachePolicy
+    {
+        CACHE_DISABLED = 0, //!< Do not read nor write the cache (default)
+        CACHE_ENABLED = 1, //!< Use the cache for unchanged libraries and update it
+        CACHE_REFRESH = 2 //!< Ignore the current cache content, but write a new one
+    };
+
+    /**
+     * @brief Options of searchForPlugins().
+     *
+     * Glob patterns are matched against file and directory names (not paths): '*' matches
+     * any sequence of characters and '?' any single character.
+     */
+    struct SearchOptions
+    {
+        //! Search inside sub-directories
+        bool recursive = false;
+        //! With recursive, maximum depth of the searched sub-directories (-1 for no limit)
+        int maxDepth = -1;
+        //! If not empty, only the libraries whose file name matches one of these globs are probed
+        std::vector<std::string> include;
+        //! Files and directories whose name matches one of these globs are skipped
+        std::vector<std::string> exclude;
+        //! Policy of the discovery cache
+        CachePolicy cachePolicy = CACHE_DISABLED;
+    };
+
     /**
      * @brief Enable log output.
      *
      * If @a enable is true, the manager will ouput log information to the stream specified
      * by setLogStream or to std::cout by default.
+     * Messages are written asynchronously, from a background thread (see flushLog() and
+     * enableSynchronousLog()).
      * If the user wants to disable all log outputs (to speed up the program ?), call this function
      * with @a enable set to false.
      * @param enable
@@ -194,10 +305,145 @@ public:
      */
     void setLogStream(std::ostream &logStream);
 
+    /**
+     * @brief Set the minimum level of the log messages.
+     *
+     * Messages below @a level are discarded before being formatted, so they cost almost
+     * nothing. By default, LOG_DEBUG messages (written for each request, among others) are
+     * discarded (LOG_INFO).
+     * @param level The minimum level
+     * @see enableLogOutput()
+     */
+    void setLogLevel(LogLevel level);
+
+    /**
+     * @brief Set a function receiving the log messages, instead of the log stream.
+     *
+     * Log messages are queued by the manager and written from a background thread, so
+     * @a logFunc is called from this thread (but never concurrently).
+     * Set an empty function to use the log stream again.
+     * @param logFunc The function
+     * @see setLogStream(), flushLog()
+     */
+    void setLogCallback(const logCallback& logFunc);
+
+    /**
+     * @brief Wait until all the log messages queued so far are written.
+     *
+     * Log messages are written asynchronously: call this function before reading the
+     * log stream (or when the ordering with other outputs matters).
+     * The log is also flushed at the end of searchForPlugins(), loadPlugins() (and of the
+     * asynchronous load), unloadPlugins() and by the destructor of the manager.
+     */
+    void flushLog();
+    /**
+     * @brief Write the log messages synchronously.
+     *
+     * If @a enable is true, each message is formatted and written (to the log stream or the
+     * log callback) before the function that logged it continues: messages are never dropped
+     * and are ordered with other outputs, but logging is slower and the log callback is called
+     * from the threads of the manager. The messages already queued are written first.
+     * Disabled by default.
+     * @param enable
+     * @see flushLog()
+     */
+    void enableSynchronousLog(const bool& enable = true);
+    /**
+     * @brief Get the number of log messages dropped so far.
+     *
+     * In asynchronous mode, messages are dropped when they are logged faster than they are
+     * written (a warning with the number of dropped messages is then logged).
+     * @return The number of dropped messages since the creation of the manager
+     */
+    size_t droppedLogMessages() const;
+
+    /**
+     * @brief Enable profiling.
+     *
+     * If @a enable is true (the default), the manager records the wall time spent in each phase
+     * (dlopen, symbol lookup, metadata parse, dependency check, plugin creation, loaded(),
+     * aboutToBeUnloaded() and dlclose) for each plugin.
+     * Recording only costs two clock reads per phase.
+     * @param enable
+     * @see profile(), disableProfiling()
+     */
+    void enableProfiling(const bool& enable = true);
+    /**
+     * @brief Disable profiling.
+     *
+     * Same as enableProfiling(false)
+     * @see enableProfiling()
+     */
+    void disableProfiling();
+
+    /**
+     * @brief Get all phases recorded since the manager creation or the last clearProfile() call.
+     * @return The list of events, in the order they ended.
+     * @see enableProfiling(), exportProfile()
+     */
+    std::vector<ProfileEvent> profile() const;
+    /**
+     * @brief Remove all recorded events and reset the time origin.
+     */
+    void clearProfile();
+    /**
+     * @brief Write the recorded events to @a out using the Chrome trace-event JSON format.
+     *
+     * The output can be opened with chrome://tracing or any compatible viewer.
+     * @param out The stream to use
+     * @see profile()
+     */
+    void exportProfile(std::ostream& out) const;
+    /**
+     * @brief Get the chain of plugins that set the duration of the last loadPlugins() call.
+     *
+     * The last plugin of the chain is the one that finished last, and each plugin is preceded
+     * by its dependency that finished last (so the chain is in load order). Shortening the load
+     * of any of these plugins shortens the startup. The load phases of these plugins are marked
+     * with a "critical" argument by exportProfile().
+     * @return The names of the plugins, empty if nothing was loaded or after clearProfile().
+     * @see setLoadHistoryFile()
+     */
+    std::vector<std::string> criticalLoadChain() const;
+
+    /**
+     * @brief Enable the request metrics (disabled by default).
+     *
+     * If @a enable is true, every request sent by a plugin (to the manager or to another plugin)
+     * is counted per route (sender, receiver and code), with its return code and its duration.
+     * Each thread records into its own counters, which are merged by requestMetrics().
+     * When disabled, a request between plugins only costs one more test.
+     * @note Requests between plugins are only recorded for plugins built with this version
+     * of the headers.
+     * @param enable
+     * @see requestMetrics(), disableRequestMetrics()
+     */
+    void enableRequestMetrics(const bool& enable = true);
+    /**
+     * @brief Disable the request metrics.
+     *
+     * Same as enableRequestMetrics(false)
+     * @see enableRequestMetrics()
+     */
+    void disableRequestMetrics();
+    /**
+     * @brief Get the metrics recorded since the manager creation or the last clearRequestMetrics() call.
+     * @return One entry per route, sorted by sender, receiver and code.
+     * @see enableRequestMetrics()
+     */
+    std::vector<RequestRoute> requestMetrics() const;
+    /**
+     * @brief Remove all recorded request metrics.
+     */
+    void clearRequestMetrics();
+
     /**
      * @brief Search for all JustPlug plugins in pluginDir.
      *
-     * This function only load the librairies in order to retrieve the metadata.
+     * This function only reads the librairies in order to retrieve the metadata.
+     * When the library format is supported (ELF and PE), the metadata are read directly from
+     * the file: the library is not loaded until loadPlugins() is called, and only if its
+     * dependencies are found. Otherwise, the library is loaded to retrieve the metadata.
      * To actually load the "plugin object" and launch it, you must call loadPlugins() after.
      * @note This function can be called several times if plugins are in different dirs.
      * @param pluginDir The dir to search for plugin
@@ -214,6 +460,93 @@ public:
      * @param callbackFunc
      */
     ReturnCode searchForPlugins(const std::string& pluginDir, callback callbackFunc = callback());
+    /**
+     * @brief Overloaded function
+     * Same as searchForPlugins(const std::string& pluginDir, bool recursive, callback callbackFunc)
+     * but allows to use the discovery cache.
+     * @param pluginDir
+     * @param recursive
+     * @param callbackFunc
+     * @param cachePolicy Tell if the discovery cache must be used
+     * @see CachePolicy, setCacheFile()
+     */
+    ReturnCode searchForPlugins(const std::string& pluginDir, bool recursive, callback callbackFunc, CachePolicy cachePolicy);
+    /**
+     * @brief Overloaded function
+     * Same as searchForPlugins(const std::string& pluginDir, bool recursive, callback callbackFunc)
+     * with filters and a depth limit.
+     * Directories are scanned without recursion, and those of a same depth are scanned concurrently
+     * with the threads set by setSearchThreadsCount().
+     * @note The directory watcher ignores the filters.
+     * @param pluginDir
+     * @param options
+     * @param callbackFunc
+     * @see SearchOptions
+     */
+    ReturnCode searchForPlugins(const std::string& pluginDir, const SearchOptions& options, callback callbackFunc = callback());
+
+    /**
+     * @brief Set the number of threads used by searchForPlugins().
+     *
+     * Libraries are read and their metadata are parsed concurrently, then the results
+     * are merged in the order of their paths, so the result of the search (and
+     * SEARCH_NAME_ALREADY_EXISTS errors) does not depend on the threads scheduling.
+     * Callback functions are always called from the calling thread.
+     * @note The threads are taken from the executor (see executor()).
+     * @param threadsCount The number of threads (1 by default, 0 to use all the threads of the executor)
+     */
+    void setSearchThreadsCount(unsigned int threadsCount);
+
+    /**
+     * @brief Register the plugins linked in the executable.
+     *
+     * Plugins registered with JP_REGISTER_STATIC_PLUGIN are added like the plugins found by
+     * searchForPlugins(), but no library is ever loaded for them. Static plugins cannot be reloaded.
+     * Calling this function again only reports errors for the plugins not registered yet.
+     * @note Only plugins linked in the module calling this function are found.
+     * @param callbackFunc Called for each plugin that cannot be registered
+     * @return ReturnCode::SEARCH_NOTHING_FOUND if no new plugin was registered
+     */
+    ReturnCode searchForStaticPlugins(callback callbackFunc = callback())
+    {
+        size_t count;
+        const jp_private::StaticPluginEntry* const* entries = jp_private::staticPlugins(&count);
+        return registerStaticPlugins(entries, count, callbackFunc);
+    }
+    /**
+     * @brief Register a table of static plugins.
+     *
+     * Used by searchForStaticPlugins(), the table is built by JP_REGISTER_STATIC_PLUGIN.
+     * @param entries The table (null entries are skipped)
+     * @param count The number of entries
+     * @param callbackFunc Called for each plugin that cannot be registered
+     */
+    ReturnCode registerStaticPlugins(const jp_private::StaticPluginEntry* const* entries, size_t count,
+                                     callback callbackFunc = callback());
+
+    /**
+     * @brief Set the file used by the discovery cache.
+     *
+     * By default (or if @a filePath is empty), the file "justplug.cache" inside the searched
+     * directory is used. A single file can be shared between several plugin directories.
+     * @param filePath
+     * @see CachePolicy
+     */
+    void setCacheFile(const std::string& filePath);
+
+    /**
+     * @brief Set the file storing the load duration of each plugin.
+     *
+     * loadPlugins() records the time spent loading each plugin, and uses the durations of the
+     * previous runs to start the plugins with the longest chain of dependent plugins first
+     * (this shortens concurrent loads, see setLoadThreadsCount()).
+     * By default (or if @a filePath is empty), the file "justplug.history" is used
+     * next to the discovery cache of the first search that uses the cache; without such
+     * a search, the durations are only kept by the manager.
+     * @param filePath
+     * @see criticalLoadChain()
+     */
+    void setLoadHistoryFile(const std::string& filePath);
 
     /**
      * @brief Register a plugin as the main plugin.
@@ -234,8 +567,13 @@ public:
     /**
      * @brief Load all plugins found by previous searchForPlugins().
      *
+     * This function can be called again after a new searchForPlugins() call: only the plugins found
+     * since the previous call (and the plugins whose dependencies were missing) are checked and
+     * added to the load order, and only the plugins that are not loaded yet are created.
+     * The main plugin's mainPluginExec() function is called by the call that loads it.
      * @param tryToContinue If true, the manager will try to load other plugins if some have errors.
-     * @param callbackFunc Callback function.
+     * @param callbackFunc Callback function. For LOAD_DEPENDENCY_CYCLE errors, it's called once per cycle
+     * with the comma-separated names of the plugins of the cycle.
      * @return true if all plugins was successfully loaded.
      */
     ReturnCode loadPlugins(bool tryToContinue, callback callbackFunc);
@@ -246,6 +584,168 @@ public:
      * @param callbackFunc
      */
     ReturnCode loadPlugins(callback callbackFunc = callback());
+    /**
+     * @brief Load only the plugins required by @a roots.
+     *
+     * Same as loadPlugins(bool tryToContinue, callback callbackFunc), but only the roots, the main
+     * plugin and all their dependencies (direct or not) are checked and loaded, in the
+     * dependencies order. Other plugins stay found but not loaded (and their errors are not
+     * reported) until a call to loadPlugins() without roots.
+     * Roots are added to the roots of the previous calls, which are still used when
+     * reloadPlugin() or processLocationChanges() load plugins again.
+     * @param roots The names of the plugins to load (may be empty to load only the main plugin)
+     * @param tryToContinue If true, the manager will try to load other plugins if some have errors
+     * (including roots that were not found, reported with ReturnCode::LOAD_PLUGIN_NOT_FOUND).
+     * @param callbackFunc Callback function (see loadPlugins()).
+     */
+    ReturnCode loadPlugins(const std::vector<std::string>& roots, bool tryToContinue, callback callbackFunc);
+    /**
+     * @brief Overloaded function.
+     *
+     * Same as loadPlugins(const std::vector<std::string>& roots, bool tryToContinue, callback callbackFunc)
+     * with tryToContinue set to true.
+     */
+    ReturnCode loadPlugins(const std::vector<std::string>& roots, callback callbackFunc = callback());
+
+    /**
+     * @brief Load all plugins found by previous searchForPlugins(), from a background thread.
+     *
+     * The dependencies are checked and the load order is computed before this function returns
+     * (so errors of this step are reported by the calling thread), then the plugins are loaded
+     * as with loadPlugins(), from another thread: use waitForPlugin() to wait for a specific plugin.
+     * The returned future is ready once all plugins are processed. The main plugin's
+     * mainPluginExec() function is then called from the loader thread.
+     * @note Functions that modify the manager (searchForPlugins(), loadPlugins(), unloadPlugins(), ...)
+     * wait for the end of the loading. Functions that only read it can be called at any time.
+     * @note Callback functions are called from the loader thread.
+     * @param tryToContinue If true, the manager will try to load other plugins if some have errors.
+     * @param callbackFunc Callback function (see loadPlugins()).
+     * @param progressFunc Called each time a plugin is processed (never concurrently).
+     * @return A future with the result of the loading.
+     */
+    std::future<ReturnCode> loadPluginsAsync(bool tryToContinue, callback callbackFunc, progressCallback progressFunc = progressCallback());
+    /**
+     * @brief Overloaded function.
+     *
+     * Same as loadPluginsAsync(bool tryToContinue, callback callbackFunc, progressCallback progressFunc)
+     * with tryToContinue set to true.
+     * @param callbackFunc
+     * @param progressFunc
+     */
+    std::future<ReturnCode> loadPluginsAsync(callback callbackFunc = callback(), progressCallback progressFunc = progressCallback());
+
+    /**
+     * @brief Wait until a plugin is processed by the current loadPlugins() or loadPluginsAsync() call.
+     *
+     * Returns immediately if the plugin is not part of the current load. With lazy loading,
+     * the plugin is loaded on demand (like pluginObject()).
+     * @note When called from a thread loading a plugin of the current load (from loaded(), a
+     * callback function or the progress function), the function never waits: it returns false
+     * if the plugin is not processed yet (waiting could deadlock the load).
+     * @param name The name of the plugin
+     * @return true if the plugin is loaded
+     */
+    bool waitForPlugin(const std::string& name);
+
+    /**
+     * @brief Enable lazy loading of plugins.
+     *
+     * With lazy loading, loadPlugins() only checks the dependencies and computes the load order.
+     * Only the main plugin (and its dependencies) are loaded immediately. Every other plugin is
+     * created (with all its dependencies) the first time its object is requested, using
+     * pluginObject() or from the main plugin with IPlugin::sendRequest().
+     * isPluginLoaded() never loads a plugin.
+     * @note On-demand loads are never concurrent, whatever setLoadThreadsCount() is set to.
+     * @param enable
+     */
+    void enableLazyLoading(const bool& enable = true);
+
+    /**
+     * @brief Set the number of threads used by loadPlugins().
+     *
+     * With more than one thread, each plugin is created and its loaded() function called
+     * as soon as all its dependencies are loaded, so independent plugins are loaded concurrently.
+     * Plugins that set "threadSafe" to false in their metadata are always loaded alone, from
+     * the thread calling loadPlugins().
+     * @note With several threads, callback functions may be called from any of them
+     * (but never concurrently).
+     * @note The load uses its own threads, not the ones of the executor, so plugins can
+     * wait for their executor tasks from loaded().
+     * @param threadsCount The number of threads (1 by default, 0 to use all hardware threads)
+     */
+    void setLoadThreadsCount(unsigned int threadsCount);
+
+    /**
+     * @brief Set the number of threads of the executor.
+     *
+     * Must be called before the first use of the executor (ignored otherwise).
+     * @param threadsCount The number of threads (0 to use all hardware threads, the default)
+     * @return false if the executor is already started
+     * @see executor()
+     */
+    bool setExecutorThreadsCount(unsigned int threadsCount);
+    /**
+     * @brief Pin each thread of the executor to one CPU.
+     *
+     * Threads are assigned in order to the CPUs the process is allowed to run on, so that
+     * consecutive threads stay on the same NUMA node with the usual CPU numbering.
+     * Must be called before the first use of the executor (ignored otherwise).
+     * @note Only supported on Linux and Windows.
+     * @param enable
+     * @return false if the executor is already started
+     */
+    bool enableExecutorPinning(const bool& enable = true);
+
+    /**
+     * @brief Set the flags used to load the plugins libraries.
+     *
+     * Flags are a combination of jp::SharedLibrary::LoadFlag values, and trade startup
+     * time for safety: for example, SharedLibrary::LOAD_NOW reports missing symbols when
+     * the plugin is loaded instead of at first call, and SharedLibrary::LOAD_DEEPBIND
+     * isolates plugins that bundle their own copy of a library.
+     * Only libraries loaded after this call are affected.
+     * @param flags The flags (SharedLibrary::LOAD_LAZY by default)
+     * @see setLibraryLoadFlags(const std::string& name, int flags)
+     */
+    void setLibraryLoadFlags(int flags);
+    /**
+     * @brief Set the flags used to load the library of one plugin.
+     *
+     * Overrides the flags set with setLibraryLoadFlags(int flags) for the plugin @a name.
+     * Libraries already opened by searchForPlugins() are reopened with these flags
+     * before the plugin is created.
+     * @param name The name of the plugin
+     * @param flags The flags (combination of jp::SharedLibrary::LoadFlag values)
+     */
+    void setLibraryLoadFlags(const std::string& name, int flags);
+
+    /**
+     * @brief Enable the prefetch of the plugins libraries.
+     *
+     * When enabled (the default), loadPlugins() asks the system to read every library of the
+     * load order from a background thread, so that disk reads overlap with the loading
+     * of the previous plugins. This mostly speeds up the first start (when libraries are
+     * not in the page cache yet). Nothing is prefetched with lazy loading.
+     * @note Only a hint on Linux and macOS, not supported on Windows.
+     * @param enable
+     */
+    void enablePrefetch(const bool& enable = true);
+
+    /**
+     * @brief Enable the per-plugin memory accounting (disabled by default).
+     *
+     * When enabled, the manager records for each plugin loaded afterwards the size of its mapped
+     * library and the resident set and heap growth caused by its creation and its loaded() function.
+     * These deltas are process-wide measures: they are approximate when plugins are loaded concurrently.
+     *
+     * The live heap counters are only maintained when the application defines JP_DEFINE_MEMORY_HOOK()
+     * (see pluginmemory.h): allocations made by a plugin while the manager runs its code (creation,
+     * loaded(), mainPluginExec(), aboutToBeUnloaded(), message bus handlers and requests sent to it by
+     * other plugins) are then attributed to it.
+     * @see pluginMemory()
+     * @param enable
+     */
+    void enableMemoryAccounting(const bool& enable = true);
 
     /**
      * @brief Unload all loaded plugins.
@@ -255,6 +755,110 @@ public:
      * @return true if all plugins are successfully unloaded.
      */
     ReturnCode unloadPlugins(callback callbackFunc = callback());
+    /**
+     * @brief Unload all loaded plugins concurrently, with deadlines.
+     *
+     * Plugins are unloaded level by level, in the reverse load order: the first level contains the
+     * plugins that no other plugin depends on, and a plugin is only unloaded once all the plugins that
+     * depend on it are unloaded. The plugins of a level are unloaded concurrently.
+     *
+     * A plugin whose aboutToBeUnloaded() function does not return before @a pluginTimeout, or that is
+     * not unloaded before @a totalTimeout, is reported to @a callbackFunc with UNLOAD_TIMEOUT (and its
+     * name as details) and the shutdown continues without it. Such plugins (and their dependencies)
+     * are never destroyed nor unloaded, since their code may still be running.
+     * Plugins that set "threadSafe" to false in their metadata are unloaded alone, from the calling
+     * thread: the deadlines are not enforced while their aboutToBeUnloaded() function runs.
+     * @param callbackFunc Callback function.
+     * @param threadsCount Maximum number of plugins unloaded at the same time (0 to use all hardware threads)
+     * @param pluginTimeout Deadline of each aboutToBeUnloaded() call, in milliseconds (0 for no deadline)
+     * @param totalTimeout Deadline of the whole unloading, in milliseconds (0 for no deadline)
+     * @return true if all plugins are successfully unloaded.
+     */
+    ReturnCode unloadPlugins(callback callbackFunc, unsigned int threadsCount,
+                             unsigned int pluginTimeout, unsigned int totalTimeout);
+
+    /**
+     * @brief Reload a plugin from its library, with all the plugins that depend on it.
+     *
+     * The plugins that depend (directly or not) on @a name are unloaded in the reverse load order,
+     * then the library of @a name is loaded again from the same path (so it can be replaced by an
+     * updated version), its metadata are read again and checked, and all these plugins are created
+     * again. Other plugins are not unloaded, and pending plugins (like those not required by the
+     * roots of loadPlugins()) are not loaded by this call.
+     * If the library is still mapped in the process once unloaded (for instance by another handle,
+     * or because it was loaded with LOAD_NODELETE), it cannot be read again: the plugins are created
+     * again from the old library and RELOAD_LIBRARY_STILL_LOADED is returned.
+     * If the library is not a valid plugin anymore (or its name changed), the plugin is removed
+     * and the plugins that depend on it cannot be loaded until a plugin with the same name is found.
+     * @note The main plugin's mainPluginExec() function is not called again.
+     * @note Objects of the reloaded plugins must not be used by other threads during this call.
+     * @param name The name of the plugin to reload
+     * @param callbackFunc Callback function (called for each plugin that cannot be loaded again).
+     * @return true if the plugin was found and its library is still a valid plugin.
+     */
+    ReturnCode reloadPlugin(const std::string& name, callback callbackFunc = callback());
+
+    /**
+     * @brief Watch the plugin locations for added, modified and removed libraries.
+     *
+     * All directories returned by pluginsLocation() are watched from a background thread, with
+     * the sub-directories (and the filters) of the last search in each directory. On Linux, inotify
+     * is used, so directories are never listed again (except the sub-directories created later, and
+     * all directories if the notifications overflow, since changes may have been missed).
+     * On other platforms, directories are polled (see setWatchPollInterval()).
+     * Changes are coalesced into batches: each time a batch is available, the function set by
+     * setWatchCallback() is called. Changes are only applied by processLocationChanges().
+     * @param enable
+     * @return false if the watcher cannot be started
+     * @see disableWatching(), processLocationChanges()
+     */
+    bool enableWatching(const bool& enable = true);
+    /**
+     * @brief Stop watching the plugin locations.
+     *
+     * Same as enableWatching(false)
+     * @see enableWatching()
+     */
+    void disableWatching();
+
+    /**
+     * @brief Set the interval between two scans of the plugin locations, when they are polled.
+     *
+     * Only used on platforms where the native notifications are not supported.
+     * Must be called before enableWatching().
+     * @param interval Interval in milliseconds (1000 by default)
+     */
+    void setWatchPollInterval(unsigned int interval);
+
+    /**
+     * @brief Set the function called each time a batch of changes is available.
+     *
+     * The function is called from the watcher thread: it must not call the manager directly,
+     * but it can schedule a call to processLocationChanges() on the thread using the manager.
+     * Must be called before enableWatching().
+     * @param func
+     */
+    void setWatchCallback(const std::function<void()>& func);
+
+    /**
+     * @brief Checks if the watcher found changes that are not processed yet.
+     * @see processLocationChanges()
+     */
+    bool hasLocationChanges() const;
+
+    /**
+     * @brief Apply the changes found by the watcher since the last call.
+     *
+     * - New libraries are read as by searchForPlugins(). If loadPlugins() was already called,
+     *   the new plugins are then loaded (see loadPlugins()).
+     * - Modified libraries are reloaded with reloadPlugin().
+     * - The plugins of removed libraries are unloaded and removed, as well as the plugins
+     *   that depend on them.
+     * @param callbackFunc Callback function (used for each error).
+     * @return true if all changes were applied without error.
+     * @see enableWatching()
+     */
+    ReturnCode processLocationChanges(callback callbackFunc = callback());
 
     //
     // Getters
@@ -315,7 +919,9 @@ public:
     /**
      * @brief Get the plugin object for the specified plugin.
      * @note The user can cast the object to the corresponding type if he wants.
+     * @note With lazy loading, the plugin and its dependencies are loaded by this call if needed.
      * @return The object or NULL if the plugin is not loaded.
+     * @see enableLazyLoading()
      */
     std::shared_ptr<IPlugin> pluginObject(const std::string& name) const;
 
@@ -326,11 +932,87 @@ public:
      * @return The PluginInfo object.
      */
     PluginInfo pluginInfo(const std::string& name) const;
+    /**
+     * @brief Get a read-only view of the metadata of the specified plugin.
+     *
+     * Nothing is copied nor allocated: the view points to the metadata stored by the
+     * manager, so it must not be freed. It stays valid while the plugin is registered.
+     * @complexity Constant on average, worst case linear in the number of plugins
+     * @param name
+     * @return The view (invalid if the plugin is not found).
+     */
+    PluginInfoView pluginInfoView(const std::string& name) const;
+    /**
+     * @brief Get the memory used by the specified plugin.
+     * @see enableMemoryAccounting()
+     * @param name
+     * @return The counters of the plugin (all zero if the plugin is not found or was never accounted).
+     */
+    PluginMemory pluginMemory(const std::string& name) const;
 
-private:
-    PluginManager();
-    ~PluginManager();
+    /**
+     * @brief Get the message bus shared by all plugins.
+     *
+     * The application can publish and subscribe like plugins (see IPlugin::messageBus()).
+     * Its subscriptions are never removed automatically.
+     * @return The bus (owned by the manager, must not be deleted)
+     */
+    IMessageBus* messageBus();
+
+    /**
+     * @brief Get the task executor shared by all plugins.
+     *
+     * The executor also runs the concurrent search of the plugins. Its threads
+     * are started by the first submitted task.
+     * @return The executor (owned by the manager, must not be deleted)
+     * @see IPlugin::executor(), setExecutorThreadsCount()
+     */
+    IExecutor* executor();
+
+    /**
+     * @brief Publish a service implemented by the application.
+     *
+     * Same as IPlugin::publishService(), the interface must be given explicitly.
+     * @param service The implementation (must stay valid until it's unpublished)
+     * @return false if another implementation is published
+     */
+    template<class Interface>
+    bool publishService(typename jp_private::ServiceType<Interface>::type* service)
+    { return publishService(Interface::jp_serviceId(), Interface::jp_serviceName(), static_cast<void*>(service)); }
+    /**
+     * @brief Remove a service published by the application.
+     * @return false if the application does not publish the service
+     */
+    template<class Interface>
+    bool unpublishService()
+    { return unpublishService(Interface::jp_serviceId()); }
+    /**
+     * @brief Resolve a service published by a plugin or the application.
+     * @complexity Constant on average
+     * @return The handle (invalid if the service is not published)
+     */
+    template<class Interface>
+    ServiceHandle<Interface> service() const
+    { return ServiceHandle<Interface>(static_cast<Interface*>(findService(Interface::jp_serviceId(), Interface::jp_serviceName()))); }
 
+    /**
+     * @brief Untyped version of publishService().
+     * @param id The id of the service
+     * @param name The name of the service (checked by findService())
+     * @param service The implementation
+     */
+    bool publishService(ServiceId id, const char* name, void* service);
+    /**
+     * @brief Untyped version of unpublishService().
+     */
+    bool unpublishService(ServiceId id);
+    /**
+     * @brief Untyped version of service().
+     * @return The service, or nullptr if not found (or if @a name is not null and doesn't match)
+     */
+    void* findService(ServiceId id, const char* name = nullptr) const;
+
+private:
     // Non-copyable
     PluginManager(const PluginManager&) = delete;
     const PluginManager& operator=(const PluginManager&) = delete;
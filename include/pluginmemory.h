@@ -0,0 +1,146 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PLUGINMEMORY_H
+#define PLUGINMEMORY_H
+
+#include <cstddef> // for size_t and std::max_align_t
+#include <cstdint> // for intN_t types
+#include <cstdlib> // for malloc and free
+#include <new> // for std::bad_alloc and std::nothrow_t
+
+#include "iplugin.h"
+
+namespace jp
+{
+
+/**
+ * @struct PluginMemory
+ * @brief Memory attributed to one plugin.
+ *
+ * Filled when memory accounting is enabled.
+ * @see jp::PluginManager::enableMemoryAccounting(), jp::PluginManager::pluginMemory()
+ */
+struct PluginMemory
+{
+    //! Size of the memory mapped for the library (0 for static plugins, or if not supported)
+    uint64_t librarySize;
+    //! Change of the process resident size during the creation of the plugin and loaded()
+    int64_t residentDelta;
+    //! Change of the memory in use by malloc during the same calls (0 if not supported)
+    int64_t heapDelta;
+    //! Bytes allocated by the plugin and not freed yet (only counted with JP_DEFINE_MEMORY_HOOK)
+    int64_t liveBytes;
+    //! Number of allocations counted in liveBytes
+    int64_t liveAllocations;
+};
+
+/**
+ * @brief Return the owner of the allocations made by the current thread.
+ *
+ * The owner is set while the manager runs the code of a plugin (creation, loaded(),
+ * mainPluginExec(), aboutToBeUnloaded() and message bus handlers), and only if memory
+ * accounting is enabled. Returns nullptr otherwise.
+ * @note Used by allocator hooks (see JP_DEFINE_MEMORY_HOOK), must not allocate.
+ */
+JP_EXPORT_SYMBOL void* currentMemoryOwner();
+/**
+ * @brief Count an allocation of @a size bytes for @a owner (returned by currentMemoryOwner()).
+ */
+JP_EXPORT_SYMBOL void memoryAllocated(void* owner, size_t size);
+/**
+ * @brief Count the release of an allocation counted with memoryAllocated().
+ *
+ * Owners are never deleted, so blocks of an unloaded plugin can still be released.
+ */
+JP_EXPORT_SYMBOL void memoryReleased(void* owner, size_t size);
+
+} // namespace jp
+
+namespace jp_private
+{
+// Stored before each block allocated by JP_DEFINE_MEMORY_HOOK (keeps the alignment of malloc)
+union MemoryHookHeader
+{
+    struct
+    {
+        void* owner;
+        size_t size;
+    } block;
+    std::max_align_t align;
+};
+
+inline void* hookAllocate(size_t size)
+{
+    MemoryHookHeader* header = static_cast<MemoryHookHeader*>(std::malloc(sizeof(MemoryHookHeader) + size));
+    if(!header)
+        return nullptr;
+    header->block.owner = jp::currentMemoryOwner();
+    header->block.size = size;
+    if(header->block.owner)
+        jp::memoryAllocated(header->block.owner, size);
+    return header + 1;
+}
+
+inline void hookRelease(void* ptr)
+{
+    if(!ptr)
+        return;
+    MemoryHookHeader* header = static_cast<MemoryHookHeader*>(ptr) - 1;
+    if(header->block.owner)
+        jp::memoryReleased(header->block.owner, header->block.size);
+    std::free(header);
+}
+} // namespace jp_private
+
+/**
+ * @brief Replace the global operator new and operator delete to count the live allocations of each plugin.
+ *
+ * Must be used once, in one source file of the executable. Since the executable's operators
+ * replace those of every library, allocations made with new by plugins (including the
+ * containers of the standard library) are counted in PluginMemory::liveBytes for the
+ * plugin running when they are made. Memory allocated with malloc() is never counted.
+ * @note Plugins loaded with SharedLibrary::LOAD_DEEPBIND may use the operators of their own
+ * C++ library, so they must not be used with this hook.
+ * @related jp::PluginMemory
+ */
+#define JP_DEFINE_MEMORY_HOOK()                                                                     \
+    void* operator new(std::size_t size)                                                            \
+    {                                                                                               \
+        void* ptr = jp_private::hookAllocate(size);                                                 \
+        if(!ptr)                                                                                    \
+            throw std::bad_alloc();                                                                 \
+        return ptr;                                                                                 \
+    }                                                                                               \
+    void* operator new[](std::size_t size) { return ::operator new(size); }                         \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept                            \
+    { return jp_private::hookAllocate(size); }                                                      \
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept                          \
+    { return jp_private::hookAllocate(size); }                                                      \
+    void operator delete(void* ptr) noexcept { jp_private::hookRelease(ptr); }                      \
+    void operator delete[](void* ptr) noexcept { jp_private::hookRelease(ptr); }                    \
+    void operator delete(void* ptr, const std::nothrow_t&) noexcept { jp_private::hookRelease(ptr); } \
+    void operator delete[](void* ptr, const std::nothrow_t&) noexcept { jp_private::hookRelease(ptr); }
+
+#endif // PLUGINMEMORY_H
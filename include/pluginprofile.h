@@ -0,0 +1,82 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PLUGINPROFILE_H
+#define PLUGINPROFILE_H
+
+#include <string> // for std::string
+#include <cstdint> // for intN_t types
+
+namespace jp
+{
+
+/**
+ * @struct ProfileEvent
+ * @brief Wall time spent by the PluginManager in one phase for one plugin.
+ *
+ * Events are recorded by searchForPlugins(), loadPlugins() and unloadPlugins()
+ * when profiling is enabled (the default).
+ * @see jp::PluginManager::profile()
+ */
+struct ProfileEvent
+{
+    /**
+     * @brief Phases measured by the PluginManager.
+     */
+    enum Phase
+    {
+        DLOPEN = 0, //!< Loading of the library
+        SYMBOL_LOOKUP, //!< Lookup of the JustPlug symbols (in the file or in the loaded library)
+        METADATA_PARSE, //!< Parsing of the plugin metadata
+        DEPENDENCY_CHECK, //!< Check of the plugin dependencies
+        CREATOR_CALL, //!< Creation of the plugin object
+        LOADED_CALL, //!< Call to IPlugin::loaded()
+        UNLOADING_CALL, //!< Call to IPlugin::aboutToBeUnloaded()
+        DLCLOSE, //!< Unloading of the library
+
+        PHASES_COUNT //!< Number of phases (not a phase)
+    };
+
+    std::string plugin; //!< Name of the plugin (or path of the library if the name is not known)
+    Phase phase; //!< Measured phase
+    int64_t start; //!< Start time, in nanoseconds since the manager creation or the last clearProfile()
+    int64_t duration; //!< Duration, in nanoseconds
+    uint32_t thread; //!< Index of the thread that ran the phase (the first profiled thread is 0)
+
+    /**
+     * @brief Name of the phase (like "dlopen" or "loaded").
+     */
+    static const char* phaseName(Phase phase)
+    {
+        static const char* const names[PHASES_COUNT] = {
+            "dlopen", "symbolLookup", "metadataParse", "dependencyCheck",
+            "creator", "loaded", "aboutToBeUnloaded", "dlclose"
+        };
+        return (phase >= 0 && phase < PHASES_COUNT) ? names[phase] : "unknown";
+    }
+};
+
+} // namespace jp
+
+#endif // PLUGINPROFILE_H
@@ -0,0 +1,169 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef REQUESTMETRICS_H
+#define REQUESTMETRICS_H
+
+#include <atomic> // for std::atomic
+#include <string> // for std::string
+#include <vector> // for std::vector
+#include <utility> // for std::pair
+#include <cstdint> // for intN_t types
+
+namespace jp
+{
+
+class IPlugin;
+struct Request;
+
+/**
+ * @struct RequestRoute
+ * @brief Metrics of the requests sent by one plugin to one receiver with one code.
+ *
+ * Recorded when request metrics are enabled.
+ * @see jp::PluginManager::enableRequestMetrics(), jp::PluginManager::requestMetrics()
+ */
+struct RequestRoute
+{
+    //! Number of buckets of the latency histogram
+    static const int HISTOGRAM_BUCKETS = 32;
+
+    std::string sender; //!< Name of the sender plugin
+    std::string receiver; //!< Name of the receiver plugin (empty for the manager)
+    uint16_t code; //!< Request code (without the ManagerRequestFlag flags for the manager)
+
+    uint64_t calls; //!< Number of requests
+    uint64_t errors; //!< Number of requests that did not return SUCCESS
+    //! Number of requests for each return code other than SUCCESS, sorted by code
+    std::vector<std::pair<uint16_t, uint64_t>> returnCodes;
+
+    int64_t totalDuration; //!< Sum of the durations, in nanoseconds
+    int64_t maxDuration; //!< Longest request, in nanoseconds
+    /**
+     * Latency histogram: bucket i counts the requests that lasted less than 2^(i+1) nanoseconds
+     * (and at least 2^i, except for the first bucket). The last bucket counts all longer requests.
+     */
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+
+    /**
+     * @brief Index of the histogram bucket of a duration (in nanoseconds).
+     */
+    static int bucket(int64_t duration)
+    {
+        int index = 0;
+        while(index < HISTOGRAM_BUCKETS - 1 && (duration >> (index + 1)) > 0)
+            ++index;
+        return index;
+    }
+
+    /**
+     * @brief Upper bound of the requested percentile of the durations, read from the histogram.
+     * @param percent Between 0 and 100
+     * @return The duration in nanoseconds (bounded by maxDuration), 0 if there is no request.
+     */
+    int64_t percentile(double percent) const
+    {
+        const double target = calls * percent / 100.0;
+        uint64_t count = 0;
+        for(int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        {
+            count += histogram[i];
+            if(count > 0 && count >= target)
+            {
+                const int64_t bound = (int64_t{2} << i) - 1;
+                return bound < maxDuration ? bound : maxDuration;
+            }
+        }
+        return maxDuration;
+    }
+};
+
+/**
+ * @class IRequestMetrics
+ * @brief Recorder of the request metrics, owned by the plugin manager.
+ *
+ * Requests sent to the manager are recorded by the manager itself. Requests between
+ * plugins do not go through the manager: while the recorder is active, IPlugin::sendRequest()
+ * and IPlugin::sendRequestBatch() call the receiver through dispatch() and dispatchBatch(), which
+ * measure the requests (if request metrics are enabled) and attribute the allocations made by
+ * the receiver to it (if memory accounting is enabled). Otherwise the receiver is called directly.
+ * @note All functions are thread-safe.
+ */
+class IRequestMetrics
+{
+public:
+    /**
+     * @brief Return true if requests between plugins must go through dispatch() and dispatchBatch().
+     *
+     * True while request metrics or memory accounting are enabled.
+     */
+    bool active() const { return _active.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Call the handleRequest() function of a plugin (in its memory scope), and record the request.
+     * @param sender The name of the sender plugin
+     * @param receiver The receiver plugin
+     * @param receiverName The name of the receiver plugin
+     * @param code The request code
+     * @param data The data of the request
+     * @param dataSize The size of the data
+     * @return The code returned by the receiver
+     */
+    virtual uint16_t dispatch(const char* sender, IPlugin* receiver, const char* receiverName,
+                              uint16_t code, void** data, uint32_t* dataSize) = 0;
+
+    /**
+     * @brief Call the handleRequestBatch() function of a plugin (in its memory scope), and record its requests.
+     *
+     * The duration of the batch is shared between its requests.
+     * @param sender The name of the sender plugin
+     * @param receiver The receiver plugin
+     * @param receiverName The name of the receiver plugin
+     * @param requests The requests
+     * @param count The number of requests
+     */
+    virtual void dispatchBatch(const char* sender, IPlugin* receiver, const char* receiverName,
+                               Request* requests, size_t count) = 0;
+
+    /**
+     * @brief Record one request (that was not dispatched, like a request to an unknown plugin).
+     * @param sender The name of the sender plugin
+     * @param receiver The name of the receiver plugin (nullptr for the manager)
+     * @param code The request code
+     * @param returnCode The code returned by the receiver
+     * @param duration The duration of the request, in nanoseconds
+     */
+    virtual void record(const char* sender, const char* receiver, uint16_t code,
+                        uint16_t returnCode, int64_t duration) = 0;
+
+protected:
+    // The recorder is owned by the manager, and cannot be deleted by its users
+    virtual ~IRequestMetrics() {}
+
+    std::atomic<bool> _active{false};
+};
+
+} // namespace jp
+
+#endif // REQUESTMETRICS_H
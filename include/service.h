@@ -0,0 +1,144 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <cstdint> // for intN_t types
+
+/**
+ * @brief Declare a service interface.
+ *
+ * Gives the interface a compile-time id (a hash of its name), used to publish and
+ * resolve implementations through the service registry of the manager.
+ * Classes declared with JP_DECLARE_INTERFACE are services too.
+ * @note Must be declared AT THE BEGINNING of the class definition. Members declared after
+ * it are public.
+ * @see jp::IPlugin::publishService(), jp::IPlugin::service()
+ */
+#define JP_DECLARE_SERVICE(className) _JP_DECLARE_SERVICE__IMPL(className)
+
+namespace jp
+{
+
+/**
+ * @brief Identifier of a service interface (FNV-1a hash of its name).
+ */
+typedef uint64_t ServiceId;
+
+/**
+ * @brief Compute the id of a service from its name, at compile-time.
+ * @param name The name of the service
+ * @param hash Used by the recursion, must not be set
+ */
+constexpr ServiceId serviceId(const char* name, ServiceId hash = 14695981039346656037ULL)
+{
+    return *name ? serviceId(name + 1, (hash ^ static_cast<unsigned char>(*name)) * 1099511628211ULL) : hash;
+}
+
+/**
+ * @struct ServiceRequest
+ * @brief Data of the PUBLISH_SERVICE, UNPUBLISH_SERVICE and GET_SERVICE manager requests.
+ *
+ * *data must point to this structure when the request is sent.
+ */
+struct ServiceRequest
+{
+    ServiceId id; //!< The id of the service
+    const char* name; //!< The name of the service (checked, to detect hash collisions)
+    void* service; //!< The service (set by GET_SERVICE, nullptr if not found)
+};
+
+/**
+ * @class ServiceHandle
+ * @brief A resolved service.
+ *
+ * Obtained once with IPlugin::service() or PluginManager::service(), then calls go
+ * directly to the implementation, with no lookup.
+ * @note The service stays valid while its provider is loaded: resolve it again after the
+ * provider is reloaded (or declare a dependency on the provider).
+ */
+template<class Interface>
+class ServiceHandle
+{
+public:
+    /**
+     * @brief Construct an invalid handle.
+     */
+    ServiceHandle() {}
+    /**
+     * @brief Construct a handle to @a service.
+     */
+    explicit ServiceHandle(Interface* service) : _service(service) {}
+
+    /**
+     * @brief Return true if the service was found.
+     */
+    bool isValid() const
+    { return _service != nullptr; }
+    /**
+     * @brief Same as isValid().
+     */
+    explicit operator bool() const
+    { return isValid(); }
+
+    /**
+     * @brief Access the service (the handle must be valid).
+     */
+    Interface* operator->() const
+    { return _service; }
+    /**
+     * @brief Access the service (the handle must be valid).
+     */
+    Interface& operator*() const
+    { return *_service; }
+    /**
+     * @brief Returns the service, or nullptr for an invalid handle.
+     */
+    Interface* get() const
+    { return _service; }
+
+private:
+    Interface* _service = nullptr;
+};
+
+} // namespace jp
+
+namespace jp_private
+{
+// Prevents the deduction of a template parameter, so the interface is always
+// explicit (the pointer is converted to the interface before being published)
+template<class T>
+struct ServiceType
+{
+    typedef T type;
+};
+} // namespace jp_private
+
+#define _JP_DECLARE_SERVICE__IMPL(className)                                        \
+    public:                                                                         \
+        static constexpr jp::ServiceId jp_serviceId() { return jp::serviceId(#className); } \
+        static constexpr const char* jp_serviceName() { return #className; }
+
+#endif // SERVICE_H
@@ -26,6 +26,8 @@
 #define SHAREDLIBRARY_H
 
 #include <string>
+#include <cstring>
+#include <cstdint>
 
 #include "confinfo.h"
 
@@ -52,6 +54,29 @@ class SharedLibrary
 {
 public:
 
+    /**
+     * @brief Flags controlling how the library is loaded.
+     *
+     * Flags can be combined with a bitwise OR and are passed to load().
+     * They map to the dlopen() flags on Unix systems. Flags not supported by
+     * the system (like LOAD_DEEPBIND outside of glibc) are ignored, and
+     * all flags are ignored on Windows.
+     */
+    enum LoadFlag
+    {
+        /// Functions are resolved on first call, symbols are not made global (default)
+        LOAD_LAZY = 0,
+        /// Resolve all undefined symbols when the library is loaded (RTLD_NOW)
+        LOAD_NOW = 1 << 0,
+        /// Make the symbols available to libraries loaded afterwards (RTLD_GLOBAL)
+        LOAD_GLOBAL = 1 << 1,
+        /// Prefer the library's own symbols over global ones (RTLD_DEEPBIND).
+        /// Beware that it breaks global objects copied into the executable (like std::cout)
+        LOAD_DEEPBIND = 1 << 2,
+        /// Never unmap the library, even after unload() (RTLD_NODELETE)
+        LOAD_NODELETE = 1 << 3
+    };
+
     /**
      * @brief Default constructor.
      *
@@ -89,22 +114,32 @@ public:
      * first unload the previous library, and only after, load the new one.
      * @note If the object was constructed using a path, the library is already loaded.
      * @param path The path to the library to load
+     * @param flags A combination of LoadFlag values
      * @return true on success
      */
-    bool load(const char* path)
+    bool load(const char* path, int flags = LOAD_LAZY)
     {
         // Try to unload previous library
         if(isLoaded() && !unload())
             return false;
-        return loadImpl(path);
+        _flags = flags;
+        _symbolsCount = 0;
+        return loadImpl(path, flags);
     }
 
     /**
      * @overload
-     * @see load(const char* path)
+     * @see load(const char* path, int flags)
      */
-    bool load(const std::string& path)
-    { return load(path.c_str()); }
+    bool load(const std::string& path, int flags = LOAD_LAZY)
+    { return load(path.c_str(), flags); }
+
+    /**
+     * @brief Returns the flags used by the last call to load().
+     * @return A combination of LoadFlag values
+     */
+    int loadFlags() const
+    { return _flags; }
 
     /**
      * @brief Checks if the library is loaded.
@@ -113,28 +148,49 @@ public:
     bool isLoaded() const
     { return _handle != nullptr; }
 
+    /**
+     * @brief Checks if a library is mapped in the process.
+     *
+     * The library is never loaded by this function: it only checks if it's still mapped
+     * (by another handle, a library that depends on it or LOAD_NODELETE), for instance
+     * after unload().
+     * @param path The path to the library, as given to load()
+     * @return true if the library is mapped in the process
+     */
+    static bool isMapped(const char* path)
+    { return isMappedImpl(path); }
+
+    /**
+     * @overload
+     * @see isMapped(const char* path)
+     */
+    static bool isMapped(const std::string& path)
+    { return isMapped(path.c_str()); }
+
     /**
      * @brief Unload the library.
      * @return true on success (if the library is already unloaded, returns false)
      */
     bool unload()
-    { return isLoaded() && unloadImpl(); }
+    {
+        _symbolsCount = 0;
+        return isLoaded() && unloadImpl();
+    }
 
 
     /**
      * @brief Checks for symbol.
      *
      * Checks if the library has the symbol specified by @a symbolName.
+     * Unlike get...() functions, this function never changes the last error.
      * @param symbolName name of the symbole
      * @return true if the library has the symbol
      */
     bool hasSymbol(const char* symbolName)
     {
-        std::string error = _lastError;
-        getImpl(symbolName);
-        bool has = _lastError.empty();
-        _lastError = error;
-        return has;
+        bool found;
+        lookup(symbolName, &found);
+        return found;
     }
 
     /**
@@ -181,6 +237,34 @@ public:
     void* getRawAddress(const std::string& symbolName)
     { return getRawAddress(symbolName.c_str()); }
 
+    /**
+     * @brief Resolve several symbols at once.
+     *
+     * Looks up the @a count symbols of @a symbolNames and stores their addresses
+     * in @a addresses (nullptr for the symbols not found).
+     * Resolved addresses are cached until the library is unloaded, so following
+     * calls to hasSymbol() or get...() for these symbols don't query the system again.
+     * The cache is a fixed table that never allocates: only the first 8 symbols with names
+     * shorter than 32 characters are cached, other symbols are queried on each call.
+     * Like hasSymbol(), this function never changes the last error.
+     * @param symbolNames The names of the symbols
+     * @param addresses Array of at least @a count elements receiving the addresses
+     * @param count The number of symbols
+     * @return The number of symbols found
+     */
+    size_t resolveSymbols(const char* const* symbolNames, void** addresses, size_t count)
+    {
+        size_t foundCount = 0;
+        for(size_t i = 0; i < count; ++i)
+        {
+            bool found;
+            addresses[i] = lookup(symbolNames[i], &found);
+            if(found)
+                ++foundCount;
+        }
+        return foundCount;
+    }
+
     /**
      * @brief Checks if the last call raise an error, or not.
      *
@@ -218,16 +302,90 @@ public:
 
 private:
 
+    // Size of the symbols cache, and maximum length of the cached names
+    // (plugins only use a few short names, like jp_name)
+    static const size_t MAX_CACHED_SYMBOLS = 8;
+    static const size_t MAX_CACHED_NAME = 32;
+
+    // A cached lookup result (the name is copied, since the caller's string
+    // may be a temporary)
+    struct Symbol
+    {
+        char name[MAX_CACHED_NAME];
+        void* address;
+        bool found;
+    };
+
     // Private members
     NativeLibHandle _handle = nullptr;
+    int _flags = LOAD_LAZY;
     std::string _lastError;
+    // Only a few symbols are looked up per library, so a linear search is enough
+    Symbol _symbols[MAX_CACHED_SYMBOLS];
+    size_t _symbolsCount = 0;
+
+    // Find a symbol in the cache, or query the system
+    // The last error is not changed and the cache is a fixed table, so lookups never allocate
+    void* lookup(const char* symbolName, bool* found)
+    {
+        *found = false;
+        if(!isLoaded())
+            return nullptr;
+
+        for(size_t i = 0; i < _symbolsCount; ++i)
+        {
+            if(std::strcmp(_symbols[i].name, symbolName) == 0)
+            {
+                *found = _symbols[i].found;
+                return _symbols[i].address;
+            }
+        }
+
+        void* address = nullptr;
+        *found = lookupImpl(symbolName, &address);
+
+        const size_t length = std::strlen(symbolName);
+        if(_symbolsCount < MAX_CACHED_SYMBOLS && length < MAX_CACHED_NAME)
+        {
+            Symbol& symbol = _symbols[_symbolsCount++];
+            std::memcpy(symbol.name, symbolName, length + 1);
+            symbol.address = address;
+            symbol.found = *found;
+        }
+        return address;
+    }
+
+    void* getImpl(const char* symbolName)
+    {
+        bool found;
+        void* address = lookup(symbolName, &found);
+        if(found)
+        {
+            // clear() keeps the capacity, so nothing is allocated here
+            _lastError.clear();
+            return address;
+        }
+        setSymbolError(symbolName);
+        return nullptr;
+    }
 
 // Linux implementation
 #if defined(CONFINFO_PLATFORM_LINUX) || defined(CONFINFO_PLATFORM_CYGWIN)
-    bool loadImpl(const char* path)
+    bool loadImpl(const char* path, int flags)
     {
+        int mode = (flags & LOAD_NOW) ? RTLD_NOW : RTLD_LAZY;
+        mode |= (flags & LOAD_GLOBAL) ? RTLD_GLOBAL : RTLD_LOCAL;
+#ifdef RTLD_DEEPBIND
+        if(flags & LOAD_DEEPBIND)
+            mode |= RTLD_DEEPBIND;
+#endif
+#ifdef RTLD_NODELETE
+        if(flags & LOAD_NODELETE)
+            mode |= RTLD_NODELETE;
+#endif
+
         _lastError.clear();
-        _handle = dlopen(path, RTLD_LAZY | RTLD_LOCAL);
+        _handle = dlopen(path, mode);
         if(!_handle)
         {
             _lastError = dlerror();
@@ -249,19 +407,45 @@ private:
         return true;
     }
 
-    void* getImpl(const char* symbolName)
+    static bool isMappedImpl(const char* path)
+    {
+#ifdef RTLD_NOLOAD
+        // RTLD_NOLOAD only returns a handle if the library is already loaded
+        void* handle = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+        if(!handle)
+        {
+            dlerror();
+            return false;
+        }
+        dlclose(handle);
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    bool lookupImpl(const char* symbolName, void** address)
     {
-        _lastError.clear();
         dlerror();
-        void* symbol = dlsym(_handle, symbolName);
-        const char* error = dlerror();
-        if(error)
+        *address = dlsym(_handle, symbolName);
+        // A symbol can have a null address, so only dlerror() reports failures
+        return dlerror() == nullptr;
+    }
+
+    void setSymbolError(const char* symbolName)
+    {
+        if(!isLoaded())
         {
-            // An error occured
-            _lastError = error;
-            return nullptr;
+            _lastError = "library not loaded";
+            return;
         }
-        return symbol;
+        // The error of the first dlsym() call has already been consumed (or the result
+        // was cached), so query the system again to get its message
+        dlerror();
+        dlsym(_handle, symbolName);
+        const char* error = dlerror();
+        _lastError = error ? error : std::string("undefined symbol: ") + symbolName;
     }
 #elif defined(CONFINFO_PLATFORM_WIN32) // Windows implementation
 
@@ -285,7 +469,7 @@ private:
         return std::string();
     }
 
-    bool loadImpl(const char* path)
+    bool loadImpl(const char* path, int /*flags*/)
     {
         _lastError.clear();
         _handle = LoadLibrary(path);
@@ -309,16 +493,31 @@ private:
         return true;
     }
 
-    void* getImpl(const char* symbolName)
+    static bool isMappedImpl(const char* path)
     {
-        _lastError.clear();
-        void* addr = (void*)GetProcAddress(_handle, symbolName);
-        if(!addr)
+        // Doesn't change the reference count of the module
+        return GetModuleHandle(path) != nullptr;
+    }
+
+    bool lookupImpl(const char* symbolName, void** address)
+    {
+        *address = (void*)GetProcAddress(_handle, symbolName);
+        return *address != nullptr;
+    }
+
+    void setSymbolError(const char* symbolName)
+    {
+        if(!isLoaded())
         {
-            _lastError = getWindowsError();
-            return nullptr;
+            _lastError = "library not loaded";
+            return;
         }
-        return addr;
+        // Query the system again to get its message (the result may come from the cache)
+        SetLastError(0);
+        GetProcAddress(_handle, symbolName);
+        _lastError = getWindowsError();
+        if(_lastError.empty())
+            _lastError = std::string("undefined symbol: ") + symbolName;
     }
 #endif
 };
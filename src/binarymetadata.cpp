@@ -0,0 +1,142 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/binarymetadata.h"
+
+#include "version/version.h"
+
+#include <cstdint> // for intN_t types
+#include <cstring> // for memchr, memcmp
+
+using namespace jp_private;
+
+namespace
+{
+
+const size_t HEADER_SIZE = 48;
+const size_t STRINGS_COUNT = 8;
+const uint16_t FORMAT_VERSION = 1;
+const uint16_t FLAG_NOT_THREADSAFE = 0x1;
+
+uint32_t readUInt(const unsigned char* data, size_t bytes)
+{
+    uint32_t value = 0;
+    for(size_t i = 0; i < bytes; ++i)
+        value |= static_cast<uint32_t>(data[i]) << (8*i);
+    return value;
+}
+
+// Reader that checks all offsets against the size of the data
+class Reader
+{
+public:
+    Reader(const unsigned char* data, size_t size): _data(data), _size(size), _ok(true) {}
+
+    bool ok() const { return _ok; }
+
+    uint32_t uint(size_t offset, size_t bytes)
+    {
+        if(!_ok || offset + bytes > _size)
+        {
+            _ok = false;
+            return 0;
+        }
+        return readUInt(_data + offset, bytes);
+    }
+
+    // String referenced by the offset stored at offset
+    std::string string(size_t offset)
+    {
+        const uint32_t strOffset = uint(offset, 4);
+        if(!_ok || strOffset >= _size
+           || !memchr(_data + strOffset, '\0', _size - strOffset))
+        {
+            _ok = false;
+            return std::string();
+        }
+        return std::string(reinterpret_cast<const char*>(_data + strOffset));
+    }
+
+private:
+    const unsigned char* _data;
+    size_t _size;
+    bool _ok;
+};
+
+} // namespace
+
+PluginInfoStd jp_private::parseBinaryMetadata(const char* data, size_t size)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if(!data || size < HEADER_SIZE || memcmp(data, "JPMB", 4) != 0
+       || readUInt(bytes + 4, 2) != FORMAT_VERSION)
+        return PluginInfoStd();
+
+    const uint32_t totalSize = readUInt(bytes + 8, 4);
+    if(totalSize < HEADER_SIZE || totalSize > size)
+        return PluginInfoStd();
+
+    Reader reader(bytes, totalSize);
+    PluginInfoStd info;
+    std::string* fields[STRINGS_COUNT - 1];
+    fields[0] = &info.name;
+    fields[1] = &info.prettyName;
+    fields[2] = &info.version;
+    fields[3] = &info.author;
+    fields[4] = &info.url;
+    fields[5] = &info.license;
+    fields[6] = &info.copyright;
+
+    // Check API version of the plugin (Version throws for some invalid strings)
+    const std::string api = reader.string(12);
+    try
+    {
+        if(!reader.ok() || !Version(api).compatible(JP_PLUGIN_API))
+            return PluginInfoStd();
+    }
+    catch(const std::exception&)
+    {
+        return PluginInfoStd();
+    }
+
+    for(size_t i = 1; i < STRINGS_COUNT; ++i)
+        *fields[i - 1] = reader.string(12 + 4*i);
+
+    const uint32_t depNb = reader.uint(44, 4);
+    if(!reader.ok() || depNb > (totalSize - HEADER_SIZE) / 8)
+        return PluginInfoStd();
+
+    info.dependencies.resize(depNb);
+    for(uint32_t i = 0; i < depNb; ++i)
+    {
+        info.dependencies[i].name = reader.string(HEADER_SIZE + 8*i);
+        info.dependencies[i].version = reader.string(HEADER_SIZE + 8*i + 4);
+    }
+
+    info.threadSafe = (readUInt(bytes + 6, 2) & FLAG_NOT_THREADSAFE) == 0;
+
+    if(!reader.ok())
+        return PluginInfoStd();
+    return info;
+}
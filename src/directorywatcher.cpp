@@ -0,0 +1,436 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/directorywatcher.h"
+#include "private/fsutil.h"
+
+#include <chrono> // for std::chrono::milliseconds
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+#include <algorithm> // for std::count
+#include <cerrno> // for errno
+#include <fcntl.h> // for O_CLOEXEC
+#include <poll.h> // for poll
+#include <unistd.h> // for pipe2, read, write and close
+#include <sys/inotify.h> // for inotify_*
+#endif
+
+using namespace jp_private;
+
+namespace {
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+// Time without events before a batch is reported (in milliseconds)
+const int settleTime = 50;
+#endif
+
+// Options of a location, limited to the sub-directories under depth
+fsutil::ScanOptions optionsAtDepth(const fsutil::ScanOptions& options, int depth)
+{
+    fsutil::ScanOptions result = options;
+    result.maxDepth = options.maxDepth < 0 ? -1 : options.maxDepth - depth;
+    result.executor = nullptr;
+    result.dirsList = nullptr;
+    return result;
+}
+
+} // anonymous namespace
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    stop();
+}
+
+bool DirectoryWatcher::start(unsigned int pollInterval, const NotifyFunction& notify)
+{
+    if(isRunning())
+        return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _notify = notify;
+    _pollInterval = pollInterval == 0 ? 1 : pollInterval;
+    _stopRequested = false;
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(_inotifyFd == -1)
+        return false;
+    if(pipe2(_wakeupPipe, O_CLOEXEC) == -1)
+    {
+        close(_inotifyFd);
+        _inotifyFd = -1;
+        return false;
+    }
+#endif
+
+    for(size_t i = 0; i < _locations.size(); ++i)
+        watchDirectory(i);
+
+    _thread = std::thread(&DirectoryWatcher::run, this);
+    return true;
+}
+
+void DirectoryWatcher::stop()
+{
+    if(!isRunning())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopRequested = true;
+    }
+#if defined(CONFINFO_PLATFORM_LINUX)
+    const char byte = 0;
+    while(write(_wakeupPipe[1], &byte, 1) == -1 && errno == EINTR) {}
+#endif
+    _cond.notify_all();
+    _thread.join();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+#if defined(CONFINFO_PLATFORM_LINUX)
+    close(_inotifyFd);
+    close(_wakeupPipe[0]);
+    close(_wakeupPipe[1]);
+    _inotifyFd = _wakeupPipe[0] = _wakeupPipe[1] = -1;
+    _watches.clear();
+#endif
+    _fingerprints.clear();
+}
+
+void DirectoryWatcher::addDirectory(const std::string& dir, const fsutil::ScanOptions& options)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t location = 0;
+    while(location < _locations.size() && _locations[location].dir != dir)
+        ++location;
+
+    if(location == _locations.size())
+        _locations.push_back(Location());
+    _locations[location].dir = dir;
+    _locations[location].options = optionsAtDepth(options, 0);
+    if(isRunning())
+        watchDirectory(location);
+}
+
+void DirectoryWatcher::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+#if defined(CONFINFO_PLATFORM_LINUX)
+    for(const auto& watch : _watches)
+        inotify_rm_watch(_inotifyFd, watch.first);
+    _watches.clear();
+#endif
+    _fingerprints.clear();
+    _locations.clear();
+    _changes.clear();
+}
+
+std::vector<std::string> DirectoryWatcher::takeChanges()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string> changes(_changes.begin(), _changes.end());
+    _changes.clear();
+    return changes;
+}
+
+bool DirectoryWatcher::hasChanges() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_changes.empty();
+}
+
+bool DirectoryWatcher::reportDifferences(const Fingerprints& previous, const Fingerprints& current)
+{
+    bool changed = false;
+    for(const auto& val : current)
+    {
+        const auto it = previous.find(val.first);
+        if(it == previous.end()
+           || it->second.size != val.second.size
+           || it->second.mtime != val.second.mtime)
+        {
+            _changes.insert(val.first);
+            changed = true;
+        }
+    }
+    for(const auto& val : previous)
+    {
+        if(current.count(val.first) == 0)
+        {
+            _changes.insert(val.first);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+
+void DirectoryWatcher::watchDirectory(size_t location)
+{
+    // Only changes made after this call are reported
+    _fingerprints[_locations[location].dir].clear();
+    watchTree(_locations[location].dir, location, 0, false);
+}
+
+bool DirectoryWatcher::watchTree(const std::string& dir, size_t location, int depth, bool reportLibraries)
+{
+    // Same directories as the search
+    fsutil::PathList dirs;
+    fsutil::PathList libraries;
+    fsutil::ScanOptions options = optionsAtDepth(_locations[location].options, depth);
+    options.dirsList = &dirs;
+    fsutil::scanDirectory(dir, options, &libraries);
+
+    for(const std::string& subDir : dirs)
+    {
+        // Paths are built with a '/' for each level
+        const int subDepth = depth + static_cast<int>(std::count(subDir.begin() + dir.size(), subDir.end(), '/'));
+        const int maxDepth = _locations[location].options.maxDepth;
+
+        // Libraries are reported once they are completely written, or moved in the directory
+        // (removed watches are reported with IN_IGNORED). Created directories are only
+        // needed if their content is watched.
+        uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+        if(maxDepth < 0 || subDepth < maxDepth)
+            mask |= IN_CREATE;
+
+        // Watching the same directory again gives the same descriptor
+        const int wd = inotify_add_watch(_inotifyFd, subDir.c_str(), mask);
+        if(wd != -1)
+            _watches[wd] = Watch{subDir, location, subDepth};
+    }
+
+    Fingerprints& fingerprints = _fingerprints[_locations[location].dir];
+    for(const std::string& path : libraries)
+    {
+        Fingerprint fingerprint;
+        if(fsutil::fileFingerprint(path, &fingerprint.size, &fingerprint.mtime))
+            fingerprints[path] = fingerprint;
+    }
+
+    if(!reportLibraries)
+        return false;
+    _changes.insert(libraries.begin(), libraries.end());
+    return !libraries.empty();
+}
+
+bool DirectoryWatcher::unwatchTree(const std::string& dir, size_t location)
+{
+    const std::string prefix = dir + "/";
+    for(auto it = _watches.begin(); it != _watches.end();)
+    {
+        const std::string& watched = it->second.dir;
+        if(watched == dir || watched.compare(0, prefix.size(), prefix) == 0)
+        {
+            inotify_rm_watch(_inotifyFd, it->first);
+            it = _watches.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    bool changed = false;
+    Fingerprints& fingerprints = _fingerprints[_locations[location].dir];
+    for(auto it = fingerprints.begin(); it != fingerprints.end();)
+    {
+        if(it->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            _changes.insert(it->first);
+            changed = true;
+            it = fingerprints.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return changed;
+}
+
+bool DirectoryWatcher::rewatchAll()
+{
+    // Stale watches (of directories removed meanwhile) are dropped too
+    for(const auto& watch : _watches)
+        inotify_rm_watch(_inotifyFd, watch.first);
+    _watches.clear();
+
+    bool changed = false;
+    for(size_t i = 0; i < _locations.size(); ++i)
+    {
+        Fingerprints previous;
+        previous.swap(_fingerprints[_locations[i].dir]);
+        watchTree(_locations[i].dir, i, 0, false);
+        if(reportDifferences(previous, _fingerprints[_locations[i].dir]))
+            changed = true;
+    }
+    return changed;
+}
+
+void DirectoryWatcher::run()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    bool pendingBatch = false;
+
+    for(;;)
+    {
+        pollfd fds[2] = { { _inotifyFd, POLLIN, 0 }, { _wakeupPipe[0], POLLIN, 0 } };
+        // Wait for the end of the current burst of events before reporting it
+        const int ret = poll(fds, 2, pendingBatch ? settleTime : -1);
+        if(ret == -1)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        if(fds[1].revents != 0)
+            break;
+
+        if(ret == 0)
+        {
+            pendingBatch = false;
+            if(_notify)
+                _notify();
+            continue;
+        }
+
+        ssize_t length;
+        while((length = read(_inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            const inotify_event* event;
+            for(char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + event->len)
+            {
+                event = reinterpret_cast<const inotify_event*>(ptr);
+                if(event->mask & IN_Q_OVERFLOW)
+                {
+                    if(rewatchAll())
+                        pendingBatch = true;
+                    continue;
+                }
+
+                const auto it = _watches.find(event->wd);
+                if(it == _watches.end())
+                    continue;
+                if(event->mask & IN_IGNORED)
+                {
+                    _watches.erase(it);
+                    continue;
+                }
+
+                if(event->len == 0)
+                    continue;
+
+                // Same path format as the paths listed by a search
+                const Watch watch = it->second;
+                const fsutil::ScanOptions& options = _locations[watch.location].options;
+                const std::string path = watch.dir + "/" + event->name;
+                if(event->mask & IN_ISDIR)
+                {
+                    const bool canWatch = (options.maxDepth < 0 || watch.depth < options.maxDepth)
+                                          && fsutil::keepDirectoryName(event->name, options);
+                    if(event->mask & IN_MOVED_FROM)
+                    {
+                        if(unwatchTree(path, watch.location))
+                            pendingBatch = true;
+                    }
+                    else if((event->mask & (IN_CREATE | IN_MOVED_TO)) && canWatch
+                            && watchTree(path, watch.location, watch.depth + 1, true))
+                        pendingBatch = true;
+                }
+                else if(!(event->mask & IN_CREATE) && fsutil::keepFileName(event->name, options))
+                {
+                    // Kept up to date for the comparison after an overflow
+                    Fingerprints& fingerprints = _fingerprints[_locations[watch.location].dir];
+                    Fingerprint fingerprint;
+                    if((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                       && fsutil::fileFingerprint(path, &fingerprint.size, &fingerprint.mtime))
+                        fingerprints[path] = fingerprint;
+                    else
+                        fingerprints.erase(path);
+
+                    _changes.insert(path);
+                    pendingBatch = true;
+                }
+            }
+        }
+    }
+}
+
+#else // Polling implementation
+
+bool DirectoryWatcher::scanDirectory(const Location& location, bool reportChanges)
+{
+    // Same libraries as the search
+    fsutil::PathList libList;
+    fsutil::scanDirectory(location.dir, location.options, &libList);
+
+    Fingerprints fingerprints;
+    for(const std::string& path : libList)
+    {
+        Fingerprint fingerprint;
+        if(fsutil::fileFingerprint(path, &fingerprint.size, &fingerprint.mtime))
+            fingerprints[path] = fingerprint;
+    }
+
+    Fingerprints& previous = _fingerprints[location.dir];
+    const bool changed = reportChanges && reportDifferences(previous, fingerprints);
+    previous.swap(fingerprints);
+    return changed;
+}
+
+void DirectoryWatcher::watchDirectory(size_t location)
+{
+    // Only changes made after this call are reported
+    scanDirectory(_locations[location], false);
+}
+
+void DirectoryWatcher::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_stopRequested)
+    {
+        _cond.wait_for(lock, std::chrono::milliseconds(_pollInterval));
+        if(_stopRequested)
+            break;
+
+        bool changed = false;
+        for(const Location& location : _locations)
+        {
+            if(scanDirectory(location, true))
+                changed = true;
+        }
+
+        if(changed && _notify)
+        {
+            lock.unlock();
+            _notify();
+            lock.lock();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/discoverycache.h"
+
+#include <fstream> // for std::ifstream and std::ofstream
+#include <unordered_set> // for std::unordered_set
+
+#include "json/json.hpp"
+
+using namespace jp_private;
+using json = nlohmann::json;
+
+// Increment each time the file format changes
+static const int CACHE_FORMAT_VERSION = 1;
+
+static json infoToJson(const PluginInfoStd& info)
+{
+    json tree;
+    tree["name"] = info.name;
+    tree["prettyName"] = info.prettyName;
+    tree["version"] = info.version;
+    tree["author"] = info.author;
+    tree["url"] = info.url;
+    tree["license"] = info.license;
+    tree["copyright"] = info.copyright;
+
+    json jsonDep = json::array();
+    for(const PluginInfoStd::Dependency& dep : info.dependencies)
+        jsonDep.push_back(json{{"name", dep.name}, {"version", dep.version}});
+    tree["dependencies"] = jsonDep;
+    tree["threadSafe"] = info.threadSafe;
+    return tree;
+}
+
+static PluginInfoStd infoFromJson(const json& tree)
+{
+    PluginInfoStd info;
+    info.name = tree.at("name").get<std::string>();
+    info.prettyName = tree.at("prettyName").get<std::string>();
+    info.version = tree.at("version").get<std::string>();
+    info.author = tree.at("author").get<std::string>();
+    info.url = tree.at("url").get<std::string>();
+    info.license = tree.at("license").get<std::string>();
+    info.copyright = tree.at("copyright").get<std::string>();
+
+    for(const json& jdep : tree.at("dependencies"))
+    {
+        PluginInfoStd::Dependency dep;
+        dep.name = jdep.at("name").get<std::string>();
+        dep.version = jdep.at("version").get<std::string>();
+        info.dependencies.push_back(dep);
+    }
+
+    if(tree.count("threadSafe") == 1)
+        info.threadSafe = tree.at("threadSafe").get<bool>();
+    return info;
+}
+
+bool DiscoveryCache::load(const std::string& filePath)
+{
+    _entries.clear();
+    _modified = false;
+
+    std::ifstream file(filePath);
+    if(!file.is_open())
+        return false;
+
+    try
+    {
+        json tree = json::parse(file);
+
+        // The result of the metadata parsing depends on the plugin API,
+        // so a cache written by another version is useless
+        if(tree.at("cacheVersion").get<int>() != CACHE_FORMAT_VERSION
+           || tree.at("api").get<std::string>() != JP_PLUGIN_API)
+        {
+            return false;
+        }
+
+        const json& libraries = tree.at("libraries");
+        for(json::const_iterator it = libraries.begin(); it != libraries.end(); ++it)
+        {
+            const json& jentry = it.value();
+            Entry entry;
+            entry.size = jentry.at("size").get<uint64_t>();
+            entry.mtime = jentry.at("mtime").get<int64_t>();
+            entry.isPlugin = jentry.at("isPlugin").get<bool>();
+            if(entry.isPlugin)
+            {
+                entry.name = jentry.at("name").get<std::string>();
+                entry.info = infoFromJson(jentry.at("info"));
+            }
+            _entries[it.key()] = entry;
+        }
+    }
+    catch(const std::exception&)
+    {
+        _entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool DiscoveryCache::save(const std::string& filePath)
+{
+    if(!_modified)
+        return true;
+
+    json libraries = json::object();
+    for(const auto& val : _entries)
+    {
+        json jentry;
+        jentry["size"] = val.second.size;
+        jentry["mtime"] = val.second.mtime;
+        jentry["isPlugin"] = val.second.isPlugin;
+        if(val.second.isPlugin)
+        {
+            jentry["name"] = val.second.name;
+            jentry["info"] = infoToJson(val.second.info);
+        }
+        libraries[val.first] = jentry;
+    }
+
+    json tree;
+    tree["cacheVersion"] = CACHE_FORMAT_VERSION;
+    tree["api"] = JP_PLUGIN_API;
+    tree["libraries"] = libraries;
+
+    std::ofstream file(filePath, std::ios::out | std::ios::trunc);
+    if(!file.is_open())
+        return false;
+    file << tree.dump(4);
+    if(!file.good())
+        return false;
+
+    _modified = false;
+    return true;
+}
+
+const DiscoveryCache::Entry* DiscoveryCache::find(const std::string& libPath, uint64_t size, int64_t mtime) const
+{
+    auto it = _entries.find(libPath);
+    if(it == _entries.end() || it->second.size != size || it->second.mtime != mtime)
+        return nullptr;
+    return &(it->second);
+}
+
+void DiscoveryCache::insert(const std::string& libPath, const Entry& entry)
+{
+    _entries[libPath] = entry;
+    _modified = true;
+}
+
+void DiscoveryCache::remove(const std::string& libPath)
+{
+    if(_entries.erase(libPath) != 0)
+        _modified = true;
+}
+
+void DiscoveryCache::removeMissing(const std::string& dir, bool recursive, const fsutil::PathList& libList)
+{
+    const std::string prefix = dir + "/";
+    std::unordered_set<std::string> existing(libList.begin(), libList.end());
+    for(auto it = _entries.begin(); it != _entries.end();)
+    {
+        const std::string& path = it->first;
+        const bool inDir = path.compare(0, prefix.size(), prefix) == 0
+                           && (recursive || path.find('/', prefix.size()) == std::string::npos);
+        if(inDir && existing.count(path) == 0)
+        {
+            it = _entries.erase(it);
+            _modified = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
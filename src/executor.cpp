@@ -0,0 +1,435 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/executorprivate.h"
+
+#include <chrono> // for std::chrono
+
+#include "private/parallel.h"
+
+#include "confinfo.h"
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+#  include <pthread.h> // for pthread_setaffinity_np
+#  include <sched.h> // for sched_getaffinity
+#elif defined(CONFINFO_PLATFORM_WIN32)
+#  include <windows.h> // for SetThreadAffinityMask
+#endif
+
+using namespace jp_private;
+
+namespace
+{
+
+// Worker running on the current thread
+struct CurrentWorker
+{
+    const Executor* executor;
+    size_t index;
+};
+thread_local CurrentWorker currentWorkerInfo = {nullptr, 0};
+
+// Pin the current thread to the index-th CPU the process may run on
+void pinCurrentThread(size_t index)
+{
+#if defined(CONFINFO_PLATFORM_LINUX)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return;
+
+    // CPUs are numbered node by node, so consecutive workers stay on the same NUMA node
+    size_t position = index % static_cast<size_t>(CPU_COUNT(&allowed));
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if(!CPU_ISSET(cpu, &allowed))
+            continue;
+        if(position-- == 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            return;
+        }
+    }
+#elif defined(CONFINFO_PLATFORM_WIN32)
+    DWORD_PTR processMask, systemMask;
+    if(!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || processMask == 0)
+        return;
+
+    size_t count = 0;
+    for(DWORD_PTR mask = processMask; mask; mask &= mask - 1)
+        ++count;
+    size_t position = index % count;
+    for(size_t bit = 0; bit < sizeof(DWORD_PTR) * 8; ++bit)
+    {
+        const DWORD_PTR mask = DWORD_PTR(1) << bit;
+        if((processMask & mask) && position-- == 0)
+        {
+            SetThreadAffinityMask(GetCurrentThread(), mask);
+            return;
+        }
+    }
+#else
+    // Not supported (macOS only provides affinity hints between threads)
+    (void)index;
+#endif
+}
+
+void runFunction(void* context)
+{
+    (*static_cast<std::function<void()>*>(context))();
+}
+
+// Take the newest (or oldest) task of group in tasks (any task if group is null)
+template<typename Task>
+bool takeTask(std::deque<Task>& tasks, bool newest, const jp::TaskGroup* group, Task* task)
+{
+    if(tasks.empty())
+        return false;
+
+    if(!group)
+    {
+        *task = newest ? tasks.back() : tasks.front();
+        if(newest)
+            tasks.pop_back();
+        else
+            tasks.pop_front();
+        return true;
+    }
+
+    const size_t size = tasks.size();
+    for(size_t i = 0; i < size; ++i)
+    {
+        const size_t index = newest ? size - 1 - i : i;
+        if(tasks[index].group == group)
+        {
+            *task = tasks[index];
+            tasks.erase(tasks.begin() + static_cast<std::ptrdiff_t>(index));
+            return true;
+        }
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+Executor::Executor()
+    : _threadsCount(effectiveThreadsCount(0))
+{
+}
+
+Executor::~Executor()
+{
+    if(!_running)
+        return;
+
+    // Workers exit once all queued tasks are done
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for(const std::unique_ptr<Worker>& worker : _workers)
+        worker->thread.join();
+}
+
+void Executor::setThreadsCount(unsigned int threadsCount)
+{
+    if(configurable())
+        _threadsCount = effectiveThreadsCount(threadsCount);
+}
+
+void Executor::setPinning(bool enabled)
+{
+    if(configurable())
+        _pinning = enabled;
+}
+
+bool Executor::configurable() const
+{
+    return !_running;
+}
+
+void Executor::start()
+{
+    std::call_once(_started, [this]() {
+        _workers.reserve(_threadsCount);
+        for(unsigned int i = 0; i < _threadsCount; ++i)
+            _workers.emplace_back(new Worker());
+        // All the deques exist before the first worker can steal
+        _running = true;
+        for(size_t i = 0; i < _workers.size(); ++i)
+            _workers[i]->thread = std::thread(&Executor::run, this, i);
+    });
+}
+
+size_t Executor::currentWorker() const
+{
+    return currentWorkerInfo.executor == this ? currentWorkerInfo.index : NO_WORKER;
+}
+
+void Executor::run(size_t index)
+{
+    currentWorkerInfo.executor = this;
+    currentWorkerInfo.index = index;
+    if(_pinning)
+        pinCurrentThread(index);
+
+    for(;;)
+    {
+        Task task;
+        if(pop(index, &task))
+        {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        ++_sleeping;
+        while(_queued == 0 && !_stop)
+            _wake.wait(lock);
+        --_sleeping;
+        if(_stop && _queued == 0)
+            return;
+    }
+}
+
+void Executor::push(const Task& task)
+{
+    start();
+
+    // Counted first, so that a worker never sleeps while the task is queued
+    ++_queued;
+    const size_t self = currentWorker();
+    if(self != NO_WORKER)
+    {
+        Worker& worker = *_workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(task);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_injectionMutex);
+        _injection.push_back(task);
+    }
+
+    if(_sleeping > 0)
+    {
+        // Taking the lock guarantees the worker is either waiting or will see the task
+        { std::lock_guard<std::mutex> lock(_sleepMutex); }
+        _wake.notify_one();
+    }
+}
+
+bool Executor::pop(size_t self, Task* task, const jp::TaskGroup* group)
+{
+    if(!_running)
+        return false;
+
+    // Own tasks, newest first (their data is more likely in the cache)
+    if(self != NO_WORKER)
+    {
+        Worker& worker = *_workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(takeTask(worker.tasks, true, group, task))
+        {
+            --_queued;
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_injectionMutex);
+        if(takeTask(_injection, false, group, task))
+        {
+            --_queued;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker
+    const size_t count = _workers.size();
+    const size_t first = self != NO_WORKER ? self + 1 : 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const size_t victim = (first + i) % count;
+        if(victim == self)
+            continue;
+        Worker& worker = *_workers[victim];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(takeTask(worker.tasks, false, group, task))
+        {
+            --_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Executor::execute(const Task& task)
+{
+    task.func(task.context);
+    if(task.group)
+        taskDone(task.group);
+}
+
+void Executor::taskDone(jp::TaskGroup* group)
+{
+    if(--group->pending == 0)
+    {
+        std::vector<jp::TaskGroup::Continuation> continuations;
+        {
+            std::lock_guard<std::mutex> lock(group->mutex);
+            continuations.swap(group->continuations);
+            group->done.notify_all();
+        }
+        // Continuations are already counted by their group
+        for(const jp::TaskGroup::Continuation& continuation : continuations)
+            push(Task{continuation.func, continuation.context, continuation.next});
+    }
+    unref(group);
+}
+
+// Static
+void Executor::unref(jp::TaskGroup* group)
+{
+    if(--group->refs == 0)
+        delete group;
+}
+
+void Executor::submit(jp::TaskFunction func, void* context, jp::TaskGroup* group)
+{
+    if(!func)
+        return;
+
+    if(group)
+    {
+        ++group->refs;
+        ++group->pending;
+    }
+    push(Task{func, context, group});
+}
+
+jp::TaskGroup* Executor::createGroup()
+{
+    return new jp::TaskGroup();
+}
+
+void Executor::then(jp::TaskGroup* group, jp::TaskFunction func, void* context, jp::TaskGroup* next)
+{
+    if(!func)
+        return;
+    if(!group)
+    {
+        submit(func, context, next);
+        return;
+    }
+
+    // The continuation is part of next as soon as it's added
+    if(next)
+    {
+        ++next->refs;
+        ++next->pending;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if(group->pending > 0)
+        {
+            group->continuations.push_back(jp::TaskGroup::Continuation{func, context, next});
+            return;
+        }
+    }
+    push(Task{func, context, next});
+}
+
+void Executor::wait(jp::TaskGroup* group)
+{
+    if(!group)
+        return;
+
+    // Only the tasks of the group are run meanwhile: another task may block (a plugin
+    // waiting for something this thread holds), and would never return here
+    const size_t self = currentWorker();
+    while(group->pending > 0)
+    {
+        Task task;
+        if(pop(self, &task, group))
+        {
+            execute(task);
+            continue;
+        }
+
+        // Nothing to run: the remaining tasks are running on other threads, or are
+        // continuations not submitted yet. The timeout lets this thread help again if
+        // new tasks of the group are queued meanwhile.
+        std::unique_lock<std::mutex> lock(group->mutex);
+        group->done.wait_for(lock, std::chrono::milliseconds(1), [group]() { return group->pending == 0; });
+    }
+}
+
+void Executor::releaseGroup(jp::TaskGroup* group)
+{
+    if(group)
+        unref(group);
+}
+
+unsigned int Executor::threadsCount() const
+{
+    return _threadsCount;
+}
+
+void Executor::parallelFor(size_t count, unsigned int threadsCount, const std::function<void(size_t)>& func)
+{
+    // The calling thread runs the loop too, so at most one task per worker is needed
+    size_t helpers = effectiveThreadsCount(threadsCount == 0 ? _threadsCount : threadsCount) - 1;
+    if(helpers > _threadsCount)
+        helpers = _threadsCount;
+    if(helpers >= count)
+        helpers = count > 0 ? count - 1 : 0;
+
+    if(helpers == 0)
+    {
+        for(size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> next(1);
+    std::function<void()> loop = [&]() {
+        for(size_t i = next++; i < count; i = next++)
+            func(i);
+    };
+
+    jp::TaskGroup* group = createGroup();
+    for(size_t i = 0; i < helpers; ++i)
+        submit(&runFunction, &loop, group);
+    func(0);
+    loop();
+    wait(group);
+    releaseGroup(group);
+}
@@ -26,11 +26,23 @@
 
 #include <cerrno> // for errno
 #include <cstdlib> // for malloc and free
+#include <sys/types.h> // for stat
+#include <sys/stat.h> // for stat
+#include <fcntl.h> // for open and posix_fadvise
+#include <cstring> // for strcmp, strlen and memcmp
+#include <iterator> // for std::make_move_iterator
 
-#include "tinydir/tinydir.h"
 #include "whereami/src/whereami.h"
 
 #include "confinfo.h"
+#include "private/executorprivate.h"
+
+#if defined(CONFINFO_PLATFORM_WIN32)
+#  include <windows.h> // for FindFirstFileEx
+#else
+#  include <unistd.h> // for close
+#  include <dirent.h> // for opendir and readdir
+#endif
 
 namespace jp_private
 {
@@ -53,56 +65,267 @@ std::string librarySuffix()
     return "." + libraryExtension();
 }
 
-bool listFilesInDir(const std::string& rootDir,
-                    PathList* filesList,
-                    const std::string& extFilter,
-                    bool recursive)
+namespace
 {
+
+// Result of the scan of one directory
+struct DirScan
+{
+    PathList files;
+    PathList dirs;
     bool success = true;
+    int error = 0;
+};
+
+bool matchAny(const std::vector<std::string>& patterns, const char* name)
+{
+    for(const std::string& pattern : patterns)
+    {
+        if(matchGlob(pattern.c_str(), name))
+            return true;
+    }
+    return false;
+}
+
+// Check the name of a file against the filters, without building any string
+bool keepFile(const char* name, size_t length, const ScanOptions& options)
+{
+    const std::string& ext = options.extension;
+    if(!ext.empty())
+    {
+        if(length <= ext.size() || name[length - ext.size() - 1] != '.'
+           || memcmp(name + length - ext.size(), ext.data(), ext.size()) != 0)
+            return false;
+    }
+    return options.include.empty() || matchAny(options.include, name);
+}
+
+void addEntry(const std::string& dir, const char* name, size_t length, PathList* list)
+{
+    std::string path;
+    path.reserve(dir.size() + 1 + length);
+    path.append(dir).append(1, '/').append(name, length);
+    list->push_back(std::move(path));
+}
+
+// List the files (and sub-directories if listDirs is true) of dir
+void scanOne(const std::string& dir, bool listDirs, const ScanOptions& options, DirScan* result)
+{
+#if defined(CONFINFO_PLATFORM_WIN32)
+    // Large fetches reduce the number of round trips on network shares, and the basic
+    // info level skips the short names
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileExA((dir + "/*").c_str(), FindExInfoBasic, &data,
+                                     FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if(handle == INVALID_HANDLE_VALUE)
+    {
+        const DWORD error = GetLastError();
+        result->success = false;
+        result->error = (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) ? ENOENT : EACCES;
+        return;
+    }
+
+    do
+    {
+        const char* name = data.cFileName;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        if(!options.exclude.empty() && matchAny(options.exclude, name))
+            continue;
+
+        const size_t length = strlen(name);
+        if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if(listDirs)
+                addEntry(dir, name, length, &result->dirs);
+        }
+        else if(keepFile(name, length, options))
+        {
+            addEntry(dir, name, length, &result->files);
+        }
+    } while(FindNextFileA(handle, &data));
 
+    if(GetLastError() != ERROR_NO_MORE_FILES)
+    {
+        result->success = false;
+        result->error = EIO;
+    }
+    FindClose(handle);
+#else
+    // readdir() reads the entries by large blocks (getdents64 on Linux)
+    DIR* dirp = opendir(dir.c_str());
+    if(!dirp)
+    {
+        result->success = false;
+        result->error = errno;
+        return;
+    }
+
+    errno = 0;
+    while(struct dirent* entry = readdir(dirp))
+    {
+        const char* name = entry->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        if(!options.exclude.empty() && matchAny(options.exclude, name))
+            continue;
+
+        const size_t length = strlen(name);
+        bool isDir = false;
+        bool isReg = false;
+#  if defined(_DIRENT_HAVE_D_TYPE) || defined(DT_DIR)
+        isDir = entry->d_type == DT_DIR;
+        isReg = entry->d_type == DT_REG;
+        const bool known = entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN;
+#  else
+        const bool known = false;
+#  endif
+        if(!known)
+        {
+            // Rejected files are never stat'ed
+            if(!listDirs && !keepFile(name, length, options))
+                continue;
+
+            struct stat st;
+            if(fstatat(dirfd(dirp), name, &st, 0) != 0)
+            {
+                // Broken symbolic links are not errors
+                errno = 0;
+                continue;
+            }
+            isDir = S_ISDIR(st.st_mode);
+            isReg = S_ISREG(st.st_mode);
+        }
+
+        if(isDir)
+        {
+            if(listDirs)
+                addEntry(dir, name, length, &result->dirs);
+        }
+        else if(isReg && keepFile(name, length, options))
+        {
+            addEntry(dir, name, length, &result->files);
+        }
+        errno = 0;
+    }
+
+    if(errno != 0)
+    {
+        result->success = false;
+        result->error = errno;
+    }
+    closedir(dirp);
+#endif
+}
+
+} // anonymous namespace
+
+bool matchGlob(const char* pattern, const char* name)
+{
+    // Iterative matching: on mismatch, only the last '*' is retried one character further
+    const char* star = nullptr;
+    const char* retry = nullptr;
+    while(*name)
+    {
+        if(*pattern == '*')
+        {
+            star = pattern++;
+            retry = name;
+        }
+        else if(*pattern == '?' || *pattern == *name)
+        {
+            ++pattern;
+            ++name;
+        }
+        else if(star)
+        {
+            pattern = star + 1;
+            name = ++retry;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while(*pattern == '*')
+        ++pattern;
+    return *pattern == '\0';
+}
+
+bool scanDirectory(const std::string& rootDir, const ScanOptions& options, PathList* filesList)
+{
     if(!filesList)
     {
         errno = EINVAL;
         return false;
     }
 
-    tinydir_dir dir;
-    if(tinydir_open(&dir, rootDir.c_str()) == -1)
-        return false;
+    bool success = true;
+    int error = 0;
 
-    while(dir.has_next)
+    // Directories of the current depth
+    PathList level(1, rootDir);
+    for(int depth = 0; !level.empty(); ++depth)
     {
-        tinydir_file file;
-        if(tinydir_readfile(&dir, &file) == -1)
+        const bool listDirs = options.maxDepth < 0 || depth < options.maxDepth;
+        if(options.dirsList)
+            options.dirsList->insert(options.dirsList->end(), level.begin(), level.end());
+
+        std::vector<DirScan> results(level.size());
+        const auto scan = [&](size_t i) { scanOne(level[i], listDirs, options, &results[i]); };
+        if(options.executor)
         {
-            success = false;
-            continue;
+            options.executor->parallelFor(level.size(), options.threadsCount, scan);
         }
-
-        // Regular file
-        if(file.is_reg && (extFilter.empty() || extFilter == file.extension))
-            filesList->push_back(file.path);
-        // Directory
-        else if(recursive
-                && file.is_dir
-                && strcmp(file.name, ".") != 0
-                && strcmp(file.name, "..") != 0)
+        else
         {
-            if(!listFilesInDir(file.path, filesList, extFilter, true))
-                success = false;
+            for(size_t i = 0; i < level.size(); ++i)
+                scan(i);
         }
 
-        if(tinydir_next(&dir) == -1)
+        PathList next;
+        for(DirScan& result : results)
         {
-            success = false;
-            break;
+            filesList->insert(filesList->end(), std::make_move_iterator(result.files.begin()),
+                              std::make_move_iterator(result.files.end()));
+            next.insert(next.end(), std::make_move_iterator(result.dirs.begin()),
+                        std::make_move_iterator(result.dirs.end()));
+            if(!result.success)
+            {
+                if(success)
+                    error = result.error;
+                success = false;
+            }
         }
+        level.swap(next);
     }
-    tinydir_close(&dir);
 
+    if(!success)
+        errno = error;
     return success;
 }
 
+bool keepFileName(const char* name, const ScanOptions& options)
+{
+    return keepDirectoryName(name, options) && keepFile(name, strlen(name), options);
+}
+
+bool keepDirectoryName(const char* name, const ScanOptions& options)
+{
+    return options.exclude.empty() || !matchAny(options.exclude, name);
+}
+
+bool listFilesInDir(const std::string& rootDir,
+                    PathList* filesList,
+                    const std::string& extFilter,
+                    bool recursive)
+{
+    ScanOptions options;
+    options.extension = extFilter;
+    options.maxDepth = recursive ? -1 : 0;
+    return scanDirectory(rootDir, options, filesList);
+}
+
 bool listLibrariesInDir(const std::string& rootDir,
                         PathList* filesList,
                         bool recursive)
@@ -110,6 +333,63 @@ bool listLibrariesInDir(const std::string& rootDir,
     return listFilesInDir(rootDir, filesList, libraryExtension(), recursive);
 }
 
+bool fileFingerprint(const std::string& path, uint64_t* size, int64_t* mtime)
+{
+#if defined(CONFINFO_PLATFORM_WIN32)
+    struct _stat64 st;
+    if(_stat64(path.c_str(), &st) != 0)
+        return false;
+    *mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return false;
+#  if defined(CONFINFO_PLATFORM_MACOS)
+    *mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#  elif defined(CONFINFO_PLATFORM_LINUX) || defined(CONFINFO_PLATFORM_CYGWIN)
+    *mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#  else
+    *mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#  endif
+#endif
+    *size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
+bool prefetchFile(const std::string& path)
+{
+#if defined(CONFINFO_PLATFORM_WIN32)
+    // PrefetchVirtualMemory() needs a mapping of the file, and the library is
+    // mapped again by LoadLibrary(), so nothing is done here
+    (void)path;
+    return false;
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+        return false;
+
+#  if defined(CONFINFO_PLATFORM_MACOS)
+    struct stat st;
+    bool success = fstat(fd, &st) == 0;
+    if(success)
+    {
+        struct radvisory advice;
+        advice.ra_offset = 0;
+        advice.ra_count = static_cast<int>(st.st_size);
+        success = fcntl(fd, F_RDADVISE, &advice) != -1;
+    }
+#  elif defined(POSIX_FADV_WILLNEED)
+    // The read is started immediately, and the pages stay in the cache after close()
+    const bool success = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+#  else
+    const bool success = false;
+#  endif
+
+    close(fd);
+    return success;
+#endif
+}
+
 std::string appDir()
 {
     const int length = wai_getExecutablePath(nullptr, 0, nullptr);
@@ -118,7 +398,10 @@ std::string appDir()
     char* path = (char*)malloc(length+1);
     int dirnameLength = length;
     if(wai_getExecutablePath(path, length, &dirnameLength) != length)
+    {
+        free(path);
         return std::string();
+    }
 
     // Only get the dirname
     path[dirnameLength] = '\0';
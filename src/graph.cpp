@@ -24,53 +24,212 @@
 
 #include "private/graph.h"
 
+#include <algorithm> // for std::min, std::max, std::find
+#include <utility> // for std::pair
+#include <queue> // for std::priority_queue
+
 using namespace jp_private;
 
 // Constructor
-Graph::Graph(const NodeList& nodeList): _nodeList(nodeList)
+Graph::Graph(const NodeList& nodeList)
 {
+    const int count = static_cast<int>(nodeList.size());
+    _names.reserve(count);
+    _parentOffsets.reserve(count + 1);
+    _childOffsets.assign(count + 1, 0);
+
+    // Parents are stored in the node order, children are counted at the same time
+    _parentOffsets.push_back(0);
+    for(const Node& node : nodeList)
+    {
+        _names.push_back(node.name);
+        for(int parentId : node.parentNodes)
+        {
+            if(parentId < 0 || parentId >= count)
+                continue;
+            _parents.push_back(parentId);
+            ++_childOffsets[parentId + 1];
+        }
+        _parentOffsets.push_back(static_cast<int>(_parents.size()));
+    }
+
+    // Children offsets are the prefix sums of the counts
+    for(int i = 0; i < count; ++i)
+        _childOffsets[i + 1] += _childOffsets[i];
 
+    std::vector<int> nextChild(_childOffsets.begin(), _childOffsets.end() - 1);
+    _children.resize(_parents.size());
+    for(int id = 0; id < count; ++id)
+    {
+        for(const int* parent = parentsBegin(id); parent != parentsEnd(id); ++parent)
+            _children[nextChild[*parent]++] = id;
+    }
 }
 
-Graph::NodeNamesList Graph::topologicalSort(bool& error)
+std::vector<int> Graph::sortedIds(bool& error) const
 {
-    NodeNamesList list;
-    list.reserve(_nodeList.size());
-    for(Node& node: _nodeList)
+    const int count = static_cast<int>(size());
+    std::vector<int> pendingParents(count);
+    std::vector<int> order;
+    order.reserve(count);
+
+    // order is also used as the queue of nodes without pending parents
+    for(int id = 0; id < count; ++id)
+    {
+        pendingParents[id] = _parentOffsets[id + 1] - _parentOffsets[id];
+        if(pendingParents[id] == 0)
+            order.push_back(id);
+    }
+
+    for(size_t next = 0; next < order.size(); ++next)
     {
-        if(node.flag == UNMARKED)
+        const int id = order[next];
+        for(const int* child = childrenBegin(id); child != childrenEnd(id); ++child)
         {
-            if(!visitNode(node, &list))
-            {
-                error = true;
-                return NodeNamesList();
-            }
+            if(--pendingParents[*child] == 0)
+                order.push_back(*child);
         }
     }
 
-    error = false;
+    // Remaining nodes are in a cycle (or depend on a cycle)
+    error = static_cast<int>(order.size()) != count;
+    return order;
+}
+
+std::vector<int> Graph::sortedIds(bool& error, const std::vector<int64_t>& priorities) const
+{
+    const int count = static_cast<int>(size());
+    std::vector<int> pendingParents(count);
+    std::vector<int> order;
+    order.reserve(count);
+
+    // Top of the queue: highest priority, then lowest id (so the order is deterministic)
+    auto lower = [&](int a, int b) {
+        return priorities[a] != priorities[b] ? priorities[a] < priorities[b] : a > b;
+    };
+    std::priority_queue<int, std::vector<int>, decltype(lower)> queue(lower);
+
+    for(int id = 0; id < count; ++id)
+    {
+        pendingParents[id] = _parentOffsets[id + 1] - _parentOffsets[id];
+        if(pendingParents[id] == 0)
+            queue.push(id);
+    }
+
+    while(!queue.empty())
+    {
+        const int id = queue.top();
+        queue.pop();
+        order.push_back(id);
+        for(const int* child = childrenBegin(id); child != childrenEnd(id); ++child)
+        {
+            if(--pendingParents[*child] == 0)
+                queue.push(*child);
+        }
+    }
+
+    // Remaining nodes are in a cycle (or depend on a cycle)
+    error = static_cast<int>(order.size()) != count;
+    return order;
+}
+
+Graph::NodeNamesList Graph::topologicalSort(bool& error) const
+{
+    NodeNamesList list;
+    const std::vector<int> order = sortedIds(error);
+    list.reserve(order.size());
+    for(int id : order)
+        list.push_back(*_names[id]);
     return list;
 }
 
-//
-// Private
-//
+std::vector<int64_t> Graph::pathLengths(const std::vector<int64_t>& weights) const
+{
+    std::vector<int64_t> lengths(weights.begin(), weights.begin() + size());
 
-// implement depth search algorithm
-bool Graph::visitNode(Node& node, NodeNamesList* list)
+    // Children are always after their parents in the sorted order, so each
+    // node is computed after all its children
+    bool error = false;
+    const std::vector<int> order = sortedIds(error);
+    for(auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        int64_t longestChild = 0;
+        for(const int* child = childrenBegin(*it); child != childrenEnd(*it); ++child)
+            longestChild = std::max(longestChild, lengths[*child]);
+        lengths[*it] += longestChild;
+    }
+    return lengths;
+}
+
+std::vector<Graph::NodeNamesList> Graph::cycles() const
 {
-    if(node.flag == MARK_PERMANENT)
-        return true;
-    else if(node.flag == MARK_TEMP)
-        return false; // it's not a directed acyclic graph
+    const int count = static_cast<int>(size());
+    std::vector<NodeNamesList> result;
+
+    std::vector<int> index(count, -1);
+    std::vector<int> lowLink(count, 0);
+    std::vector<bool> onStack(count, false);
+    std::vector<int> stack;
+    // Explicit call stack: node id and position of the next parent to visit
+    std::vector<std::pair<int, int>> callStack;
+    int nextIndex = 0;
+
+    auto push = [&](int id) {
+        index[id] = lowLink[id] = nextIndex++;
+        stack.push_back(id);
+        onStack[id] = true;
+        callStack.push_back(std::make_pair(id, _parentOffsets[id]));
+    };
 
-    node.flag = MARK_TEMP;
-    for(int parentId : node.parentNodes)
+    for(int root = 0; root < count; ++root)
     {
-        if(!visitNode(_nodeList[parentId], list))
-            return false;
+        if(index[root] != -1)
+            continue;
+
+        push(root);
+        while(!callStack.empty())
+        {
+            const int id = callStack.back().first;
+            if(callStack.back().second < _parentOffsets[id + 1])
+            {
+                const int parent = _parents[callStack.back().second++];
+                if(index[parent] == -1)
+                    push(parent);
+                else if(onStack[parent])
+                    lowLink[id] = std::min(lowLink[id], index[parent]);
+                continue;
+            }
+
+            // All parents visited
+            callStack.pop_back();
+            if(!callStack.empty())
+            {
+                const int caller = callStack.back().first;
+                lowLink[caller] = std::min(lowLink[caller], lowLink[id]);
+            }
+
+            if(lowLink[id] == index[id])
+            {
+                // id is the root of a strongly connected component
+                NodeNamesList component;
+                int member;
+                do
+                {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    component.push_back(*_names[member]);
+                } while(member != id);
+
+                const bool selfLoop = std::find(parentsBegin(id), parentsEnd(id), id) != parentsEnd(id);
+                if(component.size() > 1 || selfLoop)
+                {
+                    std::reverse(component.begin(), component.end());
+                    result.push_back(component);
+                }
+            }
+        }
     }
-    node.flag = MARK_PERMANENT;
-    list->push_back(*(node.name));
-    return true;
+
+    return result;
 }
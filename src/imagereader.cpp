@@ -0,0 +1,971 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/imagereader.h"
+
+#include <cstring> // for memcpy, memchr and strcmp
+
+#if defined(CONFINFO_PLATFORM_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h> // for open
+#include <unistd.h> // for close
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#endif
+
+using namespace jp_private;
+
+namespace
+{
+
+// ELF constants (from the System V ABI)
+const unsigned char ELF_CLASS32 = 1;
+const unsigned char ELF_CLASS64 = 2;
+const unsigned char ELF_DATA_LSB = 1;
+const unsigned char ELF_DATA_MSB = 2;
+const uint32_t ELF_PT_LOAD = 1;
+const uint32_t ELF_SHT_RELA = 4;
+const uint32_t ELF_SHT_DYNSYM = 11;
+const uint32_t ELF_SHT_REL = 9;
+const uint32_t ELF_SHT_RELR = 19;
+const uint16_t ELF_ET_EXEC = 2;
+const uint16_t ELF_SHN_UNDEF = 0;
+const unsigned char ELF_STB_GLOBAL = 1;
+const unsigned char ELF_STB_WEAK = 2;
+const unsigned char ELF_STB_GNU_UNIQUE = 10;
+const unsigned char ELF_STV_HIDDEN = 2;
+const unsigned char ELF_STV_INTERNAL = 1;
+
+// PE constants (from the Microsoft PE/COFF specification)
+const uint16_t PE_MAGIC_PE32 = 0x10b;
+const uint16_t PE_MAGIC_PE64 = 0x20b;
+const uint64_t PE_SECTION_HEADER_SIZE = 40;
+
+// Machine of the images loadable by this process (0 if the check is not supported)
+#if defined(__x86_64__) || defined(_M_X64)
+const uint16_t HOST_ELF_MACHINE = 62; // EM_X86_64
+const uint16_t HOST_PE_MACHINE = 0x8664; // IMAGE_FILE_MACHINE_AMD64
+#elif defined(__i386__) || defined(_M_IX86)
+const uint16_t HOST_ELF_MACHINE = 3; // EM_386
+const uint16_t HOST_PE_MACHINE = 0x14c; // IMAGE_FILE_MACHINE_I386
+#elif defined(__aarch64__) || defined(_M_ARM64)
+const uint16_t HOST_ELF_MACHINE = 183; // EM_AARCH64
+const uint16_t HOST_PE_MACHINE = 0xaa64; // IMAGE_FILE_MACHINE_ARM64
+#elif defined(__arm__) || defined(_M_ARM)
+const uint16_t HOST_ELF_MACHINE = 40; // EM_ARM
+const uint16_t HOST_PE_MACHINE = 0x1c4; // IMAGE_FILE_MACHINE_ARMNT
+#elif defined(__powerpc64__)
+const uint16_t HOST_ELF_MACHINE = 21; // EM_PPC64
+const uint16_t HOST_PE_MACHINE = 0;
+#elif defined(__powerpc__)
+const uint16_t HOST_ELF_MACHINE = 20; // EM_PPC
+const uint16_t HOST_PE_MACHINE = 0;
+#elif defined(__riscv)
+const uint16_t HOST_ELF_MACHINE = 243; // EM_RISCV
+const uint16_t HOST_PE_MACHINE = 0;
+#elif defined(__s390x__)
+const uint16_t HOST_ELF_MACHINE = 22; // EM_S390
+const uint16_t HOST_PE_MACHINE = 0;
+#else
+const uint16_t HOST_ELF_MACHINE = 0;
+const uint16_t HOST_PE_MACHINE = 0;
+#endif
+
+// Pointers of the host (x32 uses 32 bits ELF images on x86-64)
+const bool HOST_IS_64 = sizeof(void*) == 8;
+
+bool hostIsLittleEndian()
+{
+    const uint16_t value = 1;
+    unsigned char byte;
+    memcpy(&byte, &value, 1);
+    return byte == 1;
+}
+
+} // namespace
+
+ImageReader::~ImageReader()
+{
+    close();
+}
+
+bool ImageReader::open(const std::string& path)
+{
+    close();
+
+#if defined(CONFINFO_PLATFORM_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    _fileHandle = file;
+    _mappingHandle = mapping;
+    _data = static_cast<const char*>(data);
+    _size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file descriptor is closed
+    ::close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    _data = static_cast<const char*>(data);
+    _size = static_cast<size_t>(st.st_size);
+#endif
+
+    if(_size >= 4 && memcmp(_data, "\x7f" "ELF", 4) == 0 && openElf())
+        return true;
+    if(_size >= 2 && memcmp(_data, "MZ", 2) == 0 && openPe())
+        return true;
+
+    close();
+    return false;
+}
+
+void ImageReader::close()
+{
+    if(_data)
+    {
+#if defined(CONFINFO_PLATFORM_WIN32)
+        UnmapViewOfFile(_data);
+        CloseHandle(static_cast<HANDLE>(_mappingHandle));
+        CloseHandle(static_cast<HANDLE>(_fileHandle));
+        _mappingHandle = nullptr;
+        _fileHandle = nullptr;
+#else
+        munmap(const_cast<char*>(_data), _size);
+#endif
+    }
+
+    _data = nullptr;
+    _size = 0;
+    _format = FORMAT_UNKNOWN;
+    _elfExecutable = false;
+    _symbols.clear();
+}
+
+size_t ImageReader::resolveSymbols(const char* const* symbolNames, size_t count)
+{
+    const size_t first = _symbols.size();
+    _symbols.resize(first + count);
+    for(size_t i = 0; i < count; ++i)
+        _symbols[first + i].name = symbolNames[i];
+    findSymbols(_symbols.data() + first, count);
+
+    size_t found = 0;
+    for(size_t i = first; i < _symbols.size(); ++i)
+    {
+        if(_symbols[i].found)
+            ++found;
+    }
+    return found;
+}
+
+bool ImageReader::hasSymbol(const char* symbolName) const
+{
+    ImageAddr addr;
+    uint64_t symSize;
+    return findSymbol(symbolName, &addr, &symSize);
+}
+
+const char* ImageReader::symbolData(const char* symbolName, size_t* size) const
+{
+    ImageAddr addr;
+    uint64_t symSize;
+    if(!findSymbol(symbolName, &addr, &symSize))
+        return nullptr;
+
+    uint64_t available = 0;
+    const char* ptr = addrToPtr(addr, symSize > 0 ? symSize : 1, &available);
+    if(ptr && size)
+        *size = static_cast<size_t>(symSize > 0 ? symSize : available);
+    return ptr;
+}
+
+const char* ImageReader::pointedString(const char* symbolName) const
+{
+    ImageAddr addr;
+    uint64_t symSize;
+    ImageAddr target;
+    if(!findSymbol(symbolName, &addr, &symSize) || !readPointer(addr, &target))
+        return nullptr;
+
+    uint64_t available = 0;
+    const char* str = addrToPtr(target, 1, &available);
+    // The string must be terminated inside the file
+    if(!str || !memchr(str, '\0', static_cast<size_t>(available)))
+        return nullptr;
+    return str;
+}
+
+//
+// Private
+//
+
+template<typename T>
+bool ImageReader::read(uint64_t offset, T* value) const
+{
+    const char* ptr = at(offset, sizeof(T));
+    if(!ptr)
+        return false;
+    // Alignment is not guaranteed inside the file
+    memcpy(value, ptr, sizeof(T));
+    return true;
+}
+
+const char* ImageReader::at(uint64_t offset, uint64_t len) const
+{
+    if(offset > _size || len > _size - offset)
+        return nullptr;
+    return _data + offset;
+}
+
+bool ImageReader::findSymbol(const char* symbolName, ImageAddr* addr, uint64_t* symSize) const
+{
+    const SymbolLookup* symbol = nullptr;
+    for(const SymbolLookup& cached : _symbols)
+    {
+        if(strcmp(cached.name, symbolName) == 0)
+        {
+            symbol = &cached;
+            break;
+        }
+    }
+
+    SymbolLookup lookup;
+    if(!symbol)
+    {
+        lookup.name = symbolName;
+        findSymbols(&lookup, 1);
+        symbol = &lookup;
+    }
+
+    *addr = symbol->addr;
+    *symSize = symbol->size;
+    return symbol->found;
+}
+
+void ImageReader::findSymbols(SymbolLookup* symbols, size_t count) const
+{
+    switch(_format)
+    {
+    case FORMAT_ELF32:
+    case FORMAT_ELF64:
+        findElfSymbols(symbols, count);
+        break;
+    case FORMAT_PE32:
+    case FORMAT_PE64:
+        findPeSymbols(symbols, count);
+        break;
+    default:
+        break;
+    }
+}
+
+const char* ImageReader::addrToPtr(ImageAddr addr, uint64_t len, uint64_t* available) const
+{
+    switch(_format)
+    {
+    case FORMAT_ELF32:
+    case FORMAT_ELF64:
+        return elfAddrToPtr(addr, len, available);
+    case FORMAT_PE32:
+    case FORMAT_PE64:
+        return peAddrToPtr(addr, len, available);
+    default:
+        return nullptr;
+    }
+}
+
+bool ImageReader::readPointer(ImageAddr addr, ImageAddr* value) const
+{
+    switch(_format)
+    {
+    case FORMAT_ELF32:
+    case FORMAT_ELF64:
+        return readElfPointer(addr, value);
+    case FORMAT_PE32:
+    case FORMAT_PE64:
+        return readPePointer(addr, value);
+    default:
+        return false;
+    }
+}
+
+/*****************************************************************************/
+/***** ELF implementation ****************************************************/
+/*****************************************************************************/
+
+// Fields offsets depend on the ELF class, so each structure is read
+// field by field instead of using the <elf.h> structures (not available everywhere).
+
+bool ImageReader::openElf()
+{
+    unsigned char elfClass, elfData;
+    if(!read(4, &elfClass) || !read(5, &elfData))
+        return false;
+
+    // Only images with the same endianness than the host are supported
+    if(elfData != (hostIsLittleEndian() ? ELF_DATA_LSB : ELF_DATA_MSB))
+        return false;
+
+    // The image must be loadable by this process, otherwise its metadata would
+    // be read but the library could never be loaded
+    if(elfClass != (HOST_IS_64 ? ELF_CLASS64 : ELF_CLASS32))
+        return false;
+    _format = HOST_IS_64 ? FORMAT_ELF64 : FORMAT_ELF32;
+
+    uint16_t type, machine;
+    if(!read(16, &type) || !read(18, &machine))
+        return false;
+    if(HOST_ELF_MACHINE != 0 && machine != HOST_ELF_MACHINE)
+        return false;
+    _elfExecutable = type == ELF_ET_EXEC;
+
+    const bool is64 = _format == FORMAT_ELF64;
+    uint64_t shoff = 0;
+    uint16_t shentsize = 0, shnum = 0;
+    if(is64)
+    {
+        if(!read(40, &shoff))
+            return false;
+    }
+    else
+    {
+        uint32_t shoff32;
+        if(!read(32, &shoff32))
+            return false;
+        shoff = shoff32;
+    }
+    if(!read(is64 ? 58 : 46, &shentsize) || !read(is64 ? 60 : 48, &shnum))
+        return false;
+
+    // Look for the dynamic symbol table
+    for(uint16_t i = 0; i < shnum; ++i)
+    {
+        const uint64_t sh = shoff + static_cast<uint64_t>(i) * shentsize;
+        uint32_t type, link;
+        uint64_t offset, size, entsize;
+        if(!read(sh + 4, &type))
+            return false;
+        if(type != ELF_SHT_DYNSYM)
+            continue;
+
+        if(is64)
+        {
+            if(!read(sh + 24, &offset) || !read(sh + 32, &size)
+               || !read(sh + 40, &link) || !read(sh + 56, &entsize))
+                return false;
+        }
+        else
+        {
+            uint32_t offset32, size32, entsize32;
+            if(!read(sh + 16, &offset32) || !read(sh + 20, &size32)
+               || !read(sh + 24, &link) || !read(sh + 36, &entsize32))
+                return false;
+            offset = offset32;
+            size = size32;
+            entsize = entsize32;
+        }
+
+        if(entsize == 0 || link >= shnum || !at(offset, size))
+            return false;
+
+        // Linked string table
+        const uint64_t strSh = shoff + static_cast<uint64_t>(link) * shentsize;
+        uint64_t strOffset, strSize;
+        if(is64)
+        {
+            if(!read(strSh + 24, &strOffset) || !read(strSh + 32, &strSize))
+                return false;
+        }
+        else
+        {
+            uint32_t strOffset32, strSize32;
+            if(!read(strSh + 16, &strOffset32) || !read(strSh + 20, &strSize32))
+                return false;
+            strOffset = strOffset32;
+            strSize = strSize32;
+        }
+        if(!at(strOffset, strSize))
+            return false;
+
+        _elfSymOffset = offset;
+        _elfSymCount = size / entsize;
+        _elfSymEntSize = entsize;
+        _elfStrOffset = strOffset;
+        _elfStrSize = strSize;
+        return true;
+    }
+
+    // No section headers (stripped image), cannot find symbols
+    return false;
+}
+
+void ImageReader::findElfSymbols(SymbolLookup* symbols, size_t count) const
+{
+    const bool is64 = _format == FORMAT_ELF64;
+    size_t remaining = count;
+
+    for(uint64_t i = 1; i < _elfSymCount && remaining > 0; ++i)
+    {
+        const uint64_t sym = _elfSymOffset + i * _elfSymEntSize;
+        uint32_t nameOffset;
+        unsigned char info, other;
+        uint16_t shndx;
+        if(!read(sym, &nameOffset))
+            return;
+        if(is64)
+        {
+            if(!read(sym + 4, &info) || !read(sym + 5, &other) || !read(sym + 6, &shndx))
+                return;
+        }
+        else
+        {
+            if(!read(sym + 12, &info) || !read(sym + 13, &other) || !read(sym + 14, &shndx))
+                return;
+        }
+
+        // Only defined global symbols are exported
+        const unsigned char bind = info >> 4;
+        const unsigned char visibility = other & 0x3;
+        if(shndx == ELF_SHN_UNDEF
+           || (bind != ELF_STB_GLOBAL && bind != ELF_STB_WEAK && bind != ELF_STB_GNU_UNIQUE)
+           || visibility == ELF_STV_HIDDEN || visibility == ELF_STV_INTERNAL)
+            continue;
+
+        if(nameOffset >= _elfStrSize)
+            continue;
+        const char* name = _data + _elfStrOffset + nameOffset;
+        const size_t maxLen = static_cast<size_t>(_elfStrSize - nameOffset);
+
+        for(size_t j = 0; j < count; ++j)
+        {
+            SymbolLookup& symbol = symbols[j];
+            const size_t nameLen = strlen(symbol.name);
+            if(symbol.resolved || maxLen <= nameLen || memcmp(name, symbol.name, nameLen + 1) != 0)
+                continue;
+
+            symbol.resolved = true;
+            --remaining;
+
+            if(is64)
+            {
+                uint64_t value, size;
+                if(!read(sym + 8, &value) || !read(sym + 16, &size))
+                    return;
+                symbol.addr = value;
+                symbol.size = size;
+            }
+            else
+            {
+                uint32_t value, size;
+                if(!read(sym + 4, &value) || !read(sym + 8, &size))
+                    return;
+                symbol.addr = value;
+                symbol.size = size;
+            }
+            symbol.found = true;
+            break;
+        }
+    }
+}
+
+const char* ImageReader::elfAddrToPtr(ImageAddr addr, uint64_t len, uint64_t* available) const
+{
+    const bool is64 = _format == FORMAT_ELF64;
+    uint64_t phoff = 0;
+    uint16_t phentsize = 0, phnum = 0;
+    if(is64)
+    {
+        if(!read(32, &phoff))
+            return nullptr;
+    }
+    else
+    {
+        uint32_t phoff32;
+        if(!read(28, &phoff32))
+            return nullptr;
+        phoff = phoff32;
+    }
+    if(!read(is64 ? 54 : 42, &phentsize) || !read(is64 ? 56 : 44, &phnum))
+        return nullptr;
+
+    for(uint16_t i = 0; i < phnum; ++i)
+    {
+        const uint64_t ph = phoff + static_cast<uint64_t>(i) * phentsize;
+        uint32_t type;
+        uint64_t offset, vaddr, filesz;
+        if(!read(ph, &type))
+            return nullptr;
+        if(type != ELF_PT_LOAD)
+            continue;
+
+        if(is64)
+        {
+            if(!read(ph + 8, &offset) || !read(ph + 16, &vaddr) || !read(ph + 32, &filesz))
+                return nullptr;
+        }
+        else
+        {
+            uint32_t offset32, vaddr32, filesz32;
+            if(!read(ph + 4, &offset32) || !read(ph + 8, &vaddr32) || !read(ph + 16, &filesz32))
+                return nullptr;
+            offset = offset32;
+            vaddr = vaddr32;
+            filesz = filesz32;
+        }
+
+        // Data after filesz is zero-initialized memory (.bss), not stored in the file
+        if(addr < vaddr || addr - vaddr >= filesz)
+            continue;
+        const uint64_t remaining = filesz - (addr - vaddr);
+        if(len > remaining)
+            return nullptr;
+
+        const char* ptr = at(offset + (addr - vaddr), remaining);
+        if(ptr && available)
+            *available = remaining;
+        return ptr;
+    }
+    return nullptr;
+}
+
+bool ImageReader::readElfPointer(ImageAddr addr, ImageAddr* value) const
+{
+    const bool is64 = _format == FORMAT_ELF64;
+    const uint64_t ptrSize = is64 ? 8 : 4;
+
+    // Value stored in the file
+    const char* ptr = elfAddrToPtr(addr, ptrSize, nullptr);
+    if(!ptr)
+        return false;
+    ImageAddr inPlace = 0;
+    if(is64)
+    {
+        uint64_t v;
+        memcpy(&v, ptr, sizeof(v));
+        inPlace = v;
+    }
+    else
+    {
+        uint32_t v;
+        memcpy(&v, ptr, sizeof(v));
+        inPlace = v;
+    }
+
+    // Pointers of shared libraries are fixed by dynamic relocations when loaded,
+    // so look for a relocation that targets addr
+    uint64_t shoff = 0;
+    uint16_t shentsize = 0, shnum = 0;
+    if(is64)
+    {
+        if(!read(40, &shoff))
+            return false;
+    }
+    else
+    {
+        uint32_t shoff32;
+        if(!read(32, &shoff32))
+            return false;
+        shoff = shoff32;
+    }
+    if(!read(is64 ? 58 : 46, &shentsize) || !read(is64 ? 60 : 48, &shnum))
+        return false;
+
+    for(uint16_t i = 0; i < shnum; ++i)
+    {
+        const uint64_t sh = shoff + static_cast<uint64_t>(i) * shentsize;
+        uint32_t type;
+        if(!read(sh + 4, &type))
+            return false;
+        if(type != ELF_SHT_RELA && type != ELF_SHT_REL && type != ELF_SHT_RELR)
+            continue;
+        const bool hasAddend = type == ELF_SHT_RELA;
+
+        uint64_t offset, size, entsize;
+        if(is64)
+        {
+            if(!read(sh + 24, &offset) || !read(sh + 32, &size) || !read(sh + 56, &entsize))
+                return false;
+        }
+        else
+        {
+            uint32_t offset32, size32, entsize32;
+            if(!read(sh + 16, &offset32) || !read(sh + 20, &size32) || !read(sh + 36, &entsize32))
+                return false;
+            offset = offset32;
+            size = size32;
+            entsize = entsize32;
+        }
+        if(entsize == 0 || !at(offset, size))
+            continue;
+
+        if(type == ELF_SHT_RELR)
+        {
+            // Packed relative relocations keep the addend in place
+            if(relrCovers(offset, size, addr))
+            {
+                *value = inPlace;
+                return true;
+            }
+            continue;
+        }
+
+        for(uint64_t rel = offset; rel + entsize <= offset + size; rel += entsize)
+        {
+            uint64_t rOffset = 0, rSym = 0;
+            int64_t rAddend = 0;
+            if(is64)
+            {
+                uint64_t rInfo = 0;
+                if(!read(rel, &rOffset) || !read(rel + 8, &rInfo)
+                   || (hasAddend && !read(rel + 16, &rAddend)))
+                    return false;
+                rSym = rInfo >> 32;
+            }
+            else
+            {
+                uint32_t rOffset32 = 0, rInfo32 = 0;
+                int32_t rAddend32 = 0;
+                if(!read(rel, &rOffset32) || !read(rel + 4, &rInfo32)
+                   || (hasAddend && !read(rel + 8, &rAddend32)))
+                    return false;
+                rOffset = rOffset32;
+                rSym = rInfo32 >> 8;
+                rAddend = rAddend32;
+            }
+
+            if(rOffset != addr)
+                continue;
+
+            const ImageAddr addend = hasAddend ? static_cast<ImageAddr>(rAddend) : inPlace;
+            if(rSym == 0)
+            {
+                // Relative relocation: base + addend
+                *value = addend;
+                return true;
+            }
+
+            // Symbol relocation: only resolvable if the symbol is defined in this image
+            if(rSym >= _elfSymCount)
+                return false;
+            const uint64_t sym = _elfSymOffset + rSym * _elfSymEntSize;
+            uint16_t shndx;
+            ImageAddr symValue;
+            if(is64)
+            {
+                uint64_t v;
+                if(!read(sym + 6, &shndx) || !read(sym + 8, &v))
+                    return false;
+                symValue = v;
+            }
+            else
+            {
+                uint32_t v;
+                if(!read(sym + 14, &shndx) || !read(sym + 4, &v))
+                    return false;
+                symValue = v;
+            }
+            if(shndx == ELF_SHN_UNDEF)
+                return false;
+            *value = symValue + addend;
+            return true;
+        }
+    }
+
+    // No relocation: the value is only known for a position-dependent executable
+    // (the relocation may be in a format not understood here)
+    if(!_elfExecutable)
+        return false;
+    *value = inPlace;
+    return true;
+}
+
+bool ImageReader::relrCovers(uint64_t offset, uint64_t size, ImageAddr addr) const
+{
+    const bool is64 = _format == FORMAT_ELF64;
+    const uint64_t ptrSize = is64 ? 8 : 4;
+    const uint64_t bits = ptrSize * 8;
+
+    // An even entry is the address of a relocated word, and the following odd entries
+    // are bitmaps of the relocated words after it (bit 0 excepted)
+    ImageAddr next = 0;
+    for(uint64_t rel = offset; rel + ptrSize <= offset + size; rel += ptrSize)
+    {
+        uint64_t entry;
+        if(is64)
+        {
+            if(!read(rel, &entry))
+                return false;
+        }
+        else
+        {
+            uint32_t entry32;
+            if(!read(rel, &entry32))
+                return false;
+            entry = entry32;
+        }
+
+        if((entry & 1) == 0)
+        {
+            if(entry == addr)
+                return true;
+            next = entry + ptrSize;
+            continue;
+        }
+
+        if(addr >= next && addr < next + (bits - 1) * ptrSize && (addr - next) % ptrSize == 0)
+        {
+            const uint64_t bit = (addr - next) / ptrSize + 1;
+            if((entry >> bit) & 1)
+                return true;
+        }
+        next += (bits - 1) * ptrSize;
+    }
+    return false;
+}
+
+/*****************************************************************************/
+/***** PE implementation *****************************************************/
+/*****************************************************************************/
+
+bool ImageReader::openPe()
+{
+    // PE images are always little endian
+    if(!hostIsLittleEndian())
+        return false;
+
+    uint32_t peOffset;
+    if(!read(0x3C, &peOffset))
+        return false;
+    const char* signature = at(peOffset, 4);
+    if(!signature || memcmp(signature, "PE\0\0", 4) != 0)
+        return false;
+
+    const uint64_t coff = peOffset + 4;
+    uint16_t machine, sectionsCount, optHeaderSize, magic;
+    if(!read(coff, &machine) || !read(coff + 2, &sectionsCount) || !read(coff + 16, &optHeaderSize))
+        return false;
+    // The image must be loadable by this process
+    if(HOST_PE_MACHINE != 0 && machine != HOST_PE_MACHINE)
+        return false;
+
+    const uint64_t optHeader = coff + 20;
+    if(!read(optHeader, &magic))
+        return false;
+
+    uint32_t rvaCount;
+    uint64_t dataDirectory;
+    if(magic != (HOST_IS_64 ? PE_MAGIC_PE64 : PE_MAGIC_PE32))
+        return false;
+
+    if(magic == PE_MAGIC_PE32)
+    {
+        uint32_t imageBase;
+        if(!read(optHeader + 28, &imageBase) || !read(optHeader + 92, &rvaCount))
+            return false;
+        _peImageBase = imageBase;
+        dataDirectory = optHeader + 96;
+        _format = FORMAT_PE32;
+    }
+    else if(magic == PE_MAGIC_PE64)
+    {
+        if(!read(optHeader + 24, &_peImageBase) || !read(optHeader + 108, &rvaCount))
+            return false;
+        dataDirectory = optHeader + 112;
+        _format = FORMAT_PE64;
+    }
+    else
+    {
+        return false;
+    }
+
+    _peSectionsOffset = optHeader + optHeaderSize;
+    _peSectionsCount = sectionsCount;
+    if(!at(_peSectionsOffset, _peSectionsCount * PE_SECTION_HEADER_SIZE))
+        return false;
+
+    // The export table is the first data directory (may be empty)
+    _peExportRva = 0;
+    _peExportSize = 0;
+    if(rvaCount > 0)
+    {
+        if(!read(dataDirectory, &_peExportRva) || !read(dataDirectory + 4, &_peExportSize))
+            return false;
+    }
+    return true;
+}
+
+void ImageReader::findPeSymbols(SymbolLookup* symbols, size_t count) const
+{
+    if(_peExportRva == 0)
+        return;
+
+    const char* exportDir = peAddrToPtr(_peExportRva, 40, nullptr);
+    if(!exportDir)
+        return;
+
+    uint32_t functionsCount, namesCount, functionsRva, namesRva, ordinalsRva;
+    memcpy(&functionsCount, exportDir + 20, 4);
+    memcpy(&namesCount, exportDir + 24, 4);
+    memcpy(&functionsRva, exportDir + 28, 4);
+    memcpy(&namesRva, exportDir + 32, 4);
+    memcpy(&ordinalsRva, exportDir + 36, 4);
+
+    const char* names = peAddrToPtr(namesRva, static_cast<uint64_t>(namesCount) * 4, nullptr);
+    const char* ordinals = peAddrToPtr(ordinalsRva, static_cast<uint64_t>(namesCount) * 2, nullptr);
+    const char* functions = peAddrToPtr(functionsRva, static_cast<uint64_t>(functionsCount) * 4, nullptr);
+    if(!names || !ordinals || !functions)
+        return;
+
+    size_t remaining = count;
+    for(uint32_t i = 0; i < namesCount && remaining > 0; ++i)
+    {
+        uint32_t nameRva;
+        memcpy(&nameRva, names + i * 4, 4);
+        uint64_t available = 0;
+        const char* name = peAddrToPtr(nameRva, 1, &available);
+        if(!name || !memchr(name, '\0', static_cast<size_t>(available)))
+            continue;
+
+        for(size_t j = 0; j < count; ++j)
+        {
+            SymbolLookup& symbol = symbols[j];
+            if(symbol.resolved || strcmp(name, symbol.name) != 0)
+                continue;
+
+            // Names are unique, so the symbol is resolved even if it's not usable
+            symbol.resolved = true;
+            --remaining;
+
+            uint16_t ordinal;
+            memcpy(&ordinal, ordinals + i * 2, 2);
+            if(ordinal >= functionsCount)
+                break;
+            uint32_t rva;
+            memcpy(&rva, functions + ordinal * 4, 4);
+
+            // Forwarded export (points inside the export directory), not resolvable here
+            if(rva >= _peExportRva && rva < _peExportRva + _peExportSize)
+                break;
+
+            symbol.addr = rva;
+            symbol.size = 0; // Not stored in PE images
+            symbol.found = true;
+            break;
+        }
+    }
+}
+
+const char* ImageReader::peAddrToPtr(ImageAddr addr, uint64_t len, uint64_t* available) const
+{
+    for(uint16_t i = 0; i < _peSectionsCount; ++i)
+    {
+        const uint64_t section = _peSectionsOffset + i * PE_SECTION_HEADER_SIZE;
+        uint32_t virtualSize, virtualAddress, rawSize, rawOffset;
+        if(!read(section + 8, &virtualSize) || !read(section + 12, &virtualAddress)
+           || !read(section + 16, &rawSize) || !read(section + 20, &rawOffset))
+            return nullptr;
+
+        // Only the raw data is stored in the file (the rest is zero-initialized)
+        const uint64_t storedSize = virtualSize < rawSize && virtualSize != 0 ? virtualSize : rawSize;
+        if(addr < virtualAddress || addr - virtualAddress >= storedSize)
+            continue;
+        const uint64_t remaining = storedSize - (addr - virtualAddress);
+        if(len > remaining)
+            return nullptr;
+
+        const char* ptr = at(rawOffset + (addr - virtualAddress), remaining);
+        if(ptr && available)
+            *available = remaining;
+        return ptr;
+    }
+    return nullptr;
+}
+
+bool ImageReader::readPePointer(ImageAddr addr, ImageAddr* value) const
+{
+    // Pointers are stored as absolute addresses using the preferred image base
+    // (base relocations only apply the difference when loaded elsewhere)
+    ImageAddr absolute = 0;
+    if(_format == FORMAT_PE64)
+    {
+        const char* ptr = peAddrToPtr(addr, 8, nullptr);
+        if(!ptr)
+            return false;
+        uint64_t v;
+        memcpy(&v, ptr, sizeof(v));
+        absolute = v;
+    }
+    else
+    {
+        const char* ptr = peAddrToPtr(addr, 4, nullptr);
+        if(!ptr)
+            return false;
+        uint32_t v;
+        memcpy(&v, ptr, sizeof(v));
+        absolute = v;
+    }
+
+    if(absolute < _peImageBase)
+        return false;
+    *value = absolute - _peImageBase;
+    return true;
+}
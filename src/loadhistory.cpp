@@ -0,0 +1,120 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/loadhistory.h"
+
+#include <fstream> // for std::ifstream and std::ofstream
+
+#include "json/json.hpp"
+
+using namespace jp_private;
+using json = nlohmann::json;
+
+// Increment each time the file format changes
+static const int HISTORY_FORMAT_VERSION = 1;
+
+bool LoadHistory::load(const std::string& filePath)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _durations.clear();
+    _modified = false;
+
+    std::ifstream file(filePath);
+    if(!file.is_open())
+        return false;
+
+    try
+    {
+        json tree = json::parse(file);
+        if(tree.at("historyVersion").get<int>() != HISTORY_FORMAT_VERSION)
+            return false;
+
+        const json& durations = tree.at("durations");
+        for(json::const_iterator it = durations.begin(); it != durations.end(); ++it)
+            _durations[it.key()] = it.value().get<int64_t>();
+    }
+    catch(const std::exception&)
+    {
+        _durations.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool LoadHistory::save(const std::string& filePath)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!_modified)
+        return true;
+
+    json durations = json::object();
+    for(const auto& val : _durations)
+        durations[val.first] = val.second;
+
+    json tree;
+    tree["historyVersion"] = HISTORY_FORMAT_VERSION;
+    tree["durations"] = durations;
+
+    std::ofstream file(filePath, std::ios::out | std::ios::trunc);
+    if(!file.is_open())
+        return false;
+    file << tree.dump(4);
+    if(!file.good())
+        return false;
+
+    _modified = false;
+    return true;
+}
+
+int64_t LoadHistory::duration(const std::string& plugin, int64_t defaultDuration) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _durations.find(plugin);
+    return it != _durations.end() ? it->second : defaultDuration;
+}
+
+int64_t LoadHistory::averageDuration() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_durations.empty())
+        return 0;
+
+    int64_t total = 0;
+    for(const auto& val : _durations)
+        total += val.second;
+    return total / static_cast<int64_t>(_durations.size());
+}
+
+void LoadHistory::record(const std::string& plugin, int64_t duration)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Exponential moving average (the last run counts for a quarter)
+    const auto it = _durations.find(plugin);
+    if(it == _durations.end())
+        _durations[plugin] = duration;
+    else
+        it->second = (it->second * 3 + duration) / 4;
+    _modified = true;
+}
@@ -0,0 +1,311 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/logger.h"
+
+#include <iostream> // for std::cout
+#include <cstdio> // for snprintf
+#include <cstring> // for strlen and memcpy
+#include <chrono> // for std::chrono::milliseconds
+
+using namespace jp_private;
+
+// The thread also checks the buffer periodically, in case a notification is missed
+static const std::chrono::milliseconds MAX_WAIT_TIME(100);
+
+Logger::Logger()
+    : _enabled(true),
+      _level(jp::PluginManager::LOG_INFO),
+      _slots(new Slot[CAPACITY]),
+      _enqueuePos(0),
+      _dequeuePos(0),
+      _dropped(0),
+      _droppedTotal(0),
+      _synchronous(false),
+      _sleeping(false),
+      _stream(&std::cout)
+{
+    for(size_t i = 0; i < CAPACITY; ++i)
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+Logger::~Logger()
+{
+    if(_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_one();
+        _thread.join();
+    }
+}
+
+void Logger::setSynchronous(bool synchronous)
+{
+    if(synchronous)
+        flush();
+    _synchronous.store(synchronous, std::memory_order_relaxed);
+}
+
+void Logger::setStream(std::ostream& stream)
+{
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    _stream = &stream;
+}
+
+void Logger::setCallback(const Callback& callback)
+{
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    _callback = callback;
+}
+
+void Logger::flush()
+{
+    const size_t target = _enqueuePos.load(std::memory_order_acquire);
+    if(target == 0)
+        return;
+
+    // The thread may still be starting (call_once synchronizes with its creation)
+    startThread();
+    if(std::this_thread::get_id() == _thread.get_id())
+        return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond.notify_one();
+    _writtenCond.wait(lock, [this, target]() { return _written >= target || _stop; });
+}
+
+Logger::Slot* Logger::acquire(size_t* pos)
+{
+    size_t enqueuePos = _enqueuePos.load(std::memory_order_relaxed);
+    for(;;)
+    {
+        Slot* slot = &_slots[enqueuePos & (CAPACITY - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(enqueuePos);
+        if(diff == 0)
+        {
+            // The slot is free, try to take it
+            if(_enqueuePos.compare_exchange_weak(enqueuePos, enqueuePos + 1, std::memory_order_relaxed))
+            {
+                *pos = enqueuePos;
+                return slot;
+            }
+        }
+        else if(diff < 0)
+        {
+            // Full: the slot still holds a message not written yet
+            // Dropped at once, so a caller never waits for the thread
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            _droppedTotal.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+        {
+            // Another producer took the slot
+            enqueuePos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::publish(Slot* slot, size_t pos)
+{
+    slot->sequence.store(pos + 1, std::memory_order_seq_cst);
+
+    startThread();
+    if(_sleeping.load(std::memory_order_seq_cst))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cond.notify_one();
+    }
+}
+
+void Logger::startThread()
+{
+    std::call_once(_started, [this]() { _thread = std::thread(&Logger::run, this); });
+}
+
+bool Logger::isEmpty() const
+{
+    const size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    return _slots[pos & (CAPACITY - 1)].sequence.load(std::memory_order_seq_cst) != pos + 1;
+}
+
+void Logger::run()
+{
+    // Reused for all messages, so only the first ones allocate
+    std::string buffer;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(;;)
+    {
+        lock.unlock();
+        drain(buffer);
+        lock.lock();
+
+        _written = _dequeuePos.load(std::memory_order_relaxed);
+        _writtenCond.notify_all();
+
+        if(_stop && isEmpty())
+            break;
+
+        _sleeping.store(true, std::memory_order_seq_cst);
+        if(isEmpty() && !_stop)
+            _cond.wait_for(lock, MAX_WAIT_TIME);
+        _sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::drain(std::string& buffer)
+{
+    size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    bool written = false;
+    for(;;)
+    {
+        Slot& slot = _slots[pos & (CAPACITY - 1)];
+        if(slot.sequence.load(std::memory_order_acquire) != pos + 1)
+            break;
+
+        const Level level = slot.record.level;
+        buffer.clear();
+        format(slot.record, buffer);
+        // The slot can be reused by producers from now
+        slot.sequence.store(pos + CAPACITY, std::memory_order_release);
+        ++pos;
+        _dequeuePos.store(pos, std::memory_order_relaxed);
+
+        write(level, buffer);
+        written = true;
+    }
+
+    const size_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+    if(dropped > 0)
+    {
+        buffer = std::to_string(dropped) + " log messages dropped (buffer full)";
+        write(jp::PluginManager::LOG_WARNING, buffer);
+        written = true;
+    }
+
+    if(written)
+    {
+        std::lock_guard<std::mutex> lock(_outputMutex);
+        if(!_callback)
+            _stream->flush();
+    }
+}
+
+void Logger::write(Level level, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    if(_callback)
+        _callback(level, message.c_str());
+    else
+        *_stream << message << '\n';
+}
+
+void Logger::writeNow(const Record& record)
+{
+    std::string message;
+    format(record, message);
+
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    if(_callback)
+    {
+        _callback(record.level, message.c_str());
+    }
+    else
+    {
+        *_stream << message << '\n';
+        _stream->flush();
+    }
+}
+
+void Logger::format(const Record& record, std::string& out)
+{
+    size_t argIndex = 0;
+    for(const char* c = record.format; *c; ++c)
+    {
+        if(c[0] != '{' || c[1] != '}' || argIndex >= record.argsCount)
+        {
+            out += *c;
+            continue;
+        }
+
+        const Arg& arg = record.args[argIndex++];
+        ++c;
+        switch(arg.type)
+        {
+        case ARG_STRING:
+            out.append(record.text + arg.str.offset, arg.str.size);
+            break;
+        case ARG_SIGNED:
+            out += std::to_string(static_cast<long long>(arg.i));
+            break;
+        case ARG_UNSIGNED:
+            out += std::to_string(static_cast<unsigned long long>(arg.u));
+            break;
+        case ARG_DOUBLE:
+        {
+            char number[32];
+            snprintf(number, sizeof(number), "%g", arg.d);
+            out += number;
+            break;
+        }
+        }
+    }
+}
+
+void Logger::addArg(Record* record, const char* str)
+{
+    addString(record, str ? str : "(null)", str ? strlen(str) : 6);
+}
+
+void Logger::addArg(Record* record, const std::string& str)
+{
+    addString(record, str.c_str(), str.size());
+}
+
+void Logger::addArg(Record* record, double value)
+{
+    Arg& arg = record->args[record->argsCount++];
+    arg.type = ARG_DOUBLE;
+    arg.d = value;
+}
+
+void Logger::addString(Record* record, const char* str, size_t size)
+{
+    // Truncate the string if the slot is full
+    const size_t available = TEXT_SIZE - record->textSize;
+    if(size > available)
+        size = available;
+    memcpy(record->text + record->textSize, str, size);
+
+    Arg& arg = record->args[record->argsCount++];
+    arg.type = ARG_STRING;
+    arg.str.offset = static_cast<uint16_t>(record->textSize);
+    arg.str.size = static_cast<uint16_t>(size);
+    record->textSize += size;
+}
@@ -0,0 +1,201 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/memoryaccounting.h"
+
+#include "confinfo.h"
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+#  include <cstdio> // for fopen and fscanf
+#  include <cstring> // for strcmp
+#  include <link.h> // for dl_iterate_phdr
+#  include <malloc.h> // for mallinfo2
+#  include <unistd.h> // for sysconf
+#elif defined(CONFINFO_PLATFORM_MACOS)
+#  include <mach/mach.h> // for task_info
+#  include <malloc/malloc.h> // for malloc_zone_statistics
+#elif defined(CONFINFO_PLATFORM_WIN32)
+#  include <psapi.h> // for GetProcessMemoryInfo and GetModuleInformation
+#endif
+
+using namespace jp_private;
+
+namespace
+{
+
+// Counters of the plugin running on this thread
+thread_local MemoryCounters* currentCounters = nullptr;
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+struct ModuleSearch
+{
+    const char* name;
+    ElfW(Addr) address;
+    size_t size;
+};
+
+int addModuleSize(struct dl_phdr_info* info, size_t, void* data)
+{
+    ModuleSearch* search = static_cast<ModuleSearch*>(data);
+    if(info->dlpi_addr != search->address || !info->dlpi_name || strcmp(info->dlpi_name, search->name) != 0)
+        return 0;
+
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for(ElfW(Half) i = 0; i < info->dlpi_phnum; ++i)
+    {
+        const ElfW(Phdr)& header = info->dlpi_phdr[i];
+        if(header.p_type != PT_LOAD)
+            continue;
+        // Segments are mapped with whole pages
+        const size_t begin = header.p_vaddr & ~(pageSize - 1);
+        const size_t end = (header.p_vaddr + header.p_memsz + pageSize - 1) & ~(pageSize - 1);
+        search->size += end - begin;
+    }
+    return 1;
+}
+#endif
+
+} // anonymous namespace
+
+void* jp::currentMemoryOwner()
+{
+    return currentCounters;
+}
+
+void jp::memoryAllocated(void* owner, size_t size)
+{
+    MemoryCounters* counters = static_cast<MemoryCounters*>(owner);
+    counters->liveBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    counters->liveAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void jp::memoryReleased(void* owner, size_t size)
+{
+    MemoryCounters* counters = static_cast<MemoryCounters*>(owner);
+    counters->liveBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+    counters->liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+jp::PluginMemory MemoryCounters::toPluginMemory() const
+{
+    jp::PluginMemory memory;
+    memory.librarySize = librarySize.load(std::memory_order_relaxed);
+    memory.residentDelta = residentDelta.load(std::memory_order_relaxed);
+    memory.heapDelta = heapDelta.load(std::memory_order_relaxed);
+    memory.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    memory.liveAllocations = liveAllocations.load(std::memory_order_relaxed);
+    return memory;
+}
+
+MemoryScope::MemoryScope(MemoryCounters* counters) : _previous(currentCounters), _active(counters != nullptr)
+{
+    // A plugin may call another one (for example by loading it on demand)
+    if(_active)
+        currentCounters = counters;
+}
+
+MemoryScope::~MemoryScope()
+{
+    if(_active)
+        currentCounters = _previous;
+}
+
+MemoryDelta::MemoryDelta(MemoryCounters* counters)
+    : _counters(counters),
+      _resident(counters ? memutil::residentSize() : 0),
+      _heap(counters ? memutil::heapSize() : 0)
+{}
+
+MemoryDelta::~MemoryDelta()
+{
+    if(!_counters)
+        return;
+    // Replaced on each load (the deltas of a previous instance are not relevant anymore)
+    _counters->residentDelta.store(static_cast<int64_t>(memutil::residentSize()) - static_cast<int64_t>(_resident),
+                                   std::memory_order_relaxed);
+    _counters->heapDelta.store(static_cast<int64_t>(memutil::heapSize()) - static_cast<int64_t>(_heap),
+                               std::memory_order_relaxed);
+}
+
+size_t memutil::residentSize()
+{
+#if defined(CONFINFO_PLATFORM_LINUX)
+    FILE* file = fopen("/proc/self/statm", "r");
+    if(!file)
+        return 0;
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    const bool read = fscanf(file, "%lu %lu", &size, &resident) == 2;
+    fclose(file);
+    return read ? static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#elif defined(CONFINFO_PLATFORM_MACOS)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if(task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        return 0;
+    return static_cast<size_t>(info.resident_size);
+#elif defined(CONFINFO_PLATFORM_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return static_cast<size_t>(counters.WorkingSetSize);
+#else
+    return 0;
+#endif
+}
+
+size_t memutil::heapSize()
+{
+#if defined(CONFINFO_PLATFORM_LINUX) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#elif defined(CONFINFO_PLATFORM_MACOS)
+    malloc_statistics_t stats;
+    malloc_zone_statistics(nullptr, &stats);
+    return stats.size_in_use;
+#else
+    return 0;
+#endif
+}
+
+size_t memutil::mappedSize(const jp::SharedLibrary& lib)
+{
+    if(!lib.isLoaded())
+        return 0;
+#if defined(CONFINFO_PLATFORM_LINUX)
+    struct link_map* map = nullptr;
+    if(dlinfo(lib.handle(), RTLD_DI_LINKMAP, &map) != 0 || !map)
+        return 0;
+    ModuleSearch search = {map->l_name, map->l_addr, 0};
+    dl_iterate_phdr(&addModuleSize, &search);
+    return search.size;
+#elif defined(CONFINFO_PLATFORM_WIN32)
+    MODULEINFO info;
+    if(!GetModuleInformation(GetCurrentProcess(), lib.handle(), &info, sizeof(info)))
+        return 0;
+    return static_cast<size_t>(info.SizeOfImage);
+#else
+    return 0;
+#endif
+}
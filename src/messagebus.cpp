@@ -0,0 +1,371 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/messagebusprivate.h"
+
+#include <new> // for placement new
+#include <algorithm> // for std::find_if
+
+using namespace jp_private;
+
+/*****************************************************************************/
+/***** MessageBus::Client class **********************************************/
+/*****************************************************************************/
+
+// Forward all calls to the bus, with the name of the plugin using this client
+class MessageBus::Client : public jp::IMessageBus
+{
+public:
+    Client(MessageBus* bus, const std::string& owner)
+        : _bus(bus), _owner(owner)
+    {}
+    ~Client() {}
+
+    size_t publish(jp::TopicId topic, void* payload, uint32_t size, jp::PayloadRelease release) override
+    { return _bus->publish(topic, payload, size, release); }
+
+    uint64_t subscribe(jp::TopicId topic, jp::MessageHandler handler, void* context) override
+    { return _bus->subscribe(_owner, topic, handler, context); }
+
+    bool unsubscribe(uint64_t subscription) override
+    { return _bus->unsubscribe(subscription); }
+
+    void flush() override
+    { _bus->flush(); }
+
+private:
+    MessageBus* const _bus;
+    const std::string _owner;
+};
+
+/*****************************************************************************/
+/***** MessageBus::Queue class ***********************************************/
+/*****************************************************************************/
+
+MessageBus::Queue::Queue()
+    : _head(&_stub), _tail(&_stub)
+{
+    _stub.next.store(nullptr, std::memory_order_relaxed);
+    _stub.envelope = nullptr;
+}
+
+void MessageBus::Queue::push(Node* node)
+{
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+    // Until this store, the node is not reachable from the tail
+    prev->next.store(node, std::memory_order_release);
+}
+
+MessageBus::Node* MessageBus::Queue::pop()
+{
+    Node* tail = _tail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if(tail == &_stub)
+    {
+        if(!next)
+            return nullptr;
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if(next)
+    {
+        _tail = next;
+        return tail;
+    }
+
+    // A producer is between the exchange and the store of push()
+    if(tail != _head.load(std::memory_order_acquire))
+        return nullptr;
+
+    // tail is the last node: push the stub behind it, so tail can be returned
+    push(&_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if(next)
+    {
+        _tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+/*****************************************************************************/
+/***** MessageBus class ******************************************************/
+/*****************************************************************************/
+
+MessageBus::MessageBus()
+    : _topics(std::make_shared<TopicsMap>()),
+      _queued(0),
+      _processed(0)
+{
+}
+
+MessageBus::~MessageBus()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_one();
+    // Scheduled subscriptions are run before the thread stops
+    if(_thread.joinable())
+        _thread.join();
+}
+
+jp::IMessageBus* MessageBus::client(const std::string& owner)
+{
+    std::lock_guard<std::mutex> lock(_clientsMutex);
+    std::unique_ptr<Client>& client = _clients[owner];
+    if(!client)
+        client.reset(new Client(this, owner));
+    return client.get();
+}
+
+size_t MessageBus::publish(jp::TopicId topic, void* payload, uint32_t size, jp::PayloadRelease release)
+{
+    const std::shared_ptr<const TopicsMap> topics = std::atomic_load(&_topics);
+    auto it = topics->find(topic);
+    if(it == topics->end())
+    {
+        if(release)
+            release(payload);
+        return 0;
+    }
+
+    // The message and all the nodes are allocated at once
+    const std::vector<SubscriptionPtr>& subscriptions = it->second;
+    const size_t count = subscriptions.size();
+    char* block = new char[sizeof(Envelope) + count * sizeof(Node)];
+    Envelope* envelope = new(block) Envelope;
+    envelope->refs.store(count, std::memory_order_relaxed);
+    envelope->message.topic = topic;
+    envelope->message.payload = payload;
+    envelope->message.size = size;
+    envelope->payload = payload;
+    envelope->release = release;
+
+    _queued.fetch_add(count, std::memory_order_relaxed);
+    Node* nodes = envelope->nodes();
+    for(size_t i = 0; i < count; ++i)
+    {
+        const SubscriptionPtr& subscription = subscriptions[i];
+        Node* node = new(&nodes[i]) Node;
+        node->envelope = envelope;
+        subscription->queue.push(node);
+        subscription->pending.fetch_add(1, std::memory_order_seq_cst);
+        if(!subscription->scheduled.exchange(true, std::memory_order_seq_cst))
+            schedule(subscription);
+    }
+    return count;
+}
+
+void MessageBus::setMemoryCountersFunction(const std::function<MemoryCounters*(const std::string&)>& func)
+{
+    _memoryCounters = func;
+}
+
+uint64_t MessageBus::subscribe(const std::string& owner, jp::TopicId topic, jp::MessageHandler handler, void* context)
+{
+    std::call_once(_started, [this]() { _thread = std::thread(&MessageBus::run, this); });
+
+    SubscriptionPtr subscription = std::make_shared<Subscription>();
+    subscription->owner = owner;
+    subscription->topic = topic;
+    subscription->handler = handler;
+    subscription->context = context;
+    subscription->memory = _memoryCounters ? _memoryCounters(owner) : nullptr;
+    subscription->pending.store(0, std::memory_order_relaxed);
+    subscription->scheduled.store(false, std::memory_order_relaxed);
+    subscription->closed.store(false, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_topicsMutex);
+    subscription->id = ++_lastId;
+    std::shared_ptr<TopicsMap> topics = std::make_shared<TopicsMap>(*_topics);
+    (*topics)[topic].push_back(subscription);
+    std::atomic_store(&_topics, std::shared_ptr<const TopicsMap>(topics));
+    return subscription->id;
+}
+
+bool MessageBus::unsubscribe(uint64_t id)
+{
+    SubscriptionPtr subscription;
+    {
+        std::lock_guard<std::mutex> lock(_topicsMutex);
+        std::shared_ptr<TopicsMap> topics = std::make_shared<TopicsMap>(*_topics);
+        for(auto it = topics->begin(); it != topics->end(); ++it)
+        {
+            std::vector<SubscriptionPtr>& list = it->second;
+            auto subIt = std::find_if(list.begin(), list.end(),
+                                      [id](const SubscriptionPtr& sub) { return sub->id == id; });
+            if(subIt == list.end())
+                continue;
+
+            subscription = *subIt;
+            list.erase(subIt);
+            if(list.empty())
+                topics->erase(it);
+            break;
+        }
+
+        if(!subscription)
+            return false;
+        std::atomic_store(&_topics, std::shared_ptr<const TopicsMap>(topics));
+    }
+
+    close(*subscription);
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(subscription->pending.load(std::memory_order_seq_cst) > 0
+       && !subscription->scheduled.exchange(true, std::memory_order_seq_cst))
+        _ready.push_back(subscription);
+    _cond.notify_one();
+    if(!isDispatcherThread())
+        _idleCond.wait(lock, [this, &subscription]() { return _current != subscription.get(); });
+    return true;
+}
+
+void MessageBus::removeSubscriptions(const std::string& owner)
+{
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(_topicsMutex);
+        for(const auto& topic : *_topics)
+        {
+            for(const SubscriptionPtr& subscription : topic.second)
+            {
+                if(subscription->owner == owner)
+                    ids.push_back(subscription->id);
+            }
+        }
+    }
+
+    for(uint64_t id : ids)
+        unsubscribe(id);
+}
+
+void MessageBus::flush()
+{
+    const uint64_t target = _queued.load(std::memory_order_acquire);
+    if(target == 0 || isDispatcherThread())
+        return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idleCond.wait(lock, [this, target]() {
+        return _processed.load(std::memory_order_acquire) >= target;
+    });
+}
+
+void MessageBus::schedule(const SubscriptionPtr& subscription)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ready.push_back(subscription);
+    }
+    _cond.notify_one();
+}
+
+void MessageBus::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(;;)
+    {
+        _cond.wait(lock, [this]() { return _stop || !_ready.empty(); });
+        if(_ready.empty())
+            break;
+
+        SubscriptionPtr subscription = std::move(_ready.front());
+        _ready.pop_front();
+        _current = subscription.get();
+        lock.unlock();
+
+        process(*subscription);
+
+        // Messages pushed meanwhile may have seen the subscription as scheduled
+        subscription->scheduled.store(false, std::memory_order_seq_cst);
+        const bool again = subscription->pending.load(std::memory_order_seq_cst) > 0
+                           && !subscription->scheduled.exchange(true, std::memory_order_seq_cst);
+
+        lock.lock();
+        if(again)
+            _ready.push_back(std::move(subscription));
+        _current = nullptr;
+        _idleCond.notify_all();
+    }
+}
+
+void MessageBus::process(Subscription& subscription)
+{
+    jp::Message messages[BATCH_SIZE];
+    Envelope* envelopes[BATCH_SIZE];
+    size_t count = 0;
+    while(count < BATCH_SIZE)
+    {
+        Node* node = subscription.queue.pop();
+        if(!node)
+            break;
+        envelopes[count] = node->envelope;
+        messages[count] = node->envelope->message;
+        ++count;
+    }
+
+    if(count == 0)
+    {
+        // A publisher is still pushing the next node
+        std::this_thread::yield();
+        return;
+    }
+    subscription.pending.fetch_sub(count, std::memory_order_seq_cst);
+
+    if(!subscription.closed.load(std::memory_order_acquire))
+    {
+        MemoryScope scope(subscription.memory);
+        subscription.handler(subscription.context, messages, count);
+    }
+
+    for(size_t i = 0; i < count; ++i)
+        releaseEnvelope(envelopes[i]);
+    _processed.fetch_add(count, std::memory_order_release);
+}
+
+void MessageBus::close(Subscription& subscription)
+{
+    subscription.closed.store(true, std::memory_order_release);
+}
+
+void MessageBus::releaseEnvelope(Envelope* envelope)
+{
+    if(envelope->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if(envelope->release)
+        envelope->release(envelope->payload);
+    envelope->~Envelope();
+    delete[] reinterpret_cast<char*>(envelope);
+}
+
+bool MessageBus::isDispatcherThread() const
+{
+    return std::this_thread::get_id() == _thread.get_id();
+}
@@ -27,6 +27,9 @@
 #include "private/stringutil.h"
 
 #include <algorithm> // for std::copy
+#include <cstring> // for std::memcpy
+#include <new> // for placement new
+#include <exception> // for std::exception
 
 using namespace jp_private;
 
@@ -59,6 +62,50 @@ jp::PluginInfo PluginInfoStd::toPluginInfo()
     return info;
 }
 
+size_t PluginInfoStd::copyTo(void* buffer, size_t size) const
+{
+    const std::string* strings[] = { &name, &prettyName, &version, &author,
+                                     &url, &license, &copyright };
+
+    size_t required = sizeof(jp::PluginInfo) + sizeof(jp::Dependency)*dependencies.size();
+    for(const std::string* str : strings)
+        required += str->size() + 1;
+    for(const Dependency& dep : dependencies)
+        required += dep.name.size() + dep.version.size() + 2;
+
+    if(size < required)
+        return required;
+
+    jp::PluginInfo* info = new(buffer) jp::PluginInfo;
+    jp::Dependency* depArray = reinterpret_cast<jp::Dependency*>(info + 1);
+    char* pos = reinterpret_cast<char*>(depArray + dependencies.size());
+
+    auto copyString = [&pos](const std::string& str) -> const char* {
+        const char* copy = pos;
+        std::memcpy(pos, str.c_str(), str.size() + 1);
+        pos += str.size() + 1;
+        return copy;
+    };
+
+    info->name = copyString(name);
+    info->prettyName = copyString(prettyName);
+    info->version = copyString(version);
+    info->author = copyString(author);
+    info->url = copyString(url);
+    info->license = copyString(license);
+    info->copyright = copyString(copyright);
+
+    for(size_t i=0; i < dependencies.size(); ++i)
+    {
+        depArray[i].name = copyString(dependencies[i].name);
+        depArray[i].version = copyString(dependencies[i].version);
+    }
+    info->dependencies = dependencies.empty() ? nullptr : depArray;
+    info->dependenciesNb = dependencies.size();
+
+    return required;
+}
+
 std::string PluginInfoStd::toString()
 {
     if(name.empty())
@@ -82,6 +129,53 @@ std::string PluginInfoStd::toString()
 /***** Plugin class **********************************************************/
 /*****************************************************************************/
 
+namespace {
+
+// Version::parse() throws (from std::stoi) for some invalid strings
+// version is not modified if str is invalid
+void parseVersion(Version& version, const std::string& str)
+{
+    try
+    {
+        version.parse(str);
+    }
+    catch(const std::exception&)
+    {
+    }
+}
+
+} // anonymous namespace
+
+void Plugin::setInfo(const PluginInfoStd& newInfo, StringArena& strings)
+{
+    info = newInfo;
+    updateInfoView(strings);
+
+    parseVersion(version, info.version);
+    dependencyVersions.clear();
+    dependencyVersions.resize(info.dependencies.size());
+    for(size_t i=0; i < info.dependencies.size(); ++i)
+        parseVersion(dependencyVersions[i], info.dependencies[i].version);
+}
+
+void Plugin::updateInfoView(StringArena& strings)
+{
+    infoView.name = strings.intern(info.name);
+    infoView.prettyName = strings.intern(info.prettyName);
+    infoView.version = strings.intern(info.version);
+    infoView.author = strings.intern(info.author);
+    infoView.url = strings.intern(info.url);
+    infoView.license = strings.intern(info.license);
+    infoView.copyright = strings.intern(info.copyright);
+
+    infoViewDependencies.clear();
+    infoViewDependencies.reserve(info.dependencies.size());
+    for(const PluginInfoStd::Dependency& dep : info.dependencies)
+        infoViewDependencies.emplace_back(jp::Dependency{strings.intern(dep.name), strings.intern(dep.version)});
+    infoView.dependencies = infoViewDependencies.empty() ? nullptr : infoViewDependencies.data();
+    infoView.dependenciesNb = infoViewDependencies.size();
+}
+
 // Destructor
 Plugin::~Plugin()
 {
@@ -24,15 +24,15 @@
 
 #include "pluginmanager.h"
 
-#include <algorithm> // for std::find
+#include <algorithm> // for std::find and std::sort
 #include <unordered_map> // for std::unordered_map
 
 #include "sharedlibrary.h"
 
-#include "private/graph.h"
 #include "private/fsutil.h"
 #include "private/stringutil.h"
 #include "private/plugin.h"
+#include "private/discoverycache.h"
 
 #include "version/version.h"
 
@@ -103,9 +103,30 @@ const char* ReturnCode::message(const ReturnCode &code)
     case LOAD_DEPENDENCY_CYCLE:
         return "The dependencies graph contains a cycle, which makes impossible to load plugins";
         break;
+    case LOAD_LIBRARY_ERROR:
+        return "The plugin library cannot be loaded (maybe it changed since the search ?)";
+        break;
+    case LOAD_PLUGIN_NOT_FOUND:
+        return "The plugin to load doesn't exist";
+        break;
+    case LOAD_TOO_MANY_MANAGERS:
+        return "Too many plugin managers exist at the same time, so plugins cannot send requests to this one";
+        break;
     case UNLOAD_NOT_ALL:
         return "Not all plugins have been unloaded";
         break;
+    case UNLOAD_TIMEOUT:
+        return "A plugin was not unloaded before the deadline (it's never unloaded)";
+        break;
+    case RELOAD_PLUGIN_NOT_FOUND:
+        return "The plugin to reload doesn't exist";
+        break;
+    case RELOAD_INVALID_LIBRARY:
+        return "The reloaded library is not a valid plugin anymore (or its name changed)";
+        break;
+    case RELOAD_LIBRARY_STILL_LOADED:
+        return "The library to reload is still loaded in the process, so it cannot be read again";
+        break;
     }
     return "";
 }
@@ -114,14 +135,18 @@ const char* ReturnCode::message(const ReturnCode &code)
 /* PluginManager class *******************************************************/
 /*****************************************************************************/
 
+const size_t PluginManager::MAX_MANAGERS;
+
 PluginManager::PluginManager() : _p(new PlugMgrPrivate(this))
 {
 }
 
 PluginManager::~PluginManager()
 {
+    _p->waitAsyncLoad();
     if(!_p->pluginsMap.empty())
         unloadPlugins();
+    _p->logger.flush();
     delete _p;
 }
 
@@ -134,14 +159,40 @@ PluginManager& PluginManager::instance()
 
 void PluginManager::setLogStream(std::ostream& logStream)
 {
-    _p->log = std::ref(logStream);
+    _p->logger.setStream(logStream);
+}
+
+void PluginManager::setLogLevel(LogLevel level)
+{
+    _p->logger.setLevel(level);
+}
+
+void PluginManager::setLogCallback(const logCallback& logFunc)
+{
+    _p->logger.setCallback(logFunc);
+}
+
+void PluginManager::flushLog()
+{
+    _p->logger.flush();
+}
+
+void PluginManager::enableSynchronousLog(const bool& enable)
+{
+    _p->logger.setSynchronous(enable);
+}
+
+size_t PluginManager::droppedLogMessages() const
+{
+    return _p->logger.droppedCount();
 }
 
 void PluginManager::enableLogOutput(const bool &enable)
 {
-    if(!_p->useLog && enable)
-        _p->log.get() << "Enable log output" << std::endl;
-    _p->useLog = enable;
+    const bool wasEnabled = _p->logger.isEnabled();
+    _p->logger.setEnabled(enable);
+    if(!wasEnabled && enable)
+        _p->logger.log(LOG_INFO, "Enable log output");
 }
 
 void PluginManager::disableLogOutput()
@@ -149,14 +200,90 @@ void PluginManager::disableLogOutput()
     enableLogOutput(false);
 }
 
+void PluginManager::enableProfiling(const bool& enable)
+{
+    _p->profiler.setEnabled(enable);
+}
+
+void PluginManager::disableProfiling()
+{
+    enableProfiling(false);
+}
+
+std::vector<ProfileEvent> PluginManager::profile() const
+{
+    return _p->profiler.events();
+}
+
+void PluginManager::clearProfile()
+{
+    _p->profiler.clear();
+}
+
+void PluginManager::exportProfile(std::ostream& out) const
+{
+    _p->profiler.writeChromeTrace(out);
+}
+
+std::vector<std::string> PluginManager::criticalLoadChain() const
+{
+    return _p->profiler.criticalChain();
+}
+
+void PluginManager::enableRequestMetrics(const bool& enable)
+{
+    _p->requestMetrics.setEnabled(enable);
+}
+
+void PluginManager::disableRequestMetrics()
+{
+    enableRequestMetrics(false);
+}
+
+std::vector<RequestRoute> PluginManager::requestMetrics() const
+{
+    return _p->requestMetrics.snapshot();
+}
+
+void PluginManager::clearRequestMetrics()
+{
+    _p->requestMetrics.clear();
+}
+
 ReturnCode PluginManager::searchForPlugins(const std::string &pluginDir, bool recursive, callback callbackFunc)
 {
-    if(_p->useLog)
-        _p->log.get() << "Search for plugins in " << pluginDir << std::endl;
+    return searchForPlugins(pluginDir, recursive, callbackFunc, CACHE_DISABLED);
+}
+
+ReturnCode PluginManager::searchForPlugins(const std::string &pluginDir, bool recursive, callback callbackFunc, CachePolicy cachePolicy)
+{
+    SearchOptions options;
+    options.recursive = recursive;
+    options.cachePolicy = cachePolicy;
+    return searchForPlugins(pluginDir, options, callbackFunc);
+}
+
+ReturnCode PluginManager::searchForPlugins(const std::string &pluginDir, const SearchOptions& options, callback callbackFunc)
+{
+    _p->waitAsyncLoad();
+    Logger::FlushScope logFlush(_p->logger);
+
+    _p->logger.log(LOG_INFO, "Search for plugins in {}", pluginDir);
+
+    const bool recursive = options.recursive;
+    const CachePolicy cachePolicy = options.cachePolicy;
+
+    fsutil::ScanOptions scanOptions;
+    scanOptions.extension = fsutil::libraryExtension();
+    scanOptions.include = options.include;
+    scanOptions.exclude = options.exclude;
+    scanOptions.maxDepth = recursive ? options.maxDepth : 0;
+    scanOptions.executor = &_p->executor;
+    scanOptions.threadsCount = _p->searchThreadsCount;
 
     bool atLeastOneFound = false;
     fsutil::PathList libList;
-    if(!fsutil::listLibrariesInDir(pluginDir, &libList, recursive))
+    if(!fsutil::scanDirectory(pluginDir, scanOptions, &libList))
     {
         // An error occured
         if(callbackFunc)
@@ -166,62 +293,93 @@ ReturnCode PluginManager::searchForPlugins(const std::string &pluginDir, bool re
             return ReturnCode::SEARCH_LISTFILES_ERROR;
     }
 
-    for(const std::string& path : libList)
+    // Sort the list so that duplicated names are always resolved the same way
+    std::sort(libList.begin(), libList.end());
+
+    const bool useCache = cachePolicy != CACHE_DISABLED;
+    const std::string cacheFile = _p->cacheFile.empty() ? pluginDir + "/justplug.cache" : _p->cacheFile;
+    DiscoveryCache cache;
+    if(useCache)
     {
-        PluginPtr plugin(new Plugin());
-        plugin->lib.load(path);
+        // With CACHE_REFRESH, the previous content is still loaded to keep entries of other dirs
+        // but every library of this dir is probed again
+        cache.load(cacheFile);
+        cache.removeMissing(pluginDir, recursive, libList);
 
-        if(plugin->lib.isLoaded()
-           && plugin->lib.hasSymbol("jp_name")
-           && plugin->lib.hasSymbol("jp_metadata")
-           && plugin->lib.hasSymbol("jp_createPlugin"))
+        // Load durations are stored next to the cache (unless another file is set)
+        if(_p->historyFile.empty())
         {
-            // This is a JustPlug library
-            if(_p->useLog)
-                _p->log.get() << "Found library at: " << path << std::endl;
-            plugin->path = path;
-            std::string name = plugin->lib.get<const char*>("jp_name");;
-
-            // name must be unique for each plugin
-            if(_p->pluginsMap.count(name) == 1)
-            {
-                if(callbackFunc)
-                    callbackFunc(ReturnCode::SEARCH_NAME_ALREADY_EXISTS, strdup(path.c_str()));
-                plugin.reset();
-                continue;
-            }
-
-            if(_p->useLog)
-                _p->log.get() << "Library name: " << name << std::endl;
-
-            PluginInfoStd info = _p->parseMetadata(plugin->lib.get<const char[]>("jp_metadata"));
-            if(info.name.empty())
-            {
-                if(callbackFunc)
-                    callbackFunc(ReturnCode::SEARCH_CANNOT_PARSE_METADATA, strdup(path.c_str()));
-                plugin.reset();
-                continue;
-            }
-
-            plugin->info = info;
-            // Print plugin's info
-            if(_p->useLog)
-                _p->log.get() << info.toString() << std::endl;
-
-            _p->pluginsMap[name] = plugin;
-            atLeastOneFound = true;
+            const size_t sep = cacheFile.find_last_of("/\\");
+            _p->historyFile = (sep != std::string::npos ? cacheFile.substr(0, sep) : std::string(".")) + "/justplug.history";
+            _p->loadHistory.load(_p->historyFile);
+        }
+    }
+
+    // Probe all libraries (concurrently if enabled), then merge the results
+    // in the order of libList, so that the result never depends on the threads scheduling
+    struct ProbeResult
+    {
+        PluginPtr plugin;
+        DiscoveryCache::Entry entry;
+        bool hasFingerprint = false;
+        bool cached = false;
+    };
+    std::vector<ProbeResult> results(libList.size());
+
+    _p->executor.parallelFor(libList.size(), _p->searchThreadsCount, [&](size_t i) {
+        const std::string& path = libList[i];
+        ProbeResult& result = results[i];
+        result.plugin.reset(new Plugin());
+
+        result.hasFingerprint = useCache && fsutil::fileFingerprint(path, &result.entry.size, &result.entry.mtime);
+        const DiscoveryCache::Entry* cached = nullptr;
+        if(result.hasFingerprint && cachePolicy == CACHE_ENABLED)
+            cached = cache.find(path, result.entry.size, result.entry.mtime);
+
+        // Libraries are only loaded by loadPlugins(), unless their symbols
+        // cannot be read directly from the file
+        if(cached)
+        {
+            result.entry = *cached;
+            result.cached = true;
         }
         else
         {
-            plugin.reset();
+            _p->probeLibrary(path, result.plugin, &result.entry);
         }
+    });
+
+    for(size_t i = 0; i < libList.size(); ++i)
+    {
+        const std::string& path = libList[i];
+        PluginPtr& plugin = results[i].plugin;
+        const DiscoveryCache::Entry& entry = results[i].entry;
+        const bool cached = results[i].cached;
+
+        if(results[i].hasFingerprint && !cached)
+            cache.insert(path, entry);
+        // A stale entry is removed by loadPlugin() if the library doesn't match
+        if(cached)
+            plugin->cacheFile = cacheFile;
+
+        if(_p->addPlugin(plugin, path, entry, cached, callbackFunc))
+            atLeastOneFound = true;
     }
 
+    if(useCache && !cache.save(cacheFile))
+        _p->logger.log(LOG_WARNING, "Cannot write the discovery cache to {}", cacheFile);
+
+    // New plugins are visible to readers from now
+    _p->publishRegistry();
+
     if(atLeastOneFound)
     {
         // Only add the location if it's not already in the list
         if(std::find(_p->locations.begin(), _p->locations.end(), pluginDir) == _p->locations.end())
             _p->locations.push_back(pluginDir);
+        // The sub-directories of a recursive search are watched too (with the options
+        // of the last search of the location)
+        _p->watcher.addDirectory(pluginDir, scanOptions);
         return ReturnCode::SUCCESS;
     }
     return ReturnCode::SEARCH_NOTHING_FOUND;
@@ -232,12 +390,115 @@ ReturnCode PluginManager::searchForPlugins(const std::string &pluginDir, callbac
     return searchForPlugins(pluginDir, false, callbackFunc);
 }
 
+ReturnCode PluginManager::registerStaticPlugins(const jp_private::StaticPluginEntry* const* entries, size_t count,
+                                                callback callbackFunc)
+{
+    _p->waitAsyncLoad();
+
+    _p->logger.log(LOG_INFO, "Register static plugins ...");
+
+    bool atLeastOneFound = false;
+    for(size_t i = 0; i < count; ++i)
+    {
+        // The linker may pad the table with null pointers
+        if(entries[i] && _p->addStaticPlugin(*entries[i], callbackFunc))
+            atLeastOneFound = true;
+    }
+
+    // New plugins are visible to readers from now
+    _p->publishRegistry();
+
+    return atLeastOneFound ? ReturnCode::SUCCESS : ReturnCode::SEARCH_NOTHING_FOUND;
+}
+
+void PluginManager::setSearchThreadsCount(unsigned int threadsCount)
+{
+    _p->searchThreadsCount = threadsCount;
+}
+
+void PluginManager::enableLazyLoading(const bool& enable)
+{
+    _p->waitAsyncLoad();
+
+    _p->lazyLoading = enable;
+}
+
+void PluginManager::setLoadThreadsCount(unsigned int threadsCount)
+{
+    _p->waitAsyncLoad();
+
+    _p->loadThreadsCount = threadsCount;
+}
+
+bool PluginManager::setExecutorThreadsCount(unsigned int threadsCount)
+{
+    if(!_p->executor.configurable())
+        return false;
+    _p->executor.setThreadsCount(threadsCount);
+    return true;
+}
+
+bool PluginManager::enableExecutorPinning(const bool& enable)
+{
+    if(!_p->executor.configurable())
+        return false;
+    _p->executor.setPinning(enable);
+    return true;
+}
+
+void PluginManager::setLibraryLoadFlags(int flags)
+{
+    _p->waitAsyncLoad();
+
+    _p->libraryLoadFlags = flags;
+}
+
+void PluginManager::setLibraryLoadFlags(const std::string& name, int flags)
+{
+    _p->waitAsyncLoad();
+
+    _p->pluginLoadFlags[name] = flags;
+}
+
+void PluginManager::enablePrefetch(const bool& enable)
+{
+    _p->waitAsyncLoad();
+
+    _p->prefetchLibraries = enable;
+}
+
+void PluginManager::enableMemoryAccounting(const bool& enable)
+{
+    _p->waitAsyncLoad();
+
+    _p->memoryAccounting = enable;
+    _p->requestMetrics.setMemoryAccounting(enable);
+}
+
+void PluginManager::setCacheFile(const std::string& filePath)
+{
+    _p->waitAsyncLoad();
+
+    _p->cacheFile = filePath;
+}
+
+void PluginManager::setLoadHistoryFile(const std::string& filePath)
+{
+    _p->waitAsyncLoad();
+
+    _p->historyFile = filePath;
+    if(!filePath.empty())
+        _p->loadHistory.load(filePath);
+}
+
 ReturnCode PluginManager::registerMainPlugin(const std::string &pluginName)
 {
+    _p->waitAsyncLoad();
+
     if(_p->mainPluginName.empty() && hasPlugin(pluginName))
     {
         _p->mainPluginName = pluginName;
-        _p->pluginsMap[pluginName]->isMainPlugin = true;
+        _p->pluginsMap.at(pluginName)->isMainPlugin = true;
         return ReturnCode::SUCCESS;
     }
     return ReturnCode::UNKNOWN_ERROR;
@@ -245,79 +506,96 @@ ReturnCode PluginManager::registerMainPlugin(const std::string &pluginName)
 
 ReturnCode PluginManager::loadPlugins(bool tryToContinue, callback callbackFunc)
 {
-    // First step: For each plugins, check if it's dependencies have been found
-    // Also creates a node list used by the graph to sort the dependencies
-    // NOTE: The graph is re-created even if loadPlugins() was already called.
+    _p->waitAsyncLoad();
+    Logger::FlushScope logFlush(_p->logger);
 
-    if(_p->useLog)
-        _p->log.get() << "Load plugins ..." << std::endl;
+    size_t first;
+    bool execMainPlugin;
+    ReturnCode retCode = _p->prepareLoad(tryToContinue, callbackFunc, nullptr, &first, &execMainPlugin);
+    if(!retCode)
+        return retCode;
 
-    Graph::NodeList nodeList;
-    nodeList.reserve(_p->pluginsMap.size());
+    _p->runLoad(first, execMainPlugin, callbackFunc);
 
-    for(auto& val : _p->pluginsMap)
-    {
-        // Init the ID to the default value (in case loadPlugins is called several times)
-        val.second->graphId = -1;
+    // Here, all plugins are loaded (or can be loaded on demand), the function can return
+    return ReturnCode::SUCCESS;
+}
 
-        ReturnCode retCode = _p->checkDependencies(val.second, callbackFunc);
-        if(!tryToContinue && !retCode)
-        {
-            // An error occured on one plugin, stop everything
-            return retCode;
-        }
+ReturnCode PluginManager::loadPlugins(const std::vector<std::string>& roots, bool tryToContinue, callback callbackFunc)
+{
+    _p->waitAsyncLoad();
+    Logger::FlushScope logFlush(_p->logger);
 
-        if(val.second->dependenciesExists == true)
-        {
-            Graph::Node node;
-            node.name = &(val.first);
-            nodeList.push_back(node);
-            val.second->graphId = nodeList.size() - 1;
-        }
-    }
+    size_t first;
+    bool execMainPlugin;
+    ReturnCode retCode = _p->prepareLoad(tryToContinue, callbackFunc, &roots, &first, &execMainPlugin);
+    if(!retCode)
+        return retCode;
 
-    // Fill parentNodes list for each node
-    for(auto& val : _p->pluginsMap)
-    {
-        const int nodeId = val.second->graphId;
-        if(nodeId != -1)
-        {
-            for(size_t i=0; i<val.second->info.dependencies.size(); ++i)
-                nodeList[nodeId].parentNodes.push_back(_p->pluginsMap[val.second->info.dependencies[i].name]->graphId);
-        }
-    }
+    _p->runLoad(first, execMainPlugin, callbackFunc);
 
+    // Here, all plugins are loaded (or can be loaded on demand), the function can return
+    return ReturnCode::SUCCESS;
+}
 
-    // Second step: create a graph of all dependencies
-    Graph graph(nodeList);
+std::future<ReturnCode> PluginManager::loadPluginsAsync(bool tryToContinue, callback callbackFunc, progressCallback progressFunc)
+{
+    _p->waitAsyncLoad();
 
-    // Third step: find the correct loading order using the topological Sort
-    bool error = false;
-    _p->loadOrderList = graph.topologicalSort(error);
-    if(error)
-    {
-        // There is a cycle inside the graph
-        if(callbackFunc)
-            callbackFunc(ReturnCode::LOAD_DEPENDENCY_CYCLE, nullptr);
-        return ReturnCode::LOAD_DEPENDENCY_CYCLE;
-    }
+    std::promise<ReturnCode> promise;
+    std::future<ReturnCode> future = promise.get_future();
 
-    if(_p->useLog)
+    size_t first;
+    bool execMainPlugin;
+    ReturnCode retCode = _p->prepareLoad(tryToContinue, callbackFunc, nullptr, &first, &execMainPlugin);
+    if(!retCode)
     {
-        _p->log.get() << "Load order:" << std::endl;
-        for(auto const& name : _p->loadOrderList)
-            _p->log.get() << " - " << name << std::endl;
+        _p->logger.flush();
+        promise.set_value(retCode);
+        return future;
     }
 
-    // Fourth step: load plugins
-    _p->loadPluginsInOrder();
+    _p->progressFunc = progressFunc;
+    // std::promise is only movable, and lambdas cannot capture by move in C++11
+    std::shared_ptr<std::promise<ReturnCode>> sharedPromise = std::make_shared<std::promise<ReturnCode>>(std::move(promise));
+    _p->asyncLoadThread = std::thread([this, first, execMainPlugin, callbackFunc, sharedPromise]() {
+        _p->runLoad(first, false, callbackFunc);
+        _p->progressFunc = progressCallback();
+        _p->logger.flush();
+        sharedPromise->set_value(ReturnCode::SUCCESS);
+
+        // Call the main plugin function once the future is ready
+        if(execMainPlugin)
+            _p->execMainPlugin();
+    });
+
+    return future;
+}
+
+std::future<ReturnCode> PluginManager::loadPluginsAsync(callback callbackFunc, progressCallback progressFunc)
+{
+    return loadPluginsAsync(true, callbackFunc, progressFunc);
+}
 
-    // Call the main plugin function
-    if(!_p->mainPluginName.empty())
-        _p->pluginsMap.at(_p->mainPluginName)->iplugin->mainPluginExec();
+bool PluginManager::waitForPlugin(const std::string& name)
+{
+    const PluginPtr plugin = _p->findPlugin(name);
+    if(!plugin)
+        return false;
 
-    // Here, all plugins are loaded, the function can return
-    return ReturnCode::SUCCESS;
+    {
+        std::unique_lock<std::mutex> lock(_p->progressMutex);
+        // The thread loading a plugin cannot wait: the plugin may only be processed
+        // after it (or by it), so the wait could never end
+        if(plugin->loadScheduled && _p->isLoadThread())
+            return false;
+        _p->progressCond.wait(lock, [&plugin]() { return !plugin->loadScheduled; });
+    }
+
+    if(plugin->objectPointer())
+        return true;
+    // With lazy loading, the plugin is loaded now
+    return _p->lazyLoading && _p->loadPluginOnDemand(plugin);
 }
 
 ReturnCode PluginManager::loadPlugins(callback callbackFunc)
@@ -325,10 +603,17 @@ ReturnCode PluginManager::loadPlugins(callback callbackFunc)
     return loadPlugins(true, callbackFunc);
 }
 
+ReturnCode PluginManager::loadPlugins(const std::vector<std::string>& roots, callback callbackFunc)
+{
+    return loadPlugins(roots, true, callbackFunc);
+}
+
 ReturnCode PluginManager::unloadPlugins(callback callbackFunc)
 {
-    if(_p->useLog)
-        _p->log.get() << "Unload plugins ..." << std::endl;
+    _p->waitAsyncLoad();
+    Logger::FlushScope logFlush(_p->logger);
+
+    _p->logger.log(LOG_INFO, "Unload plugins ...");
 
     if(!_p->unloadPluginsInOrder())
     {
@@ -340,6 +625,128 @@ ReturnCode PluginManager::unloadPlugins(callback callbackFunc)
     return ReturnCode::SUCCESS;
 }
 
+ReturnCode PluginManager::unloadPlugins(callback callbackFunc, unsigned int threadsCount,
+                                       unsigned int pluginTimeout, unsigned int totalTimeout)
+{
+    _p->waitAsyncLoad();
+    Logger::FlushScope logFlush(_p->logger);
+
+    _p->logger.log(LOG_INFO, "Unload plugins concurrently ...");
+
+    ReturnCode retCode = _p->unloadPluginsConcurrently(threadsCount, pluginTimeout, totalTimeout, callbackFunc);
+    if(retCode.type == ReturnCode::UNLOAD_NOT_ALL && callbackFunc)
+        callbackFunc(ReturnCode::UNLOAD_NOT_ALL, nullptr);
+    return retCode;
+}
+
+ReturnCode PluginManager::reloadPlugin(const std::string& name, callback callbackFunc)
+{
+    _p->waitAsyncLoad();
+
+    const auto pluginIt = _p->pluginsMap.find(name);
+    if(pluginIt == _p->pluginsMap.end())
+        return ReturnCode::RELOAD_PLUGIN_NOT_FOUND;
+    // Static plugins are part of the executable
+    if(pluginIt->second->isStatic)
+        return ReturnCode::RELOAD_INVALID_LIBRARY;
+
+    _p->logger.log(LOG_INFO, "Reload plugin {} ...", name);
+
+    return _p->reloadPlugin(pluginIt->second, false, callbackFunc);
+}
+
+bool PluginManager::enableWatching(const bool& enable)
+{
+    _p->waitAsyncLoad();
+
+    if(!enable)
+    {
+        _p->watcher.stop();
+        return true;
+    }
+    return _p->watcher.start(_p->watchPollInterval, _p->watchCallback);
+}
+
+void PluginManager::disableWatching()
+{
+    enableWatching(false);
+}
+
+void PluginManager::setWatchPollInterval(unsigned int interval)
+{
+    _p->watchPollInterval = interval;
+}
+
+void PluginManager::setWatchCallback(const std::function<void()>& func)
+{
+    _p->watchCallback = func;
+}
+
+bool PluginManager::hasLocationChanges() const
+{
+    return _p->watcher.hasChanges();
+}
+
+ReturnCode PluginManager::processLocationChanges(callback callbackFunc)
+{
+    _p->waitAsyncLoad();
+
+    const std::vector<std::string> changes = _p->watcher.takeChanges();
+    if(changes.empty())
+        return ReturnCode::SUCCESS;
+
+    _p->logger.log(LOG_INFO, "Process {} changed libraries ...", changes.size());
+
+    // Plugins are identified by the path of their library
+    std::unordered_map<std::string, PluginPtr> plugins;
+    plugins.reserve(_p->pluginsMap.size());
+    for(const auto& val : _p->pluginsMap)
+        plugins[val.second->path] = val.second;
+
+    ReturnCode retCode = ReturnCode::SUCCESS;
+    bool newPlugins = false;
+    for(const std::string& path : changes)
+    {
+        uint64_t size;
+        int64_t mtime;
+        const bool exists = fsutil::fileFingerprint(path, &size, &mtime);
+
+        const auto it = plugins.find(path);
+        if(it != plugins.end())
+        {
+            _p->logger.log(LOG_INFO, exists ? "Reload plugin {}" : "Remove plugin {}", it->second->info.name);
+
+            ReturnCode code = _p->reloadPlugin(it->second, !exists, callbackFunc);
+            if(!code)
+                retCode = code;
+        }
+        else if(exists)
+        {
+            // New library: same rules as searchForPlugins()
+            PluginPtr plugin(new Plugin());
+            DiscoveryCache::Entry entry;
+            _p->probeLibrary(path, plugin, &entry);
+            if(_p->addPlugin(plugin, path, entry, false, callbackFunc))
+                newPlugins = true;
+        }
+    }
+
+    if(newPlugins)
+    {
+        _p->publishRegistry();
+        if(_p->loadRequested)
+        {
+            // Only the plugins required by the roots are loaded if roots were given
+            ReturnCode code = _p->loadAllPlugins ? loadPlugins(true, callbackFunc)
+                                                 : loadPlugins(std::vector<std::string>(), true, callbackFunc);
+            if(!code)
+                retCode = code;
+        }
+    }
+
+    return retCode;
+}
+
 //
 // Getters
 //
@@ -347,7 +754,7 @@ ReturnCode PluginManager::unloadPlugins(callback callbackFunc)
 // Static
 std::string PluginManager::appDirectory()
 {
-    return fsutil::appDir();
+    return PlugMgrPrivate::cachedAppDir();
 }
 
 // Static
@@ -358,14 +765,15 @@ std::string PluginManager::pluginApi()
 
 size_t PluginManager::pluginsCount() const
 {
-    return _p->pluginsMap.size();
+    return RegistryView(_p)->size();
 }
 
 std::vector<std::string> PluginManager::pluginsList() const
 {
+    const RegistryView plugins(_p);
     std::vector<std::string> nameList;
-    nameList.reserve(_p->pluginsMap.size());
-    for(auto const& x : _p->pluginsMap)
+    nameList.reserve(plugins->size());
+    for(auto const& x : *plugins)
         nameList.push_back(x.first);
     return nameList;
 }
@@ -377,30 +785,84 @@ std::vector<std::string> PluginManager::pluginsLocation() const
 
 bool PluginManager::hasPlugin(const std::string &name) const
 {
-    return _p->pluginsMap.count(name) == 1;
+    return RegistryView(_p)->count(name) == 1;
 }
 
 bool PluginManager::hasPlugin(const std::string &name, const std::string &minVersion) const
 {
-    return hasPlugin(name) && Version(_p->pluginsMap[name]->info.version).compatible(minVersion);
+    const PluginPtr plugin = _p->findPlugin(name);
+    return plugin && plugin->version.compatible(minVersion);
 }
 
 bool PluginManager::isPluginLoaded(const std::string &name) const
 {
-    return hasPlugin(name) && _p->pluginsMap[name]->lib.isLoaded() && _p->pluginsMap[name]->iplugin;
+    // The plugin object is only set once its library is loaded
+    const PluginPtr plugin = _p->findPlugin(name);
+    return plugin && plugin->objectPointer() != nullptr;
 }
 
 std::shared_ptr<IPlugin> PluginManager::pluginObject(const std::string& name) const
 {
-    if(!hasPlugin(name))
+    const PluginPtr plugin = _p->findPlugin(name);
+    if(!plugin)
         return std::shared_ptr<IPlugin>();
 
-    return _p->pluginsMap[name]->iplugin;
+    if(_p->lazyLoading)
+        _p->loadPluginOnDemand(plugin);
+
+    // The plugin object is only set once its library is loaded
+    return plugin->object();
 }
 
 PluginInfo PluginManager::pluginInfo(const std::string &name) const
 {
-    if(!hasPlugin(name))
+    const PluginPtr plugin = _p->findPlugin(name);
+    if(!plugin)
         return PluginInfo();
-    return _p->pluginsMap[name]->info.toPluginInfo();
+    return plugin->info.toPluginInfo();
+}
+
+PluginInfoView PluginManager::pluginInfoView(const std::string& name) const
+{
+    const PluginPtr plugin = _p->findPlugin(name);
+    if(!plugin)
+        return PluginInfoView();
+    return PluginInfoView(&plugin->infoView);
+}
+
+PluginMemory PluginManager::pluginMemory(const std::string& name) const
+{
+    if(!_p->findPlugin(name))
+        return PluginMemory();
+
+    std::lock_guard<std::mutex> lock(_p->memoryMutex);
+    const auto it = _p->memoryCounters.find(name);
+    if(it == _p->memoryCounters.end())
+        return PluginMemory();
+    return it->second->toPluginMemory();
+}
+
+IMessageBus* PluginManager::messageBus()
+{
+    return _p->messageBus.client(std::string());
+}
+
+IExecutor* PluginManager::executor()
+{
+    return &_p->executor;
+}
+
+bool PluginManager::publishService(ServiceId id, const char* name, void* service)
+{
+    return _p->services.add(id, name, service, std::string());
+}
+
+bool PluginManager::unpublishService(ServiceId id)
+{
+    return _p->services.remove(id, std::string());
+}
+
+void* PluginManager::findService(ServiceId id, const char* name) const
+{
+    return _p->services.find(id, name);
 }
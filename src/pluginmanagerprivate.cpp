@@ -29,14 +29,129 @@
 #include "version/version.h"
 #include "json/json.hpp"
 
+#include "private/binarymetadata.h"
 #include "private/graph.h"
+#include "private/imagereader.h"
 #include "private/tribool.h"
 #include "private/fsutil.h"
 #include "private/stringutil.h"
+#include "private/parallel.h"
+
+#include <condition_variable> // for std::condition_variable
+#include <queue> // for std::priority_queue
+#include <unordered_set> // for std::unordered_set
+#include <algorithm> // for std::find, std::any_of, std::max and std::reverse
+#include <thread> // for std::thread
 
 using namespace jp_private;
 using namespace jp;
 
+namespace {
+
+// Plugins whose code may still be running (stuck in aboutToBeUnloaded()) cannot be
+// released: neither their object nor their library. They are intentionally kept
+// until the end of the process.
+void leakPlugin(const PluginPtr& plugin)
+{
+    static std::mutex mutex;
+    static std::vector<PluginPtr>* leakedPlugins = new std::vector<PluginPtr>();
+    std::lock_guard<std::mutex> lock(mutex);
+    leakedPlugins->push_back(plugin);
+}
+
+// Registry kept by the current thread for RegistryView
+struct ThreadRegistry
+{
+    uint64_t generation = 0;
+    std::shared_ptr<const PlugMgrPrivate::PluginsMap> registry;
+    // Number of views using it (it cannot be replaced meanwhile)
+    unsigned int views = 0;
+};
+thread_local ThreadRegistry threadRegistry;
+
+// Manager loading a plugin of its load order on the current thread (see loadScheduledPlugin())
+thread_local const PlugMgrPrivate* loadingManager = nullptr;
+
+// Symbols exported by plugins, resolved in one pass
+// (the first PLUGIN_REQUIRED_SYMBOLS are required, the others are optional)
+const char* const PLUGIN_SYMBOLS[] = {"jp_name", "jp_metadata", "jp_createPlugin", "jp_metadata_bin"};
+enum PluginSymbol { SYMBOL_NAME = 0, SYMBOL_METADATA, SYMBOL_CREATE, SYMBOL_METADATA_BIN };
+const size_t PLUGIN_SYMBOLS_COUNT = sizeof(PLUGIN_SYMBOLS) / sizeof(PLUGIN_SYMBOLS[0]);
+const size_t PLUGIN_REQUIRED_SYMBOLS = 3;
+
+// Resolve the plugin symbols of a loaded library
+// Returns true if all required symbols are found
+bool resolvePluginSymbols(SharedLibrary& lib, void** symbols)
+{
+    lib.resolveSymbols(PLUGIN_SYMBOLS, symbols, PLUGIN_SYMBOLS_COUNT);
+    for(size_t i = 0; i < PLUGIN_REQUIRED_SYMBOLS; ++i)
+    {
+        if(!symbols[i])
+            return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+RegistryView::RegistryView(const PlugMgrPrivate* p)
+{
+    ThreadRegistry& kept = threadRegistry;
+    // Read before the registry: if a newer one is published meanwhile, the next view
+    // sees a different generation and loads it
+    const uint64_t generation = p->registryGeneration.load(std::memory_order_acquire);
+    if(kept.generation != generation)
+    {
+        if(kept.views > 0)
+        {
+            // Nested view on another manager, or on a registry published while the
+            // outer view is alive
+            _ownRegistry = std::atomic_load(&p->registry);
+            _plugins = _ownRegistry.get();
+            return;
+        }
+        kept.registry = std::atomic_load(&p->registry);
+        kept.generation = generation;
+    }
+    ++kept.views;
+    _plugins = kept.registry.get();
+}
+
+RegistryView::~RegistryView()
+{
+    if(!_ownRegistry)
+        --threadRegistry.views;
+}
+
+Plugin* RegistryView::find(const std::string& name) const
+{
+    const auto it = _plugins->find(name);
+    return it != _plugins->end() ? it->second.get() : nullptr;
+}
+
+// Static
+uint64_t PlugMgrPrivate::newRegistryGeneration()
+{
+    // Generations are never reused, so a registry kept by a thread cannot be taken for
+    // the registry of another manager (even one allocated at the same address)
+    static std::atomic<uint64_t> lastGeneration(0);
+    return ++lastGeneration;
+}
+
+void PlugMgrPrivate::publishRegistry()
+{
+    std::shared_ptr<const PluginsMap> copy = std::make_shared<PluginsMap>(pluginsMap);
+    std::atomic_store(&registry, copy);
+    registryGeneration.store(newRegistryGeneration(), std::memory_order_release);
+}
+
+PluginPtr PlugMgrPrivate::findPlugin(const std::string& name) const
+{
+    const RegistryView plugins(this);
+    auto it = plugins->find(name);
+    return it != plugins->end() ? it->second : PluginPtr();
+}
+
 // Parse json metadata using json.hpp (in thirdparty/ folder)
 PluginInfoStd PlugMgrPrivate::parseMetadata(const char *metadata)
 {
@@ -66,6 +181,9 @@ PluginInfoStd PlugMgrPrivate::parseMetadata(const char *metadata)
                 info.dependencies.push_back(dep);
             }
 
+            if(tree.count("threadSafe") == 1)
+                info.threadSafe = tree.at("threadSafe").get<bool>();
+
             return info;
         }
     }
@@ -74,71 +192,1023 @@ PluginInfoStd PlugMgrPrivate::parseMetadata(const char *metadata)
     return PluginInfoStd();
 }
 
-// Checks if the dependencies required by the plugin exists and are compatible
-// with the required version.
-// If all dependencies match, mark the plugin as "compatible"
-ReturnCode PlugMgrPrivate::checkDependencies(PluginPtr& plugin, PluginManager::callback callbackFunc)
+PluginInfoStd PlugMgrPrivate::readMetadata(const char* binMetadata, size_t binMetadataSize, const char* metadata)
 {
-    if(!plugin->dependenciesExists.indeterminate())
-        return plugin->dependenciesExists == true ? ReturnCode::SUCCESS
-                                                  : (pluginsMap.count(plugin->info.name) == 0 ? ReturnCode::LOAD_DEPENDENCY_NOT_FOUND
-                                                                                              : ReturnCode::LOAD_DEPENDENCY_BAD_VERSION);
+    // Binary metadata are not available for plugins built with an old
+    // EmbedMetadata.cmake script or CMake version
+    if(binMetadata)
+    {
+        PluginInfoStd info = parseBinaryMetadata(binMetadata, binMetadataSize);
+        if(!info.name.empty())
+            return info;
+    }
+    return parseMetadata(metadata);
+}
 
-    for(size_t i=0; i < plugin->info.dependencies.size(); ++i)
+void PlugMgrPrivate::probeLibrary(const std::string& path, PluginPtr& plugin, DiscoveryCache::Entry* entry)
+{
+    // The plugin name is only known once the symbols are read, so events are
+    // recorded at the end of each step
+    Profiler::Clock::time_point start = profiler.now();
+
+    ImageReader image;
+    if(image.open(path))
     {
-        const std::string& depName = plugin->info.dependencies[i].name;
-        const std::string& depVer = plugin->info.dependencies[i].version;
-        // Checks if the plugin dep is compatible
-        if(pluginsMap.count(depName) == 0)
+        // Scan the symbols table only once, following lookups use the cached results
+        image.resolveSymbols(PLUGIN_SYMBOLS, PLUGIN_SYMBOLS_COUNT);
+        entry->isPlugin = image.hasSymbol("jp_name")
+                          && image.hasSymbol("jp_metadata")
+                          && image.hasSymbol("jp_createPlugin");
+        if(!entry->isPlugin)
+        {
+            profiler.record(path, ProfileEvent::SYMBOL_LOOKUP, start);
+            return;
+        }
+
+        // Metadata are parsed directly from the mapped file
+        size_t metadataSize = 0;
+        size_t binMetadataSize = 0;
+        const char* name = image.pointedString("jp_name");
+        const char* metadata = image.symbolData("jp_metadata", &metadataSize);
+        const char* binMetadata = image.hasSymbol("jp_metadata_bin")
+                                  ? image.symbolData("jp_metadata_bin", &binMetadataSize) : nullptr;
+        if(name && metadata && memchr(metadata, '\0', metadataSize))
+        {
+            entry->name = name;
+            profiler.record(entry->name, ProfileEvent::SYMBOL_LOOKUP, start);
+
+            ProfileScope scope(profiler, entry->name, ProfileEvent::METADATA_PARSE);
+            entry->info = readMetadata(binMetadata, binMetadataSize, metadata);
+            return;
+        }
+
+        // The symbols cannot be resolved without loading the library
+        image.close();
+        start = profiler.now();
+    }
+
+    // The plugin name is not known yet, so per-plugin flags cannot be used here
+    // (the library is reloaded by loadPlugin() if they differ)
+    plugin->lib.load(path, libraryLoadFlags);
+    const Profiler::Clock::time_point loadEnd = profiler.now();
+
+    void* symbols[PLUGIN_SYMBOLS_COUNT];
+    entry->isPlugin = plugin->lib.isLoaded() && resolvePluginSymbols(plugin->lib, symbols);
+    if(entry->isPlugin)
+    {
+        entry->name = *static_cast<const char* const*>(symbols[SYMBOL_NAME]);
+        profiler.record(entry->name, ProfileEvent::DLOPEN, start, loadEnd);
+        profiler.record(entry->name, ProfileEvent::SYMBOL_LOOKUP, loadEnd);
+
+        // The size of the binary metadata is not known here, so the size stored
+        // inside the data is used
+        ProfileScope scope(profiler, entry->name, ProfileEvent::METADATA_PARSE);
+        entry->info = readMetadata(static_cast<const char*>(symbols[SYMBOL_METADATA_BIN]),
+                                   BINARY_METADATA_UNKNOWN_SIZE,
+                                   static_cast<const char*>(symbols[SYMBOL_METADATA]));
+    }
+    else
+    {
+        profiler.record(path, ProfileEvent::DLOPEN, start, loadEnd);
+        profiler.record(path, ProfileEvent::SYMBOL_LOOKUP, loadEnd);
+    }
+}
+
+bool PlugMgrPrivate::addPlugin(PluginPtr& plugin, const std::string& path, const DiscoveryCache::Entry& entry,
+                               bool cached, PluginManager::callback callbackFunc)
+{
+    if(!entry.isPlugin)
+    {
+        plugin.reset();
+        return false;
+    }
+
+    // This is a JustPlug library (or a static plugin, without any path)
+    if(plugin->isStatic)
+        logger.log(PluginManager::LOG_INFO, "Found static plugin: {}", entry.name);
+    else
+        logger.log(PluginManager::LOG_INFO, "Found library at: {}{}", path, cached ? " (cached)" : "");
+    plugin->path = path;
+    const std::string& name = entry.name;
+    // Errors are reported with the path of the library, or the name of static plugins
+    const std::string& location = plugin->isStatic ? name : path;
+
+    // name must be unique for each plugin
+    if(pluginsMap.count(name) == 1)
+    {
+        if(callbackFunc)
+            callbackFunc(ReturnCode::SEARCH_NAME_ALREADY_EXISTS, strdup(location.c_str()));
+        plugin.reset();
+        return false;
+    }
+
+    logger.log(PluginManager::LOG_DEBUG, "Library name: {}", name);
+
+    if(entry.info.name.empty())
+    {
+        if(callbackFunc)
+            callbackFunc(ReturnCode::SEARCH_CANNOT_PARSE_METADATA, strdup(location.c_str()));
+        plugin.reset();
+        return false;
+    }
+
+    plugin->setInfo(entry.info, strings);
+    // Print plugin's info
+    const PluginInfoStd& info = plugin->info;
+    if(logger.isEnabled(PluginManager::LOG_DEBUG))
+    {
+        // Arguments are copied, but only formatted by the logger thread
+        logger.log(PluginManager::LOG_DEBUG, "Plugin info:\nName: {}\nPretty name: {}\nVersion: {}\nAuthor: {}"
+                                             "\nUrl: {}\nLicense: {}\nCopyright: {}\nDependencies:",
+                   info.name, info.prettyName, info.version, info.author, info.url, info.license, info.copyright);
+        for(const PluginInfoStd::Dependency& dep : info.dependencies)
+            logger.log(PluginManager::LOG_DEBUG, " - {} ({})", dep.name, dep.version);
+    }
+
+    pluginsMap[name] = plugin;
+    pendingPlugins.push_back(plugin);
+    return true;
+}
+
+bool PlugMgrPrivate::addStaticPlugin(const StaticPluginEntry& staticEntry, PluginManager::callback callbackFunc)
+{
+    // The table is the same for each call, so plugins registered by a previous call are skipped
+    const auto it = pluginsMap.find(staticEntry.name);
+    if(it != pluginsMap.end() && it->second->isStatic)
+        return false;
+
+    DiscoveryCache::Entry entry;
+    entry.isPlugin = true;
+    entry.name = staticEntry.name;
+    {
+        // The size of the binary metadata is not known here, so the size stored
+        // inside the data is used
+        ProfileScope scope(profiler, entry.name, ProfileEvent::METADATA_PARSE);
+        entry.info = readMetadata(reinterpret_cast<const char*>(staticEntry.binMetadata),
+                                  BINARY_METADATA_UNKNOWN_SIZE, staticEntry.metadata);
+    }
+
+    PluginPtr plugin = std::make_shared<Plugin>();
+    plugin->isStatic = true;
+    plugin->creator = staticEntry.create;
+    return addPlugin(plugin, std::string(), entry, false, callbackFunc);
+}
+
+// Find the load order of the pending plugins, in one pass over these plugins:
+// - each dependency is resolved (with its pre-parsed version) only once
+// - the graph of the pending plugins is then sorted: a plugin is marked as
+//   "compatible" once all its dependencies have been checked, so it's only visited once
+// - the plugins that are never reached belong to (or depend on) a cycle
+// The plugins that can be loaded are appended to loadOrderList. Plugins already
+// in loadOrderList are compatible, so they are not part of the graph and the
+// cost only depends on the number of pending plugins.
+ReturnCode PlugMgrPrivate::computeLoadOrder(bool tryToContinue, PluginManager::callback callbackFunc)
+{
+    // Plugins not required by the roots are not checked, and stay pending
+    std::vector<PluginPtr> deferred;
+    std::vector<Plugin*> plugins;
+    plugins.reserve(pendingPlugins.size());
+    if(loadAllPlugins)
+    {
+        for(const PluginPtr& plugin : pendingPlugins)
+            plugins.push_back(plugin.get());
+    }
+    else
+    {
+        const std::unordered_set<const Plugin*> closure = rootsClosure();
+        for(const PluginPtr& plugin : pendingPlugins)
+        {
+            if(closure.count(plugin.get()) == 1)
+                plugins.push_back(plugin.get());
+            else
+                deferred.push_back(plugin);
+        }
+        logger.log(PluginManager::LOG_DEBUG, "{} plugins required by the roots, {} deferred",
+                   plugins.size(), deferred.size());
+    }
+
+    Graph::NodeList nodeList;
+    nodeList.reserve(plugins.size());
+
+    // Init the flags to the default values (in case loadPlugins() was already called)
+    for(Plugin* plugin : plugins)
+    {
+        plugin->graphId = static_cast<int>(nodeList.size());
+        plugin->dependenciesExists = TriBool::Indeterminate;
+        {
+            std::lock_guard<std::recursive_mutex> lock(lazyMutex);
+            plugin->loadable = false;
+        }
+
+        Graph::Node node;
+        node.name = &(plugin->info.name);
+        nodeList.push_back(node);
+    }
+
+    // Checks if the dependencies required by each plugin exists and are compatible
+    // with the required version
+    for(Plugin* plugin : plugins)
+    {
+        ProfileScope scope(profiler, plugin->info.name, ProfileEvent::DEPENDENCY_CHECK);
+
+        ReturnCode retCode = ReturnCode::SUCCESS;
+        plugin->resolvedDependencies.assign(plugin->info.dependencies.size(), nullptr);
+        for(size_t i=0; i < plugin->info.dependencies.size(); ++i)
+        {
+            const auto it = pluginsMap.find(plugin->info.dependencies[i].name);
+            if(it == pluginsMap.end())
+            {
+                if(retCode)
+                    retCode = ReturnCode::LOAD_DEPENDENCY_NOT_FOUND;
+                continue;
+            }
+
+            Plugin* dependency = it->second.get();
+            plugin->resolvedDependencies[i] = dependency;
+            // Only pending plugins are part of the graph (the other ones are
+            // already in loadOrderList)
+            if(dependency->dependenciesExists != true)
+                nodeList[plugin->graphId].parentNodes.push_back(dependency->graphId);
+
+            if(retCode && !dependency->version.compatible(plugin->dependencyVersions[i]))
+                retCode = ReturnCode::LOAD_DEPENDENCY_BAD_VERSION;
+        }
+
+        if(!retCode)
         {
             plugin->dependenciesExists = false;
             if(callbackFunc)
-                callbackFunc(ReturnCode::LOAD_DEPENDENCY_NOT_FOUND, strdup(plugin->path.c_str()));
-            return ReturnCode::LOAD_DEPENDENCY_NOT_FOUND;
+                callbackFunc(retCode, strdup(plugin->path.c_str()));
+            // An error occured on one plugin, stop everything
+            if(!tryToContinue)
+                return retCode;
         }
+    }
 
-        if(!Version(pluginsMap[depName]->info.version).compatible(depVer))
+    // Find the correct loading order using the topological sort:
+    // the dependencies of a plugin are always checked before the plugin itself
+    const Graph graph(nodeList);
+
+    // Plugins on the longest chain (weighted by the load durations of the previous
+    // runs) come first, so they are started first by a concurrent load
+    const int64_t defaultDuration = std::max<int64_t>(loadHistory.averageDuration(), 1);
+    std::vector<int64_t> weights(plugins.size());
+    for(size_t i = 0; i < plugins.size(); ++i)
+        weights[i] = loadHistory.duration(plugins[i]->info.name, defaultDuration);
+
+    bool error = false;
+    const std::vector<int> order = graph.sortedIds(error, graph.pathLengths(weights));
+
+    if(error)
+    {
+        // There is a cycle inside the graph, report the plugins of each cycle
+        for(const Graph::NodeNamesList& cycle : graph.cycles())
         {
-            plugin->dependenciesExists = false;
+            std::string names;
+            for(const std::string& name : cycle)
+                names += (names.empty() ? "" : ", ") + name;
+
+            logger.log(PluginManager::LOG_ERROR, "Dependency cycle: {}", names);
             if(callbackFunc)
-                callbackFunc(ReturnCode::LOAD_DEPENDENCY_BAD_VERSION, strdup(plugin->path.c_str()));
-            return ReturnCode::LOAD_DEPENDENCY_BAD_VERSION;
+                callbackFunc(ReturnCode::LOAD_DEPENDENCY_CYCLE, strdup(names.c_str()));
         }
+        return ReturnCode::LOAD_DEPENDENCY_CYCLE;
+    }
 
-        // Checks if the dependencies of the dependency exists
-        ReturnCode retCode = checkDependencies(pluginsMap[depName], callbackFunc);
-        if(!retCode)
-            return retCode;
+    loadOrderList.reserve(loadOrderList.size() + order.size());
+    for(int id : order)
+    {
+        Plugin* plugin = plugins[id];
+        if(plugin->dependenciesExists.indeterminate())
+        {
+            plugin->dependenciesExists = true;
+            for(const int* parent = graph.parentsBegin(id); parent != graph.parentsEnd(id); ++parent)
+            {
+                if(plugins[*parent]->dependenciesExists != true)
+                {
+                    plugin->dependenciesExists = false;
+                    break;
+                }
+            }
+        }
+
+        if(plugin->dependenciesExists == true)
+            loadOrderList.push_back(graph.name(id));
+    }
+
+    // Plugins that cannot be loaded yet are checked again by the next
+    // call (their dependencies may be found by another search)
+    std::vector<PluginPtr> stillPending;
+    for(Plugin* plugin : plugins)
+    {
+        if(plugin->dependenciesExists != true)
+            stillPending.push_back(pluginsMap.at(plugin->info.name));
+    }
+    stillPending.insert(stillPending.end(), deferred.begin(), deferred.end());
+    pendingPlugins.swap(stillPending);
+
+    return ReturnCode::SUCCESS;
+}
+
+std::unordered_set<const Plugin*> PlugMgrPrivate::rootsClosure() const
+{
+    std::unordered_set<const Plugin*> closure;
+    std::vector<const Plugin*> stack;
+    auto visit = [&](const std::string& name) {
+        const auto it = pluginsMap.find(name);
+        // Missing dependencies are reported by computeLoadOrder()
+        if(it != pluginsMap.end() && closure.insert(it->second.get()).second)
+            stack.push_back(it->second.get());
+    };
+
+    for(const std::string& root : loadRoots)
+        visit(root);
+    if(!mainPluginName.empty())
+        visit(mainPluginName);
+
+    while(!stack.empty())
+    {
+        const Plugin* plugin = stack.back();
+        stack.pop_back();
+        for(const PluginInfoStd::Dependency& dep : plugin->info.dependencies)
+            visit(dep.name);
+    }
+    return closure;
+}
+
+// First step of loadPlugins(): check the dependencies of the plugins found since
+// the last call, and extend the load order
+ReturnCode PlugMgrPrivate::prepareLoad(bool tryToContinue, PluginManager::callback callbackFunc,
+                                       const std::vector<std::string>* roots, size_t* first, bool* execMain)
+{
+    // NOTE: If loadPlugins() was already called, the load order is only extended with
+    // the plugins found since then (and the plugins that could not be loaded yet).
+
+    logger.log(PluginManager::LOG_INFO, "Load plugins ...");
+    loadRequested = true;
+
+    if(roots)
+    {
+        for(const std::string& root : *roots)
+        {
+            if(pluginsMap.count(root) == 0)
+            {
+                if(callbackFunc)
+                    callbackFunc(ReturnCode::LOAD_PLUGIN_NOT_FOUND, strdup(root.c_str()));
+                if(!tryToContinue)
+                    return ReturnCode::LOAD_PLUGIN_NOT_FOUND;
+                continue;
+            }
+            if(std::find(loadRoots.begin(), loadRoots.end(), root) == loadRoots.end())
+                loadRoots.push_back(root);
+        }
+        loadAllPlugins = false;
+    }
+    else
+    {
+        loadRoots.clear();
+        loadAllPlugins = true;
+    }
+
+    // Plugins before this index are already loaded (or can be loaded on demand)
+    *first = loadOrderList.size();
+    // The main plugin function is only called by the call that loads the main plugin
+    *execMain = !mainPluginName.empty() && !pluginsMap.at(mainPluginName)->objectPointer();
+
+    ReturnCode retCode = computeLoadOrder(tryToContinue, callbackFunc);
+    if(!retCode)
+        return retCode;
+
+    if(logger.isEnabled(PluginManager::LOG_DEBUG))
+    {
+        logger.log(PluginManager::LOG_DEBUG, "Load order:");
+        for(size_t i = *first; i < loadOrderList.size(); ++i)
+            logger.log(PluginManager::LOG_DEBUG, " - {}", loadOrderList[i]);
+    }
+
+    {
+        // On-demand loads may be running from other threads
+        std::lock_guard<std::recursive_mutex> lock(lazyMutex);
+        for(size_t i = *first; i < loadOrderList.size(); ++i)
+            pluginsMap.at(loadOrderList[i])->loadable = true;
+    }
+
+    // waitForPlugin() waits for these plugins (with lazy loading, plugins are only
+    // loaded on demand)
+    {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        progressDone = 0;
+        progressTotal = loadOrderList.size() - *first;
+        if(!lazyLoading)
+        {
+            for(size_t i = *first; i < loadOrderList.size(); ++i)
+                pluginsMap.at(loadOrderList[i])->loadScheduled = true;
+        }
     }
 
-    plugin->dependenciesExists = true;
     return ReturnCode::SUCCESS;
 }
 
-void PlugMgrPrivate::loadPluginsInOrder()
+// Second step of loadPlugins(): create the plugins
+void PlugMgrPrivate::runLoad(size_t first, bool execMain, PluginManager::callback callbackFunc)
+{
+    // With lazy loading, only the main plugin and its dependencies are loaded now
+    if(lazyLoading)
+    {
+        lazyCallback = callbackFunc;
+        if(!mainPluginName.empty())
+            loadPluginOnDemand(pluginsMap.at(mainPluginName));
+    }
+    else
+    {
+        std::thread prefetcher;
+        if(prefetchLibraries)
+            prefetcher = startPrefetch(first);
+
+        const Profiler::Clock::time_point start = Profiler::Clock::now();
+        loadPluginsInOrder(first, callbackFunc);
+        updateCriticalChain(first, start);
+
+        if(prefetcher.joinable())
+            prefetcher.join();
+    }
+
+    if(!historyFile.empty() && !loadHistory.save(historyFile))
+        logger.log(PluginManager::LOG_WARNING, "Cannot write the load history to {}", historyFile);
+
+    if(execMain)
+        execMainPlugin();
+}
+
+std::thread PlugMgrPrivate::startPrefetch(size_t first)
+{
+    // Libraries opened by searchForPlugins() are already in the page cache, and
+    // static plugins have no library
+    fsutil::PathList paths;
+    for(size_t i = first; i < loadOrderList.size(); ++i)
+    {
+        const PluginPtr& plugin = pluginsMap.at(loadOrderList[i]);
+        if(!plugin->isStatic && !plugin->lib.isLoaded())
+            paths.push_back(plugin->path);
+    }
+
+    if(paths.empty())
+        return std::thread();
+
+    logger.log(PluginManager::LOG_DEBUG, "Prefetch {} libraries", paths.size());
+    // Requests are sent in load order, so the first libraries are read first
+    return std::thread([](const fsutil::PathList& list) {
+        for(const std::string& path : list)
+            fsutil::prefetchFile(path);
+    }, std::move(paths));
+}
+
+void PlugMgrPrivate::execMainPlugin()
+{
+    const std::shared_ptr<IPlugin> mainPlugin = pluginsMap.at(mainPluginName)->object();
+    if(mainPlugin)
+    {
+        MemoryScope memoryScope(memoryAccounting ? memoryCountersFor(mainPluginName) : nullptr);
+        mainPlugin->mainPluginExec();
+    }
+}
+
+void PlugMgrPrivate::waitAsyncLoad()
+{
+    // A plugin may call the manager from its loaded() function
+    if(asyncLoadThread.joinable() && asyncLoadThread.get_id() != std::this_thread::get_id())
+        asyncLoadThread.join();
+}
+
+bool PlugMgrPrivate::isLoadThread() const
+{
+    return loadingManager == this;
+}
+
+void PlugMgrPrivate::loadScheduledPlugin(const PluginPtr& plugin, PluginManager::callback callbackFunc)
+{
+    // Restored on return (a plugin may load another manager from loaded())
+    const PlugMgrPrivate* const previousManager = loadingManager;
+    loadingManager = this;
+    struct Restore
+    {
+        const PlugMgrPrivate* manager;
+        ~Restore() { loadingManager = manager; }
+    } restore{previousManager};
+
+    // Skip plugins with a dependency that cannot be loaded
+    const bool loaded = dependenciesLoaded(plugin) && loadPlugin(plugin, callbackFunc);
+
+    size_t done;
+    {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        plugin->loadScheduled = false;
+        done = ++progressDone;
+    }
+    progressCond.notify_all();
+
+    if(progressFunc)
+    {
+        // Plugins may be loaded concurrently
+        std::lock_guard<std::mutex> lock(progressCallbackMutex);
+        progressFunc(plugin->info.name, loaded, done, progressTotal);
+    }
+}
+
+void PlugMgrPrivate::loadPluginsInOrder(size_t first, PluginManager::callback callbackFunc)
+{
+    if(effectiveThreadsCount(loadThreadsCount) > 1 && loadOrderList.size() - first > 1)
+    {
+        loadPluginsConcurrently(first, callbackFunc);
+        return;
+    }
+
+    for(size_t i = first; i < loadOrderList.size(); ++i)
+        loadScheduledPlugin(pluginsMap.at(loadOrderList[i]), callbackFunc);
+}
+
+void PlugMgrPrivate::loadPluginsConcurrently(size_t first, PluginManager::callback callbackFunc)
+{
+    const size_t count = loadOrderList.size() - first;
+
+    // Build the list of children of each plugin, and count the dependencies
+    // that are not loaded yet (dependencies before first are already processed)
+    std::vector<PluginPtr*> plugins(count);
+    std::unordered_map<const Plugin*, size_t> ids;
+    ids.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        plugins[i] = &pluginsMap.at(loadOrderList[first + i]);
+        ids[plugins[i]->get()] = i;
+    }
+
+    std::vector<size_t> pendingDeps(count, 0);
+    std::vector<std::vector<size_t>> children(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        for(const Plugin* dep : (*plugins[i])->resolvedDependencies)
+        {
+            const auto it = ids.find(dep);
+            if(it == ids.end())
+                continue;
+            children[it->second].push_back(i);
+            ++pendingDeps[i];
+        }
+    }
+
+    // Duration of the longest chain starting at each plugin, using the durations
+    // of the previous runs (children are always after their dependencies)
+    const int64_t defaultDuration = std::max<int64_t>(loadHistory.averageDuration(), 1);
+    std::vector<int64_t> pathLengths(count);
+    for(size_t i = count; i-- > 0;)
+    {
+        int64_t longestChild = 0;
+        for(size_t child : children[i])
+            longestChild = std::max(longestChild, pathLengths[child]);
+        pathLengths[i] = loadHistory.duration((*plugins[i])->info.name, defaultDuration) + longestChild;
+    }
+    // Plugins with the longest remaining chain are started first (then in load order)
+    auto shorterChain = [&](size_t a, size_t b) {
+        return pathLengths[a] != pathLengths[b] ? pathLengths[a] < pathLengths[b] : a > b;
+    };
+    typedef std::priority_queue<size_t, std::vector<size_t>, decltype(shorterChain)> ReadyQueue;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Plugins that can be loaded now
+    ReadyQueue ready(shorterChain);
+    // Same, but for plugins that are not thread-safe: they are loaded alone,
+    // from the calling thread
+    ReadyQueue readyExclusive(shorterChain);
+    size_t remaining = count;
+    size_t running = 0;
+    bool exclusiveRunning = false;
+
+    auto pushReady = [&](size_t id) {
+        if((*plugins[id])->info.threadSafe)
+            ready.push(id);
+        else
+            readyExclusive.push(id);
+    };
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(pendingDeps[i] == 0)
+            pushReady(i);
+    }
+
+    // Callback functions may be called from several threads, so serialize them
+    std::mutex callbackMutex;
+    PluginManager::callback safeCallback;
+    if(callbackFunc)
+    {
+        safeCallback = [&](const ReturnCode& code, const char* details) {
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            callbackFunc(code, details);
+        };
+    }
+
+    auto worker = [&](bool isCallingThread) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(remaining > 0)
+        {
+            // Exclusive plugins have the priority: no other load is started
+            // while one of them is waiting
+            size_t id;
+            bool exclusive = false;
+            if(isCallingThread && running == 0 && !readyExclusive.empty())
+            {
+                id = readyExclusive.top();
+                readyExclusive.pop();
+                exclusive = true;
+            }
+            else if(!exclusiveRunning && readyExclusive.empty() && !ready.empty())
+            {
+                id = ready.top();
+                ready.pop();
+            }
+            else
+            {
+                cond.wait(lock);
+                continue;
+            }
+
+            ++running;
+            exclusiveRunning = exclusive;
+            lock.unlock();
+
+            loadScheduledPlugin(*plugins[id], safeCallback);
+
+            lock.lock();
+            --running;
+            --remaining;
+            if(exclusive)
+                exclusiveRunning = false;
+            for(size_t child : children[id])
+            {
+                if(--pendingDeps[child] == 0)
+                    pushReady(child);
+            }
+            cond.notify_all();
+        }
+    };
+
+    size_t threadsCount = effectiveThreadsCount(loadThreadsCount);
+    if(threadsCount > count)
+        threadsCount = count;
+
+    // The workers block while they wait for ready plugins, so they don't run on
+    // the executor: a plugin that waits for its own tasks from loaded() would
+    // then run (or wait behind) a blocked worker
+    std::vector<std::thread> threads;
+    threads.reserve(threadsCount - 1);
+    for(size_t i = 1; i < threadsCount; ++i)
+        threads.emplace_back(worker, false);
+    worker(true);
+
+    for(std::thread& thread : threads)
+        thread.join();
+}
+
+void PlugMgrPrivate::updateCriticalChain(size_t first, Profiler::Clock::time_point start)
+{
+    // The plugin that finished last sets the end of the load, and it could only start
+    // once its dependencies were loaded: follow the dependency that finished last,
+    // up to a plugin without dependency loaded by this call
+    auto loadedSinceStart = [&](const Plugin* plugin) {
+        return plugin && plugin->objectPointer() && plugin->loadEnd >= start;
+    };
+    auto finishedLast = [&](const Plugin* plugin, const Plugin* current) {
+        return loadedSinceStart(plugin) && (!current || plugin->loadEnd > current->loadEnd);
+    };
+
+    const Plugin* last = nullptr;
+    for(size_t i = first; i < loadOrderList.size(); ++i)
+    {
+        const Plugin* plugin = pluginsMap.at(loadOrderList[i]).get();
+        if(finishedLast(plugin, last))
+            last = plugin;
+    }
+
+    std::vector<std::string> chain;
+    while(last)
+    {
+        chain.push_back(last->info.name);
+        const Plugin* next = nullptr;
+        for(const Plugin* dep : last->resolvedDependencies)
+        {
+            if(finishedLast(dep, next))
+                next = dep;
+        }
+        last = next;
+    }
+    std::reverse(chain.begin(), chain.end());
+
+    if(!chain.empty() && logger.isEnabled(PluginManager::LOG_DEBUG))
+    {
+        std::string names;
+        for(const std::string& name : chain)
+            names += (names.empty() ? "" : " -> ") + name;
+        logger.log(PluginManager::LOG_DEBUG, "Critical load chain: {}", names);
+    }
+    profiler.setCriticalChain(chain, start);
+}
+
+std::vector<PluginPtr> PlugMgrPrivate::takeDependentPlugins(const PluginPtr& plugin)
 {
-    for(const std::string& name : loadOrderList)
-        loadPlugin(pluginsMap.at(name));
+    std::vector<PluginPtr> plugins;
+    plugins.push_back(plugin);
+
+    const auto it = std::find(loadOrderList.begin(), loadOrderList.end(), plugin->info.name);
+    if(it == loadOrderList.end())
+        return plugins;
+
+    // loadOrderList is sorted, so dependent plugins are always after their
+    // dependencies: a single pass finds all of them
+    std::unordered_set<const Plugin*> removed;
+    removed.insert(plugin.get());
+    auto last = it;
+    for(auto current = it + 1; current != loadOrderList.end(); ++current)
+    {
+        const PluginPtr& other = pluginsMap.at(*current);
+        const bool dependent = std::any_of(other->resolvedDependencies.begin(),
+                                           other->resolvedDependencies.end(),
+                                           [&](const Plugin* dep) { return removed.count(dep) != 0; });
+        if(dependent)
+        {
+            removed.insert(other.get());
+            plugins.push_back(other);
+        }
+        else
+        {
+            *last++ = std::move(*current);
+        }
+    }
+    loadOrderList.erase(last, loadOrderList.end());
+
+    return plugins;
+}
+
+ReturnCode PlugMgrPrivate::reloadPlugin(const PluginPtr& oldPlugin, bool remove, PluginManager::callback callbackFunc)
+{
+    const std::string name = oldPlugin->info.name;
+
+    // No on-demand load can be performed during the reload
+    std::lock_guard<std::recursive_mutex> lock(lazyMutex);
+
+    // First step: unload the plugin and all plugins that depend on it, in the reverse load order
+    std::vector<PluginPtr> plugins = takeDependentPlugins(oldPlugin);
+    std::vector<std::string> wasLoaded;
+    for(auto it = plugins.rbegin(); it != plugins.rend(); ++it)
+    {
+        if((*it)->objectPointer())
+            wasLoaded.push_back((*it)->info.name);
+
+        // unloadPlugin() resets the pointer it receives
+        PluginPtr plugin = *it;
+        if(!unloadPlugin(plugin) && callbackFunc)
+            callbackFunc(ReturnCode::UNLOAD_NOT_ALL, strdup((*it)->path.c_str()));
+        (*it)->loadable = false;
+    }
+
+    // If the old image is still mapped (another handle, a library linked to it or
+    // LOAD_NODELETE), dlopen() would return it again instead of reading the file:
+    // the reload fails and the plugins are created again from the old image
+    bool stillLoaded = false;
+    if(!remove && SharedLibrary::isMapped(oldPlugin->path))
+    {
+        stillLoaded = true;
+        logger.log(PluginManager::LOG_ERROR, "Cannot reload plugin {}: its library is still loaded", name);
+        if(callbackFunc)
+            callbackFunc(ReturnCode::RELOAD_LIBRARY_STILL_LOADED, strdup(oldPlugin->path.c_str()));
+    }
+
+    // Second step: read the library again (a new Plugin object is used, so registry
+    // snapshots held by other threads are never modified)
+    bool valid = stillLoaded;
+    if(!remove && !stillLoaded)
+    {
+        PluginPtr plugin = std::make_shared<Plugin>();
+        plugin->path = oldPlugin->path;
+        DiscoveryCache::Entry entry;
+        probeLibrary(plugin->path, plugin, &entry);
+
+        valid = entry.isPlugin && entry.name == name && !entry.info.name.empty();
+        if(valid)
+        {
+            plugin->setInfo(entry.info, strings);
+            plugin->isMainPlugin = oldPlugin->isMainPlugin;
+            pluginsMap[name] = plugin;
+            plugins.front() = plugin;
+        }
+        else if(callbackFunc)
+        {
+            callbackFunc(ReturnCode::RELOAD_INVALID_LIBRARY, strdup(plugin->path.c_str()));
+        }
+    }
+
+    if(!valid)
+    {
+        pluginsMap.erase(name);
+        plugins.erase(plugins.begin());
+        if(mainPluginName == name)
+            mainPluginName.clear();
+    }
+    publishRegistry();
+
+    // Third step: check the plugins again and load them (the previous load order is
+    // only extended with the plugins that can be loaded)
+    // Only these plugins are checked: the other pending plugins are left untouched,
+    // so the reload never loads a plugin that was not loaded before
+    std::vector<PluginPtr> otherPending;
+    otherPending.reserve(pendingPlugins.size());
+    for(PluginPtr& plugin : pendingPlugins)
+    {
+        if(plugin != oldPlugin)
+            otherPending.push_back(std::move(plugin));
+    }
+    pendingPlugins = plugins;
+
+    const size_t first = loadOrderList.size();
+    ReturnCode retCode = computeLoadOrder(true, callbackFunc);
+    pendingPlugins.insert(pendingPlugins.end(), otherPending.begin(), otherPending.end());
+    for(size_t i = first; i < loadOrderList.size(); ++i)
+        pluginsMap.at(loadOrderList[i])->loadable = true;
+
+    if(lazyLoading)
+    {
+        // Only the plugins that were loaded before are loaded again
+        for(const std::string& loadedName : wasLoaded)
+        {
+            const auto it = pluginsMap.find(loadedName);
+            if(it != pluginsMap.end())
+                loadPluginOnDemand(it->second);
+        }
+    }
+    else
+    {
+        loadPluginsInOrder(first, callbackFunc);
+    }
+
+    if(stillLoaded)
+        return ReturnCode::RELOAD_LIBRARY_STILL_LOADED;
+    if(!valid && !remove)
+        return ReturnCode::RELOAD_INVALID_LIBRARY;
+    return retCode;
 }
 
-void PlugMgrPrivate::loadPlugin(PluginPtr& plugin)
+bool PlugMgrPrivate::dependenciesLoaded(const PluginPtr& plugin)
 {
-    plugin->creator = *(plugin->lib.get<Plugin::iplugin_create_t*>("jp_createPlugin"));
+    const RegistryView plugins(this);
+    for(const PluginInfoStd::Dependency& dep : plugin->info.dependencies)
+    {
+        if(!plugins->at(dep.name)->objectPointer())
+            return false;
+    }
+    return true;
+}
+
+bool PlugMgrPrivate::loadPluginOnDemand(const PluginPtr& plugin)
+{
+    std::lock_guard<std::recursive_mutex> lock(lazyMutex);
+    if(plugin->objectPointer())
+        return true;
+    if(!plugin->loadable)
+        return false;
+
+    // Dependencies are always part of the load order if the plugin is
+    const RegistryView plugins(this);
+    for(const PluginInfoStd::Dependency& dep : plugin->info.dependencies)
+    {
+        if(!loadPluginOnDemand(plugins->at(dep.name)))
+            return false;
+    }
+
+    logger.log(PluginManager::LOG_DEBUG, "Load plugin {} on demand", plugin->info.name);
+    // Don't retry (and report the error again) on the next request
+    if(!loadPlugin(plugin, lazyCallback))
+        plugin->loadable = false;
+    return plugin->loadable;
+}
+
+bool PlugMgrPrivate::openLibrary(const PluginPtr& plugin, PluginManager::callback callbackFunc)
+{
+    // Plugins found in the discovery cache are not loaded yet, and plugins loaded
+    // during the search use the default flags
+    const std::string& name = plugin->info.name;
+    auto flagsIt = pluginLoadFlags.find(name);
+    const int flags = flagsIt != pluginLoadFlags.end() ? flagsIt->second : libraryLoadFlags;
+    if(plugin->lib.isLoaded() && plugin->lib.loadFlags() != flags)
+        plugin->lib.unload();
+
+    void* symbols[PLUGIN_SYMBOLS_COUNT];
+    if(!plugin->lib.isLoaded())
+    {
+        bool loaded;
+        {
+            ProfileScope scope(profiler, name, ProfileEvent::DLOPEN);
+            loaded = plugin->lib.load(plugin->path, flags);
+        }
+
+        // The fingerprint of a cached entry may match a different library (same size
+        // and modification time), so the name is checked once the library is loaded
+        const bool valid = loaded && resolvePluginSymbols(plugin->lib, symbols);
+        if(!valid || name != *static_cast<const char* const*>(symbols[SYMBOL_NAME]))
+        {
+            if(valid)
+                logger.log(PluginManager::LOG_ERROR, "The library {} is not the plugin {} anymore",
+                           plugin->path, name);
+            // The next search probes the library again
+            invalidateCacheEntry(plugin);
+            plugin->lib.unload();
+            if(callbackFunc)
+                callbackFunc(ReturnCode::LOAD_LIBRARY_ERROR, strdup(plugin->path.c_str()));
+            return false;
+        }
+    }
+
+    // Symbols are cached by the library, so this doesn't query the system again
+    ProfileScope scope(profiler, name, ProfileEvent::SYMBOL_LOOKUP);
+    resolvePluginSymbols(plugin->lib, symbols);
+    plugin->creator = *static_cast<Plugin::iplugin_create_t* const*>(symbols[SYMBOL_CREATE]);
+    return true;
+}
+
+void PlugMgrPrivate::invalidateCacheEntry(const PluginPtr& plugin)
+{
+    if(plugin->cacheFile.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    DiscoveryCache cache;
+    if(cache.load(plugin->cacheFile))
+    {
+        cache.remove(plugin->path);
+        if(!cache.save(plugin->cacheFile))
+            logger.log(PluginManager::LOG_WARNING, "Cannot write the discovery cache to {}", plugin->cacheFile);
+    }
+    plugin->cacheFile.clear();
+}
+
+bool PlugMgrPrivate::loadPlugin(const PluginPtr& plugin, PluginManager::callback callbackFunc)
+{
+    // Never create the object twice (the plugin is already loaded if it was
+    // part of a previous loadPlugins() call)
+    if(plugin->objectPointer())
+        return true;
+
+    // Plugins of this manager could not send requests
+    if(!requestContext.isValid())
+    {
+        if(callbackFunc)
+            callbackFunc(ReturnCode::LOAD_TOO_MANY_MANAGERS, strdup(plugin->info.name.c_str()));
+        return false;
+    }
+
+    // Static plugins are linked in the executable, so their creator is already known
+    const std::string& name = plugin->info.name;
+    const Profiler::Clock::time_point loadStart = Profiler::Clock::now();
+    if(!plugin->isStatic && !openLibrary(plugin, callbackFunc))
+        return false;
 
     // Get a list of dependencies names and handle request functions
     const int depNb = plugin->info.dependencies.size();
     IPlugin** depPlugins = (IPlugin**)malloc(sizeof(IPlugin*)*depNb);
 
     // Dependencies are already loaded, so it's safe to get the plugin object
+    const RegistryView plugins(this);
     for(int i=0; i < depNb; ++i)
-        depPlugins[i] = pluginsMap[plugin->info.dependencies[i].name]->iplugin.get();
+        depPlugins[i] = plugins->at(plugin->info.dependencies[i].name)->objectPointer();
+
+    // Memory allocated by the creator and loaded() is attributed to the plugin
+    MemoryCounters* memory = memoryAccounting ? memoryCountersFor(name) : nullptr;
+    if(memory)
+        memory->librarySize.store(memutil::mappedSize(plugin->lib), std::memory_order_relaxed);
+    MemoryDelta memoryDelta(memory);
+    MemoryScope memoryScope(memory);
+
+    IPlugin* object;
+    {
+        ProfileScope scope(profiler, name, ProfileEvent::CREATOR_CALL);
+        object = plugin->creator(requestContext.requestFunction(),
+                                 requestContext.nonDepPluginFunction(),
+                                 depPlugins,
+                                 depNb,
+                                 plugin->isMainPlugin);
+    }
+    // Given after the creation, so the constructors don't send any request
+    // (the plugin is not visible to other plugins yet)
+    object->_requestMetrics = &requestMetrics;
+    plugin->setObject(std::shared_ptr<IPlugin>(object));
+
+    {
+        ProfileScope scope(profiler, name, ProfileEvent::LOADED_CALL);
+        object->loaded();
+    }
 
-    plugin->iplugin.reset(plugin->creator(PlugMgrPrivate::handleRequest,
-                                          PlugMgrPrivate::getNonDepPlugin,
-                                          depPlugins,
-                                          depNb,
-                                          plugin->isMainPlugin));
-    plugin->iplugin->loaded();
+    // The next loads are scheduled with this duration
+    plugin->loadEnd = Profiler::Clock::now();
+    loadHistory.record(name, std::chrono::duration_cast<std::chrono::nanoseconds>(plugin->loadEnd - loadStart).count());
+    return true;
 }
 
 bool PlugMgrPrivate::unloadPluginsInOrder()
@@ -148,21 +1218,270 @@ bool PlugMgrPrivate::unloadPluginsInOrder()
     for(auto it = loadOrderList.rbegin();
         it != loadOrderList.rend(); ++it)
     {
-        if(!unloadPlugin(pluginsMap[*it]))
+        auto pluginIt = pluginsMap.find(*it);
+        if(pluginIt == pluginsMap.end())
+            continue;
+        if(!unloadPlugin(pluginIt->second))
+            allUnloaded = false;
+        pluginsMap.erase(pluginIt);
+    }
+
+    if(!clearPlugins())
+        allUnloaded = false;
+    return allUnloaded;
+}
+
+ReturnCode PlugMgrPrivate::unloadPluginsConcurrently(unsigned int threadsCount, unsigned int pluginTimeout,
+                                                     unsigned int totalTimeout, PluginManager::callback callbackFunc)
+{
+    typedef Profiler::Clock Clock;
+    const Clock::time_point totalDeadline = profiler.now() + std::chrono::milliseconds(totalTimeout);
+    const std::chrono::milliseconds pluginDuration(pluginTimeout);
+    threadsCount = effectiveThreadsCount(threadsCount);
+
+    const size_t count = loadOrderList.size();
+    std::vector<PluginPtr> plugins;
+    plugins.reserve(count);
+    std::unordered_map<const Plugin*, size_t> ids;
+    ids.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        plugins.push_back(pluginsMap.at(loadOrderList[i]));
+        ids[plugins[i].get()] = i;
+    }
+
+    // Level 0 contains the plugins without dependent plugins, level N the plugins
+    // whose dependent plugins are all in the levels before N.
+    // loadOrderList is sorted, so the level of a plugin is known once all plugins
+    // after it are visited.
+    std::vector<size_t> levels(count, 0);
+    std::vector<std::vector<size_t>> levelPlugins;
+    for(size_t i = count; i-- > 0;)
+    {
+        for(const Plugin* dep : plugins[i]->resolvedDependencies)
+        {
+            const auto it = ids.find(dep);
+            if(it != ids.end() && levels[it->second] < levels[i] + 1)
+                levels[it->second] = levels[i] + 1;
+        }
+        if(levels[i] >= levelPlugins.size())
+            levelPlugins.resize(levels[i] + 1);
+        levelPlugins[levels[i]].push_back(i);
+    }
+
+    // aboutToBeUnloaded() is called from detached threads, which may outlive the
+    // manager if they are stuck. The threads only share this state with the manager,
+    // but a leaked plugin may still use what the manager gave it: its requests
+    // fail once the manager is deleted (the request slot is retained until its
+    // thread exits), but the message bus, the executor and the request recorder
+    // must not be used anymore.
+    struct SharedState
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<Clock::time_point> endTimes;
+        std::vector<bool> done;
+        // Request slot retained for the threads of leaked plugins (MAX_CONTEXTS if not)
+        std::vector<size_t> retainedSlots;
+    };
+    std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+    state->endTimes.resize(count);
+    state->done.assign(count, false);
+    state->retainedSlots.assign(count, RequestContext::MAX_CONTEXTS);
+    // Plugins whose aboutToBeUnloaded() function was started on a thread
+    std::vector<bool> started(count, false);
+
+    bool allUnloaded = true;
+    bool timedOut = false;
+    // A plugin is leaked if its code may still be running, and its dependencies
+    // are leaked with it
+    std::vector<bool> leaked(count, false);
+    auto leak = [&](size_t id) {
+        leaked[id] = true;
+        for(const Plugin* dep : plugins[id]->resolvedDependencies)
+        {
+            const auto it = ids.find(dep);
+            if(it != ids.end())
+                leaked[it->second] = true;
+        }
+        leakPlugin(plugins[id]);
+        if(started[id])
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if(!state->done[id])
+                state->retainedSlots[id] = requestContext.retainForThread();
+        }
+        timedOut = true;
+        logger.log(PluginManager::LOG_WARNING, "Plugin {} exceeded the unload deadline (leaked)", plugins[id]->info.name);
+        if(callbackFunc)
+            callbackFunc(ReturnCode::UNLOAD_TIMEOUT, strdup(plugins[id]->info.name.c_str()));
+    };
+    auto finish = [&](size_t id, Clock::time_point start) {
+        const PluginPtr& plugin = plugins[id];
+        profiler.record(plugin->info.name, ProfileEvent::UNLOADING_CALL, start, state->endTimes[id]);
+        plugin->setObject(nullptr);
+        releasePluginResources(*plugin);
+        if(plugin->lib.isLoaded())
+        {
+            ProfileScope scope(profiler, plugin->info.name, ProfileEvent::DLCLOSE);
+            plugin->lib.unload();
+        }
+        if(plugin->lib.isLoaded())
             allUnloaded = false;
-        pluginsMap.erase(*it);
+    };
+
+    for(const std::vector<size_t>& level : levelPlugins)
+    {
+        // Plugins running aboutToBeUnloaded(), with their start time
+        std::vector<std::pair<size_t, Clock::time_point>> running;
+        size_t next = 0;
+        while(next < level.size() || !running.empty())
+        {
+            // Start the next plugins of the level
+            while(next < level.size() && running.size() < threadsCount
+                  && (totalTimeout == 0 || profiler.now() < totalDeadline))
+            {
+                const size_t id = level[next];
+                const PluginPtr& plugin = plugins[id];
+                // Plugins that are not thread-safe are unloaded alone, once the
+                // running plugins are done
+                const bool exclusive = plugin->iplugin && !plugin->info.threadSafe;
+                if(exclusive && !running.empty() && !leaked[id])
+                    break;
+                ++next;
+
+                if(leaked[id])
+                {
+                    leak(id);
+                    continue;
+                }
+                MemoryCounters* memory = memoryAccounting ? memoryCountersFor(plugin->info.name) : nullptr;
+                if(!plugin->iplugin || exclusive)
+                {
+                    // From the calling thread, so without deadline
+                    const Clock::time_point start = profiler.now();
+                    if(exclusive)
+                    {
+                        MemoryScope memoryScope(memory);
+                        plugin->iplugin->aboutToBeUnloaded();
+                    }
+                    state->endTimes[id] = profiler.now();
+                    finish(id, start);
+                    continue;
+                }
+
+                running.push_back(std::make_pair(id, profiler.now()));
+                started[id] = true;
+                std::thread([state, plugin, id, memory]() {
+                    {
+                        MemoryScope memoryScope(memory);
+                        plugin->iplugin->aboutToBeUnloaded();
+                    }
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->endTimes[id] = Clock::now();
+                    state->done[id] = true;
+                    // The manager may be deleted already if the plugin was leaked
+                    RequestContext::releaseThread(state->retainedSlots[id]);
+                    state->cond.notify_all();
+                }).detach();
+            }
+
+            if(totalTimeout != 0 && profiler.now() >= totalDeadline)
+            {
+                // Nothing else can be unloaded
+                for(const auto& val : running)
+                    leak(val.first);
+                running.clear();
+                for(; next < level.size(); ++next)
+                    leak(level[next]);
+                break;
+            }
+            if(running.empty())
+                continue;
+
+            // Wait for the end of a plugin, or for the next deadline
+            Clock::time_point deadline = totalTimeout == 0 ? Clock::time_point::max() : totalDeadline;
+            if(pluginTimeout != 0)
+            {
+                for(const auto& val : running)
+                    deadline = std::min(deadline, val.second + pluginDuration);
+            }
+            std::vector<size_t> finished;
+            {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                auto anyDone = [&]() {
+                    for(const auto& val : running)
+                    {
+                        if(state->done[val.first])
+                            return true;
+                    }
+                    return false;
+                };
+                if(deadline == Clock::time_point::max())
+                    state->cond.wait(lock, anyDone);
+                else
+                    state->cond.wait_until(lock, deadline, anyDone);
+
+                for(const auto& val : running)
+                {
+                    if(state->done[val.first])
+                        finished.push_back(val.first);
+                }
+            }
+
+            const Clock::time_point now = profiler.now();
+            for(auto it = running.begin(); it != running.end();)
+            {
+                if(std::find(finished.begin(), finished.end(), it->first) != finished.end())
+                    finish(it->first, it->second);
+                else if(pluginTimeout != 0 && now >= it->second + pluginDuration)
+                    leak(it->first);
+                else
+                {
+                    ++it;
+                    continue;
+                }
+                it = running.erase(it);
+            }
+        }
     }
 
+    for(const PluginPtr& plugin : plugins)
+        pluginsMap.erase(plugin->info.name);
+    plugins.clear();
+
+    if(!clearPlugins())
+        allUnloaded = false;
+
+    if(timedOut)
+        return ReturnCode::UNLOAD_TIMEOUT;
+    return allUnloaded ? ReturnCode::SUCCESS : ReturnCode::UNLOAD_NOT_ALL;
+}
+
+bool PlugMgrPrivate::clearPlugins()
+{
+    loadOrderList.clear();
+    pendingPlugins.clear();
+
     // Remove remaining plugins (if they are not in the loading list)
-    while(!pluginsMap.empty())
+    bool allUnloaded = true;
+    for(auto& val : pluginsMap)
     {
-        if(!unloadPlugin(pluginsMap.begin()->second))
+        if(!unloadPlugin(val.second))
             allUnloaded = false;
-        pluginsMap.erase(pluginsMap.begin());
     }
+    pluginsMap.clear();
+
+    publishRegistry();
 
-    // Clear the locations list
+    // Clear the locations list and the main plugin (it can be registered again
+    // after the next search)
     locations.clear();
+    watcher.clear();
+    mainPluginName.clear();
+    loadRequested = false;
+    loadAllPlugins = true;
+    loadRoots.clear();
 
     return allUnloaded;
 }
@@ -170,84 +1489,290 @@ bool PlugMgrPrivate::unloadPluginsInOrder()
 // Return true if the plugin is successfully unloaded
 bool PlugMgrPrivate::unloadPlugin(PluginPtr& plugin)
 {
+    const std::string& name = plugin->info.name.empty() ? plugin->path : plugin->info.name;
     if(plugin->iplugin)
     {
+        MemoryScope memoryScope(memoryAccounting ? memoryCountersFor(name) : nullptr);
+        ProfileScope scope(profiler, name, ProfileEvent::UNLOADING_CALL);
         plugin->iplugin->aboutToBeUnloaded();
-        plugin->iplugin.reset();
+        plugin->setObject(nullptr);
+    }
+    releasePluginResources(*plugin);
+    if(plugin->lib.isLoaded())
+    {
+        ProfileScope scope(profiler, name, ProfileEvent::DLCLOSE);
+        plugin->lib.unload();
     }
-    plugin->lib.unload();
     const bool isLoaded = plugin->lib.isLoaded();
     plugin.reset();
 
     return !isLoaded;
 }
 
+MemoryCounters* PlugMgrPrivate::memoryCountersFor(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    MemoryCounters*& counters = memoryCounters[name];
+    if(!counters)
+        counters = new MemoryCounters();
+    return counters;
+}
+
+void PlugMgrPrivate::releasePluginResources(const Plugin& plugin)
+{
+    services.removeAll(plugin.info.name);
+    // Handlers and release functions of the plugin must not run once its library is closed
+    messageBus.removeSubscriptions(plugin.info.name);
+    messageBus.flush();
+}
+
 // Static
-uint16_t PlugMgrPrivate::handleRequest(const char *sender,
+const std::string& PlugMgrPrivate::cachedAppDir()
+{
+    // The executable cannot move, so the path is only computed once
+    static const std::string appDir = fsutil::appDir();
+    return appDir;
+}
+
+// Static
+// Return the string str as requested by flags (see IPlugin::ManagerRequestFlag)
+uint16_t PlugMgrPrivate::returnString(const char* str, size_t length, uint16_t flags, void** data, uint32_t* dataSize)
+{
+    if(flags == IPlugin::CALLER_BUFFER)
+    {
+        if(*dataSize < length + 1)
+        {
+            *dataSize = length + 1;
+            return IPlugin::BUFFER_TOO_SMALL;
+        }
+        memcpy(*data, str, length + 1);
+    }
+    else if(flags == IPlugin::MANAGER_OWNED)
+    {
+        *data = (void*)str;
+    }
+    else
+    {
+        *data = (void*)strdup(str);
+    }
+
+    *dataSize = length;
+    return IPlugin::SUCCESS;
+}
+
+// Static
+// Name of the plugin targeted by a GET_PLUGININFO, GET_PLUGINVERSION or GET_PLUGINMEMORY request
+const char* PlugMgrPrivate::requestedPlugin(const char* sender, uint16_t flags, void** data)
+{
+    // With CALLER_BUFFER, the name is stored inside the buffer (an empty name means the sender)
+    const char* name = (const char*)*data;
+    if(!name || (flags == IPlugin::CALLER_BUFFER && name[0] == '\0'))
+        return sender;
+    return name;
+}
+
+// Static
+uint16_t PlugMgrPrivate::handleRequest(PlugMgrPrivate* _p,
+                                       const char *sender,
                                        uint16_t code,
                                        void **data,
                                        uint32_t *dataSize)
 {
-    PlugMgrPrivate *_p = PluginManager::instance()._p;
+    if(!_p->requestMetrics.active())
+        return processRequest(_p, sender, code, data, dataSize);
 
-    if(_p->useLog)
-        _p->log.get() << "Request from " << sender << " !" << std::endl;
+    const Profiler::Clock::time_point start = Profiler::Clock::now();
+    const uint16_t returnCode = processRequest(_p, sender, code, data, dataSize);
+    const int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Profiler::Clock::now() - start).count();
+    _p->requestMetrics.record(sender, nullptr, code & ~(IPlugin::CALLER_BUFFER | IPlugin::MANAGER_OWNED),
+                              returnCode, duration);
+    return returnCode;
+}
+
+// Static
+uint16_t PlugMgrPrivate::processRequest(PlugMgrPrivate* _p,
+                                        const char *sender,
+                                        uint16_t code,
+                                        void **data,
+                                        uint32_t *dataSize)
+{
+    // Lookups of the objects owned by the manager are sent by the IPlugin helpers
+    // (like messageBus() or executor()), so they are not logged
+    const uint16_t requestCode = code & ~(IPlugin::CALLER_BUFFER | IPlugin::MANAGER_OWNED);
+    if(requestCode != IPlugin::GET_MESSAGEBUS && requestCode != IPlugin::GET_REQUESTMETRICS
+       && requestCode != IPlugin::GET_EXECUTOR)
+    {
+        _p->logger.log(PluginManager::LOG_DEBUG, "Request from {} !", sender);
+    }
 
     // All requests to the manager sent or receive data, so check here if dataSize is null
     if(!dataSize)
         return IPlugin::DATASIZE_NULL;
 
+    const uint16_t flags = code & (IPlugin::CALLER_BUFFER | IPlugin::MANAGER_OWNED);
+    if(flags == (IPlugin::CALLER_BUFFER | IPlugin::MANAGER_OWNED))
+        return IPlugin::UNSUPPORTED_FLAG;
+    code &= ~flags;
+
     switch(code)
     {
     case IPlugin::GET_APPDIRECTORY:
+        return returnString(cachedAppDir().c_str(), cachedAppDir().size(), flags, data, dataSize);
+    case IPlugin::GET_PLUGINAPI:
+        return returnString(JP_PLUGIN_API, strlen(JP_PLUGIN_API), flags, data, dataSize);
+    case IPlugin::GET_PLUGINSCOUNT:
     {
-        *data = (void*)strdup(PluginManager::appDirectory().c_str());
-        *dataSize = strlen((char*)*data);
+        // The count can change at any time
+        if(flags == IPlugin::MANAGER_OWNED)
+            return IPlugin::UNSUPPORTED_FLAG;
+
+        const size_t count = RegistryView(_p)->size();
+        if(flags == IPlugin::CALLER_BUFFER)
+        {
+            if(*dataSize < sizeof(size_t))
+            {
+                *dataSize = sizeof(size_t);
+                return IPlugin::BUFFER_TOO_SMALL;
+            }
+            memcpy(*data, &count, sizeof(size_t));
+        }
+        else
+        {
+            *data = (void*)(new size_t(count));
+        }
+        *dataSize = sizeof(size_t);
         break;
     }
-    case IPlugin::GET_PLUGINAPI:
+    case IPlugin::GET_PLUGININFO:
     {
-        *data = (void*)strdup(PluginManager::pluginApi().c_str());
-        *dataSize = strlen((char*)*data);
+        const PluginPtr plugin = _p->findPlugin(requestedPlugin(sender, flags, data));
+        if(!plugin)
+            return IPlugin::NOT_FOUND;
+
+        if(flags == IPlugin::CALLER_BUFFER)
+        {
+            const size_t required = plugin->info.copyTo(*data, *dataSize);
+            const bool tooSmall = *dataSize < required;
+            *dataSize = required;
+            if(tooSmall)
+                return IPlugin::BUFFER_TOO_SMALL;
+        }
+        else if(flags == IPlugin::MANAGER_OWNED)
+        {
+            *data = (void*)(&plugin->infoView);
+            *dataSize = 1;
+        }
+        else
+        {
+            *data = (void*)(new PluginInfo(plugin->info.toPluginInfo()));
+            *dataSize = 1;
+        }
         break;
     }
-    case IPlugin::GET_PLUGINSCOUNT:
+    case IPlugin::GET_PLUGINVERSION:
+    {
+        const PluginPtr plugin = _p->findPlugin(requestedPlugin(sender, flags, data));
+        if(!plugin)
+            return IPlugin::NOT_FOUND;
+
+        const std::string& version = plugin->info.version;
+        return returnString(version.c_str(), version.size(), flags, data, dataSize);
+    }
+    case IPlugin::GET_PLUGINMEMORY:
     {
-        *data = (void*)(new size_t(PluginManager::instance().pluginsCount()));
+        // The counters change at any time
+        if(flags == IPlugin::MANAGER_OWNED)
+            return IPlugin::UNSUPPORTED_FLAG;
+
+        const PluginPtr plugin = _p->findPlugin(requestedPlugin(sender, flags, data));
+        if(!plugin)
+            return IPlugin::NOT_FOUND;
+
+        const PluginMemory memory = _p->pluginManager->pluginMemory(plugin->info.name);
+        if(flags == IPlugin::CALLER_BUFFER)
+        {
+            if(*dataSize < sizeof(PluginMemory))
+            {
+                *dataSize = sizeof(PluginMemory);
+                return IPlugin::BUFFER_TOO_SMALL;
+            }
+            memcpy(*data, &memory, sizeof(PluginMemory));
+            *dataSize = sizeof(PluginMemory);
+        }
+        else
+        {
+            *data = (void*)(new PluginMemory(memory));
+            *dataSize = 1;
+        }
+        break;
+    }
+    case IPlugin::GET_MESSAGEBUS:
+    {
+        if(flags == IPlugin::CALLER_BUFFER)
+            return IPlugin::UNSUPPORTED_FLAG;
+
+        // Each plugin uses its own client, so its subscriptions are removed on unload
+        *data = (void*)_p->messageBus.client(sender);
         *dataSize = 1;
         break;
     }
-    case IPlugin::GET_PLUGININFO:
+    case IPlugin::GET_REQUESTMETRICS:
     {
-        PluginInfo info = PluginManager::instance().pluginInfo(*data ? (const char*)*data : sender);
-        if(!info.name)
-            return IPlugin::NOT_FOUND;
+        if(flags == IPlugin::CALLER_BUFFER)
+            return IPlugin::UNSUPPORTED_FLAG;
 
-        *data = (void*)(new PluginInfo(info));
+        *data = (void*)static_cast<jp::IRequestMetrics*>(&_p->requestMetrics);
         *dataSize = 1;
         break;
     }
-    case IPlugin::GET_PLUGINVERSION:
+    case IPlugin::GET_EXECUTOR:
     {
-        PluginInfo info = PluginManager::instance().pluginInfo(*data ? (const char*)*data : sender);
-        if(!info.name)
-            return IPlugin::NOT_FOUND;
+        if(flags == IPlugin::CALLER_BUFFER)
+            return IPlugin::UNSUPPORTED_FLAG;
 
-        *data = (void*)strdup(info.version);
-        *dataSize = strlen((char*)*data);
-        info.free();
+        *data = (void*)static_cast<jp::IExecutor*>(&_p->executor);
+        *dataSize = 1;
+        break;
+    }
+    case IPlugin::PUBLISH_SERVICE:
+    case IPlugin::UNPUBLISH_SERVICE:
+    case IPlugin::GET_SERVICE:
+    {
+        if(flags != 0)
+            return IPlugin::UNSUPPORTED_FLAG;
+        ServiceRequest* request = (ServiceRequest*)*data;
+        if(!request)
+            return IPlugin::COMMON_ERROR;
+
+        if(code == IPlugin::PUBLISH_SERVICE)
+        {
+            if(!_p->services.add(request->id, request->name, request->service, sender))
+                return IPlugin::ALREADY_EXISTS;
+        }
+        else if(code == IPlugin::UNPUBLISH_SERVICE)
+        {
+            if(!_p->services.remove(request->id, sender))
+                return IPlugin::NOT_FOUND;
+        }
+        else
+        {
+            request->service = _p->services.find(request->id, request->name);
+            if(!request->service)
+                return IPlugin::NOT_FOUND;
+        }
         break;
     }
     case IPlugin::CHECK_PLUGIN:
     {
-        if(PluginManager::instance().hasPlugin((const char*)*data))
+        if(_p->pluginManager->hasPlugin((const char*)*data))
             return IPlugin::RESULT_TRUE;
         return IPlugin::RESULT_FALSE;
         break;
     }
     case IPlugin::CHECK_PLUGINLOADED:
     {
-        if(PluginManager::instance().isPluginLoaded((const char*)*data))
+        if(_p->pluginManager->isPluginLoaded((const char*)*data))
             return IPlugin::RESULT_TRUE;
         return IPlugin::RESULT_FALSE;
         break;
@@ -261,18 +1786,21 @@ uint16_t PlugMgrPrivate::handleRequest(const char *sender,
 }
 
 // Static
-IPlugin* PlugMgrPrivate::getNonDepPlugin(const char* sender, const char* pluginName)
+IPlugin* PlugMgrPrivate::getNonDepPlugin(PlugMgrPrivate* _p, const char* sender, const char* pluginName)
 {
-    PlugMgrPrivate *_p = PluginManager::instance()._p;
+    const RegistryView plugins(_p);
+    const Plugin* senderPlugin = plugins.find(sender);
+    if(!senderPlugin || !senderPlugin->isMainPlugin)
+        return nullptr;
 
-    if(_p->pluginsMap[std::string(sender)]->isMainPlugin)
-    {
-        if(_p->useLog)
-            _p->log.get() << "Get plugin object of " << pluginName << " plugin (request from the main plugin)" << std::endl;
+    _p->logger.log(PluginManager::LOG_DEBUG, "Get plugin object of {} plugin (request from the main plugin)", pluginName);
 
-        if(_p->pluginManager->isPluginLoaded(pluginName))
-            return _p->pluginsMap[std::string(pluginName)]->iplugin.get();
-    }
+    const auto it = plugins->find(pluginName);
+    if(it == plugins->end())
+        return nullptr;
 
-    return nullptr;
+    // The plugin is loaded here if lazy loading is enabled
+    if(_p->lazyLoading)
+        _p->loadPluginOnDemand(it->second);
+    return it->second->objectPointer();
 }
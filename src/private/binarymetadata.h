@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BINARYMETADATA_H
+#define BINARYMETADATA_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <cstddef> // for size_t
+
+#include "plugin.h"
+
+namespace jp_private
+{
+
+// Binary metadata, exported as jp_metadata_bin by plugins built with
+// EmbedMetadata.cmake (CMake >= 3.19), next to the JSON metadata.
+//
+// All integers are unsigned little-endian, offsets are relative to the start
+// of the data and point to NUL-terminated strings of the string table:
+//
+//   0  char[4]   magic "JPMB"
+//   4  uint16    format version (1)
+//   6  uint16    flags (bit 0: the plugin is not thread-safe)
+//   8  uint32    total size of the data
+//   12 uint32[8] offsets of api, name, prettyName, version, author, url,
+//                license and copyright
+//   44 uint32    number of dependencies
+//   48 uint32[2] offsets of the name and version of each dependency
+//   .. string table
+//
+// Keep in sync with BINARY_METADATA in include/EmbedMetadata.cmake
+
+// Max size of the data, used when the symbol size is not known
+const size_t BINARY_METADATA_UNKNOWN_SIZE = static_cast<size_t>(-1);
+
+// Read the binary metadata of size bytes (or BINARY_METADATA_UNKNOWN_SIZE to
+// trust the size stored in the data).
+// Return an invalid PluginInfoStd (with an empty name) if the data are not
+// valid or if the plugin API is not compatible
+PluginInfoStd parseBinaryMetadata(const char* data, size_t size);
+
+} // namespace jp_private
+
+#endif // BINARYMETADATA_H
@@ -0,0 +1,165 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <vector> // for std::vector
+#include <set> // for std::set
+#include <unordered_map> // for std::unordered_map
+#include <functional> // for std::function
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <thread> // for std::thread
+#include <cstdint> // for intN_t types
+
+#include "confinfo.h"
+
+#include "fsutil.h"
+
+namespace jp_private
+{
+
+// Watch directories (and their sub-directories, up to the depth of the search that
+// found them) for added, modified and removed libraries, from a background thread.
+// On Linux, inotify is used: each directory is watched, and only the libraries that
+// changed are reported, without listing the directories (except the sub-directories
+// created or moved inside a watched one). The libraries of a directory moved out are
+// reported as removed. If the event queue overflows, the locations are listed again
+// and compared to the known libraries. On other platforms, the directories are
+// listed every pollInterval milliseconds and the fingerprint of each library is compared.
+// Changes are coalesced: each path is only reported once per batch, whatever the
+// number of events received for it, and the notify function is called once the
+// directories are quiet for a short time.
+class DirectoryWatcher
+{
+public:
+    typedef std::function<void()> NotifyFunction;
+
+    DirectoryWatcher() {}
+    ~DirectoryWatcher();
+
+    // Non-copyable
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    const DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Start the watcher thread
+    // notify (may be empty) is called from this thread each time a new batch is available
+    // Return false if the watcher cannot be started
+    bool start(unsigned int pollInterval, const NotifyFunction& notify);
+    void stop();
+    bool isRunning() const { return _thread.joinable(); }
+
+    // Add dir to the watched directories (can be called while the watcher is running)
+    // Only the files and sub-directories kept by the filters and the depth of options
+    // are watched (the executor of options is never used). If dir is already
+    // watched, its options are replaced.
+    void addDirectory(const std::string& dir, const fsutil::ScanOptions& options);
+    // Stop watching all directories
+    void clear();
+
+    // Return the libraries added, modified or removed since the last call
+    // (sorted, without duplicates)
+    std::vector<std::string> takeChanges();
+    bool hasChanges() const;
+
+private:
+    struct Location
+    {
+        std::string dir;
+        fsutil::ScanOptions options;
+    };
+
+    struct Fingerprint
+    {
+        uint64_t size;
+        int64_t mtime;
+    };
+    typedef std::unordered_map<std::string, Fingerprint> Fingerprints;
+
+    void run();
+    // Must be called with _mutex locked
+    void watchDirectory(size_t location);
+    // Must be called with _mutex locked
+    // Report the libraries added, modified or removed between previous and current
+    // Return true if a change was found
+    bool reportDifferences(const Fingerprints& previous, const Fingerprints& current);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    std::thread _thread;
+    bool _stopRequested = false;
+
+    std::vector<Location> _locations;
+    std::set<std::string> _changes;
+
+    NotifyFunction _notify;
+    unsigned int _pollInterval = 1000;
+
+    // Known libraries of each location (directory -> path -> fingerprint)
+    std::unordered_map<std::string, Fingerprints> _fingerprints;
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+    int _inotifyFd = -1;
+    // Used to wake up the thread when stop() is called
+    int _wakeupPipe[2] = {-1, -1};
+    struct Watch
+    {
+        std::string dir;
+        // Index in _locations, and depth of dir inside the location
+        size_t location;
+        int depth;
+    };
+    // Watch descriptor -> directory
+    std::unordered_map<int, Watch> _watches;
+    // Must be called with _mutex locked
+    // Watch dir and the sub-directories allowed by the options of the location
+    // The libraries inside are added to the known libraries of the location. If
+    // reportLibraries is true, they are also reported (for a directory created or moved
+    // inside a watched directory); return true if one is found
+    bool watchTree(const std::string& dir, size_t location, int depth, bool reportLibraries);
+    // Must be called with _mutex locked
+    // Stop watching dir and its sub-directories (moved out of a watched directory),
+    // and report the libraries that were inside as removed; return true if one is found
+    bool unwatchTree(const std::string& dir, size_t location);
+    // Must be called with _mutex locked
+    // Watch all locations again (after an overflow of the event queue, events were lost)
+    // Return true if a change was found
+    bool rewatchAll();
+#else
+    // Must be called with _mutex locked
+    // Return true if a change was found
+    bool scanDirectory(const Location& location, bool reportChanges);
+#endif
+};
+
+} // namespace jp_private
+
+#endif // DIRECTORYWATCHER_H
@@ -0,0 +1,88 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DISCOVERYCACHE_H
+#define DISCOVERYCACHE_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <unordered_map> // for std::unordered_map
+#include <cstdint> // for intN_t types
+
+#include "plugin.h"
+#include "fsutil.h"
+
+namespace jp_private
+{
+
+// On-disk cache of the results of PluginManager::searchForPlugins()
+// Each library is identified by its path, and the entry is only valid while
+// the size and the modification time of the file are the same.
+class DiscoveryCache
+{
+public:
+
+    struct Entry
+    {
+        // Fingerprint of the library file
+        uint64_t size = 0;
+        int64_t mtime = 0;
+
+        // true if the library exports jp_name, jp_metadata and jp_createPlugin
+        bool isPlugin = false;
+
+        // Only meaningful if isPlugin is true
+        // info.name is empty if the metadata cannot be parsed
+        std::string name;
+        PluginInfoStd info;
+    };
+
+    // Read the cache file. Return false if the file doesn't exist or is invalid
+    // (in this case, the cache is simply empty)
+    bool load(const std::string& filePath);
+    // Write the cache file (only if something changed since load())
+    bool save(const std::string& filePath);
+
+    // Returns the entry for libPath if its fingerprint still match, nullptr otherwise
+    const Entry* find(const std::string& libPath, uint64_t size, int64_t mtime) const;
+    void insert(const std::string& libPath, const Entry& entry);
+    // Remove the entry of libPath (if it exists)
+    void remove(const std::string& libPath);
+
+    // Remove entries that are inside dir (or its sub-dirs if recursive)
+    // but not part of libList anymore
+    void removeMissing(const std::string& dir, bool recursive, const fsutil::PathList& libList);
+
+private:
+    std::unordered_map<std::string, Entry> _entries;
+    bool _modified = false;
+};
+
+} // namespace jp_private
+
+#endif // DISCOVERYCACHE_H
@@ -0,0 +1,158 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef EXECUTORPRIVATE_H
+#define EXECUTORPRIVATE_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <vector> // for std::vector
+#include <deque> // for std::deque
+#include <memory> // for std::unique_ptr
+#include <atomic> // for std::atomic
+#include <mutex> // for std::mutex and std::once_flag
+#include <condition_variable> // for std::condition_variable
+#include <thread> // for std::thread
+#include <functional> // for std::function
+
+#include "executor.h"
+
+namespace jp
+{
+
+// Definition of the opaque type of the public API
+struct TaskGroup
+{
+    struct Continuation
+    {
+        TaskFunction func;
+        void* context;
+        TaskGroup* next;
+    };
+
+    // Tasks submitted and not done yet
+    std::atomic<size_t> pending{0};
+    // One for the owner (until releaseGroup()), plus one per pending task
+    std::atomic<size_t> refs{1};
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<Continuation> continuations;
+};
+
+} // namespace jp
+
+namespace jp_private
+{
+
+// Work-stealing executor shared by the plugins and the manager.
+// Each worker has its own deque: it pushes and pops its tasks at the back, and
+// steals the front of the other deques when its own is empty. Tasks submitted
+// from other threads go to a shared injection queue. Idle workers sleep until a
+// task is queued. Threads are only started by the first submitted task.
+class Executor : public jp::IExecutor
+{
+public:
+    Executor();
+    ~Executor();
+
+    // Non-copyable
+    Executor(const Executor&) = delete;
+    const Executor& operator=(const Executor&) = delete;
+
+    // Must be called before the first task is submitted (ignored otherwise)
+    // threadsCount is 0 for all hardware threads (the default)
+    void setThreadsCount(unsigned int threadsCount);
+    // Pin each worker to one of the CPUs the process may run on
+    void setPinning(bool enabled);
+    // Return false once the threads are started
+    bool configurable() const;
+
+    void submit(jp::TaskFunction func, void* context, jp::TaskGroup* group) override;
+    jp::TaskGroup* createGroup() override;
+    void then(jp::TaskGroup* group, jp::TaskFunction func, void* context, jp::TaskGroup* next) override;
+    void wait(jp::TaskGroup* group) override;
+    void releaseGroup(jp::TaskGroup* group) override;
+    unsigned int threadsCount() const override;
+
+    // Call func(i) for each i in [0, count) using at most threadsCount threads (the
+    // calling thread is one of them, 0 means as many as the pool)
+    // func(0) is always called first from the calling thread, other indices are
+    // distributed dynamically, so their calling order is unspecified.
+    // Returns once every call is done.
+    void parallelFor(size_t count, unsigned int threadsCount, const std::function<void(size_t)>& func);
+
+private:
+    struct Task
+    {
+        jp::TaskFunction func;
+        void* context;
+        jp::TaskGroup* group;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    static const size_t NO_WORKER = static_cast<size_t>(-1);
+
+    void start();
+    void run(size_t index);
+    // Index of the current thread in the pool (NO_WORKER for other threads)
+    size_t currentWorker() const;
+
+    // The task must already be counted by its group
+    void push(const Task& task);
+    // Take a task of group (any task if group is null)
+    bool pop(size_t self, Task* task, const jp::TaskGroup* group = nullptr);
+    void execute(const Task& task);
+    void taskDone(jp::TaskGroup* group);
+    static void unref(jp::TaskGroup* group);
+
+    unsigned int _threadsCount;
+    bool _pinning = false;
+    std::once_flag _started;
+    std::atomic<bool> _running{false};
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::mutex _injectionMutex;
+    std::deque<Task> _injection;
+
+    // Number of queued tasks (incremented before the push), and of sleeping workers
+    std::atomic<size_t> _queued{0};
+    std::atomic<size_t> _sleeping{0};
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+    std::atomic<bool> _stop{false};
+};
+
+} // namespace jp_private
+
+#endif // EXECUTORPRIVATE_H
@@ -32,6 +32,7 @@
 
 #include <string> // for std::string
 #include <vector> // for std::vector
+#include <cstdint> // for intN_t types
 
 /*
  * Collection of some useful filesystem functions.
@@ -39,6 +40,8 @@
 
 namespace jp_private
 {
+class Executor;
+
 namespace fsutil
 {
 
@@ -50,12 +53,49 @@ std::string librarySuffix();
 
 typedef std::vector<std::string> PathList;
 
-// List files in the specified directory, and append them to filesList
-// The search can be recursive across directories
-// extFilter can be used to search only for specified files
+// Filters and limits of scanDirectory()
+struct ScanOptions
+{
+    // Only keep files with this extension (without dot), if not empty
+    std::string extension;
+    // If not empty, only keep files whose name matches one of these globs
+    std::vector<std::string> include;
+    // Skip files and directories whose name matches one of these globs
+    std::vector<std::string> exclude;
+    // Maximum depth of the sub-directories scanned (0 for only the root, -1 for no limit)
+    int maxDepth = 0;
+    // Executor scanning the directories of a same depth concurrently (if not null),
+    // with at most threadsCount threads (0 for all the threads of the executor)
+    Executor* executor = nullptr;
+    unsigned int threadsCount = 1;
+    // If not null, the scanned directories (rootDir included) are appended to it
+    PathList* dirsList = nullptr;
+};
+
+// List the files of rootDir (and its sub-directories, up to options.maxDepth),
+// and append them to filesList (in an unspecified order)
+// Directories are scanned level by level, without recursion. The type of the
+// entries is read from the directory itself when the system provides it, so
+// stat() is only called for symbolic links (which are followed) and unknown types.
+// Paths are only built for the files kept.
 // NOTE: Return false on error (even if errors occurs, filesList
 // could have been modified)
 // NOTE: This function sets the errno variable in case of errors
+bool scanDirectory(const std::string& rootDir, const ScanOptions& options, PathList* filesList);
+
+// Return true if name matches the glob pattern ('*' matches any sequence of
+// characters and '?' any single character)
+bool matchGlob(const char* pattern, const char* name);
+
+// Return true if scanDirectory() keeps a file (resp. scans a sub-directory) with
+// this name, according to the filters of options (depth is not checked)
+bool keepFileName(const char* name, const ScanOptions& options);
+bool keepDirectoryName(const char* name, const ScanOptions& options);
+
+// List files in the specified directory, and append them to filesList
+// The search can be recursive across directories
+// extFilter can be used to search only for specified files
+// NOTE: Same return value and errors as scanDirectory()
 bool listFilesInDir(const std::string& rootDir,
                     PathList* filesList,
                     const std::string& extFilter = std::string(),
@@ -65,6 +105,18 @@ bool listLibrariesInDir(const std::string& rootDir,
                         PathList* filesList,
                         bool recursive = false);
 
+// Get the size and the last modification time (in nanoseconds since epoch)
+// of a file. Used to detect if a library changed since the last search.
+// NOTE: Return false if the file cannot be stat'ed
+bool fileFingerprint(const std::string& path, uint64_t* size, int64_t* mtime);
+
+// Ask the system to read the whole file into the page cache, without waiting
+// for the data. Used before loading libraries so that disk reads overlap with
+// the work done for the previous ones.
+// NOTE: Return false if the file cannot be opened or if the platform doesn't
+// support it (this is only a hint)
+bool prefetchFile(const std::string& path);
+
 // Returns the app directory
 // Use whereami library
 std::string appDir();
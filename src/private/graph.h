@@ -32,48 +32,74 @@
 
 #include <vector>
 #include <string>
-#include <list>
+#include <cstdint> // for intN_t types
 
 namespace jp_private
 {
 
 // Internal class that encapsulates all Graph-stuffs
 // Mainly used to find the plugin loading order and manage dependencies
-// NOTE: The graph is altered after the sort (flags aren't reset), so only
-// use it once.
+// Edges are stored in a compressed (CSR) form, in both directions: the
+// parents (dependencies) and the children of node i are stored contiguously.
+// The graph is never modified after its construction, so all functions can
+// be called several times (and concurrently).
 class Graph
 {
 public:
 
-    enum Flag
-    {
-        UNMARKED = 0,
-        MARK_TEMP = 1,
-        MARK_PERMANENT = 2
-    };
-
+    // Only used to build the graph
     struct Node
     {
         const std::string* name;
         // Edge: parent --> this
-        std::list<int> parentNodes;
-        Flag flag = UNMARKED;
+        std::vector<int> parentNodes;
     };
 
     typedef std::vector<std::string> NodeNamesList;
     typedef std::vector<Node> NodeList;
 
+    // Invalid parent ids are ignored
     Graph(const NodeList& nodeList);
 
-    // This sort use a Depth-first search algorithm as described at:
-    // https://en.wikipedia.org/wiki/Topological_sorting#Depth-first_search
-    NodeNamesList topologicalSort(bool& error);
+    size_t size() const { return _names.size(); }
+    const std::string& name(int id) const { return *_names[id]; }
+
+    // Parents (dependencies) of a node, as a range of ids
+    const int* parentsBegin(int id) const { return _parents.data() + _parentOffsets[id]; }
+    const int* parentsEnd(int id) const { return _parents.data() + _parentOffsets[id+1]; }
+    // Children (nodes that depend on this node), as a range of ids
+    const int* childrenBegin(int id) const { return _children.data() + _childOffsets[id]; }
+    const int* childrenEnd(int id) const { return _children.data() + _childOffsets[id+1]; }
+
+    // Ids of all nodes, each node after all its parents
+    // If there is a cycle, error is set to true and only the nodes that are not
+    // part of (or depending on) a cycle are returned
+    // Uses Kahn's algorithm, as described at:
+    // https://en.wikipedia.org/wiki/Topological_sorting#Kahn's_algorithm
+    std::vector<int> sortedIds(bool& error) const;
+    // Same as sortedIds(), but among the nodes whose parents are all sorted, the one
+    // with the highest priority comes first (then the one with the lowest id)
+    std::vector<int> sortedIds(bool& error, const std::vector<int64_t>& priorities) const;
+    // Same as sortedIds(), but return the names
+    NodeNamesList topologicalSort(bool& error) const;
+
+    // Length of the longest path that starts at each node and follows the children,
+    // where each node counts for its weight (its own weight included)
+    // Nodes in (or depending on) a cycle only count for their own weight
+    std::vector<int64_t> pathLengths(const std::vector<int64_t>& weights) const;
+
+    // Return the names of the nodes of each cycle (strongly connected components
+    // with more than one node, or a node that depends on itself)
+    // Uses an iterative version of Tarjan's algorithm
+    std::vector<NodeNamesList> cycles() const;
 
 private:
-    NodeList _nodeList;
-    std::vector<int> _unmarkedNodes;
+    std::vector<const std::string*> _names;
 
-    bool visitNode(Node& node, NodeNamesList* list);
+    std::vector<int> _parentOffsets; // size() + 1 items
+    std::vector<int> _parents;
+    std::vector<int> _childOffsets; // size() + 1 items
+    std::vector<int> _children;
 };
 
 } // namespace jp_private
@@ -0,0 +1,175 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IMAGEREADER_H
+#define IMAGEREADER_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <vector> // for std::vector
+#include <cstddef> // for size_t
+#include <cstdint> // for intN_t types
+
+#include "confinfo.h"
+
+namespace jp_private
+{
+
+// Read exported symbols directly from a library file, without loading it.
+// The file is memory-mapped and all returned pointers point inside the mapping
+// (no copy is performed), so they are only valid until close() is called.
+//
+// Supported formats are ELF (32 and 64 bits) and PE (PE32 and PE32+) images
+// built for the host (same machine, class and endianness). For other images, open()
+// returns false and the library must be loaded with SharedLibrary (which rejects
+// images that cannot be loaded by the process).
+class ImageReader
+{
+public:
+    ImageReader() {}
+    ~ImageReader();
+
+    // Non-copyable
+    ImageReader(const ImageReader&) = delete;
+    const ImageReader& operator=(const ImageReader&) = delete;
+
+    // Map the file and check its format
+    // Return false if the file cannot be mapped or if the format is not supported
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const
+    { return _data != nullptr; }
+
+    // Look up several symbols in a single pass over the symbols table.
+    // Results are cached until close(), so the following calls for these
+    // symbols don't scan the table again. The names are not copied and must
+    // stay valid until close().
+    // Returns the number of symbols found
+    size_t resolveSymbols(const char* const* symbolNames, size_t count);
+
+    // Checks if the image exports symbolName
+    bool hasSymbol(const char* symbolName) const;
+
+    // Returns a pointer to the content of an exported variable (like a "const char[]"),
+    // or nullptr if the symbol is not found or not stored inside the file.
+    // If size is not null, it's set to the number of bytes available for the symbol.
+    const char* symbolData(const char* symbolName, size_t* size = nullptr) const;
+
+    // Returns the NUL-terminated string pointed by an exported pointer variable
+    // (like a "const char*"), or nullptr if it cannot be resolved without loading the library
+    // (for example if the value is set by a relocation that is not understood).
+    const char* pointedString(const char* symbolName) const;
+
+private:
+
+    enum Format
+    {
+        FORMAT_UNKNOWN = 0,
+        FORMAT_ELF32,
+        FORMAT_ELF64,
+        FORMAT_PE32,
+        FORMAT_PE64
+    };
+
+    // An address relative to the image base (ELF virtual address or PE RVA)
+    typedef uint64_t ImageAddr;
+
+    // A symbol searched in the image
+    struct SymbolLookup
+    {
+        const char* name = nullptr;
+        ImageAddr addr = 0;
+        uint64_t size = 0;
+        // true once the name is matched in the table
+        bool resolved = false;
+        // true if the symbol is exported and usable
+        bool found = false;
+    };
+
+    const char* _data = nullptr;
+    size_t _size = 0;
+    Format _format = FORMAT_UNKNOWN;
+
+    // Symbols resolved by resolveSymbols()
+    std::vector<SymbolLookup> _symbols;
+
+#if defined(CONFINFO_PLATFORM_WIN32)
+    void* _fileHandle = nullptr;
+    void* _mappingHandle = nullptr;
+#endif
+
+    // ELF: dynamic symbol table and its string table (found in open())
+    uint64_t _elfSymOffset = 0;
+    uint64_t _elfSymCount = 0;
+    uint64_t _elfSymEntSize = 0;
+    uint64_t _elfStrOffset = 0;
+    uint64_t _elfStrSize = 0;
+    // Position-dependent executable (pointers are not relocated)
+    bool _elfExecutable = false;
+
+    // PE: export directory and sections table (found in open())
+    uint64_t _peImageBase = 0;
+    uint32_t _peExportRva = 0;
+    uint32_t _peExportSize = 0;
+    uint64_t _peSectionsOffset = 0;
+    uint16_t _peSectionsCount = 0;
+
+    bool openElf();
+    bool openPe();
+
+    // Find the address of symbolName, return false if not exported
+    bool findSymbol(const char* symbolName, ImageAddr* addr, uint64_t* symSize) const;
+    // Resolve all the symbols in one pass (the symbols must not be resolved yet)
+    void findSymbols(SymbolLookup* symbols, size_t count) const;
+    // Convert an address to a pointer inside the mapped file
+    // (nullptr if the range [addr, addr+len) is not stored in the file)
+    // If available is not null, it's set to the number of bytes stored in the file from addr
+    const char* addrToPtr(ImageAddr addr, uint64_t len, uint64_t* available = nullptr) const;
+    // Read the pointer stored at addr as it will be once the library is loaded
+    bool readPointer(ImageAddr addr, ImageAddr* value) const;
+
+    // Format specific implementations
+    void findElfSymbols(SymbolLookup* symbols, size_t count) const;
+    void findPeSymbols(SymbolLookup* symbols, size_t count) const;
+    const char* elfAddrToPtr(ImageAddr addr, uint64_t len, uint64_t* available) const;
+    const char* peAddrToPtr(ImageAddr addr, uint64_t len, uint64_t* available) const;
+    bool readElfPointer(ImageAddr addr, ImageAddr* value) const;
+    // Checks if a packed relative relocations table (SHT_RELR) relocates the word at addr
+    bool relrCovers(uint64_t offset, uint64_t size, ImageAddr addr) const;
+    bool readPePointer(ImageAddr addr, ImageAddr* value) const;
+
+    // Bounds-checked access to the mapped file
+    template<typename T>
+    bool read(uint64_t offset, T* value) const;
+    const char* at(uint64_t offset, uint64_t len) const;
+};
+
+} // namespace jp_private
+
+#endif // IMAGEREADER_H
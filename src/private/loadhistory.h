@@ -0,0 +1,67 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOADHISTORY_H
+#define LOADHISTORY_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <unordered_map> // for std::unordered_map
+#include <mutex> // for std::mutex
+#include <cstdint> // for intN_t types
+
+namespace jp_private
+{
+
+// Load duration of each plugin, recorded by the previous runs
+// Durations (in nanoseconds) are smoothed over the runs, so a single slow load
+// doesn't change the schedule much. Every function is thread-safe.
+class LoadHistory
+{
+public:
+    // Read the history file. Return false if the file doesn't exist or is invalid
+    // (in this case, the history is simply empty)
+    bool load(const std::string& filePath);
+    // Write the history file (only if something changed since load())
+    bool save(const std::string& filePath);
+
+    // Return the recorded duration of plugin, or defaultDuration if it was never loaded
+    int64_t duration(const std::string& plugin, int64_t defaultDuration) const;
+    // Average of the recorded durations (0 if the history is empty)
+    int64_t averageDuration() const;
+    void record(const std::string& plugin, int64_t duration);
+
+private:
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, int64_t> _durations;
+    bool _modified = false;
+};
+
+} // namespace jp_private
+
+#endif // LOADHISTORY_H
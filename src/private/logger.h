@@ -0,0 +1,261 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <ostream> // for std::ostream
+#include <functional> // for std::function
+#include <atomic> // for std::atomic
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <thread> // for std::thread
+#include <type_traits> // for std::is_integral
+#include <memory> // for std::unique_ptr
+#include <cstdint> // for intN_t types
+#include <cstddef> // for size_t
+
+#include "pluginmanager.h"
+
+namespace jp_private
+{
+
+// Asynchronous leveled logger.
+// log() only copies its arguments inside a slot of a bounded lock-free ring
+// buffer (multi-producer queue from D. Vyukov): nothing is allocated and no lock
+// is taken. A background thread (started by the first message) drains the
+// buffer, formats the messages and writes them to the stream or the callback.
+// Formatting is lazy: "{}" placeholders in the format string are replaced by the
+// arguments, in order, from the background thread only.
+// If the buffer is full, messages are dropped at once (and the number of dropped
+// messages is reported later) so callers never block nor wait.
+// In synchronous mode, messages are formatted and written by log() itself.
+class Logger
+{
+public:
+    typedef jp::PluginManager::LogLevel Level;
+    typedef jp::PluginManager::logCallback Callback;
+
+    Logger();
+    ~Logger();
+
+    // Non-copyable
+    Logger(const Logger&) = delete;
+    const Logger& operator=(const Logger&) = delete;
+
+    // Messages below the level, or all messages if disabled, are discarded
+    void setEnabled(bool enable)
+    { _enabled.store(enable, std::memory_order_relaxed); }
+    bool isEnabled() const
+    { return _enabled.load(std::memory_order_relaxed); }
+    void setLevel(Level level)
+    { _level.store(level, std::memory_order_relaxed); }
+    bool isEnabled(Level level) const
+    { return isEnabled() && level >= _level.load(std::memory_order_relaxed); }
+
+    // Write the messages from log() (queued messages are flushed first)
+    void setSynchronous(bool synchronous);
+
+    // Output of the messages (callback is used instead of stream if not empty)
+    void setStream(std::ostream& stream);
+    void setCallback(const Callback& callback);
+
+    // Queue a message (format must be a string literal, it's not copied)
+    // Supported arguments are strings and numbers
+    template<typename... Args>
+    void log(Level level, const char* format, const Args&... args)
+    {
+        if(!isEnabled(level))
+            return;
+        if(_synchronous.load(std::memory_order_relaxed))
+        {
+            Record record;
+            record.level = level;
+            record.format = format;
+            record.argsCount = 0;
+            record.textSize = 0;
+            addArgs(&record, args...);
+            writeNow(record);
+            return;
+        }
+        size_t pos;
+        Slot* slot = acquire(&pos);
+        if(!slot)
+            return;
+        Record* record = &slot->record;
+        record->level = level;
+        record->format = format;
+        record->argsCount = 0;
+        record->textSize = 0;
+        addArgs(record, args...);
+        publish(slot, pos);
+    }
+
+    // Wait until all the messages queued before this call are written
+    void flush();
+
+    // Number of messages dropped since the creation of the logger
+    size_t droppedCount() const
+    { return _droppedTotal.load(std::memory_order_relaxed); }
+
+    // Flush the logger when destroyed
+    class FlushScope
+    {
+    public:
+        explicit FlushScope(Logger& logger) : _logger(logger) {}
+        ~FlushScope() { _logger.flush(); }
+
+    private:
+        Logger& _logger;
+    };
+
+private:
+    // Slots are fixed-size, longer arguments are truncated
+    static const size_t CAPACITY = 256; // must be a power of 2
+    static const size_t MAX_ARGS = 8;
+    static const size_t TEXT_SIZE = 384;
+
+    enum ArgType : uint8_t
+    {
+        ARG_STRING,
+        ARG_SIGNED,
+        ARG_UNSIGNED,
+        ARG_DOUBLE
+    };
+
+    struct Arg
+    {
+        ArgType type;
+        union
+        {
+            int64_t i;
+            uint64_t u;
+            double d;
+            struct
+            {
+                uint16_t offset;
+                uint16_t size;
+            } str;
+        };
+    };
+
+    struct Record
+    {
+        Level level;
+        const char* format;
+        size_t argsCount;
+        Arg args[MAX_ARGS];
+        size_t textSize;
+        char text[TEXT_SIZE];
+    };
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    std::atomic<bool> _enabled;
+    std::atomic<Level> _level;
+
+    std::unique_ptr<Slot[]> _slots;
+    // Producers and consumer positions are kept on separate cache lines
+    std::atomic<size_t> _enqueuePos;
+    char _padding[64];
+    std::atomic<size_t> _dequeuePos;
+    std::atomic<size_t> _dropped;
+    std::atomic<size_t> _droppedTotal;
+    std::atomic<bool> _synchronous;
+
+    // Background thread
+    std::once_flag _started;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stop = false;
+    // true while the thread waits for messages (producers only notify it in this case)
+    std::atomic<bool> _sleeping;
+    // Number of messages written (a flush waits until it reaches its target)
+    size_t _written = 0;
+    std::condition_variable _writtenCond;
+
+    // Protected by _outputMutex (changed while the thread writes)
+    std::mutex _outputMutex;
+    std::ostream* _stream;
+    Callback _callback;
+
+    // Find a free slot, return nullptr if the buffer is full
+    Slot* acquire(size_t* pos);
+    // Make the slot filled after acquire() visible to the background thread
+    void publish(Slot* slot, size_t pos);
+
+    void startThread();
+    void run();
+    // Write all the available messages
+    void drain(std::string& buffer);
+    bool isEmpty() const;
+    void write(Level level, const std::string& message);
+    // Synchronous mode
+    void writeNow(const Record& record);
+    static void format(const Record& record, std::string& out);
+
+    static void addArgs(Record*) {}
+    template<typename T, typename... Args>
+    static void addArgs(Record* record, const T& arg, const Args&... args)
+    {
+        if(record->argsCount < MAX_ARGS)
+            addArg(record, arg);
+        addArgs(record, args...);
+    }
+
+    static void addArg(Record* record, const char* str);
+    static void addArg(Record* record, const std::string& str);
+    static void addArg(Record* record, double value);
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type addArg(Record* record, T value)
+    {
+        Arg& arg = record->args[record->argsCount++];
+        if(std::is_signed<T>::value)
+        {
+            arg.type = ARG_SIGNED;
+            arg.i = static_cast<int64_t>(value);
+        }
+        else
+        {
+            arg.type = ARG_UNSIGNED;
+            arg.u = static_cast<uint64_t>(value);
+        }
+    }
+    static void addString(Record* record, const char* str, size_t size);
+};
+
+} // namespace jp_private
+
+#endif // LOGGER_H
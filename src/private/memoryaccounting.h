@@ -0,0 +1,107 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <atomic> // for std::atomic
+#include <cstdint> // for intN_t types
+#include <cstddef> // for size_t
+
+#include "pluginmemory.h"
+#include "sharedlibrary.h"
+
+namespace jp_private
+{
+
+// Memory attributed to one plugin (the owner given to allocator hooks).
+// Counters are never deleted (see jp::memoryReleased()), and are kept when the
+// plugin is reloaded since blocks of the previous instance may still be alive.
+struct MemoryCounters
+{
+    std::atomic<uint64_t> librarySize;
+    std::atomic<int64_t> residentDelta;
+    std::atomic<int64_t> heapDelta;
+    std::atomic<int64_t> liveBytes;
+    std::atomic<int64_t> liveAllocations;
+
+    MemoryCounters() : librarySize(0), residentDelta(0), heapDelta(0), liveBytes(0), liveAllocations(0) {}
+
+    jp::PluginMemory toPluginMemory() const;
+};
+
+// Allocations of the current thread are attributed to counters (if not null)
+// until the scope is destroyed
+class MemoryScope
+{
+public:
+    explicit MemoryScope(MemoryCounters* counters);
+    ~MemoryScope();
+
+    // Non-copyable
+    MemoryScope(const MemoryScope&) = delete;
+    const MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+    MemoryCounters* _previous;
+    bool _active;
+};
+
+// Measures the change of the resident size and of the heap between the constructor
+// and the destructor, and adds it to counters (if not null)
+class MemoryDelta
+{
+public:
+    explicit MemoryDelta(MemoryCounters* counters);
+    ~MemoryDelta();
+
+    // Non-copyable
+    MemoryDelta(const MemoryDelta&) = delete;
+    const MemoryDelta& operator=(const MemoryDelta&) = delete;
+
+private:
+    MemoryCounters* _counters;
+    size_t _resident;
+    size_t _heap;
+};
+
+namespace memutil
+{
+
+// Resident set size of the process, in bytes (0 if unknown)
+size_t residentSize();
+// Bytes in use by malloc (0 if unknown)
+size_t heapSize();
+// Size of the memory mapped for the library (0 if unknown)
+size_t mappedSize(const jp::SharedLibrary& lib);
+
+} // namespace memutil
+} // namespace jp_private
+
+#endif // MEMORYACCOUNTING_H
@@ -0,0 +1,186 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGEBUSPRIVATE_H
+#define MESSAGEBUSPRIVATE_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <vector> // for std::vector
+#include <deque> // for std::deque
+#include <unordered_map> // for std::unordered_map
+#include <memory> // for std::shared_ptr and std::unique_ptr
+#include <atomic> // for std::atomic
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <thread> // for std::thread
+#include <cstdint> // for intN_t types
+#include <functional> // for std::function
+
+#include "messagebus.h"
+#include "memoryaccounting.h"
+
+namespace jp_private
+{
+
+// Implementation of the message bus shared by all plugins.
+// Each plugin uses its own client (see client()), so its subscriptions can be
+// removed once it's unloaded.
+//
+// Each subscription has a lock-free multi-producer single-consumer queue (the
+// intrusive queue from D. Vyukov). Publishing allocates a single block holding the
+// message and one queue node per subscriber, pushes the nodes and schedules the
+// subscriptions that were idle. A single dispatcher thread runs the scheduled
+// subscriptions, calling each handler with up to BATCH_SIZE messages at once.
+// The list of subscriptions is copied on write, so publishers never take a lock
+// (except to schedule an idle subscription).
+class MessageBus
+{
+public:
+    MessageBus();
+    ~MessageBus();
+
+    // Non-copyable
+    MessageBus(const MessageBus&) = delete;
+    const MessageBus& operator=(const MessageBus&) = delete;
+
+    // Return the bus interface used by owner (a plugin name, or empty for the
+    // application). Clients are never deleted before the bus.
+    jp::IMessageBus* client(const std::string& owner);
+
+    // Remove all subscriptions created by owner
+    void removeSubscriptions(const std::string& owner);
+
+    // Set the function giving the memory counters of an owner (called by subscribe(), may
+    // return nullptr), allocations of the handlers are then attributed to these counters
+    // Must be set before the first subscription
+    void setMemoryCountersFunction(const std::function<MemoryCounters*(const std::string&)>& func);
+
+    size_t publish(jp::TopicId topic, void* payload, uint32_t size, jp::PayloadRelease release);
+    uint64_t subscribe(const std::string& owner, jp::TopicId topic, jp::MessageHandler handler, void* context);
+    bool unsubscribe(uint64_t id);
+    void flush();
+
+private:
+    class Client;
+    struct Envelope;
+
+    static const size_t BATCH_SIZE = 64;
+
+    struct Node
+    {
+        std::atomic<Node*> next;
+        Envelope* envelope;
+    };
+
+    // A published message, followed in memory by one Node per subscriber
+    struct Envelope
+    {
+        std::atomic<size_t> refs;
+        jp::Message message;
+        void* payload;
+        jp::PayloadRelease release;
+
+        Node* nodes() { return reinterpret_cast<Node*>(this + 1); }
+    };
+
+    // Intrusive MPSC queue: push() is wait-free, pop() is only called by the dispatcher
+    class Queue
+    {
+    public:
+        Queue();
+        void push(Node* node);
+        // May return nullptr while a push is in progress
+        Node* pop();
+
+    private:
+        std::atomic<Node*> _head;
+        Node* _tail;
+        Node _stub;
+    };
+
+    struct Subscription
+    {
+        uint64_t id;
+        std::string owner;
+        jp::TopicId topic;
+        jp::MessageHandler handler;
+        void* context;
+        MemoryCounters* memory;
+
+        Queue queue;
+        // Number of nodes pushed and not popped yet
+        std::atomic<size_t> pending;
+        // true while the subscription is in the ready list (or being run)
+        std::atomic<bool> scheduled;
+        // Set by unsubscribe(), remaining messages are released without calling the handler
+        std::atomic<bool> closed;
+    };
+    typedef std::shared_ptr<Subscription> SubscriptionPtr;
+    typedef std::unordered_map<jp::TopicId, std::vector<SubscriptionPtr>> TopicsMap;
+
+    // Subscriptions by topic (copied on write, read with std::atomic_load)
+    std::shared_ptr<const TopicsMap> _topics;
+    // Serializes the writers of _topics
+    std::mutex _topicsMutex;
+    uint64_t _lastId = 0;
+
+    std::mutex _clientsMutex;
+    std::unordered_map<std::string, std::unique_ptr<Client>> _clients;
+
+    std::function<MemoryCounters*(const std::string&)> _memoryCounters;
+
+    // Dispatcher thread (started by the first subscription)
+    std::once_flag _started;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    // Signaled each time the dispatcher finishes running a subscription
+    std::condition_variable _idleCond;
+    bool _stop = false;
+    std::deque<SubscriptionPtr> _ready;
+    // The subscription being run by the dispatcher
+    Subscription* _current = nullptr;
+
+    // Nodes pushed and nodes processed (delivered or discarded), used by flush()
+    std::atomic<uint64_t> _queued;
+    std::atomic<uint64_t> _processed;
+
+    void schedule(const SubscriptionPtr& subscription);
+    void run();
+    // Deliver (or discard) up to BATCH_SIZE messages
+    void process(Subscription& subscription);
+    // The dispatcher then releases the remaining messages without calling the handler
+    void close(Subscription& subscription);
+    void releaseEnvelope(Envelope* envelope);
+    bool isDispatcherThread() const;
+};
+
+} // namespace jp_private
+
+#endif // MESSAGEBUSPRIVATE_H
@@ -31,15 +31,19 @@
  */
 
 #include <string> // for std::string
-#include <memory> // for std::shared_ptr
+#include <memory> // for std::shared_ptr, std::atomic_load
 #include <vector> // for std::vector
 #include <functional> // for std::function
+#include <chrono> // for std::chrono
+#include <atomic> // for std::atomic
 
 #include "plugininfo.h"
 #include "iplugin.h"
 #include "sharedlibrary.h"
 
 #include "tribool.h"
+#include "stringarena.h"
+#include "version/version.h"
 
 namespace jp_private
 {
@@ -65,9 +69,18 @@ struct PluginInfoStd
 
     std::vector<Dependency> dependencies;
 
+    // Optional "threadSafe" key: if false, the plugin is never loaded concurrently
+    // with other plugins, and always from the thread calling loadPlugins()
+    bool threadSafe = true;
+
     // A copy of each string is performed
     jp::PluginInfo toPluginInfo();
 
+    // Copy the PluginInfo object and all its strings inside buffer if size is
+    // big enough (strings are stored just after the object)
+    // Return the required size
+    size_t copyTo(void* buffer, size_t size) const;
+
     std::string toString();
 };
 
@@ -80,21 +93,67 @@ struct Plugin
                                             int,
                                             bool);
 
+    // Set (with setObject()) once the plugin is loaded. Plugins can be loaded while
+    // other threads query the manager, so reads from these threads use object(), or
+    // objectPointer() when no reference is needed (std::atomic_load() takes a lock)
     std::shared_ptr<jp::IPlugin> iplugin;
+    std::shared_ptr<jp::IPlugin> object() const { return std::atomic_load(&iplugin); }
+    jp::IPlugin* objectPointer() const { return rawObject.load(std::memory_order_acquire); }
+    void setObject(const std::shared_ptr<jp::IPlugin>& obj)
+    {
+        // The raw pointer is never set before, or cleared after, the object it points to
+        if(!obj)
+            rawObject.store(nullptr, std::memory_order_release);
+        std::atomic_store(&iplugin, obj);
+        if(obj)
+            rawObject.store(obj.get(), std::memory_order_release);
+    }
+    std::atomic<jp::IPlugin*> rawObject{nullptr};
     std::function<iplugin_create_t> creator;
     jp::SharedLibrary lib;
 
     std::string path;
     PluginInfoStd info;
+    // Discovery cache file the plugin was read from (empty if the library was probed)
+    std::string cacheFile;
+
+    // Versions parsed once from info (invalid strings give a 0.0.0 version)
+    // dependencyVersions[i] is the version required for info.dependencies[i]
+    Version version;
+    std::vector<Version> dependencyVersions;
+
+    // Set info and update all the objects computed from it
+    // (only called once, on a new Plugin)
+    void setInfo(const PluginInfoStd& newInfo, StringArena& strings);
+
+    // PluginInfo object pointing to the interned copies of the strings of info,
+    // returned by PluginManager::pluginInfoView() and to plugins with the
+    // MANAGER_OWNED flag (must be updated each time info is modified)
+    jp::PluginInfo infoView;
+    std::vector<jp::Dependency> infoViewDependencies;
+    void updateInfoView(StringArena& strings);
 
     bool isMainPlugin = false;
+    // true for plugins registered with JP_REGISTER_STATIC_PLUGIN (lib and path are never used)
+    bool isStatic = false;
 
     //
     // Flags used when loading
 
     // true if all dependencies are present, indeterminate if not yet checked
     TriBool dependenciesExists = TriBool::Indeterminate;
+    // Id in the graph of the last loadPlugins() call that checked this plugin
     int graphId = -1;
+    // Dependencies resolved by the last check (same order as info.dependencies,
+    // nullptr if not found). These plugins are owned by the registry.
+    std::vector<Plugin*> resolvedDependencies;
+    // true if the plugin is part of the last load order (so it can be loaded)
+    bool loadable = false;
+    // true until the current loadPlugins() call tried to load the plugin
+    // (only accessed with PlugMgrPrivate::progressMutex locked)
+    bool loadScheduled = false;
+    // End of the last successful load (used to find the critical chain of a load)
+    std::chrono::steady_clock::time_point loadEnd;
 
     // Destructor
     virtual ~Plugin();
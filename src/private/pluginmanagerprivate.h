@@ -30,11 +30,26 @@
  * and may change at any moment.
  */
 
-#include <iostream> // for std::cout
 #include <unordered_map> // for std::unordered_map
+#include <unordered_set> // for std::unordered_set
 #include <vector> // for std::vector
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <thread> // for std::thread
+#include <atomic> // for std::atomic
 
 #include "plugin.h"
+#include "discoverycache.h"
+#include "profiler.h"
+#include "directorywatcher.h"
+#include "logger.h"
+#include "messagebusprivate.h"
+#include "serviceregistry.h"
+#include "requestcontext.h"
+#include "memoryaccounting.h"
+#include "requestmetricsprivate.h"
+#include "executorprivate.h"
+#include "loadhistory.h"
 
 #include "pluginmanager.h"
 
@@ -45,47 +60,273 @@ namespace jp_private
 // (used to ensure ABI compatibility if implementation changes)
 struct PlugMgrPrivate
 {
-    PlugMgrPrivate(jp::PluginManager* plugMgr): pluginManager(plugMgr) {}
-    ~PlugMgrPrivate() {}
+    typedef std::unordered_map<std::string, PluginPtr> PluginsMap;
+
+    PlugMgrPrivate(jp::PluginManager* plugMgr)
+        : pluginManager(plugMgr), registry(std::make_shared<PluginsMap>()), requestContext(this)
+    {
+        // The application (empty owner) is never accounted
+        messageBus.setMemoryCountersFunction([this](const std::string& owner) -> MemoryCounters* {
+            return memoryAccounting && !owner.empty() ? memoryCountersFor(owner) : nullptr;
+        });
+        requestMetrics.setMemoryCountersFunction([this](const std::string& receiver) {
+            return memoryCountersFor(receiver);
+        });
+    }
+    // Plugins leaked by unloadPluginsConcurrently() may still send requests: they
+    // must fail before the members used by handleRequest() are destroyed
+    ~PlugMgrPrivate() { requestContext.release(); }
 
     jp::PluginManager* pluginManager;
 
-    std::unordered_map<std::string, PluginPtr> pluginsMap;
+    // Working copy of the registry, only used by the functions that modify it
+    // (searchForPlugins(), registerMainPlugin(), loadPlugins() and unloadPlugins(),
+    // which must not be called concurrently)
+    PluginsMap pluginsMap;
+    // Immutable copy of pluginsMap, used by every read-only function (through a
+    // RegistryView), so readers always see a complete registry.
+    // Only accessed with std::atomic_load()/std::atomic_store(). These functions take
+    // a lock, so RegistryView only loads it again when registryGeneration changes.
+    std::shared_ptr<const PluginsMap> registry;
+    // Changed by each publishRegistry(), unique among all managers
+    std::atomic<uint64_t> registryGeneration{newRegistryGeneration()};
+    static uint64_t newRegistryGeneration();
 
     // Contains the last load order used
     std::vector<std::string> loadOrderList;
+    // Plugins found that are not part of loadOrderList (new plugins, or plugins
+    // with a dependency that cannot be loaded)
+    std::vector<PluginPtr> pendingPlugins;
 
     // List all locations to load plugins
     std::vector<std::string> locations;
 
-    // Stream used to print log outputs.
-    // (default set to std::cout)
-    std::reference_wrapper<std::ostream> log = std::ref(std::cout);
+    // Asynchronous logger (enabled by default, writes to std::cout)
+    Logger logger;
+
+    // Publish/subscribe bus shared by all plugins
+    MessageBus messageBus;
+    // Services published by plugins
+    ServiceRegistry services;
+    // Slot of the request functions given to the plugins created by this manager
+    RequestContext requestContext;
 
-    bool useLog = true; // log output is enable by default
+    // If true, memory is attributed to the plugins while the manager runs their code
+    std::atomic<bool> memoryAccounting{false};
+    // Counters of each plugin, created on first use and never deleted: allocations
+    // made by a plugin may be released after it's unloaded (or after the manager is deleted)
+    std::mutex memoryMutex;
+    std::unordered_map<std::string, MemoryCounters*> memoryCounters;
+    MemoryCounters* memoryCountersFor(const std::string& name);
 
     std::string mainPluginName;
 
+    // Number of threads used to probe libraries in searchForPlugins() (0 for all cores)
+    unsigned int searchThreadsCount = 1;
+
+    // Number of threads used to load plugins in loadPlugins() (0 for all cores)
+    unsigned int loadThreadsCount = 1;
+
+    // If true, plugins are only loaded when their object is first requested
+    bool lazyLoading = false;
+    // If true, libraries of the load order are read in the background before being loaded
+    bool prefetchLibraries = true;
+    // Serializes on-demand loads (recursive since a plugin may request another
+    // plugin from its loaded() function)
+    std::recursive_mutex lazyMutex;
+    // Callback given to the last loadPlugins() call, used by on-demand loads
+    jp::PluginManager::callback lazyCallback;
+
+    // Flags used to load the libraries (combination of jp::SharedLibrary::LoadFlag)
+    int libraryLoadFlags = jp::SharedLibrary::LOAD_LAZY;
+    // Per-plugin flags, overriding libraryLoadFlags
+    std::unordered_map<std::string, int> pluginLoadFlags;
+
+    // Interned metadata strings of all the plugins (never freed before the manager,
+    // so the views of unregistered plugins never point to freed strings)
+    StringArena strings;
+
+    // Records the time spent in each phase for each plugin
+    Profiler profiler;
+    // Records the requests sent to the manager and between plugins (disabled by default)
+    RequestMetrics requestMetrics;
+    // Pool shared by the plugins, the concurrent search and the concurrent load
+    Executor executor;
+
+    // File used by the discovery cache (if empty, use a file inside the searched dir)
+    std::string cacheFile;
+    // Locked while a stale entry is removed from a cache file (plugins can be loaded concurrently)
+    std::mutex cacheMutex;
+    // Load duration of each plugin, used to start the longest chains of dependencies first
+    LoadHistory loadHistory;
+    // File of loadHistory (if empty, the durations are only kept in memory)
+    std::string historyFile;
+
+    // true once loadPlugins() is called (new plugins found by the watcher are then loaded)
+    bool loadRequested = false;
+    // false if the last loadPlugins() call was given roots: only the plugins required by
+    // loadRoots (and the main plugin) are then checked and loaded, the others stay pending
+    bool loadAllPlugins = true;
+    // Roots of all loadPlugins() calls since the last call without roots
+    std::vector<std::string> loadRoots;
+
+    // Thread used by loadPluginsAsync()
+    std::thread asyncLoadThread;
+    // Progress of the current load (protects Plugin::loadScheduled too)
+    std::mutex progressMutex;
+    std::condition_variable progressCond;
+    size_t progressDone = 0;
+    size_t progressTotal = 0;
+    // Progress callback given to loadPluginsAsync() (calls are serialized with progressCallbackMutex)
+    jp::PluginManager::progressCallback progressFunc;
+    std::mutex progressCallbackMutex;
+
+    // Watches all locations (when enabled)
+    DirectoryWatcher watcher;
+    unsigned int watchPollInterval = 1000;
+    std::function<void()> watchCallback;
+
     //
     // Functions
 
+    // Make the current state of pluginsMap visible to readers
+    void publishRegistry();
+    // Return nullptr if the plugin is not in the current registry
+    PluginPtr findPlugin(const std::string& name) const;
+
     PluginInfoStd parseMetadata(const char* metadata);
-    jp::ReturnCode checkDependencies(PluginPtr& plugin, jp::PluginManager::callback callbackFunc);
+    // Use the binary metadata if available and valid, the JSON metadata otherwise
+    PluginInfoStd readMetadata(const char* binMetadata, size_t binMetadataSize, const char* metadata);
+    // Read the JustPlug symbols and the metadata of the library at path
+    // The symbols are read from the file when possible, so the library is only
+    // loaded (inside plugin->lib) if its format is not supported by ImageReader
+    void probeLibrary(const std::string& path, PluginPtr& plugin, DiscoveryCache::Entry* entry);
+    // Register a plugin found at path (entry contains the result of probeLibrary())
+    // Return false (and reset plugin) if the library cannot be used as a plugin
+    bool addPlugin(PluginPtr& plugin, const std::string& path, const DiscoveryCache::Entry& entry,
+                   bool cached, jp::PluginManager::callback callbackFunc);
+    // Register a plugin linked in the executable
+    // Return false if it cannot be used, or if it's already registered
+    bool addStaticPlugin(const StaticPluginEntry& staticEntry, jp::PluginManager::callback callbackFunc);
+    // Checks the dependencies of the pending plugins (only those required by the roots
+    // if loadAllPlugins is false) and append the plugins that can be loaded to loadOrderList
+    // Called by PluginManager::loadPlugins()
+    jp::ReturnCode computeLoadOrder(bool tryToContinue, jp::PluginManager::callback callbackFunc);
+    // Return loadRoots, the main plugin and all their dependencies (direct or not)
+    std::unordered_set<const Plugin*> rootsClosure() const;
+
+    // Steps of PluginManager::loadPlugins(), also used by loadPluginsAsync()
+    // prepareLoad() must be called from the calling thread; runLoad() loads the plugins
+    // from index first of loadOrderList then calls the main plugin function if execMain is true
+    // If roots is not null, only the plugins required by roots (and the previous roots) are loaded
+    jp::ReturnCode prepareLoad(bool tryToContinue, jp::PluginManager::callback callbackFunc,
+                               const std::vector<std::string>* roots, size_t* first, bool* execMain);
+    void runLoad(size_t first, bool execMain, jp::PluginManager::callback callbackFunc);
+    // Start a thread that prefetches the libraries not opened yet, starting at first
+    // in the load order (the thread is not joinable if there is nothing to prefetch)
+    std::thread startPrefetch(size_t first);
+    void execMainPlugin();
+    // Wait for the end of the current asynchronous load (if any)
+    // Called by every function that modifies the manager state
+    void waitAsyncLoad();
+    // Checks if the current thread is loading a plugin of the load order (from
+    // loaded(), a callback function or the progress function)
+    bool isLoadThread() const;
+
+    // Load a plugin of the load order (if its dependencies are loaded), then
+    // report the progress
+    void loadScheduledPlugin(const PluginPtr& plugin, jp::PluginManager::callback callbackFunc);
 
-    // Simply load all plugins in the order specified by loadOrderList
+    // Simply load all plugins in the order specified by loadOrderList, starting
+    // at index first (previous plugins were loaded by a previous call)
     // Called by PluginManager::loadPlugins()
-    void loadPluginsInOrder();
+    void loadPluginsInOrder(size_t first, jp::PluginManager::callback callbackFunc);
+    // Same as loadPluginsInOrder(), but each plugin is loaded by a pool of threads
+    // as soon as all its dependencies are loaded
+    void loadPluginsConcurrently(size_t first, jp::PluginManager::callback callbackFunc);
+    // Find the chain of plugins that set the duration of the load of loadOrderList
+    // from index first (started at start), and give it to the profiler
+    void updateCriticalChain(size_t first, Profiler::Clock::time_point start);
+    // Returns false if one of the dependencies of plugin is not loaded
+    bool dependenciesLoaded(const PluginPtr& plugin);
+    // Load plugin and all its dependencies if they are not loaded yet
+    // Return false if the plugin is not part of the load order or cannot be loaded
+    bool loadPluginOnDemand(const PluginPtr& plugin);
     // No checks is performed for the dependencies, they MUST be loaded
-    void loadPlugin(PluginPtr& plugin);
+    // Return false if the library cannot be loaded (only possible if the library
+    // was not loaded during the search, ie. found in the discovery cache)
+    bool loadPlugin(const PluginPtr& plugin, jp::PluginManager::callback callbackFunc);
+    // Open the library of plugin (again if its load flags changed) and set its creator
+    // Fails if the library doesn't export the plugin's name anymore (stale cache entry)
+    bool openLibrary(const PluginPtr& plugin, jp::PluginManager::callback callbackFunc);
+    // Remove the entry of plugin from the discovery cache it was read from, so the
+    // library is probed again by the next search
+    void invalidateCacheEntry(const PluginPtr& plugin);
+
+    // Remove the plugin and all plugins that depend on it (directly or not) from
+    // loadOrderList, and return them in load order (plugin is always the first one)
+    // Called by PluginManager::reloadPlugin()
+    std::vector<PluginPtr> takeDependentPlugins(const PluginPtr& plugin);
+
+    // Unload the plugin and the plugins that depend on it, then read its library again
+    // (or remove the plugin if remove is true) and load all these plugins again
+    // Called by PluginManager::reloadPlugin() and when a watched library changed
+    jp::ReturnCode reloadPlugin(const PluginPtr& plugin, bool remove, jp::PluginManager::callback callbackFunc);
 
     // Like loadPluginsInOrder, but for the unload step
     bool unloadPluginsInOrder();
+    // Unload plugins level by level in reverse order (plugins of a level are unloaded
+    // concurrently), with deadlines (in milliseconds, 0 for no deadline)
+    jp::ReturnCode unloadPluginsConcurrently(unsigned int threadsCount, unsigned int pluginTimeout,
+                                             unsigned int totalTimeout, jp::PluginManager::callback callbackFunc);
+    // Unload the plugins that are not part of the load order, then reset the manager
+    // Return false if some plugins cannot be unloaded
+    bool clearPlugins();
     bool unloadPlugin(PluginPtr &plugin);
+    // Remove the services and subscriptions of plugin, and deliver the pending messages
+    void releasePluginResources(const Plugin& plugin);
 
-    // Function called by plugins throught IPlugin::sendRequest()
-    static uint16_t handleRequest(const char* sender, uint16_t code, void** data, uint32_t *dataSize);
+    // Function called by plugins throught IPlugin::sendRequest() (through the
+    // trampolines of requestContext, which give the manager that created them)
+    static uint16_t handleRequest(PlugMgrPrivate* _p, const char* sender, uint16_t code, void** data, uint32_t *dataSize);
+    // Process the request (handleRequest() only records its metrics)
+    static uint16_t processRequest(PlugMgrPrivate* _p, const char* sender, uint16_t code, void** data, uint32_t *dataSize);
+    // Helpers for handleRequest() (flags are a combination of IPlugin::ManagerRequestFlag)
+    static uint16_t returnString(const char* str, size_t length, uint16_t flags, void** data, uint32_t* dataSize);
+    static const char* requestedPlugin(const char* sender, uint16_t flags, void** data);
+    // Application directory, computed at the first call
+    static const std::string& cachedAppDir();
     // Return nullptr if sender is not the main plugin or if pluginName is not loaded
-    static jp::IPlugin* getNonDepPlugin(const char* sender, const char* pluginName);
+    static jp::IPlugin* getNonDepPlugin(PlugMgrPrivate* _p, const char* sender, const char* pluginName);
+};
+
+// Read-only access to the registry of a manager, from any thread.
+// Each thread keeps the last registry it read, and only loads it again once a new one
+// is published, so a view usually costs two thread-local accesses and an atomic load.
+// Views opened while another one is alive on the same thread never replace the kept
+// registry: pointers taken from a view stay valid until it's destroyed.
+// The kept registry (and its plugins) may outlive the manager until the thread reads
+// another registry or exits. Plugins are always unloaded by then.
+class RegistryView
+{
+public:
+    explicit RegistryView(const PlugMgrPrivate* p);
+    ~RegistryView();
+
+    // Non-copyable
+    RegistryView(const RegistryView&) = delete;
+    const RegistryView& operator=(const RegistryView&) = delete;
+
+    const PlugMgrPrivate::PluginsMap& operator*() const { return *_plugins; }
+    const PlugMgrPrivate::PluginsMap* operator->() const { return _plugins; }
+
+    // Return nullptr if the plugin is not in the registry
+    Plugin* find(const std::string& name) const;
+
+private:
+    const PlugMgrPrivate::PluginsMap* _plugins;
+    // Only set if the registry kept by the thread cannot be used
+    std::shared_ptr<const PlugMgrPrivate::PluginsMap> _ownRegistry;
 };
 
 } // namespace jp_private
@@ -0,0 +1,105 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <chrono> // for std::chrono
+#include <mutex> // for std::mutex
+#include <ostream> // for std::ostream
+#include <vector> // for std::vector
+#include <string> // for std::string
+
+#include "pluginprofile.h"
+
+namespace jp_private
+{
+
+// Records ProfileEvent objects
+// Recording costs two clock reads and one locked push_back per phase, so it
+// can stay enabled by default. Every function is thread-safe.
+class Profiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler();
+
+    void setEnabled(bool enabled) { _enabled = enabled; }
+    bool enabled() const { return _enabled; }
+
+    // Returns the current time (to be given to record() at the end of the phase)
+    Clock::time_point now() const { return Clock::now(); }
+
+    // Record a phase that started at start and ends now
+    void record(const std::string& plugin, jp::ProfileEvent::Phase phase, Clock::time_point start);
+    // Same as record(), with an explicit end time
+    void record(const std::string& plugin, jp::ProfileEvent::Phase phase,
+                Clock::time_point start, Clock::time_point end);
+
+    std::vector<jp::ProfileEvent> events() const;
+    void clear();
+
+    // Set the plugins (in load order) that set the duration of the load that started
+    // at start. Their load phases are marked in the Chrome trace
+    void setCriticalChain(const std::vector<std::string>& chain, Clock::time_point start);
+    std::vector<std::string> criticalChain() const;
+
+    // Write all events using the Chrome trace-event format (JSON object format)
+    void writeChromeTrace(std::ostream& out) const;
+
+private:
+    bool _enabled = true;
+    Clock::time_point _epoch;
+
+    mutable std::mutex _mutex;
+    std::vector<jp::ProfileEvent> _events;
+    std::vector<std::string> _criticalChain;
+    // Start of the load of the critical chain, in nanoseconds since _epoch
+    int64_t _criticalStart = 0;
+};
+
+// Record the phase from the construction to the destruction of the object
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler& profiler, const std::string& plugin, jp::ProfileEvent::Phase phase)
+        : _profiler(profiler), _plugin(plugin), _phase(phase), _start(profiler.now()) {}
+    ~ProfileScope() { _profiler.record(_plugin, _phase, _start); }
+
+private:
+    Profiler& _profiler;
+    const std::string& _plugin;
+    jp::ProfileEvent::Phase _phase;
+    Profiler::Clock::time_point _start;
+};
+
+} // namespace jp_private
+
+#endif // PROFILER_H
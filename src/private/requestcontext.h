@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef REQUESTCONTEXT_H
+#define REQUESTCONTEXT_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <cstddef> // for size_t
+#include <cstdint> // for uint16_t and uint32_t
+
+namespace jp
+{
+class IPlugin;
+}
+
+namespace jp_private
+{
+
+struct PlugMgrPrivate;
+
+// Plugins receive plain function pointers (without any context argument) to send
+// requests to the manager. To keep this ABI, each manager reserves a slot in a fixed
+// pool of trampolines: the functions of a slot forward to the manager that owns it.
+class RequestContext
+{
+public:
+    typedef uint16_t (*RequestFunction)(const char*, uint16_t, void**, uint32_t*);
+    typedef jp::IPlugin* (*NonDepPluginFunction)(const char*, const char*);
+
+    // Maximum number of managers alive at the same time (PluginManager::MAX_MANAGERS)
+    static const size_t MAX_CONTEXTS = 64;
+
+    // Reserve a slot for manager (isValid() returns false if all slots are used)
+    explicit RequestContext(PlugMgrPrivate* manager);
+    // Same as release()
+    ~RequestContext();
+
+    // Non-copyable
+    RequestContext(const RequestContext&) = delete;
+    const RequestContext& operator=(const RequestContext&) = delete;
+
+    bool isValid() const { return _slot < MAX_CONTEXTS; }
+
+    // Keep the slot reserved after release() until the returned slot is given to
+    // releaseThread(): the thread running a leaked plugin (see
+    // PlugMgrPrivate::unloadPluginsConcurrently()) may still call the functions of
+    // the slot, so they must never forward to another manager meanwhile.
+    size_t retainForThread();
+    // Called once the thread retaining the slot is done (from any thread, even
+    // after the manager is destroyed)
+    static void releaseThread(size_t slot);
+    // Detach the manager from the slot, then wait for the end of the requests that
+    // are running (must be called before the manager is destroyed). The slot can
+    // then be reserved by another manager, once no thread retains it.
+    // Requests sent through the slot after this call fail.
+    void release();
+
+    // Functions passed to jp_createPlugin (the request function returns
+    // IPlugin::COMMON_ERROR and getNonDepPlugin nullptr if the context is not valid)
+    RequestFunction requestFunction() const;
+    NonDepPluginFunction nonDepPluginFunction() const;
+
+private:
+    size_t _slot;
+};
+
+} // namespace jp_private
+
+#endif // REQUESTCONTEXT_H
@@ -0,0 +1,145 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef REQUESTMETRICSPRIVATE_H
+#define REQUESTMETRICSPRIVATE_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <vector> // for std::vector
+#include <map> // for std::map
+#include <unordered_map> // for std::unordered_map
+#include <tuple> // for std::tuple
+#include <memory> // for std::unique_ptr and std::shared_ptr
+#include <mutex> // for std::mutex
+#include <functional> // for std::function
+#include <cstdint> // for intN_t types
+
+#include "requestmetrics.h"
+#include "memoryaccounting.h"
+
+namespace jp_private
+{
+
+// Records the metrics of the requests, per (sender, receiver, code) route.
+// Each thread records into its own shard, so recording only takes an uncontended
+// lock and, once the route is known, a lookup by pointers (names are compared to
+// detect pointers reused after an unload). Shards are merged when read. When a
+// thread exits, its shard is merged into the retired routes and deleted.
+// Requests between plugins are also dispatched here while memory accounting is
+// enabled, to run the receiver in its memory scope.
+class RequestMetrics : public jp::IRequestMetrics
+{
+public:
+    RequestMetrics();
+    ~RequestMetrics();
+
+    // Non-copyable
+    RequestMetrics(const RequestMetrics&) = delete;
+    const RequestMetrics& operator=(const RequestMetrics&) = delete;
+
+    void setEnabled(bool enabled);
+    void setMemoryAccounting(bool enabled);
+    // Counters of a receiver (called for each dispatched request while memory accounting is enabled)
+    void setMemoryCountersFunction(const std::function<MemoryCounters*(const std::string&)>& func);
+
+    uint16_t dispatch(const char* sender, jp::IPlugin* receiver, const char* receiverName,
+                      uint16_t code, void** data, uint32_t* dataSize) override;
+    void dispatchBatch(const char* sender, jp::IPlugin* receiver, const char* receiverName,
+                       jp::Request* requests, size_t count) override;
+    void record(const char* sender, const char* receiver, uint16_t code,
+                uint16_t returnCode, int64_t duration) override;
+
+    // Merge the shards, routes are sorted by sender, receiver and code
+    std::vector<jp::RequestRoute> snapshot() const;
+    void clear();
+
+    typedef std::tuple<std::string, std::string, uint16_t> RouteName;
+    typedef std::map<RouteName, jp::RequestRoute> RoutesMap;
+
+    struct RoutePointers
+    {
+        const char* sender;
+        const char* receiver;
+        uint16_t code;
+
+        bool operator==(const RoutePointers& other) const
+        {
+            return sender == other.sender && receiver == other.receiver && code == other.code;
+        }
+    };
+    struct RoutePointersHash
+    {
+        size_t operator()(const RoutePointers& key) const;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        RoutesMap routes;
+        // Cache of the routes by name pointers. Only the routes whose names are kept by
+        // their plugins are added, and nothing is added once it's full.
+        std::unordered_map<RoutePointers, jp::RequestRoute*, RoutePointersHash> index;
+
+        jp::RequestRoute& route(const char* sender, const char* receiver, uint16_t code, bool indexed);
+    };
+
+    // State shared with the recording threads, which may exit after the recorder is deleted
+    struct Core
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Shard>> shards;
+        // Routes of the shards whose thread exited
+        RoutesMap retired;
+    };
+
+    // Called when the thread of shard exits
+    static void retireShard(Core& core, Shard* shard);
+
+private:
+    static const size_t MAX_INDEX_SIZE = 1024;
+
+    void updateActive();
+    MemoryCounters* memoryCounters(const char* receiverName);
+    Shard* localShard();
+    void add(const char* sender, const char* receiver, uint16_t code,
+             uint16_t returnCode, int64_t duration, bool indexed);
+
+    // Unique among all instances (unlike the address), used by the per-thread cache
+    const uint64_t _id;
+
+    std::shared_ptr<Core> _core;
+
+    std::atomic<bool> _recording{false};
+    std::atomic<bool> _memoryAccounting{false};
+    std::function<MemoryCounters*(const std::string&)> _memoryCounters;
+};
+
+} // namespace jp_private
+
+#endif // REQUESTMETRICSPRIVATE_H
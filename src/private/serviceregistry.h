@@ -0,0 +1,82 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SERVICEREGISTRY_H
+#define SERVICEREGISTRY_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <unordered_map> // for std::unordered_map
+#include <mutex> // for std::mutex
+
+#include "service.h"
+
+namespace jp_private
+{
+
+// Services published by plugins (or the application, with an empty owner),
+// indexed by their id. All functions are thread-safe.
+class ServiceRegistry
+{
+public:
+    ServiceRegistry() {}
+
+    // Non-copyable
+    ServiceRegistry(const ServiceRegistry&) = delete;
+    const ServiceRegistry& operator=(const ServiceRegistry&) = delete;
+
+    // Return false if the id is already published
+    bool add(jp::ServiceId id, const char* name, void* service, const std::string& owner);
+    // Return false if owner does not publish the service
+    bool remove(jp::ServiceId id, const std::string& owner);
+    // Remove all services published by owner
+    void removeAll(const std::string& owner);
+    // Return nullptr if the service is not found (or if name doesn't match)
+    void* find(jp::ServiceId id, const char* name) const;
+
+private:
+    struct Service
+    {
+        std::string name;
+        void* service;
+        std::string owner;
+    };
+
+    mutable std::mutex _mutex;
+    // ServiceId is already a hash, so it's used as is
+    struct IdHash
+    {
+        size_t operator()(jp::ServiceId id) const
+        { return static_cast<size_t>(id ^ (id >> 32)); }
+    };
+    std::unordered_map<jp::ServiceId, Service, IdHash> _services;
+};
+
+} // namespace jp_private
+
+#endif // SERVICEREGISTRY_H
@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+/*
+ * This file is an internal header. It's not part of the public API,
+ * and may change at any moment.
+ */
+
+#include <string> // for std::string
+#include <vector> // for std::vector
+#include <unordered_set> // for std::unordered_set
+#include <memory> // for std::unique_ptr
+#include <mutex> // for std::mutex
+#include <cstddef> // for size_t
+
+namespace jp_private
+{
+
+// Stores NUL-terminated strings in large blocks that are never moved or freed
+// before the arena itself.
+// Strings are interned: storing a string equal to a previous one returns the
+// same pointer, so metadata shared by many plugins (authors, licenses,
+// dependency names) is only stored once, and reloading a plugin does not
+// grow the arena.
+// All functions are thread-safe.
+class StringArena
+{
+public:
+    StringArena() {}
+
+    // Non-copyable
+    StringArena(const StringArena&) = delete;
+    const StringArena& operator=(const StringArena&) = delete;
+
+    // Return the interned copy of str (valid until the arena is destroyed)
+    const char* intern(const std::string& str);
+
+    // Number of bytes allocated by the arena
+    size_t capacity() const;
+
+private:
+    // Strings longer than this get their own block
+    static const size_t BLOCK_SIZE = 4096;
+
+    struct Hash
+    {
+        size_t operator()(const char* str) const;
+    };
+    struct Equal
+    {
+        bool operator()(const char* a, const char* b) const;
+    };
+
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    size_t _capacity = 0;
+    // Free space at the end of the last block
+    char* _pos = nullptr;
+    size_t _available = 0;
+    // All strings stored in the blocks
+    std::unordered_set<const char*, Hash, Equal> _strings;
+};
+
+} // namespace jp_private
+
+#endif // STRINGARENA_H
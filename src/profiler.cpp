@@ -0,0 +1,146 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/profiler.h"
+
+#include "json/json.hpp"
+
+#include <atomic> // for std::atomic
+#include <algorithm> // for std::find
+
+using namespace jp_private;
+using namespace jp;
+
+namespace
+{
+
+// Give a small index to each thread that records an event
+uint32_t currentThreadIndex()
+{
+    static std::atomic<uint32_t> nextIndex(0);
+    static thread_local uint32_t index = nextIndex++;
+    return index;
+}
+
+} // namespace
+
+Profiler::Profiler(): _epoch(Clock::now())
+{
+}
+
+void Profiler::record(const std::string& plugin, ProfileEvent::Phase phase, Clock::time_point start)
+{
+    record(plugin, phase, start, Clock::now());
+}
+
+void Profiler::record(const std::string& plugin, ProfileEvent::Phase phase,
+                      Clock::time_point start, Clock::time_point end)
+{
+    if(!_enabled)
+        return;
+
+    ProfileEvent event;
+    event.plugin = plugin;
+    event.phase = phase;
+    event.thread = currentThreadIndex();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _epoch).count();
+    event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    _events.push_back(std::move(event));
+}
+
+std::vector<ProfileEvent> Profiler::events() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _events;
+}
+
+void Profiler::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.clear();
+    _criticalChain.clear();
+    _epoch = Clock::now();
+}
+
+void Profiler::setCriticalChain(const std::vector<std::string>& chain, Clock::time_point start)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _criticalChain = chain;
+    _criticalStart = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _epoch).count();
+}
+
+std::vector<std::string> Profiler::criticalChain() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _criticalChain;
+}
+
+void Profiler::writeChromeTrace(std::ostream& out) const
+{
+    using json = nlohmann::json;
+
+    std::vector<ProfileEvent> allEvents;
+    std::vector<std::string> chain;
+    int64_t chainStart;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        allEvents = _events;
+        chain = _criticalChain;
+        chainStart = _criticalStart;
+    }
+
+    json traceEvents = json::array();
+    for(const ProfileEvent& event : allEvents)
+    {
+        // Chrome trace-event times are in microseconds
+        json jevent;
+        jevent["name"] = std::string(ProfileEvent::phaseName(event.phase)) + " " + event.plugin;
+        jevent["cat"] = ProfileEvent::phaseName(event.phase);
+        jevent["ph"] = "X";
+        jevent["ts"] = event.start / 1000.0;
+        jevent["dur"] = event.duration / 1000.0;
+        jevent["pid"] = 1;
+        jevent["tid"] = event.thread;
+        jevent["args"]["plugin"] = event.plugin;
+
+        // Load phases of the plugins that set the duration of the last load
+        const bool loadPhase = event.phase == ProfileEvent::DLOPEN || event.phase == ProfileEvent::SYMBOL_LOOKUP
+                               || event.phase == ProfileEvent::CREATOR_CALL || event.phase == ProfileEvent::LOADED_CALL;
+        if(loadPhase && event.start >= chainStart
+           && std::find(chain.begin(), chain.end(), event.plugin) != chain.end())
+        {
+            jevent["args"]["critical"] = true;
+        }
+        traceEvents.push_back(jevent);
+    }
+
+    json trace;
+    trace["traceEvents"] = traceEvents;
+    if(!chain.empty())
+        trace["otherData"]["criticalLoadChain"] = chain;
+    trace["displayTimeUnit"] = "ms";
+    out << trace.dump() << std::endl;
+}
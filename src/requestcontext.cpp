@@ -0,0 +1,227 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/requestcontext.h"
+
+#include <atomic> // for std::atomic
+#include <thread> // for std::this_thread
+#include <chrono> // for std::chrono::milliseconds
+
+#include "private/pluginmanagerprivate.h"
+
+using namespace jp_private;
+
+namespace
+{
+
+std::atomic<PlugMgrPrivate*> contexts[RequestContext::MAX_CONTEXTS];
+// Number of calls running through the trampolines of each slot
+std::atomic<unsigned int> runningCalls[RequestContext::MAX_CONTEXTS];
+// Number of threads of leaked plugins still running, for each slot
+std::atomic<unsigned int> retainingThreads[RequestContext::MAX_CONTEXTS];
+
+// Value of the slots released while some of their plugins were leaked
+// (not reserved again until reclaimSlot(), and never a valid manager)
+PlugMgrPrivate* retiredSlot()
+{
+    static char tag;
+    return reinterpret_cast<PlugMgrPrivate*>(&tag);
+}
+
+// Make a retired slot free again once nothing can use it
+void reclaimSlot(size_t slot)
+{
+    if(retainingThreads[slot].load() != 0 || runningCalls[slot].load() != 0)
+        return;
+    PlugMgrPrivate* expected = retiredSlot();
+    contexts[slot].compare_exchange_strong(expected, nullptr);
+}
+
+// Counts the call for release(), which waits for it
+// (sequentially consistent with the store of release(), so either release() waits
+// for the call, or the call sees the released slot)
+class RunningCall
+{
+public:
+    explicit RunningCall(size_t slot) : _slot(slot) { runningCalls[_slot].fetch_add(1); }
+    ~RunningCall()
+    {
+        // The last call through a retired slot reclaims it (releaseThread() skips it
+        // while calls are running)
+        if(runningCalls[_slot].fetch_sub(1) == 1 && contexts[_slot].load() == retiredSlot())
+            reclaimSlot(_slot);
+    }
+
+    PlugMgrPrivate* manager() const
+    {
+        PlugMgrPrivate* manager = contexts[_slot].load();
+        return manager != retiredSlot() ? manager : nullptr;
+    }
+
+private:
+    size_t _slot;
+};
+
+struct Functions
+{
+    RequestContext::RequestFunction request;
+    RequestContext::NonDepPluginFunction nonDepPlugin;
+};
+
+// Trampolines of the slot N
+// Leaked plugins may call them after their manager is deleted: the slot is then
+// released (and retained), so they fail instead of reaching a deleted manager
+template<size_t N>
+struct Trampolines
+{
+    static uint16_t request(const char* sender, uint16_t code, void** data, uint32_t* dataSize)
+    {
+        const RunningCall call(N);
+        PlugMgrPrivate* manager = call.manager();
+        if(!manager)
+            return jp::IPlugin::COMMON_ERROR;
+        return PlugMgrPrivate::handleRequest(manager, sender, code, data, dataSize);
+    }
+
+    static jp::IPlugin* nonDepPlugin(const char* sender, const char* pluginName)
+    {
+        const RunningCall call(N);
+        PlugMgrPrivate* manager = call.manager();
+        if(!manager)
+            return nullptr;
+        return PlugMgrPrivate::getNonDepPlugin(manager, sender, pluginName);
+    }
+};
+
+// Build the table of all trampolines at compile time
+template<size_t... I>
+struct IndexList {};
+
+template<size_t N, size_t... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct MakeIndexList<0, I...>
+{
+    typedef IndexList<I...> type;
+};
+
+template<size_t... I>
+const Functions* buildTable(IndexList<I...>)
+{
+    static const Functions table[] = {{&Trampolines<I>::request, &Trampolines<I>::nonDepPlugin}...};
+    return table;
+}
+
+const Functions* trampolines()
+{
+    static const Functions* table = buildTable(MakeIndexList<RequestContext::MAX_CONTEXTS>::type());
+    return table;
+}
+
+uint16_t invalidRequest(const char*, uint16_t, void**, uint32_t*)
+{
+    return jp::IPlugin::COMMON_ERROR;
+}
+
+jp::IPlugin* invalidNonDepPlugin(const char*, const char*)
+{
+    return nullptr;
+}
+
+} // namespace
+
+const size_t RequestContext::MAX_CONTEXTS;
+static_assert(RequestContext::MAX_CONTEXTS == jp::PluginManager::MAX_MANAGERS,
+              "The documented limit must match the number of slots");
+
+RequestContext::RequestContext(PlugMgrPrivate* manager) : _slot(MAX_CONTEXTS)
+{
+    for(size_t i = 0; i < MAX_CONTEXTS; ++i)
+    {
+        // A retired slot is free once its last call returned, even if no
+        // reclaimSlot() call saw it (a call was still running meanwhile)
+        if(contexts[i].load() == retiredSlot())
+            reclaimSlot(i);
+
+        PlugMgrPrivate* expected = nullptr;
+        if(contexts[i].compare_exchange_strong(expected, manager, std::memory_order_acq_rel))
+        {
+            _slot = i;
+            break;
+        }
+    }
+}
+
+RequestContext::~RequestContext()
+{
+    release();
+}
+
+size_t RequestContext::retainForThread()
+{
+    if(isValid())
+        retainingThreads[_slot].fetch_add(1);
+    return _slot;
+}
+
+// Static
+void RequestContext::releaseThread(size_t slot)
+{
+    if(slot >= MAX_CONTEXTS)
+        return;
+    // Reclaimed here if release() is already done (release() reclaims it otherwise)
+    if(retainingThreads[slot].fetch_sub(1) == 1)
+        reclaimSlot(slot);
+}
+
+void RequestContext::release()
+{
+    if(!isValid())
+        return;
+
+    contexts[_slot].store(retainingThreads[_slot].load() != 0 ? retiredSlot() : nullptr);
+    // A request may take long (with lazy loading, getNonDepPlugin() loads the requested
+    // plugin and its dependencies), so don't keep a core busy meanwhile
+    for(unsigned int i = 0; runningCalls[_slot].load() != 0; ++i)
+    {
+        if(i < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // The last retaining thread may have exited before the slot was retired
+    reclaimSlot(_slot);
+    _slot = MAX_CONTEXTS;
+}
+
+RequestContext::RequestFunction RequestContext::requestFunction() const
+{
+    return isValid() ? trampolines()[_slot].request : &invalidRequest;
+}
+
+RequestContext::NonDepPluginFunction RequestContext::nonDepPluginFunction() const
+{
+    return isValid() ? trampolines()[_slot].nonDepPlugin : &invalidNonDepPlugin;
+}
@@ -0,0 +1,328 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/requestmetricsprivate.h"
+
+#include <algorithm> // for std::lower_bound and std::find_if
+#include <atomic> // for std::atomic
+#include <chrono> // for std::chrono
+#include <functional> // for std::hash
+
+#include "iplugin.h"
+
+using namespace jp_private;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+std::atomic<uint64_t> nextId(1);
+
+// Shards created by the current thread: each one is retired when the thread exits
+// (if its recorder still exists, the shard is deleted with the recorder otherwise)
+struct ThreadShards
+{
+    struct Entry
+    {
+        uint64_t id;
+        std::weak_ptr<RequestMetrics::Core> core;
+        RequestMetrics::Shard* shard;
+    };
+
+    // Shard of the last recorder used by the thread
+    uint64_t lastId = 0;
+    RequestMetrics::Shard* lastShard = nullptr;
+    std::vector<Entry> entries;
+
+    ~ThreadShards()
+    {
+        for(const Entry& entry : entries)
+        {
+            const std::shared_ptr<RequestMetrics::Core> core = entry.core.lock();
+            if(core)
+                RequestMetrics::retireShard(*core, entry.shard);
+        }
+    }
+};
+thread_local ThreadShards threadShards;
+
+bool sameName(const std::string& name, const char* str)
+{
+    return str ? name == str : name.empty();
+}
+
+void addRoute(jp::RequestRoute& to, const jp::RequestRoute& from)
+{
+    to.calls += from.calls;
+    to.errors += from.errors;
+    to.totalDuration += from.totalDuration;
+    if(from.maxDuration > to.maxDuration)
+        to.maxDuration = from.maxDuration;
+    for(int i = 0; i < jp::RequestRoute::HISTOGRAM_BUCKETS; ++i)
+        to.histogram[i] += from.histogram[i];
+
+    for(const auto& count : from.returnCodes)
+    {
+        auto it = std::lower_bound(to.returnCodes.begin(), to.returnCodes.end(), count,
+                                   [](const std::pair<uint16_t, uint64_t>& a,
+                                      const std::pair<uint16_t, uint64_t>& b) { return a.first < b.first; });
+        if(it != to.returnCodes.end() && it->first == count.first)
+            it->second += count.second;
+        else
+            to.returnCodes.insert(it, count);
+    }
+}
+
+void mergeRoutes(RequestMetrics::RoutesMap& to, const RequestMetrics::RoutesMap& from)
+{
+    for(const auto& route : from)
+    {
+        auto inserted = to.insert(route);
+        if(!inserted.second)
+            addRoute(inserted.first->second, route.second);
+    }
+}
+
+int64_t elapsed(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+} // anonymous namespace
+
+size_t RequestMetrics::RoutePointersHash::operator()(const RoutePointers& key) const
+{
+    const std::hash<const void*> hash;
+    return (hash(key.sender) * 31 + hash(key.receiver)) * 31 + key.code;
+}
+
+jp::RequestRoute& RequestMetrics::Shard::route(const char* sender, const char* receiver, uint16_t code, bool indexed)
+{
+    const RoutePointers key = {sender, receiver, code};
+    if(indexed)
+    {
+        const auto it = index.find(key);
+        if(it != index.end() && sameName(it->second->sender, sender) && sameName(it->second->receiver, receiver))
+            return *it->second;
+    }
+
+    const std::string senderName(sender ? sender : "");
+    const std::string receiverName(receiver ? receiver : "");
+    auto inserted = routes.insert(std::make_pair(RouteName(senderName, receiverName, code), jp::RequestRoute()));
+    jp::RequestRoute& route = inserted.first->second;
+    if(inserted.second)
+    {
+        route.sender = senderName;
+        route.receiver = receiverName;
+        route.code = code;
+    }
+
+    // Once the index is full, other routes are found by name (still counted)
+    if(indexed && (index.size() < MAX_INDEX_SIZE || index.count(key)))
+        index[key] = &route;
+    return route;
+}
+
+RequestMetrics::RequestMetrics()
+    : _id(nextId.fetch_add(1, std::memory_order_relaxed)), _core(std::make_shared<Core>())
+{
+}
+
+RequestMetrics::~RequestMetrics()
+{
+}
+
+void RequestMetrics::setEnabled(bool enabled)
+{
+    _recording.store(enabled, std::memory_order_relaxed);
+    updateActive();
+}
+
+void RequestMetrics::setMemoryAccounting(bool enabled)
+{
+    _memoryAccounting.store(enabled, std::memory_order_relaxed);
+    updateActive();
+}
+
+void RequestMetrics::setMemoryCountersFunction(const std::function<MemoryCounters*(const std::string&)>& func)
+{
+    _memoryCounters = func;
+}
+
+void RequestMetrics::updateActive()
+{
+    _active.store(_recording.load(std::memory_order_relaxed) || _memoryAccounting.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+}
+
+MemoryCounters* RequestMetrics::memoryCounters(const char* receiverName)
+{
+    if(!_memoryAccounting.load(std::memory_order_relaxed) || !_memoryCounters || !receiverName)
+        return nullptr;
+    return _memoryCounters(receiverName);
+}
+
+// Static
+void RequestMetrics::retireShard(Core& core, Shard* shard)
+{
+    std::lock_guard<std::mutex> lock(core.mutex);
+    const auto it = std::find_if(core.shards.begin(), core.shards.end(),
+                                 [shard](const std::unique_ptr<Shard>& item) { return item.get() == shard; });
+    if(it == core.shards.end())
+        return;
+
+    {
+        std::lock_guard<std::mutex> shardLock(shard->mutex);
+        mergeRoutes(core.retired, shard->routes);
+    }
+    core.shards.erase(it);
+}
+
+RequestMetrics::Shard* RequestMetrics::localShard()
+{
+    ThreadShards& local = threadShards;
+    if(local.lastId == _id)
+        return local.lastShard;
+
+    Shard* shard = nullptr;
+    for(const ThreadShards::Entry& entry : local.entries)
+    {
+        if(entry.id == _id)
+            shard = entry.shard;
+    }
+    if(!shard)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_core->mutex);
+            _core->shards.emplace_back(new Shard());
+            shard = _core->shards.back().get();
+        }
+        // Entries of deleted recorders are useless
+        local.entries.erase(std::remove_if(local.entries.begin(), local.entries.end(),
+                                           [](const ThreadShards::Entry& entry) { return entry.core.expired(); }),
+                            local.entries.end());
+        local.entries.push_back(ThreadShards::Entry{_id, _core, shard});
+    }
+
+    local.lastId = _id;
+    local.lastShard = shard;
+    return shard;
+}
+
+uint16_t RequestMetrics::dispatch(const char* sender, jp::IPlugin* receiver, const char* receiverName,
+                                  uint16_t code, void** data, uint32_t* dataSize)
+{
+    MemoryCounters* memory = memoryCounters(receiverName);
+    const Clock::time_point start = Clock::now();
+    uint16_t returnCode;
+    {
+        MemoryScope memoryScope(memory);
+        returnCode = receiver->handleRequest(sender, code, data, dataSize);
+    }
+    add(sender, receiverName, code, returnCode, elapsed(start), true);
+    return returnCode;
+}
+
+void RequestMetrics::dispatchBatch(const char* sender, jp::IPlugin* receiver, const char* receiverName,
+                                   jp::Request* requests, size_t count)
+{
+    MemoryCounters* memory = memoryCounters(receiverName);
+    const Clock::time_point start = Clock::now();
+    {
+        MemoryScope memoryScope(memory);
+        receiver->handleRequestBatch(sender, requests, count);
+    }
+    const int64_t duration = count > 0 ? elapsed(start) / static_cast<int64_t>(count) : 0;
+    for(size_t i = 0; i < count; ++i)
+        add(sender, receiverName, requests[i].code, requests[i].result, duration, true);
+}
+
+void RequestMetrics::record(const char* sender, const char* receiver, uint16_t code,
+                            uint16_t returnCode, int64_t duration)
+{
+    // The receiver of a request that was not dispatched may be any string
+    add(sender, receiver, code, returnCode, duration, returnCode != jp::IPlugin::NOT_A_DEPENDENCY);
+}
+
+void RequestMetrics::add(const char* sender, const char* receiver, uint16_t code,
+                         uint16_t returnCode, int64_t duration, bool indexed)
+{
+    if(!_recording.load(std::memory_order_relaxed))
+        return;
+
+    Shard* shard = localShard();
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    jp::RequestRoute& route = shard->route(sender, receiver, code, indexed);
+
+    ++route.calls;
+    route.totalDuration += duration;
+    if(duration > route.maxDuration)
+        route.maxDuration = duration;
+    ++route.histogram[jp::RequestRoute::bucket(duration)];
+
+    if(returnCode != 0)
+    {
+        ++route.errors;
+        auto it = route.returnCodes.begin();
+        while(it != route.returnCodes.end() && it->first < returnCode)
+            ++it;
+        if(it != route.returnCodes.end() && it->first == returnCode)
+            ++it->second;
+        else
+            route.returnCodes.insert(it, std::make_pair(returnCode, uint64_t{1}));
+    }
+}
+
+std::vector<jp::RequestRoute> RequestMetrics::snapshot() const
+{
+    RoutesMap merged;
+    {
+        std::lock_guard<std::mutex> lock(_core->mutex);
+        merged = _core->retired;
+        for(const std::unique_ptr<Shard>& shard : _core->shards)
+        {
+            std::lock_guard<std::mutex> shardLock(shard->mutex);
+            mergeRoutes(merged, shard->routes);
+        }
+    }
+
+    std::vector<jp::RequestRoute> routes;
+    routes.reserve(merged.size());
+    for(auto& route : merged)
+        routes.push_back(std::move(route.second));
+    return routes;
+}
+
+void RequestMetrics::clear()
+{
+    std::lock_guard<std::mutex> lock(_core->mutex);
+    _core->retired.clear();
+    for(const std::unique_ptr<Shard>& shard : _core->shards)
+    {
+        std::lock_guard<std::mutex> shardLock(shard->mutex);
+        shard->routes.clear();
+        shard->index.clear();
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/serviceregistry.h"
+
+using namespace jp_private;
+
+bool ServiceRegistry::add(jp::ServiceId id, const char* name, void* service, const std::string& owner)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _services.emplace(id, Service{name ? name : "", service, owner}).second;
+}
+
+bool ServiceRegistry::remove(jp::ServiceId id, const std::string& owner)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _services.find(id);
+    if(it == _services.end() || it->second.owner != owner)
+        return false;
+    _services.erase(it);
+    return true;
+}
+
+void ServiceRegistry::removeAll(const std::string& owner)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(auto it = _services.begin(); it != _services.end();)
+    {
+        if(it->second.owner == owner)
+            it = _services.erase(it);
+        else
+            ++it;
+    }
+}
+
+void* ServiceRegistry::find(jp::ServiceId id, const char* name) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _services.find(id);
+    // Different names with the same hash are not the same service
+    if(it == _services.end() || (name && it->second.name != name))
+        return nullptr;
+    return it->second.service;
+}
@@ -0,0 +1,88 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "private/stringarena.h"
+
+#include <cstring> // for std::memcpy and std::strcmp
+
+using namespace jp_private;
+
+const char* StringArena::intern(const std::string& str)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _strings.find(str.c_str());
+    if(it != _strings.end())
+        return *it;
+
+    const size_t size = str.size() + 1;
+    char* copy;
+    if(size > BLOCK_SIZE / 4)
+    {
+        // Keep the free space of the current block for smaller strings
+        _blocks.emplace_back(new char[size]);
+        _capacity += size;
+        copy = _blocks.back().get();
+    }
+    else
+    {
+        if(size > _available)
+        {
+            _blocks.emplace_back(new char[BLOCK_SIZE]);
+            _capacity += BLOCK_SIZE;
+            _pos = _blocks.back().get();
+            _available = BLOCK_SIZE;
+        }
+        copy = _pos;
+        _pos += size;
+        _available -= size;
+    }
+
+    std::memcpy(copy, str.c_str(), size);
+    _strings.insert(copy);
+    return copy;
+}
+
+size_t StringArena::capacity() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _capacity;
+}
+
+size_t StringArena::Hash::operator()(const char* str) const
+{
+    // FNV-1a
+    size_t hash = static_cast<size_t>(14695981039346656037ULL);
+    for(; *str; ++str)
+    {
+        hash ^= static_cast<unsigned char>(*str);
+        hash *= static_cast<size_t>(1099511628211ULL);
+    }
+    return hash;
+}
+
+bool StringArena::Equal::operator()(const char* a, const char* b) const
+{
+    return std::strcmp(a, b) == 0;
+}
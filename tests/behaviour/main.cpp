@@ -0,0 +1,847 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pluginmanager.h"
+#include "sharedlibrary.h"
+
+#include "plugin/managercall.h"
+#include "plugin/graphplugin.h"
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+using namespace jp;
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const std::string& what)
+{
+    std::cout << (condition ? "[PASS] " : "[FAIL] ") << what << std::endl;
+    if(!condition)
+        ++failures;
+}
+
+// Directory of the plugins of one test
+std::string pluginDir(const std::string& name)
+{
+    return PluginManager::appDirectory() + "/plugin/" + name;
+}
+
+// Path of the library of a plugin
+std::string libraryPath(const std::string& dir, const std::string& name)
+{
+    return pluginDir(dir) + "/" + LIBRARY_PREFIX + name + LIBRARY_SUFFIX;
+}
+
+std::vector<std::string> sortedPlugins(const PluginManager& mgr)
+{
+    std::vector<std::string> list = mgr.pluginsList();
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+// Send a request to a plugin from the application
+uint16_t sendRequest(const PluginManager& mgr, const std::string& name, uint16_t code, void** data)
+{
+    const std::shared_ptr<IPlugin> plugin = mgr.pluginObject(name);
+    if(!plugin)
+        return IPlugin::NOT_FOUND;
+    uint32_t dataSize = 0;
+    return plugin->handleRequest("behaviour", code, data, &dataSize);
+}
+
+// Wait until flag is set (false if it's not set after a few seconds)
+bool waitFor(const std::atomic<bool>& flag)
+{
+    for(int i = 0; i < 500 && !flag; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return flag;
+}
+
+/*****************************************************************************/
+/***** Executor **************************************************************/
+/*****************************************************************************/
+
+void increment(void* context)
+{
+    ++*static_cast<std::atomic<int>*>(context);
+}
+
+void testExecutorWait()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    IExecutor* exec = mgr.executor();
+
+    std::atomic<int> counter(0);
+    TaskGroup* group = exec->createGroup();
+    for(int i = 0; i < 100; ++i)
+        exec->submit(&increment, &counter, group);
+    exec->wait(group);
+    check(counter == 100, "executor: wait() returns once every task of the group is done");
+
+    // An empty group is already done
+    TaskGroup* empty = exec->createGroup();
+    exec->wait(empty);
+    check(true, "executor: wait() on an empty group returns immediately");
+
+    exec->releaseGroup(group);
+    exec->releaseGroup(empty);
+}
+
+struct ThenContext
+{
+    std::atomic<int> counter{0};
+    int seen = -1;
+};
+
+void recordCounter(void* context)
+{
+    ThenContext* then = static_cast<ThenContext*>(context);
+    then->seen = then->counter;
+}
+
+void testExecutorThen()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    IExecutor* exec = mgr.executor();
+
+    ThenContext context;
+    TaskGroup* group = exec->createGroup();
+    TaskGroup* next = exec->createGroup();
+    for(int i = 0; i < 50; ++i)
+        exec->submit(&increment, &context.counter, group);
+    exec->then(group, &recordCounter, &context, next);
+    exec->wait(next);
+    check(context.seen == 50, "executor: then() runs after every task of the group");
+
+    // The continuation of an empty group is submitted at once
+    std::atomic<int> counter(0);
+    TaskGroup* empty = exec->createGroup();
+    TaskGroup* emptyNext = exec->createGroup();
+    exec->then(empty, &increment, &counter, emptyNext);
+    exec->wait(emptyNext);
+    check(counter == 1, "executor: then() on an empty group runs the continuation");
+
+    exec->releaseGroup(group);
+    exec->releaseGroup(next);
+    exec->releaseGroup(empty);
+    exec->releaseGroup(emptyNext);
+}
+
+struct NestedContext
+{
+    IExecutor* exec;
+    std::atomic<int> counter{0};
+};
+
+void nestedTask(void* context)
+{
+    NestedContext* nested = static_cast<NestedContext*>(context);
+    TaskGroup* inner = nested->exec->createGroup();
+    for(int i = 0; i < 10; ++i)
+        nested->exec->submit(&increment, &nested->counter, inner);
+    nested->exec->wait(inner);
+    nested->exec->releaseGroup(inner);
+}
+
+void testExecutorNestedWait()
+{
+    // A single thread: the task waiting for its sub-tasks must run them itself
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.setExecutorThreadsCount(1);
+    IExecutor* exec = mgr.executor();
+
+    NestedContext context;
+    context.exec = exec;
+    TaskGroup* outer = exec->createGroup();
+    for(int i = 0; i < 4; ++i)
+        exec->submit(&nestedTask, &context, outer);
+    exec->wait(outer);
+    check(context.counter == 40, "executor: a task can wait for the tasks it submitted");
+    exec->releaseGroup(outer);
+}
+
+struct Blocker
+{
+    std::atomic<bool> started{false};
+    std::atomic<bool> release{false};
+};
+
+void blockingTask(void* context)
+{
+    Blocker* blocker = static_cast<Blocker*>(context);
+    blocker->started = true;
+    while(!blocker->release)
+        std::this_thread::yield();
+}
+
+void testExecutorWaitRunsOnlyItsGroup()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.setExecutorThreadsCount(1);
+    IExecutor* exec = mgr.executor();
+
+    // The only worker is blocked by the first task, the second one stays queued
+    Blocker blocker;
+    TaskGroup* blocked = exec->createGroup();
+    exec->submit(&blockingTask, &blocker, blocked);
+    while(!blocker.started)
+        std::this_thread::yield();
+    exec->submit(&blockingTask, &blocker, blocked);
+
+    // Running the queued blocking task here would never return
+    std::atomic<int> counter(0);
+    TaskGroup* group = exec->createGroup();
+    exec->submit(&increment, &counter, group);
+    exec->wait(group);
+    check(counter == 1, "executor: wait() only runs the tasks of the waited group");
+
+    blocker.release = true;
+    exec->wait(blocked);
+    exec->releaseGroup(group);
+    exec->releaseGroup(blocked);
+}
+
+void testConcurrentSearch()
+{
+    // The concurrent search runs on Executor::parallelFor()
+    PluginManager sequential;
+    sequential.disableLogOutput();
+    sequential.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+
+    PluginManager concurrent;
+    concurrent.disableLogOutput();
+    concurrent.setExecutorThreadsCount(4);
+    concurrent.setSearchThreadsCount(4);
+    concurrent.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+
+    check(sequential.pluginsCount() == 4, "executor: the sequential search finds every plugin");
+    check(sortedPlugins(concurrent) == sortedPlugins(sequential),
+          "executor: the concurrent search finds the same plugins");
+}
+
+void testLoadWaitingPlugins()
+{
+    // More load threads than executor threads: plugins waiting for their tasks
+    // from loaded() must not wait behind the load itself
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.setExecutorThreadsCount(2);
+    mgr.setLoadThreadsCount(4);
+    mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+    check(mgr.loadPlugins().type == ReturnCode::SUCCESS, "executor: plugins waiting for their tasks are loaded");
+
+    for(int i = 1; i <= 4; ++i)
+    {
+        const std::string name = "executor_" + std::to_string(i);
+        int* result = nullptr;
+        const uint16_t code = sendRequest(mgr, name, 0, (void**)&result);
+        check(code == IPlugin::SUCCESS && result && *result == 136,
+              "executor: " + name + " computed its result in loaded()");
+    }
+    mgr.unloadPlugins();
+}
+
+void testWaitForPluginFromLoadThread()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+
+    // Called from the loader thread, after the first plugin: the other ones wait behind it
+    bool processedFound = false;
+    int pendingRefused = 0;
+    auto progress = [&](const std::string& name, bool, size_t done, size_t) {
+        if(done != 1)
+            return;
+        processedFound = mgr.waitForPlugin(name);
+        for(int i = 1; i <= 4; ++i)
+        {
+            const std::string other = "executor_" + std::to_string(i);
+            if(other != name && !mgr.waitForPlugin(other))
+                ++pendingRefused;
+        }
+    };
+    std::future<ReturnCode> result = mgr.loadPluginsAsync(PluginManager::callback(), progress);
+    check(result.get().type == ReturnCode::SUCCESS, "load: the asynchronous load ends");
+    check(processedFound, "load: waitForPlugin() from the load thread finds a processed plugin");
+    check(pendingRefused == 3, "load: waitForPlugin() from the load thread fails for the pending plugins");
+    check(mgr.waitForPlugin("executor_4"), "load: waitForPlugin() finds the plugins once they are loaded");
+    mgr.unloadPlugins();
+}
+
+/*****************************************************************************/
+/***** Libraries *************************************************************/
+/*****************************************************************************/
+
+void testReloadLeavesPendingPlugins()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+    mgr.loadPlugins();
+    // Found after the load, so it's pending until the next loadPlugins() call
+    mgr.searchForPlugins(pluginDir("requests"), PluginManager::callback());
+    check(!mgr.isPluginLoaded("requests_1"), "reload: the plugin found later is pending");
+
+    check(mgr.reloadPlugin("executor_1").type == ReturnCode::SUCCESS, "reload: the plugin is reloaded");
+    check(mgr.isPluginLoaded("executor_1"), "reload: the reloaded plugin is loaded again");
+    check(!mgr.isPluginLoaded("requests_1"), "reload: the pending plugins are not loaded");
+    mgr.unloadPlugins();
+}
+
+void testReloadLibraryStillLoaded()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+    mgr.loadPlugins();
+
+    // Another handle keeps the old image mapped
+    SharedLibrary lib(libraryPath("executor", "executor_2"));
+    check(lib.isLoaded(), "reload: the library is opened by another handle");
+    check(mgr.reloadPlugin("executor_2").type == ReturnCode::RELOAD_LIBRARY_STILL_LOADED,
+          "reload: a library still mapped cannot be reloaded");
+    check(mgr.isPluginLoaded("executor_2"), "reload: the plugin is created again from the old library");
+    lib.unload();
+
+    check(mgr.reloadPlugin("executor_2").type == ReturnCode::SUCCESS,
+          "reload: the library is reloaded once it's not mapped anymore");
+    mgr.unloadPlugins();
+}
+
+void testSymbolError()
+{
+    SharedLibrary lib(libraryPath("executor", "executor_1"));
+    check(lib.hasSymbol("jp_name"), "symbols: the plugin symbol is found");
+    check(!lib.hasSymbol("jp_missing_symbol") && !lib.hasError(), "symbols: hasSymbol() never sets an error");
+
+    // The failed lookup is cached, but the error still comes from the system
+    check(!lib.getRawAddress("jp_missing_symbol"), "symbols: a missing symbol has no address");
+    const std::string error = lib.errorString();
+    check(!error.empty() && error != "undefined symbol: jp_missing_symbol",
+          "symbols: the error message of the system is kept (" + error + ")");
+    check(lib.getRawAddress("jp_name") && !lib.hasError(), "symbols: a successful lookup clears the error");
+}
+
+#if defined(CONFINFO_PLATFORM_LINUX)
+std::string readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Write a new file (never the same inode), with a fixed modification time
+void writeFile(const std::string& path, const std::string& content)
+{
+    std::remove(path.c_str());
+    std::ofstream(path, std::ios::binary) << content;
+    utimbuf times;
+    times.actime = times.modtime = 1000000000;
+    utime(path.c_str(), &times);
+}
+#endif
+
+void testStaleCacheEntry()
+{
+#if defined(CONFINFO_PLATFORM_LINUX)
+    const std::string dir = pluginDir("stale");
+    const std::string path = dir + "/" + LIBRARY_PREFIX + "stale" + LIBRARY_SUFFIX;
+    mkdir(dir.c_str(), 0755);
+    std::remove((dir + "/justplug.cache").c_str());
+
+    // Both libraries get the same size (trailing bytes are ignored) and modification
+    // time, so the fingerprint of the cache cannot tell them apart
+    std::string first = readFile(libraryPath("executor", "executor_1"));
+    std::string second = readFile(libraryPath("executor", "executor_2"));
+    const size_t size = std::max(first.size(), second.size());
+    first.resize(size, '\0');
+    second.resize(size, '\0');
+
+    PluginManager::SearchOptions options;
+    options.cachePolicy = PluginManager::CACHE_ENABLED;
+    writeFile(path, first);
+    {
+        PluginManager mgr;
+        mgr.disableLogOutput();
+        mgr.searchForPlugins(dir, options, PluginManager::callback());
+        check(mgr.hasPlugin("executor_1"), "cache: the library is probed and cached");
+    }
+
+    writeFile(path, second);
+    {
+        PluginManager mgr;
+        mgr.disableLogOutput();
+        mgr.searchForPlugins(dir, options, PluginManager::callback());
+        check(mgr.hasPlugin("executor_1"), "cache: the stale entry is used by the search");
+
+        bool libraryError = false;
+        mgr.loadPlugins([&libraryError](const ReturnCode& code, const char* detail) {
+            libraryError = libraryError || code.type == ReturnCode::LOAD_LIBRARY_ERROR;
+            free(const_cast<char*>(detail));
+        });
+        check(libraryError && !mgr.isPluginLoaded("executor_1"),
+              "cache: a library that exports another name is not loaded");
+    }
+    {
+        PluginManager mgr;
+        mgr.disableLogOutput();
+        mgr.searchForPlugins(dir, options, PluginManager::callback());
+        check(mgr.hasPlugin("executor_2") && !mgr.hasPlugin("executor_1"),
+              "cache: the stale entry is removed, so the library is probed again");
+    }
+#else
+    check(true, "cache: the stale entry test only runs on Linux");
+#endif
+}
+
+/*****************************************************************************/
+/***** Dependencies **********************************************************/
+/*****************************************************************************/
+
+class Recorder: public LoadRecorder
+{
+public:
+    void record(const char* name) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _names.push_back(name);
+    }
+
+    std::vector<std::string> names()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _names;
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<std::string> _names;
+};
+
+void testLoadOrder()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.setLoadThreadsCount(4);
+    Recorder recorder;
+    mgr.publishService<LoadRecorder>(&recorder);
+
+    mgr.searchForPlugins(pluginDir("graph"), PluginManager::callback());
+    check(mgr.loadPlugins().type == ReturnCode::SUCCESS, "graph: the plugins are loaded");
+    const std::vector<std::string> expected = {"graph_1", "graph_2", "graph_3"};
+    check(recorder.names() == expected, "graph: each plugin is loaded after its dependencies");
+
+    mgr.unloadPlugins();
+    mgr.unpublishService<LoadRecorder>();
+}
+
+void testDependencyCycle()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(pluginDir("cycle"), PluginManager::callback());
+
+    std::string cycle;
+    const ReturnCode code = mgr.loadPlugins(true, [&cycle](const ReturnCode& code, const char* detail) {
+        if(code.type == ReturnCode::LOAD_DEPENDENCY_CYCLE && detail)
+            cycle = detail;
+        free(const_cast<char*>(detail));
+    });
+    check(code.type == ReturnCode::LOAD_DEPENDENCY_CYCLE, "graph: a dependency cycle is detected");
+    check(cycle.find("cycle_1") != std::string::npos && cycle.find("cycle_2") != std::string::npos,
+          "graph: every plugin of the cycle is reported (" + cycle + ")");
+    check(!mgr.isPluginLoaded("cycle_1") && !mgr.isPluginLoaded("cycle_2"),
+          "graph: the plugins of the cycle are not loaded");
+}
+
+/*****************************************************************************/
+/***** Services **************************************************************/
+/*****************************************************************************/
+
+void testServiceLookup()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    Recorder recorder;
+    check(mgr.publishService<LoadRecorder>(&recorder), "service: the application publishes a service");
+    check(!mgr.publishService<LoadRecorder>(&recorder), "service: a service is only published once");
+
+    mgr.searchForPlugins(pluginDir("graph"), PluginManager::callback());
+    mgr.loadPlugins();
+    check(recorder.names().size() == 3, "service: the plugins find the service of the application");
+
+    ServiceHandle<ValueService> value = mgr.service<ValueService>();
+    check(value && value->value() == 42, "service: the application finds the service of a plugin");
+    check(!mgr.findService(ValueService::jp_serviceId(), "OtherService"),
+          "service: a service with another name is not found");
+
+    mgr.unloadPlugins();
+    check(!mgr.service<ValueService>(), "service: the services of a plugin are removed when it's unloaded");
+    check(mgr.unpublishService<LoadRecorder>(), "service: the application removes its service");
+    check(!mgr.service<LoadRecorder>(), "service: a removed service is not found");
+}
+
+/*****************************************************************************/
+/***** Message bus ***********************************************************/
+/*****************************************************************************/
+
+std::atomic<int> releasedPayloads(0);
+
+void releasePayload(void* payload)
+{
+    delete static_cast<int*>(payload);
+    ++releasedPayloads;
+}
+
+void countMessages(void* context, const Message* messages, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+        *static_cast<std::atomic<int>*>(context) += *static_cast<const int*>(messages[i].payload);
+}
+
+void testMessageBus()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(pluginDir("graph"), PluginManager::callback());
+    mgr.loadPlugins();
+
+    IMessageBus* bus = mgr.messageBus();
+    std::atomic<int> sum(0);
+    const uint64_t subscription = bus->subscribe(GRAPH_TOPIC, &countMessages, &sum);
+
+    const int messagesCount = 10;
+    releasedPayloads = 0;
+    size_t receivers = 0;
+    for(int i = 1; i <= messagesCount; ++i)
+        receivers = bus->publish(GRAPH_TOPIC, new int(i), sizeof(int), &releasePayload);
+    check(receivers == 4, "bus: the message is given to every subscription");
+
+    bus->flush();
+    check(sum == 55, "bus: the application receives every message");
+    check(releasedPayloads == messagesCount, "bus: flush() waits until every payload is released");
+    for(int i = 1; i <= 3; ++i)
+    {
+        const std::string name = "graph_" + std::to_string(i);
+        int* received = nullptr;
+        const uint16_t code = sendRequest(mgr, name, 0, (void**)&received);
+        check(code == IPlugin::SUCCESS && received && *received == messagesCount,
+              "bus: " + name + " receives every message");
+    }
+
+    mgr.unloadPlugins();
+    releasedPayloads = 0;
+    check(bus->publish(GRAPH_TOPIC, new int(0), sizeof(int), &releasePayload) == 1,
+          "bus: the subscriptions of the plugins are removed when they are unloaded");
+    bus->flush();
+    check(releasedPayloads == 1, "bus: the payload is released once delivered");
+    check(bus->unsubscribe(subscription), "bus: the application removes its subscription");
+    check(bus->publish(GRAPH_TOPIC, new int(0), sizeof(int), &releasePayload) == 0 && releasedPayloads == 2,
+          "bus: a message without subscriber is released immediately");
+}
+
+/*****************************************************************************/
+/***** Log *******************************************************************/
+/*****************************************************************************/
+
+struct LogRecorder
+{
+    std::mutex mutex;
+    std::vector<std::string> messages;
+    std::vector<std::thread::id> threads;
+
+    PluginManager::logCallback callback()
+    {
+        return [this](PluginManager::LogLevel, const char* message) {
+            std::lock_guard<std::mutex> lock(mutex);
+            messages.push_back(message);
+            threads.push_back(std::this_thread::get_id());
+        };
+    }
+
+    size_t count()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return messages.size();
+    }
+
+    size_t count(const std::string& text)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t found = 0;
+        for(const std::string& message : messages)
+        {
+            if(message.find(text) != std::string::npos)
+                ++found;
+        }
+        return found;
+    }
+};
+
+void testLogFlushedByPublicFunctions()
+{
+    LogRecorder recorder;
+    {
+        PluginManager mgr;
+        mgr.setLogCallback(recorder.callback());
+
+        mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+        check(recorder.count("Search for plugins") == 1, "log: searchForPlugins() flushes the log");
+
+        mgr.loadPlugins();
+        const size_t afterLoad = recorder.count();
+        check(afterLoad > 1, "log: loadPlugins() flushes the log");
+
+        mgr.unloadPlugins();
+        check(recorder.count("Unload plugins") == 1, "log: unloadPlugins() flushes the log");
+        check(mgr.droppedLogMessages() == 0, "log: no message is dropped by a small load");
+
+        // Unloaded by the destructor of the manager
+        mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+        mgr.loadPlugins();
+    }
+    check(recorder.count("Unload plugins") == 2, "log: the log is flushed when the manager is destroyed");
+}
+
+void testSynchronousLog()
+{
+    LogRecorder recorder;
+    PluginManager mgr;
+    mgr.setLogCallback(recorder.callback());
+    mgr.enableSynchronousLog();
+    mgr.setLoadThreadsCount(1);
+
+    mgr.searchForPlugins(pluginDir("executor"), PluginManager::callback());
+    mgr.loadPlugins();
+    mgr.unloadPlugins();
+
+    bool callingThread = recorder.count() > 0;
+    for(const std::thread::id& id : recorder.threads)
+        callingThread = callingThread && id == std::this_thread::get_id();
+    check(callingThread, "log: synchronous messages are written by the thread that logs them");
+    check(mgr.droppedLogMessages() == 0, "log: synchronous messages are never dropped");
+}
+
+/*****************************************************************************/
+/***** Watcher ***************************************************************/
+/*****************************************************************************/
+
+void testWatcherDirectoryMovedOut()
+{
+    const std::string subDir = pluginDir("watcher") + "/sub";
+    const std::string movedDir = pluginDir("watcher_moved");
+    // In case a previous run stopped before moving the directory back
+    std::rename(movedDir.c_str(), subDir.c_str());
+
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    PluginManager::SearchOptions options;
+    options.recursive = true;
+    mgr.searchForPlugins(pluginDir("watcher"), options, PluginManager::callback());
+    mgr.loadPlugins();
+    check(mgr.isPluginLoaded("watched_1"), "watcher: the plugin of the sub-directory is loaded");
+
+    std::atomic<bool> notified(false);
+    mgr.setWatchCallback([&notified]() { notified = true; });
+    check(mgr.enableWatching(), "watcher: the watcher is started");
+
+    check(std::rename(subDir.c_str(), movedDir.c_str()) == 0, "watcher: the sub-directory is moved out");
+    check(waitFor(notified), "watcher: moving a directory out is reported");
+    mgr.processLocationChanges();
+    check(!mgr.hasPlugin("watched_1"), "watcher: the plugins of a directory moved out are removed");
+
+    mgr.disableWatching();
+    std::rename(movedDir.c_str(), subDir.c_str());
+}
+
+void testWatcherAddRemove()
+{
+#if defined(CONFINFO_PLATFORM_LINUX)
+    const std::string dir = pluginDir("watcher_add");
+    const std::string existing = dir + "/" + LIBRARY_PREFIX + "existing" + LIBRARY_SUFFIX;
+    const std::string added = dir + "/" + LIBRARY_PREFIX + "added" + LIBRARY_SUFFIX;
+    mkdir(dir.c_str(), 0755);
+    std::remove(added.c_str());
+    writeFile(existing, readFile(libraryPath("executor", "executor_3")));
+
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(dir, PluginManager::callback());
+    mgr.loadPlugins();
+
+    std::atomic<bool> notified(false);
+    mgr.setWatchCallback([&notified]() { notified = true; });
+    check(mgr.enableWatching(), "watcher: the watcher is started");
+
+    // Written outside of the watched directory, so the library appears at once
+    const std::string temporary = pluginDir("added.tmp");
+    writeFile(temporary, readFile(libraryPath("executor", "executor_4")));
+    check(std::rename(temporary.c_str(), added.c_str()) == 0, "watcher: a library is added");
+    check(waitFor(notified), "watcher: the added library is reported");
+    mgr.processLocationChanges();
+    check(mgr.isPluginLoaded("executor_4"), "watcher: the plugin of the added library is loaded");
+
+    notified = false;
+    check(std::remove(added.c_str()) == 0, "watcher: the library is removed");
+    check(waitFor(notified), "watcher: the removed library is reported");
+    mgr.processLocationChanges();
+    check(!mgr.hasPlugin("executor_4") && mgr.isPluginLoaded("executor_3"),
+          "watcher: only the plugin of the removed library is removed");
+
+    mgr.disableWatching();
+    mgr.unloadPlugins();
+#else
+    check(true, "watcher: the add/remove test only runs on Linux");
+#endif
+}
+
+/*****************************************************************************/
+/***** Manager requests ******************************************************/
+/*****************************************************************************/
+
+// Send a request to the manager from the requests_1 plugin
+ManagerCall managerCall(const PluginManager& mgr, uint16_t code, void* data, uint32_t dataSize)
+{
+    ManagerCall call = {code, data, dataSize, IPlugin::COMMON_ERROR};
+    void* callData = &call;
+    sendRequest(mgr, "requests_1", 0, &callData);
+    return call;
+}
+
+void testPluginsCountRequest()
+{
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    mgr.searchForPlugins(pluginDir("requests"), PluginManager::callback());
+    mgr.loadPlugins();
+
+    ManagerCall call = managerCall(mgr, IPlugin::GET_PLUGINSCOUNT, nullptr, 0);
+    check(call.result == IPlugin::SUCCESS && call.dataSize == sizeof(size_t)
+          && call.data && *static_cast<size_t*>(call.data) == 1,
+          "requests: GET_PLUGINSCOUNT returns a size_t allocated by the manager");
+    delete static_cast<size_t*>(call.data);
+
+    size_t count = 0;
+    call = managerCall(mgr, IPlugin::GET_PLUGINSCOUNT | IPlugin::CALLER_BUFFER, &count, sizeof(count));
+    check(call.result == IPlugin::SUCCESS && call.dataSize == sizeof(size_t) && count == 1,
+          "requests: GET_PLUGINSCOUNT writes the same size_t in a caller buffer");
+
+    call = managerCall(mgr, IPlugin::GET_PLUGINSCOUNT | IPlugin::CALLER_BUFFER, &count, 1);
+    check(call.result == IPlugin::BUFFER_TOO_SMALL && call.dataSize == sizeof(size_t),
+          "requests: GET_PLUGINSCOUNT reports the required size of a small buffer");
+
+    call = managerCall(mgr, IPlugin::GET_PLUGINSCOUNT | IPlugin::MANAGER_OWNED, nullptr, 0);
+    check(call.result == IPlugin::UNSUPPORTED_FLAG && call.data == nullptr,
+          "requests: GET_PLUGINSCOUNT rejects MANAGER_OWNED with UNSUPPORTED_FLAG");
+
+    call = managerCall(mgr, IPlugin::GET_PLUGINAPI | IPlugin::CALLER_BUFFER | IPlugin::MANAGER_OWNED, nullptr, 0);
+    check(call.result == IPlugin::UNSUPPORTED_FLAG, "requests: both flags together are rejected with UNSUPPORTED_FLAG");
+
+    call = managerCall(mgr, IPlugin::GET_EXECUTOR | IPlugin::CALLER_BUFFER, &count, sizeof(count));
+    check(call.result == IPlugin::UNSUPPORTED_FLAG, "requests: GET_EXECUTOR rejects CALLER_BUFFER with UNSUPPORTED_FLAG");
+    mgr.unloadPlugins();
+}
+
+/*****************************************************************************/
+/***** Static plugins ********************************************************/
+/*****************************************************************************/
+
+void testStaticPlugins()
+{
+#ifdef JP_HAS_STATIC_PLUGINS
+    PluginManager mgr;
+    mgr.disableLogOutput();
+    check(mgr.searchForStaticPlugins().type == ReturnCode::SUCCESS,
+          "static: the plugins linked in the executable are found");
+    check(sortedPlugins(mgr) == std::vector<std::string>{"static_1", "static_2"},
+          "static: every static plugin is registered once");
+    check(mgr.searchForStaticPlugins().type == ReturnCode::SEARCH_NOTHING_FOUND,
+          "static: a second search registers nothing");
+
+    check(mgr.loadPlugins().type == ReturnCode::SUCCESS, "static: the static plugins are loaded");
+    int* first = nullptr;
+    int* second = nullptr;
+    sendRequest(mgr, "static_1", 0, (void**)&first);
+    sendRequest(mgr, "static_2", 0, (void**)&second);
+    check(first && second && *first > 0 && *first < *second,
+          "static: a static plugin is loaded after its dependency");
+    mgr.unloadPlugins();
+#else
+    check(true, "static: static plugins are not supported on this platform");
+#endif
+}
+
+} // anonymous namespace
+
+int main()
+{
+    testExecutorWait();
+    testExecutorThen();
+    testExecutorNestedWait();
+    testExecutorWaitRunsOnlyItsGroup();
+    testConcurrentSearch();
+    testLoadWaitingPlugins();
+    testWaitForPluginFromLoadThread();
+    testReloadLeavesPendingPlugins();
+    testReloadLibraryStillLoaded();
+    testSymbolError();
+    testStaleCacheEntry();
+    testLoadOrder();
+    testDependencyCycle();
+    testServiceLookup();
+    testMessageBus();
+    testLogFlushedByPublicFunctions();
+    testSynchronousLog();
+    testWatcherDirectoryMovedOut();
+    testWatcherAddRemove();
+    testPluginsCountRequest();
+    testStaticPlugins();
+
+    std::cout << failures << " failed check(s)" << std::endl;
+    return failures;
+}
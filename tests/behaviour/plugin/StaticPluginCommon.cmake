@@ -0,0 +1,35 @@
+###############################################################################
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2017 Fabien Caylus
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+###############################################################################
+
+# Static plugins are compiled in an OBJECT library, linked in the test executable
+# (an object file of a static library would be dropped, since nothing references it)
+
+include_directories(${PLUGIN_INCLUDE_DIR})
+include(${PLUGIN_INCLUDE_DIR}/EmbedMetadata.cmake)
+
+embed_metadata(METADATA_FILE meta.json STATIC)
+
+add_library(${PROJECT_NAME} OBJECT main.cpp meta.json)
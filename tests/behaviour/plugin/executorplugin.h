@@ -0,0 +1,103 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef EXECUTORPLUGIN_H
+#define EXECUTORPLUGIN_H
+
+#include <atomic>
+
+#include "iplugin.h"
+
+// Base of the executor_N plugins: loaded() submits tasks to the executor and
+// waits for them (and for a continuation), then handleRequest(0) returns the result.
+class ExecutorPlugin: public jp::IPlugin
+{
+    JP_DECLARE_INTERFACE(ExecutorPlugin, jp::IPlugin)
+
+public:
+
+    static const int TASKS_COUNT = 16;
+
+    void loaded() override
+    {
+        jp::IExecutor* exec = executor();
+        if(!exec)
+            return;
+
+        jp::TaskGroup* tasks = exec->createGroup();
+        jp::TaskGroup* done = exec->createGroup();
+        for(int i = 0; i < TASKS_COUNT; ++i)
+        {
+            _tasks[i] = Task{this, i + 1};
+            exec->submit(&ExecutorPlugin::add, &_tasks[i], tasks);
+        }
+        exec->then(tasks, &ExecutorPlugin::finish, this, done);
+        exec->wait(done);
+        exec->releaseGroup(tasks);
+        exec->releaseGroup(done);
+    }
+
+    void aboutToBeUnloaded() override
+    {
+    }
+
+    uint16_t handleRequest(const char* sender, uint16_t code, void** data, uint32_t* dataSize) override
+    {
+        JP_UNUSED(sender);JP_UNUSED(dataSize);
+
+        // Sum of 1..TASKS_COUNT, computed by the tasks
+        if(code == 0)
+        {
+            *data = &_result;
+            return jp::IPlugin::SUCCESS;
+        }
+        return jp::IPlugin::UNKNOWN_REQUEST;
+    }
+
+private:
+
+    struct Task
+    {
+        ExecutorPlugin* plugin;
+        int value;
+    };
+
+    static void add(void* context)
+    {
+        Task* task = static_cast<Task*>(context);
+        task->plugin->_sum += task->value;
+    }
+
+    static void finish(void* context)
+    {
+        ExecutorPlugin* plugin = static_cast<ExecutorPlugin*>(context);
+        plugin->_result = plugin->_sum;
+    }
+
+    Task _tasks[TASKS_COUNT];
+    std::atomic<int> _sum{0};
+    int _result = 0;
+};
+
+#endif // EXECUTORPLUGIN_H
@@ -0,0 +1,112 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GRAPHPLUGIN_H
+#define GRAPHPLUGIN_H
+
+#include <atomic>
+
+#include "iplugin.h"
+
+// Published by the application: the plugins record the order of their loaded() calls
+class LoadRecorder
+{
+    JP_DECLARE_SERVICE(LoadRecorder)
+
+public:
+    virtual void record(const char* name) = 0;
+
+protected:
+    ~LoadRecorder() {}
+};
+
+// Published by graph_1
+class ValueService
+{
+    JP_DECLARE_SERVICE(ValueService)
+
+public:
+    virtual int value() const = 0;
+
+protected:
+    ~ValueService() {}
+};
+
+// Topic the plugins subscribe to
+const jp::TopicId GRAPH_TOPIC = 1;
+
+// Base of the graph_N and cycle_N plugins: loaded() records the plugin and subscribes
+// to GRAPH_TOPIC, then handleRequest(0) returns the number of messages received.
+class GraphPlugin: public jp::IPlugin
+{
+    JP_DECLARE_INTERFACE(GraphPlugin, jp::IPlugin)
+
+public:
+
+    void loaded() override
+    {
+        jp::ServiceHandle<LoadRecorder> recorder = service<LoadRecorder>();
+        if(recorder)
+            recorder->record(pluginName());
+
+        jp::IMessageBus* bus = messageBus();
+        if(bus)
+            bus->subscribe(GRAPH_TOPIC, &GraphPlugin::receive, this);
+    }
+
+    void aboutToBeUnloaded() override
+    {
+    }
+
+    uint16_t handleRequest(const char* sender, uint16_t code, void** data, uint32_t* dataSize) override
+    {
+        JP_UNUSED(sender);JP_UNUSED(dataSize);
+
+        if(code == 0)
+        {
+            _result = _received;
+            *data = &_result;
+            return jp::IPlugin::SUCCESS;
+        }
+        return jp::IPlugin::UNKNOWN_REQUEST;
+    }
+
+protected:
+
+    // Name of the plugin (jp_name() is private to IPlugin)
+    virtual const char* pluginName() const = 0;
+
+private:
+
+    static void receive(void* context, const jp::Message* messages, size_t count)
+    {
+        JP_UNUSED(messages);
+        static_cast<GraphPlugin*>(context)->_received += static_cast<int>(count);
+    }
+
+    std::atomic<int> _received{0};
+    int _result = 0;
+};
+
+#endif // GRAPHPLUGIN_H
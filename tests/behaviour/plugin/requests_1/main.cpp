@@ -0,0 +1,53 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "iplugin.h"
+
+#include "../managercall.h"
+
+class Plugin: public jp::IPlugin
+{
+    JP_DECLARE_PLUGIN(Plugin, requests_1)
+
+public:
+
+    void loaded() override {}
+    void aboutToBeUnloaded() override {}
+
+    uint16_t handleRequest(const char* sender, uint16_t code, void** data, uint32_t* dataSize) override
+    {
+        JP_UNUSED(sender);JP_UNUSED(dataSize);
+
+        if(code == 0 && data && *data)
+        {
+            ManagerCall* call = static_cast<ManagerCall*>(*data);
+            call->result = sendRequest(nullptr, call->code, &call->data, &call->dataSize);
+            return jp::IPlugin::SUCCESS;
+        }
+        return jp::IPlugin::UNKNOWN_REQUEST;
+    }
+};
+
+JP_REGISTER_PLUGIN(Plugin)
+#include "metadata.h"
@@ -0,0 +1,71 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef STATICPLUGIN_H
+#define STATICPLUGIN_H
+
+#include "iplugin.h"
+
+// Base of the static_N plugins (linked in the test executable): loaded() records
+// the position of the plugin in the load order, returned by handleRequest(0).
+class StaticPlugin: public jp::IPlugin
+{
+    JP_DECLARE_INTERFACE(StaticPlugin, jp::IPlugin)
+
+public:
+
+    void loaded() override
+    {
+        _loadIndex = ++loadCounter();
+    }
+
+    void aboutToBeUnloaded() override
+    {
+    }
+
+    uint16_t handleRequest(const char* sender, uint16_t code, void** data, uint32_t* dataSize) override
+    {
+        JP_UNUSED(sender);JP_UNUSED(dataSize);
+
+        if(code == 0)
+        {
+            *data = &_loadIndex;
+            return jp::IPlugin::SUCCESS;
+        }
+        return jp::IPlugin::UNKNOWN_REQUEST;
+    }
+
+private:
+
+    // Shared by all the static plugins of the executable
+    static int& loadCounter()
+    {
+        static int counter = 0;
+        return counter;
+    }
+
+    int _loadIndex = 0;
+};
+
+#endif // STATICPLUGIN_H
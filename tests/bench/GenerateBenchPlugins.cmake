@@ -0,0 +1,139 @@
+###############################################################################
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2017 Fabien Caylus
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+###############################################################################
+
+#
+# Generates a set of benchmark plugins whose dependencies form a given shape.
+# Each plugin gets its own CMake project (built with PluginCommon.cmake, so its
+# metadata are embedded with EMBED_METADATA), like the plugins of tests/app.
+#
+
+include(CMakeParseArguments)
+
+set(BENCH_TEMPLATES_DIR ${CMAKE_CURRENT_LIST_DIR}/templates)
+
+# Computes the dependencies of the plugin at INDEX for the given SHAPE.
+# Parameters:
+#   SHAPE       - chain, fanout, diamond or random
+#   INDEX       - Index of the plugin (dependencies always have a lower index)
+#   SEED        - Random state (random shape only), updated in the parent scope
+#   VARIABLE    - Output list of dependency indices
+# Shapes:
+#   chain   - Each plugin depends on the previous one
+#   fanout  - Every plugin depends on the first one
+#   diamond - Chain of diamonds: 3k+1 and 3k+2 depend on 3k, 3k+3 depends on both
+#   random  - Each plugin depends on up to 3 random plugins among the previous ones
+function(BENCH_DEPENDENCIES)
+    set(oneValueArgs SHAPE INDEX SEED VARIABLE)
+    cmake_parse_arguments(DEP "" "${oneValueArgs}" "" ${ARGN})
+
+    set(deps "")
+    if(DEP_INDEX GREATER 0)
+        if(DEP_SHAPE STREQUAL "chain")
+            math(EXPR dep "${DEP_INDEX} - 1")
+            list(APPEND deps ${dep})
+        elseif(DEP_SHAPE STREQUAL "fanout")
+            list(APPEND deps 0)
+        elseif(DEP_SHAPE STREQUAL "diamond")
+            math(EXPR pos "${DEP_INDEX} % 3")
+            if(pos EQUAL 0)
+                math(EXPR left "${DEP_INDEX} - 2")
+                math(EXPR right "${DEP_INDEX} - 1")
+                list(APPEND deps ${left} ${right})
+            else()
+                math(EXPR top "${DEP_INDEX} - ${pos}")
+                list(APPEND deps ${top})
+            endif()
+        elseif(DEP_SHAPE STREQUAL "random")
+            # Park-Miller "minimal standard" generator (deterministic for a given seed)
+            set(state ${${DEP_SEED}})
+            math(EXPR state "(${state} * 48271) % 2147483647")
+            math(EXPR depNb "${state} % 4")
+            foreach(i RANGE 1 3)
+                if(NOT i GREATER depNb)
+                    math(EXPR state "(${state} * 48271) % 2147483647")
+                    math(EXPR dep "${state} % ${DEP_INDEX}")
+                    list(FIND deps ${dep} found)
+                    if(found EQUAL -1)
+                        list(APPEND deps ${dep})
+                    endif()
+                endif()
+            endforeach()
+            set(${DEP_SEED} ${state} PARENT_SCOPE)
+        else()
+            message(FATAL_ERROR "Unknown benchmark shape: ${DEP_SHAPE}")
+        endif()
+    endif()
+
+    set(${DEP_VARIABLE} "${deps}" PARENT_SCOPE)
+endfunction()
+
+# Generates and adds COUNT plugins (plus the driver plugin) for the given shape.
+# Libraries are written to CMAKE_LIBRARY_OUTPUT_DIRECTORY.
+# Parameters:
+#   SHAPE   - See BENCH_DEPENDENCIES
+#   COUNT   - Number of plugins
+#   SEED    - Seed of the random shape (must not be 0)
+# Usage:
+#   generate_bench_plugins(SHAPE random COUNT 1000 SEED 42)
+function(GENERATE_BENCH_PLUGINS)
+    set(oneValueArgs SHAPE COUNT SEED)
+    cmake_parse_arguments(GEN "" "${oneValueArgs}" "" ${ARGN})
+
+    set(BENCH_PLUGIN_COMMON ${CMAKE_CURRENT_SOURCE_DIR}/../app/plugin/PluginCommon.cmake)
+    set(genDir ${CMAKE_CURRENT_BINARY_DIR}/generated/${GEN_SHAPE})
+    set(seed ${GEN_SEED})
+
+    # The driver is the main plugin of the set
+    set(BENCH_TARGET_NAME bench_${GEN_SHAPE}_driver)
+    configure_file(${BENCH_TEMPLATES_DIR}/CMakeLists.txt.in ${genDir}/driver/CMakeLists.txt @ONLY)
+    configure_file(${CMAKE_CURRENT_SOURCE_DIR}/driver/main.cpp ${genDir}/driver/main.cpp COPYONLY)
+    configure_file(${CMAKE_CURRENT_SOURCE_DIR}/driver/meta.json ${genDir}/driver/meta.json COPYONLY)
+    add_subdirectory(${genDir}/driver ${genDir}/driver/build)
+    set_property(GLOBAL APPEND PROPERTY BENCH_PLUGIN_TARGETS ${BENCH_TARGET_NAME})
+
+    math(EXPR last "${GEN_COUNT} - 1")
+    foreach(index RANGE ${last})
+        bench_dependencies(SHAPE ${GEN_SHAPE} INDEX ${index} SEED seed VARIABLE deps)
+
+        set(BENCH_PLUGIN_INDEX ${index})
+        set(BENCH_PLUGIN_NAME bench_${index})
+        set(BENCH_TARGET_NAME bench_${GEN_SHAPE}_${index})
+        set(BENCH_PLUGIN_DEPENDENCIES "")
+        foreach(dep ${deps})
+            if(BENCH_PLUGIN_DEPENDENCIES)
+                set(BENCH_PLUGIN_DEPENDENCIES "${BENCH_PLUGIN_DEPENDENCIES}, ")
+            endif()
+            set(BENCH_PLUGIN_DEPENDENCIES "${BENCH_PLUGIN_DEPENDENCIES}{\"name\":\"bench_${dep}\", \"version\":\"1.0.0\"}")
+        endforeach()
+
+        set(pluginDir ${genDir}/${BENCH_PLUGIN_NAME})
+        configure_file(${BENCH_TEMPLATES_DIR}/CMakeLists.txt.in ${pluginDir}/CMakeLists.txt @ONLY)
+        configure_file(${BENCH_TEMPLATES_DIR}/plugin.cpp.in ${pluginDir}/main.cpp @ONLY)
+        configure_file(${BENCH_TEMPLATES_DIR}/meta.json.in ${pluginDir}/meta.json @ONLY)
+        add_subdirectory(${pluginDir} ${pluginDir}/build)
+        set_property(GLOBAL APPEND PROPERTY BENCH_PLUGIN_TARGETS ${BENCH_TARGET_NAME})
+    endforeach()
+endfunction()
@@ -0,0 +1,54 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BENCHREQUEST_H
+#define BENCHREQUEST_H
+
+#include <cstdint> // for intN_t types
+
+// Requests shared by the benchmark, the driver plugin and the generated plugins
+enum BenchRequestCode
+{
+    // Answered by every generated plugin, without any data
+    BENCH_PING = 1000,
+    // Answered by the driver plugin, data is a BenchRoundTrip object
+    BENCH_ROUND_TRIP = 1001
+};
+
+// Data of the BENCH_ROUND_TRIP request
+struct BenchRoundTrip
+{
+    // Inputs
+    uint32_t iterations;
+    const char* target; // Plugin that receives the BENCH_PING requests
+
+    // Outputs: average time of one request, in nanoseconds
+    double managerRequestNs;
+    double managerBufferRequestNs; // Same as managerRequestNs, with the CALLER_BUFFER flag
+    double pluginRequestNs;
+    double pluginHandleRequestNs; // Same as pluginRequestNs, with a PluginHandle
+    double pluginBatchRequestNs; // Same as pluginHandleRequestNs, sent by batches with sendRequestBatch()
+};
+
+#endif // BENCHREQUEST_H
@@ -0,0 +1,122 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <algorithm>
+
+#include "iplugin.h"
+#include "benchrequest.h"
+
+// Registered as the main plugin, so it can send requests to every generated plugin
+class Driver: public jp::IPlugin
+{
+    JP_DECLARE_PLUGIN(Driver, bench_driver)
+
+public:
+
+    void loaded() override {}
+    void aboutToBeUnloaded() override {}
+
+    uint16_t handleRequest(const char* sender, uint16_t code, void** data, uint32_t* dataSize) override
+    {
+        JP_UNUSED(sender);
+        if(code != BENCH_ROUND_TRIP)
+            return UNKNOWN_REQUEST;
+        if(!dataSize || *dataSize != sizeof(BenchRoundTrip))
+            return COMMON_ERROR;
+
+        typedef std::chrono::steady_clock Clock;
+        BenchRoundTrip* bench = static_cast<BenchRoundTrip*>(*data);
+        const double iterations = bench->iterations > 0 ? bench->iterations : 1;
+
+        // Plugin -> manager -> plugin
+        Clock::time_point start = Clock::now();
+        for(uint32_t i = 0; i < bench->iterations; ++i)
+        {
+            void* count = nullptr;
+            uint32_t size = 0;
+            if(sendRequest(nullptr, GET_PLUGINSCOUNT, &count, &size) == SUCCESS)
+                delete static_cast<size_t*>(count);
+        }
+        bench->managerRequestNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+        // Same, without any allocation
+        start = Clock::now();
+        for(uint32_t i = 0; i < bench->iterations; ++i)
+        {
+            size_t count = 0;
+            void* buffer = &count;
+            uint32_t size = sizeof(count);
+            sendRequest(nullptr, GET_PLUGINSCOUNT | CALLER_BUFFER, &buffer, &size);
+        }
+        bench->managerBufferRequestNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+        // Plugin -> other plugin (not a dependency, so resolved by the manager each time)
+        start = Clock::now();
+        for(uint32_t i = 0; i < bench->iterations; ++i)
+        {
+            void* none = nullptr;
+            uint32_t size = 0;
+            if(sendRequest(bench->target, BENCH_PING, &none, &size) != SUCCESS)
+                return COMMON_ERROR;
+        }
+        bench->pluginRequestNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+        // Same, with a receiver resolved once
+        const jp::PluginHandle target = pluginHandle(bench->target);
+        start = Clock::now();
+        for(uint32_t i = 0; i < bench->iterations; ++i)
+        {
+            void* none = nullptr;
+            uint32_t size = 0;
+            if(sendRequest(target, BENCH_PING, &none, &size) != SUCCESS)
+                return COMMON_ERROR;
+        }
+        bench->pluginHandleRequestNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+        // Same, by batches
+        const uint32_t batchSize = 64;
+        jp::Request batch[batchSize];
+        start = Clock::now();
+        for(uint32_t i = 0; i < bench->iterations; i += batchSize)
+        {
+            const uint32_t count = std::min(batchSize, bench->iterations - i);
+            for(uint32_t j = 0; j < count; ++j)
+                batch[j] = jp::Request{BENCH_PING, COMMON_ERROR, 0, nullptr};
+            if(sendRequestBatch(target, batch, count) != SUCCESS)
+                return COMMON_ERROR;
+            for(uint32_t j = 0; j < count; ++j)
+            {
+                if(batch[j].result != SUCCESS)
+                    return COMMON_ERROR;
+            }
+        }
+        bench->pluginBatchRequestNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+        return SUCCESS;
+    }
+};
+
+JP_REGISTER_PLUGIN(Driver)
+#include "metadata.h"
@@ -0,0 +1,285 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Fabien Caylus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "pluginmanager.h"
+#include "private/graph.h"
+
+#include "benchrequest.h"
+
+using namespace jp;
+using namespace jp_private;
+
+typedef std::chrono::steady_clock Clock;
+
+namespace
+{
+
+struct Options
+{
+    std::string pluginDir;
+    std::string shape = "unknown";
+    std::string output; // stdout if empty
+    unsigned int repeat = 5;
+    unsigned int iterations = 10000;
+};
+
+void usage(const char* exe)
+{
+    std::cerr << "Usage: " << exe << " [--shape name] [--repeat n] [--iterations n] [--output file] pluginDir" << std::endl
+              << std::endl
+              << "Measures each step of the plugin manager with the plugins of pluginDir" << std::endl
+              << "(generated by the benchmark CMake project), and prints one JSON object" << std::endl
+              << "per measure (appended to the output file if specified)." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& opts)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+        if(arg == "--shape" && hasValue)
+            opts.shape = argv[++i];
+        else if(arg == "--repeat" && hasValue)
+            opts.repeat = std::strtoul(argv[++i], nullptr, 10);
+        else if(arg == "--iterations" && hasValue)
+            opts.iterations = std::strtoul(argv[++i], nullptr, 10);
+        else if(arg == "--output" && hasValue)
+            opts.output = argv[++i];
+        else if(!arg.empty() && arg[0] != '-' && opts.pluginDir.empty())
+            opts.pluginDir = arg;
+        else
+            return false;
+    }
+    return !opts.pluginDir.empty() && opts.repeat > 0;
+}
+
+double elapsedMs(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Samples of each measure, in the order of the first sample
+class Results
+{
+public:
+    void add(const std::string& name, const std::string& unit, double value)
+    {
+        if(_samples.count(name) == 0)
+        {
+            _names.push_back(name);
+            _units[name] = unit;
+        }
+        _samples[name].push_back(value);
+    }
+
+    void write(std::ostream& out, const Options& opts, size_t pluginsCount) const
+    {
+        for(const std::string& name : _names)
+        {
+            std::vector<double> samples = _samples.at(name);
+            std::sort(samples.begin(), samples.end());
+
+            out << "{\"shape\":\"" << opts.shape << "\""
+                << ",\"plugins\":" << pluginsCount
+                << ",\"measure\":\"" << name << "\""
+                << ",\"unit\":\"" << _units.at(name) << "\""
+                << ",\"repeat\":" << samples.size()
+                << ",\"min\":" << samples.front()
+                << ",\"median\":" << samples[samples.size() / 2]
+                << ",\"max\":" << samples.back()
+                << "}" << std::endl;
+        }
+    }
+
+private:
+    std::vector<std::string> _names;
+    std::map<std::string, std::string> _units;
+    std::map<std::string, std::vector<double>> _samples;
+};
+
+// Build the graph input like PluginManager::loadPlugins() does
+// (the dependencies are read before, since only the graph is measured)
+struct GraphInput
+{
+    std::vector<std::string> names;
+    std::vector<std::vector<std::string>> dependencies;
+};
+
+GraphInput readGraphInput(const PluginManager& mgr)
+{
+    GraphInput input;
+    input.names = mgr.pluginsList();
+    for(const std::string& name : input.names)
+    {
+        PluginInfo info = mgr.pluginInfo(name);
+        std::vector<std::string> deps;
+        for(int i = 0; i < info.dependenciesNb; ++i)
+        {
+            deps.push_back(info.dependencies[i].name);
+            std::free((char*)info.dependencies[i].name);
+            std::free((char*)info.dependencies[i].version);
+        }
+        input.dependencies.push_back(deps);
+
+        // Dependencies strings are already freed
+        info.dependenciesNb = 0;
+        info.free();
+    }
+    return input;
+}
+
+Graph::NodeList buildNodeList(const GraphInput& input)
+{
+    std::map<std::string, int> ids;
+    Graph::NodeList nodeList(input.names.size());
+    for(size_t i = 0; i < input.names.size(); ++i)
+    {
+        nodeList[i].name = &input.names[i];
+        ids[input.names[i]] = i;
+    }
+    for(size_t i = 0; i < input.names.size(); ++i)
+    {
+        for(const std::string& dep : input.dependencies[i])
+            nodeList[i].parentNodes.push_back(ids.at(dep));
+    }
+    return nodeList;
+}
+
+void callBackFunc(const ReturnCode& code, const char* data)
+{
+    std::cerr << code.message();
+    if(data)
+        std::cerr << " (" << data << ")";
+    std::cerr << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if(!parseOptions(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    PluginManager& mgr = PluginManager::instance();
+    mgr.disableLogOutput();
+
+    Results results;
+    size_t pluginsCount = 0;
+
+    for(unsigned int run = 0; run < opts.repeat; ++run)
+    {
+        mgr.clearProfile();
+
+        Clock::time_point start = Clock::now();
+        if(!mgr.searchForPlugins(opts.pluginDir, callBackFunc))
+            return 1;
+        results.add("search", "ms", elapsedMs(start));
+
+        // The driver plugin is not part of the generated plugins
+        pluginsCount = mgr.pluginsCount() - 1;
+        if(!mgr.registerMainPlugin("bench_driver") && run == 0)
+            std::cerr << "No driver plugin found" << std::endl;
+
+        const GraphInput input = readGraphInput(mgr);
+        start = Clock::now();
+        Graph graph(buildNodeList(input));
+        results.add("graphBuild", "ms", elapsedMs(start));
+
+        bool error = false;
+        start = Clock::now();
+        graph.topologicalSort(error);
+        results.add("topologicalSort", "ms", elapsedMs(start));
+
+        start = Clock::now();
+        if(!mgr.loadPlugins(callBackFunc))
+            return 1;
+        results.add("load", "ms", elapsedMs(start));
+
+        std::shared_ptr<IPlugin> driver = mgr.pluginObject("bench_driver");
+        if(driver)
+        {
+            BenchRoundTrip bench;
+            bench.iterations = opts.iterations;
+            bench.target = "bench_0";
+            void* data = &bench;
+            uint32_t dataSize = sizeof(BenchRoundTrip);
+            if(driver->handleRequest("bench", BENCH_ROUND_TRIP, &data, &dataSize) == IPlugin::SUCCESS)
+            {
+                results.add("managerRequest", "ns", bench.managerRequestNs);
+                results.add("managerBufferRequest", "ns", bench.managerBufferRequestNs);
+                results.add("pluginRequest", "ns", bench.pluginRequestNs);
+                results.add("pluginHandleRequest", "ns", bench.pluginHandleRequestNs);
+                results.add("pluginBatchRequest", "ns", bench.pluginBatchRequestNs);
+            }
+        }
+        driver.reset();
+
+        start = Clock::now();
+        if(!mgr.unloadPlugins(callBackFunc))
+            return 1;
+        results.add("unload", "ms", elapsedMs(start));
+
+        // Total time of each phase recorded by the manager
+        double phases[ProfileEvent::PHASES_COUNT] = {0};
+        for(const ProfileEvent& event : mgr.profile())
+            phases[event.phase] += event.duration / 1e6;
+        for(int phase = 0; phase < ProfileEvent::PHASES_COUNT; ++phase)
+        {
+            results.add(std::string("profile.") + ProfileEvent::phaseName(static_cast<ProfileEvent::Phase>(phase)),
+                        "ms", phases[phase]);
+        }
+    }
+
+    if(opts.output.empty())
+    {
+        results.write(std::cout, opts, pluginsCount);
+    }
+    else
+    {
+        std::ofstream out(opts.output, std::ios::app);
+        if(!out)
+        {
+            std::cerr << "Cannot open " << opts.output << std::endl;
+            return 1;
+        }
+        results.write(out, opts, pluginsCount);
+    }
+
+    return 0;
+}